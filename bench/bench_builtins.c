@@ -0,0 +1,139 @@
+/*
+ * Measures how many statements a second a script made
+ * of short commands gets through on the executor, with
+ * them run as builtins and as external commands, the
+ * latter with and without a PATH cache.
+ *
+ * Usage: bench_builtins [THREADS]
+ *
+ * Output is CSV: name,threads,statements,seconds,statements_per_second,path_hits,path_misses
+ */
+
+#include "scallop/builtin.h"
+#include "scallop/executor.h"
+#include "bench_clock.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BUILTIN_STATEMENTS 200000
+// Processes take far longer, so fewer will do
+#define EXTERNAL_STATEMENTS 2000
+
+static const char *const statements[] = {
+	"echo building target 'out/app'\n",
+	"true\n",
+	"test -n \"$dir\"\n",
+	"printf '%s: %d\\\\n' step 3\n",
+	"'[' a = a ']'\n",
+	"test -d /tmp\n",
+	"false\n",
+	"echo done\n",
+};
+
+static char *generate(size_t count, size_t *length)
+{
+	size_t size = 0;
+	for (size_t i = 0; i < count; i++)
+		size += strlen(statements[i % (sizeof(statements) / sizeof(*statements))]);
+	char *script = malloc(size + 1);
+	if (!script)
+		return NULL;
+	char *current = script;
+	for (size_t i = 0; i < count; i++)
+		current = stpcpy(current, statements[i % (sizeof(statements) / sizeof(*statements))]);
+	*length = size;
+	return script;
+}
+
+static int run(
+	const char *name,
+	struct scallop_executor *executor,
+	const struct scallop_builtins *builtins,
+	struct scallop_path_cache *paths,
+	size_t count
+)
+{
+	size_t length;
+	char *script = generate(count, &length);
+	if (!script)
+		return 0;
+	struct scallop_ast ast;
+	struct scallop_parse_error error;
+	if (!scallop_parse_memory(script, script + length, &ast, &error)) {
+		fprintf(stderr, "%s: parse error %d\n", name, error.error);
+		return 0;
+	}
+
+	struct scallop_task task;
+	scallop_task_init(&task);
+	const int null = open("/dev/null", O_WRONLY | O_CLOEXEC);
+	if (null < 0)
+		return 0;
+	task.fds[1] = (struct scallop_vfd) { SCALLOP_VFD_FD, null, NULL, 1 };
+	struct scallop_statement_context context = {
+		script,
+		script + length,
+		builtins,
+		paths,
+		&task,
+		SCALLOP_LAUNCH_SPAWN,
+		executor,
+	};
+
+	const double start = now();
+	// false makes the block's status 1
+	const int status = scallop_execute_block(executor, &ast, 0, scallop_run_statement, &context);
+	const double seconds = now() - start;
+
+	scallop_task_free(&task);
+	scallop_ast_free(&ast);
+	free(script);
+	if (status != 1) {
+		fprintf(stderr, "%s: unexpected status %d\n", name, status);
+		return 0;
+	}
+
+	struct scallop_path_cache_stats stats = { 0 };
+	if (paths)
+		scallop_path_cache_stats(paths, &stats);
+	printf(
+		"%s,%d,%zu,%f,%f,%llu,%llu\n",
+		name,
+		scallop_executor_parallelism(executor),
+		count,
+		seconds,
+		count / seconds,
+		(unsigned long long)stats.hits,
+		(unsigned long long)stats.misses
+	);
+	fflush(stdout);
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	signal(SIGPIPE, SIG_IGN);
+	struct scallop_executor *executor = scallop_executor_create(argc > 1 ? atoi(argv[1]) : 0);
+	struct scallop_builtins *builtins = scallop_builtins_create();
+	struct scallop_path_cache *paths = scallop_path_cache_create(NULL, 0);
+	if (!executor || !builtins || !paths) {
+		perror("setup");
+		return EXIT_FAILURE;
+	}
+
+	printf("name,threads,statements,seconds,statements_per_second,path_hits,path_misses\n");
+	const int ok =
+		run("builtins", executor, builtins, NULL, BUILTIN_STATEMENTS)
+		&& run("external", executor, NULL, NULL, EXTERNAL_STATEMENTS)
+		&& run("external_path_cache", executor, NULL, paths, EXTERNAL_STATEMENTS);
+
+	scallop_path_cache_destroy(paths);
+	scallop_builtins_free(builtins);
+	scallop_executor_destroy(executor);
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,94 @@
+/*
+ * Compares the cost of classifying a byte using the
+ * switch-based specification against the generated
+ * char_types table the lexer actually uses.
+ *
+ * Output is CSV: name,input,bytes,seconds,ns_per_byte
+ */
+
+#include "lexer_spec.h"
+#include "lexer_tables.h"
+#include "bench_clock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INPUT_SIZE (16 * 1024 * 1024)
+#define ITERATIONS 8
+
+static void fill(char *buffer, size_t size, const char *phrase)
+{
+	const size_t length = strlen(phrase);
+	for (size_t i = 0; i < size; i++)
+		buffer[i] = phrase[i % length];
+}
+
+static unsigned long classify_spec(const char *begin, const char *end)
+{
+	unsigned long sum = 0;
+	for (const char *current = begin; current < end; current++)
+		sum += char_type_spec(*current);
+	return sum;
+}
+
+static unsigned long classify_table(const char *begin, const char *end)
+{
+	unsigned long sum = 0;
+	for (const char *current = begin; current < end; current++)
+		sum += char_types[(unsigned char)*current];
+	return sum;
+}
+
+static void run(
+	const char *name,
+	unsigned long (*classify)(const char *, const char *),
+	const char *input_name,
+	const char *input,
+	size_t size
+)
+{
+	// Accumulating into a volatile stops the loops being optimized out
+	static volatile unsigned long sink;
+	const double start = now();
+	for (int i = 0; i < ITERATIONS; i++)
+		sink += classify(input, input + size);
+	const double seconds = now() - start;
+	const double bytes = (double)size * ITERATIONS;
+
+	printf(
+		"%s,%s,%.0f,%f,%f\n",
+		name,
+		input_name,
+		bytes,
+		seconds,
+		seconds * 1e9 / bytes
+	);
+}
+
+int main()
+{
+	static const struct {
+		const char *name;
+		const char *phrase;
+	} inputs[] = {
+		{ "ascii", "make -j8 all; cp build/out.bin '/tmp/some dir' {echo done}\n" },
+		{ "utf8", "echo 'héllo wörld' 💩 日本語のテキスト; printf \"ñ→∞\"\n" },
+	};
+
+	char *buffer = malloc(INPUT_SIZE);
+	if (!buffer) {
+		perror("malloc");
+		return EXIT_FAILURE;
+	}
+
+	printf("name,input,bytes,seconds,ns_per_byte\n");
+	for (size_t i = 0; i < sizeof(inputs) / sizeof(*inputs); i++) {
+		fill(buffer, INPUT_SIZE, inputs[i].phrase);
+		run("char_type_switch", classify_spec, inputs[i].name, buffer, INPUT_SIZE);
+		run("char_type_table", classify_table, inputs[i].name, buffer, INPUT_SIZE);
+	}
+
+	free(buffer);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,22 @@
+#ifndef BENCH_CLOCK_H
+#define BENCH_CLOCK_H
+
+#include <sys/resource.h>
+#include <time.h>
+
+static inline double now(void)
+{
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+// The whole process's, so it only ever goes up
+static inline long peak_rss_kb(void)
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+}
+
+#endif // BENCH_CLOCK_H
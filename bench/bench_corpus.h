@@ -0,0 +1,38 @@
+#ifndef BENCH_CORPUS_H
+#define BENCH_CORPUS_H
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * A xorshift generator, so generated inputs come out
+ * the same on every run; benchmarks reset random_state
+ * before generating each one.
+ */
+static uint64_t random_state = 0x9E3779B97F4A7C15;
+
+static inline uint32_t random_below(uint32_t bound)
+{
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 7;
+	random_state ^= random_state << 17;
+	return (uint32_t)(random_state % bound);
+}
+
+struct corpus {
+	char *current;
+	char *end;
+};
+
+// Returns 1, or 0 if there isn't room left
+static inline int put(struct corpus *corpus, const char *characters)
+{
+	const size_t length = strlen(characters);
+	if ((size_t)(corpus->end - corpus->current) < length)
+		return 0;
+	memcpy(corpus->current, characters, length);
+	corpus->current += length;
+	return 1;
+}
+
+#endif // BENCH_CORPUS_H
@@ -0,0 +1,116 @@
+/*
+ * Measures what giving each task its own variables
+ * costs with a persistent environment: forking one,
+ * setting a variable in a fork, and getting envp for
+ * a launch, both cached and built afresh; against
+ * copying every NAME=value string, as a shell that
+ * deep-copies its environment per task would.
+ *
+ * Usage: bench_environment
+ *
+ * Output is CSV: name,variables,operations,seconds,ns_per_operation
+ */
+
+#include "scallop/environment.h"
+#include "bench_clock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define OPERATIONS 200000
+// Copying and building envp take longer, so fewer will do
+#define SLOW_OPERATIONS 5000
+
+static void print_result(const char *name, int variables, int operations, double seconds)
+{
+	printf(
+		"%s,%d,%d,%f,%f\n",
+		name,
+		variables,
+		operations,
+		seconds,
+		seconds * 1e9 / operations
+	);
+	fflush(stdout);
+}
+
+static void measure(struct scallop_symbols *symbols, int variables)
+{
+	char **strings = malloc((variables + 1) * sizeof(*strings));
+	if (!strings) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	for (int i = 0; i < variables; i++) {
+		strings[i] = malloc(64);
+		snprintf(strings[i], 64, "VARIABLE_%d=/some/typical/value/%d", i, i);
+	}
+	strings[variables] = NULL;
+
+	struct scallop_environment *environment = scallop_environment_import(symbols, strings);
+	const uint32_t name = scallop_symbols_intern(symbols, "TASK_ID", 7);
+	if (!environment || !name) {
+		perror("scallop_environment_import");
+		exit(EXIT_FAILURE);
+	}
+
+	double start = now();
+	for (int i = 0; i < OPERATIONS; i++)
+		scallop_environment_release(scallop_environment_fork(environment));
+	print_result("fork", variables, OPERATIONS, now() - start);
+
+	start = now();
+	for (int i = 0; i < OPERATIONS; i++) {
+		struct scallop_environment *task = scallop_environment_set(environment, name, "42", 2);
+		scallop_environment_release(task);
+	}
+	print_result("fork_and_set", variables, OPERATIONS, now() - start);
+
+	scallop_environment_envp(environment);
+	start = now();
+	for (int i = 0; i < OPERATIONS; i++)
+		scallop_environment_envp(environment);
+	print_result("envp_cached", variables, OPERATIONS, now() - start);
+
+	start = now();
+	for (int i = 0; i < SLOW_OPERATIONS; i++) {
+		struct scallop_environment *task = scallop_environment_set(environment, name, "42", 2);
+		scallop_environment_envp(task);
+		scallop_environment_release(task);
+	}
+	print_result("fork_set_and_build_envp", variables, SLOW_OPERATIONS, now() - start);
+
+	start = now();
+	for (int i = 0; i < SLOW_OPERATIONS; i++) {
+		char **copy = malloc((variables + 1) * sizeof(*copy));
+		for (int j = 0; copy && j < variables; j++)
+			copy[j] = strdup(strings[j]);
+		for (int j = 0; copy && j < variables; j++)
+			free(copy[j]);
+		free(copy);
+	}
+	print_result("deep_copy", variables, SLOW_OPERATIONS, now() - start);
+
+	scallop_environment_release(environment);
+	for (int i = 0; i < variables; i++)
+		free(strings[i]);
+	free(strings);
+}
+
+int main(void)
+{
+	struct scallop_symbols *symbols = scallop_symbols_create();
+	if (!symbols) {
+		perror("scallop_symbols_create");
+		return EXIT_FAILURE;
+	}
+
+	printf("name,variables,operations,seconds,ns_per_operation\n");
+	static const int sizes[] = { 16, 64, 1024 };
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); i++)
+		measure(symbols, sizes[i]);
+
+	scallop_symbols_destroy(symbols);
+	return EXIT_SUCCESS;
+}
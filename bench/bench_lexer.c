@@ -0,0 +1,396 @@
+/*
+ * Measures the lexer's throughput over generated
+ * corpora, each shaped after a different kind of
+ * script, so regressions can be tracked between
+ * releases.
+ *
+ * Usage: bench_lexer [--json] [--huge-mb N]
+ *
+ * Output is CSV by default:
+ * name,corpus,bytes,tokens,seconds,mb_per_second,tokens_per_second,ns_per_byte
+ * or a JSON array of objects with the same fields.
+ */
+
+#include "scallop/lexer.h"
+#include "bench_clock.h"
+#include "bench_corpus.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CORPUS_SIZE (8 * 1024 * 1024)
+#define DEFAULT_HUGE_SIZE (128 * 1024 * 1024)
+// Each measurement is repeated until it's covered at least this much
+#define MIN_BYTES_MEASURED (32 * 1024 * 1024)
+
+/*
+ * Corpora
+ *
+ * Generated from a fixed seed, so every run lexes the
+ * same bytes.
+ */
+
+static const char *pick(const char *const *choices, size_t count)
+{
+	return choices[random_below(count)];
+}
+
+#define pick_array(choices) pick((choices), sizeof(choices) / sizeof(*(choices)))
+
+static const char *const commands[] = {
+	"make", "cp", "echo", "grep", "sed", "tar", "git", "cc", "ls", "rm",
+};
+
+static const char *const arguments[] = {
+	"-j8", "all", "build/out.bin", "'/tmp/some dir'", "-rf", "src/*.c",
+	"--verbose", "\"$HOME/.config\"", "origin", "main", "-o", "a.out",
+};
+
+static int put_ascii(struct corpus *corpus)
+{
+	int ok = put(corpus, pick_array(commands));
+	const uint32_t count = random_below(6);
+	for (uint32_t i = 0; ok && i < count; i++)
+		ok = put(corpus, " ") && put(corpus, pick_array(arguments));
+	return ok && put(corpus, random_below(4) ? "\n" : ";");
+}
+
+static int put_quoted(struct corpus *corpus)
+{
+	const char *quote = random_below(2) ? "'" : "\"";
+	int ok = put(corpus, "echo ") && put(corpus, quote);
+	const uint32_t length = 1000 + random_below(20000);
+	for (uint32_t i = 0; ok && i < length; i++) {
+		const char character[] = {
+			random_below(40) ? (char)('a' + random_below(26)) : ' ',
+			0,
+		};
+		ok = put(corpus, character);
+	}
+	return ok && put(corpus, quote) && put(corpus, "\n");
+}
+
+static int put_escapes(struct corpus *corpus)
+{
+	static const char *const escapes[] = {
+		"\\a", "\\ ", "\\;", "\\{", "\\}", "\\[", "\\]", "\\'", "\\\"", "\\\\",
+		"\\\n", "x",
+	};
+	int ok = put(corpus, "echo ");
+	const uint32_t words = 1 + random_below(8);
+	for (uint32_t i = 0; ok && i < words; i++) {
+		const uint32_t length = 1 + random_below(12);
+		for (uint32_t j = 0; ok && j < length; j++)
+			ok = put(corpus, pick_array(escapes));
+		ok = ok && put(corpus, i + 1 < words ? " " : "\n");
+	}
+	return ok;
+}
+
+static int put_utf8(struct corpus *corpus)
+{
+	static const char *const words[] = {
+		"héllo", "wörld", "💩💩", "日本語のテキスト", "ñandú", "→∞",
+		"'quoted ünïcode ok'", "\"double quoted 🎉 ok\"", "Ελληνικά", "ü'ber'",
+	};
+	int ok = put(corpus, "echo");
+	const uint32_t count = 1 + random_below(8);
+	for (uint32_t i = 0; ok && i < count; i++)
+		ok = put(corpus, " ") && put(corpus, pick_array(words));
+	return ok && put(corpus, "\n");
+}
+
+static int put_nested(struct corpus *corpus)
+{
+	static const char *const open[] = { "{", "[" };
+	static const char *const close[] = { "}", "]" };
+	char kinds[64];
+	const uint32_t depth = 1 + random_below(sizeof(kinds));
+	int ok = 1;
+	for (uint32_t i = 0; ok && i < depth; i++) {
+		kinds[i] = (char)random_below(2);
+		ok = put(corpus, open[(int)kinds[i]]) && put(corpus, pick_array(commands));
+	}
+	for (uint32_t i = depth; ok && i > 0; i--)
+		ok = put(corpus, close[(int)kinds[i - 1]]);
+	return ok && put(corpus, "\n");
+}
+
+static const struct {
+	const char *name;
+	int (*put)(struct corpus *);
+	char huge;
+} corpora[] = {
+	{ "ascii_commands", put_ascii, 0 },
+	{ "long_quoted_strings", put_quoted, 0 },
+	{ "escape_heavy", put_escapes, 0 },
+	{ "utf8_heavy", put_utf8, 0 },
+	{ "nested_brackets", put_nested, 0 },
+	{ "huge_file", put_ascii, 1 },
+};
+
+static size_t generate(char *buffer, size_t size, int (*put)(struct corpus *))
+{
+	random_state = 0x9E3779B97F4A7C15;
+	struct corpus corpus = { buffer, buffer + size };
+	char *last = buffer;
+	while (put(&corpus))
+		last = corpus.current;
+	// Drop anything cut off at the end
+	return last - buffer;
+}
+
+/*
+ * Lexers
+ *
+ * Each lexes the whole input, returning the number of
+ * tokens, and the offset the EOF token ends at.
+ */
+
+struct lex_result {
+	ssize_t tokens;
+	int64_t end_offset;
+};
+
+static struct lex_result lex_one_at_a_time(const char *begin, const char *end)
+{
+	struct csalt_cmemory store = csalt_cmemory_make(begin, end);
+	struct scallop_parse_token token = { 0 };
+	struct lex_result result = { 0 };
+	do {
+		token = scallop_lex((csalt_store *)&store, token);
+		result.tokens++;
+	} while (token.token != SCALLOP_TOKEN_EOF);
+	result.end_offset = token.end_offset;
+	return result;
+}
+
+static struct lex_result lex_batches(const char *begin, const char *end)
+{
+	static struct scallop_parse_token tokens[4096];
+	struct csalt_cmemory store = csalt_cmemory_make(begin, end);
+	struct scallop_parse_token token = { 0 };
+	struct lex_result result = { 0 };
+	do {
+		const struct scallop_parse_token *tokens_end = scallop_lex_batch(
+			(csalt_store *)&store,
+			token,
+			tokens,
+			arrend(tokens)
+		);
+		result.tokens += tokens_end - tokens;
+		token = tokens_end[-1];
+	} while (token.token != SCALLOP_TOKEN_EOF);
+	result.end_offset = token.end_offset;
+	return result;
+}
+
+static struct lex_result lex_memory_batches(const char *begin, const char *end)
+{
+	static struct scallop_parse_token tokens[4096];
+	struct scallop_parse_token token = { 0 };
+	struct lex_result result = { 0 };
+	do {
+		const struct scallop_parse_token *tokens_end = scallop_lex_memory_batch(
+			begin,
+			end,
+			token,
+			tokens,
+			arrend(tokens)
+		);
+		result.tokens += tokens_end - tokens;
+		token = tokens_end[-1];
+	} while (token.token != SCALLOP_TOKEN_EOF);
+	result.end_offset = token.end_offset;
+	return result;
+}
+
+// Validating counts towards the time, as it has to be
+// done before every source lexed this way
+static struct lex_result lex_validated_batches(const char *begin, const char *end)
+{
+	static struct scallop_parse_token tokens[4096];
+	struct scallop_parse_token token = { 0 };
+	struct lex_result result = { 0 };
+	struct scallop_utf8_error error;
+	if (!scallop_validate_utf8(begin, end, &error)) {
+		result.end_offset = error.offset;
+		return result;
+	}
+	do {
+		const struct scallop_parse_token *tokens_end = scallop_lex_validated_batch(
+			begin,
+			end,
+			token,
+			tokens,
+			arrend(tokens)
+		);
+		result.tokens += tokens_end - tokens;
+		token = tokens_end[-1];
+	} while (token.token != SCALLOP_TOKEN_EOF);
+	result.end_offset = token.end_offset;
+	return result;
+}
+
+// Shared between runs, so after the first one every
+// word is already there, as for a script run again
+static struct scallop_symbols *symbols;
+
+static struct lex_result lex_interned_batches(const char *begin, const char *end)
+{
+	static struct scallop_parse_token tokens[4096];
+	static uint32_t token_symbols[4096];
+	struct scallop_parse_token token = { 0 };
+	struct lex_result result = { 0 };
+	do {
+		const struct scallop_parse_token *tokens_end =
+			scallop_lex_memory_interned_batch(
+				begin,
+				end,
+				token,
+				symbols,
+				tokens,
+				arrend(tokens),
+				token_symbols
+			);
+		result.tokens += tokens_end - tokens;
+		token = tokens_end[-1];
+	} while (token.token != SCALLOP_TOKEN_EOF);
+	result.end_offset = token.end_offset;
+	return result;
+}
+
+static struct lex_result lex_compact(const char *begin, const char *end)
+{
+	struct scallop_token_list list = scallop_token_list_make(begin, end);
+	struct lex_result result = { -1, -1 };
+	if (scallop_lex_memory_compact(&list)) {
+		result.tokens = list.count;
+		result.end_offset = list.last_end;
+	}
+	scallop_token_list_free(&list);
+	return result;
+}
+
+static const struct {
+	const char *name;
+	struct lex_result (*lex)(const char *, const char *);
+} lexers[] = {
+	{ "lex", lex_one_at_a_time },
+	{ "lex_batch", lex_batches },
+	{ "lex_memory_batch", lex_memory_batches },
+	{ "lex_validated_batch", lex_validated_batches },
+	{ "lex_memory_interned_batch", lex_interned_batches },
+	{ "lex_memory_compact", lex_compact },
+};
+
+static void print_result(
+	int json,
+	int first,
+	const char *name,
+	const char *corpus,
+	size_t bytes,
+	ssize_t tokens,
+	double seconds
+)
+{
+	const char *format = json ?
+		"%s\n\t{ \"name\": \"%s\", \"corpus\": \"%s\", \"bytes\": %zu, "
+		"\"tokens\": %zd, \"seconds\": %f, \"mb_per_second\": %f, "
+		"\"tokens_per_second\": %f, \"ns_per_byte\": %f }" :
+		"%s%s,%s,%zu,%zd,%f,%f,%f,%f\n";
+	printf(
+		format,
+		json ? (first ? "" : ",") : "",
+		name,
+		corpus,
+		bytes,
+		tokens,
+		seconds,
+		bytes / seconds / 1e6,
+		tokens / seconds,
+		seconds * 1e9 / bytes
+	);
+}
+
+int main(int argc, char **argv)
+{
+	int json = 0;
+	size_t huge_size = DEFAULT_HUGE_SIZE;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--json")) {
+			json = 1;
+		} else if (!strcmp(argv[i], "--huge-mb") && i + 1 < argc) {
+			huge_size = (size_t)atol(argv[++i]) * 1024 * 1024;
+		} else {
+			fprintf(stderr, "usage: %s [--json] [--huge-mb N]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	char *buffer = malloc(huge_size > CORPUS_SIZE ? huge_size : CORPUS_SIZE);
+	symbols = scallop_symbols_create();
+	if (!buffer || !symbols) {
+		perror("malloc");
+		return EXIT_FAILURE;
+	}
+
+	if (json)
+		printf("[");
+	else
+		printf("name,corpus,bytes,tokens,seconds,mb_per_second,tokens_per_second,ns_per_byte\n");
+
+	int first = 1;
+	for (size_t i = 0; i < sizeof(corpora) / sizeof(*corpora); i++) {
+		const size_t size = generate(
+			buffer,
+			corpora[i].huge ? huge_size : CORPUS_SIZE,
+			corpora[i].put
+		);
+
+		for (size_t j = 0; j < sizeof(lexers) / sizeof(*lexers); j++) {
+			size_t bytes = 0;
+			ssize_t tokens = 0;
+			const double start = now();
+			do {
+				const struct lex_result result = lexers[j].lex(buffer, buffer + size);
+				// Anything the lexer treats as an error shows up
+				// as lexing stopping short
+				if (result.end_offset != (int64_t)size + 1) {
+					fprintf(
+						stderr,
+						"%s stopped at %lld of %zu bytes of %s\n",
+						lexers[j].name,
+						(long long)result.end_offset,
+						size,
+						corpora[i].name
+					);
+					return EXIT_FAILURE;
+				}
+				bytes += size;
+				tokens += result.tokens;
+			} while (bytes < MIN_BYTES_MEASURED);
+
+			print_result(
+				json,
+				first,
+				lexers[j].name,
+				corpora[i].name,
+				bytes,
+				tokens,
+				now() - start
+			);
+			first = 0;
+			fflush(stdout);
+		}
+	}
+
+	if (json)
+		printf("\n]\n");
+
+	scallop_symbols_destroy(symbols);
+	free(buffer);
+	return EXIT_SUCCESS;
+}
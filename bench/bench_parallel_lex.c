@@ -0,0 +1,129 @@
+/*
+ * Measures how scallop_lex_memory_parallel() scales
+ * from one thread up to one per CPU, or up to the
+ * number of threads given as the first argument.
+ *
+ * The script is generated, unless a path to one is
+ * given as the second argument.
+ *
+ * Output is CSV: name,threads,bytes,tokens,seconds,mb_per_second,speedup
+ */
+
+#include "scallop/lexer.h"
+#include "scallop/script.h"
+#include "bench_clock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SCRIPT_SIZE (32 * 1024 * 1024)
+#define ITERATIONS 4
+
+static void fill(char *buffer, size_t size, const char *phrase)
+{
+	const size_t length = strlen(phrase);
+	for (size_t i = 0; i < size; i++)
+		buffer[i] = phrase[i % length];
+}
+
+static ssize_t count_tokens(const char *begin, const char *end)
+{
+	struct scallop_parse_token tokens[1024];
+	struct scallop_parse_token token = { 0 };
+	ssize_t count = 0;
+	for (;;) {
+		const struct scallop_parse_token *tokens_end = scallop_lex_memory_batch(
+			begin,
+			end,
+			token,
+			tokens,
+			arrend(tokens)
+		);
+		count += tokens_end - tokens;
+		token = tokens_end[-1];
+		if (token.token == SCALLOP_TOKEN_EOF)
+			return count;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	int max_threads = argc > 1 ?
+		atoi(argv[1]) :
+		(int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (max_threads < 1)
+		max_threads = 1;
+
+	struct scallop_script script;
+	char *buffer = NULL;
+	if (argc > 2) {
+		if (!scallop_script_open(&script, argv[2])) {
+			perror(argv[2]);
+			return EXIT_FAILURE;
+		}
+	} else {
+		buffer = malloc(SCRIPT_SIZE);
+		if (!buffer) {
+			perror("malloc");
+			return EXIT_FAILURE;
+		}
+		fill(
+			buffer,
+			SCRIPT_SIZE,
+			"make -j8 all; cp build/out.bin '/tmp/some dir' {echo \"héllo\"}\n"
+			"echo 'a longer quoted string, with \\'escapes\\' and [brackets]'\n"
+		);
+		script.begin = buffer;
+		script.end = buffer + SCRIPT_SIZE;
+	}
+
+	const ssize_t bytes = script.end - script.begin;
+	const ssize_t token_count = count_tokens(script.begin, script.end);
+	struct scallop_parse_token *tokens = malloc(token_count * sizeof(*tokens));
+	if (!tokens) {
+		perror("malloc");
+		return EXIT_FAILURE;
+	}
+
+	printf("name,threads,bytes,tokens,seconds,mb_per_second,speedup\n");
+	double single_thread_seconds = 0;
+	for (int threads = 1; threads <= max_threads; threads++) {
+		const double start = now();
+		for (int i = 0; i < ITERATIONS; i++) {
+			const struct scallop_parse_token *tokens_end =
+				scallop_lex_memory_parallel(
+					script.begin,
+					script.end,
+					threads,
+					tokens,
+					tokens + token_count
+				);
+			if (tokens_end - tokens != token_count) {
+				fprintf(stderr, "expected %zd tokens, got %zd\n", token_count, tokens_end - tokens);
+				return EXIT_FAILURE;
+			}
+		}
+		const double seconds = (now() - start) / ITERATIONS;
+		if (threads == 1)
+			single_thread_seconds = seconds;
+
+		printf(
+			"lex_memory_parallel,%d,%zd,%zd,%f,%f,%f\n",
+			threads,
+			bytes,
+			token_count,
+			seconds,
+			bytes / seconds / 1e6,
+			single_thread_seconds / seconds
+		);
+	}
+
+	free(tokens);
+	if (buffer)
+		free(buffer);
+	else
+		scallop_script_close(&script);
+	return EXIT_SUCCESS;
+}
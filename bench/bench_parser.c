@@ -0,0 +1,123 @@
+/*
+ * Measures scallop_parse_memory()'s throughput and
+ * memory use over generated scripts of growing size.
+ *
+ * Usage: bench_parser [max-mb]
+ *
+ * Output is CSV:
+ * name,bytes,nodes,seconds,mb_per_second,ast_bytes,bytes_per_node,peak_rss_kb
+ *
+ * peak_rss_kb is the whole process's, script included;
+ * scripts are parsed smallest first, so each row shows
+ * how far that parse pushed the peak up.
+ */
+
+#include "scallop/parser.h"
+#include "bench_clock.h"
+#include "bench_corpus.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_MAX_SIZE (128 * 1024 * 1024)
+#define MIN_SIZE (8 * 1024 * 1024)
+#define MIN_BYTES_MEASURED (64 * 1024 * 1024)
+
+/*
+ * Scripts are statements of a few arguments, some of
+ * them lists, with every so often a block of more
+ * statements, nested a few deep.
+ */
+
+static const char *const commands[] = {
+	"make", "cp", "echo", "grep", "if", "for", "git", "cc", "ls", "set",
+};
+
+static const char *const arguments[] = {
+	"-j8", "all", "build/out.bin", "'/tmp/some dir'", "-rf", "src/*.c",
+	"\"$HOME/.config\"", "[a b c]", "[x [y z]]", "origin", "-o", "a.out",
+};
+
+static int put_statement(struct corpus *script, int depth)
+{
+	int ok = put(script, commands[random_below(sizeof(commands) / sizeof(*commands))]);
+	const uint32_t count = random_below(5);
+	for (uint32_t i = 0; ok && i < count; i++)
+		ok = put(script, " ")
+			&& put(script, arguments[random_below(sizeof(arguments) / sizeof(*arguments))]);
+
+	if (ok && depth < 4 && !random_below(6)) {
+		ok = put(script, " {");
+		const uint32_t statements = 1 + random_below(4);
+		for (uint32_t i = 0; ok && i < statements; i++)
+			ok = put_statement(script, depth + 1) && put(script, i + 1 < statements ? "\n" : "");
+		ok = ok && put(script, "}");
+	}
+	return ok && (depth || put(script, random_below(4) ? "\n" : ";"));
+}
+
+static size_t generate(char *buffer, size_t size)
+{
+	random_state = 0x9E3779B97F4A7C15;
+	struct corpus script = { buffer, buffer + size };
+	char *last = buffer;
+	while (put_statement(&script, 0))
+		last = script.current;
+	return last - buffer;
+}
+
+int main(int argc, char **argv)
+{
+	const size_t max_size = argc > 1 ?
+		(size_t)atol(argv[1]) * 1024 * 1024 :
+		DEFAULT_MAX_SIZE;
+	char *buffer = malloc(max_size);
+	if (!buffer) {
+		perror("malloc");
+		return EXIT_FAILURE;
+	}
+
+	printf("name,bytes,nodes,seconds,mb_per_second,ast_bytes,bytes_per_node,peak_rss_kb\n");
+	for (size_t target = MIN_SIZE; target <= max_size; target *= 2) {
+		const size_t size = generate(buffer, target);
+		uint32_t nodes = 0;
+		size_t ast_bytes = 0;
+		size_t bytes = 0;
+		const double start = now();
+		do {
+			struct scallop_ast ast;
+			struct scallop_parse_error error;
+			if (!scallop_parse_memory(buffer, buffer + size, &ast, &error)) {
+				fprintf(
+					stderr,
+					"parse error %d at %lld\n",
+					error.error,
+					(long long)error.token.start_offset
+				);
+				return EXIT_FAILURE;
+			}
+			nodes = ast.count;
+			ast_bytes = ast.capacity * sizeof(*ast.nodes);
+			scallop_ast_free(&ast);
+			bytes += size;
+		} while (bytes < MIN_BYTES_MEASURED);
+		const double seconds = now() - start;
+
+		printf(
+			"parse_memory,%zu,%u,%f,%f,%zu,%f,%ld\n",
+			size,
+			nodes,
+			seconds * size / bytes,
+			bytes / seconds / 1e6,
+			ast_bytes,
+			(double)ast_bytes / nodes,
+			peak_rss_kb()
+		);
+		fflush(stdout);
+	}
+
+	free(buffer);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,185 @@
+/*
+ * Measures throughput through multi-stage pipelines,
+ * with the stages' pipes at their default size and at
+ * SCALLOP_PIPE_SIZE, and with the shell relaying
+ * between stages itself, by splice, tee, or read and
+ * write.
+ *
+ * Usage: bench_pipeline [GIB]
+ *
+ * Output is CSV: name,stages,pipe_size,bytes,seconds,gb_per_second
+ */
+
+#include "scallop/pipeline.h"
+#include "bench_clock.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define DEFAULT_GIB 4
+#define CAT_STAGES 3
+
+static void wait_all(const pid_t *pids, ssize_t count)
+{
+	for (ssize_t i = 0; i < count; i++)
+		waitpid(pids[i], NULL, 0);
+}
+
+static void print_result(const char *name, int stages, int pipe_size, long long bytes, double seconds)
+{
+	printf(
+		"%s,%d,%d,%lld,%f,%f\n",
+		name,
+		stages,
+		pipe_size,
+		bytes,
+		seconds,
+		bytes / seconds / 1e9
+	);
+	fflush(stdout);
+}
+
+/*
+ * head -c bytes /dev/zero | cat | cat | cat, the last
+ * stage's output relayed to /dev/null by the shell.
+ */
+static int run_cats(char *size, int pipe_size, int null)
+{
+	char *const head[] = { "head", "-c", size, "/dev/zero", NULL };
+	char *const cat[] = { "cat", NULL };
+	int output[2];
+	if (!scallop_pipe(output, pipe_size))
+		return 0;
+	const struct scallop_redirect to_output[] = {
+		{ SCALLOP_REDIRECT_DUP, 1, output[1] },
+	};
+	struct scallop_command commands[1 + CAT_STAGES] = { { head } };
+	for (int i = 1; i <= CAT_STAGES; i++)
+		commands[i] = (struct scallop_command) { cat };
+	commands[CAT_STAGES].redirects = to_output;
+	commands[CAT_STAGES].redirect_count = 1;
+
+	pid_t pids[1 + CAT_STAGES];
+	if (!scallop_pipeline_launch(commands, 1 + CAT_STAGES, pipe_size, SCALLOP_LAUNCH_SPAWN, pids))
+		return 0;
+	close(output[1]);
+	const ssize_t relayed = scallop_relay(output[0], null);
+	close(output[0]);
+	wait_all(pids, 1 + CAT_STAGES);
+	return relayed == atoll(size);
+}
+
+static ssize_t copy_relay(int in, int out)
+{
+	static char buffer[SCALLOP_PIPE_SIZE];
+	ssize_t total = 0, length;
+	while ((length = read(in, buffer, sizeof(buffer))) > 0) {
+		for (ssize_t written = 0; written < length;) {
+			const ssize_t result = write(out, buffer + written, length - written);
+			if (result < 0)
+				return -1;
+			written += result;
+		}
+		total += length;
+	}
+	return length ? -1 : total;
+}
+
+enum RELAY {
+	RELAY_SPLICE,
+	RELAY_TEE,
+	RELAY_COPY,
+};
+
+/*
+ * head -c bytes /dev/zero, relayed by the shell into
+ * cat > /dev/null.
+ */
+static int run_relay(char *size, int null, enum RELAY relay)
+{
+	char *const head[] = { "head", "-c", size, "/dev/zero", NULL };
+	char *const cat[] = { "cat", NULL };
+	int in[2], out[2];
+	if (!scallop_pipe(in, SCALLOP_PIPE_SIZE) || !scallop_pipe(out, SCALLOP_PIPE_SIZE))
+		return 0;
+	const struct scallop_redirect head_redirects[] = {
+		{ SCALLOP_REDIRECT_DUP, 1, in[1] },
+	};
+	const struct scallop_redirect cat_redirects[] = {
+		{ SCALLOP_REDIRECT_DUP, 0, out[0] },
+		{ SCALLOP_REDIRECT_DUP, 1, null },
+	};
+	const struct scallop_command head_command = { head, NULL, head_redirects, 1 };
+	const struct scallop_command cat_command = { cat, NULL, cat_redirects, 2 };
+	const pid_t pids[] = {
+		scallop_launch(&head_command, SCALLOP_LAUNCH_SPAWN),
+		scallop_launch(&cat_command, SCALLOP_LAUNCH_SPAWN),
+	};
+	close(in[1]);
+	close(out[0]);
+	if (pids[0] < 0 || pids[1] < 0)
+		return 0;
+
+	ssize_t relayed = -1;
+	switch (relay) {
+	case RELAY_SPLICE:
+		relayed = scallop_relay(in[0], out[1]);
+		break;
+	case RELAY_TEE:
+		relayed = scallop_relay_tee(in[0], out[1], null);
+		break;
+	case RELAY_COPY:
+		relayed = copy_relay(in[0], out[1]);
+		break;
+	}
+	close(in[0]);
+	close(out[1]);
+	wait_all(pids, 2);
+	return relayed == atoll(size);
+}
+
+int main(int argc, char **argv)
+{
+	const long long bytes = (argc > 1 ? atoll(argv[1]) : DEFAULT_GIB) * 1024 * 1024 * 1024;
+	char size[32];
+	snprintf(size, sizeof(size), "%lld", bytes);
+	const int null = open("/dev/null", O_WRONLY | O_CLOEXEC);
+	if (null < 0) {
+		perror("/dev/null");
+		return EXIT_FAILURE;
+	}
+
+	printf("name,stages,pipe_size,bytes,seconds,gb_per_second\n");
+	static const int pipe_sizes[] = { 0, SCALLOP_PIPE_SIZE };
+	for (size_t i = 0; i < sizeof(pipe_sizes) / sizeof(*pipe_sizes); i++) {
+		const double start = now();
+		if (!run_cats(size, pipe_sizes[i], null)) {
+			perror("pipeline");
+			return EXIT_FAILURE;
+		}
+		print_result("cat_pipeline", 1 + CAT_STAGES, pipe_sizes[i], bytes, now() - start);
+	}
+
+	static const struct {
+		const char *name;
+		enum RELAY relay;
+	} relays[] = {
+		{ "relay_splice", RELAY_SPLICE },
+		{ "relay_tee", RELAY_TEE },
+		{ "relay_read_write", RELAY_COPY },
+	};
+	for (size_t i = 0; i < sizeof(relays) / sizeof(*relays); i++) {
+		const double start = now();
+		if (!run_relay(size, null, relays[i].relay)) {
+			perror(relays[i].name);
+			return EXIT_FAILURE;
+		}
+		print_result(relays[i].name, 2, SCALLOP_PIPE_SIZE, bytes, now() - start);
+	}
+
+	close(null);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,195 @@
+/*
+ * Compares a binary pipe's ring buffer against an
+ * ordinary pipe between two threads, with small
+ * messages and with bulk writes. The batched ring
+ * writes messages straight into reserved space,
+ * committing them a batch at a time.
+ *
+ * Usage: bench_ring [MIB]
+ *
+ * Output is CSV: name,workload,message_bytes,bytes,seconds,gb_per_second,messages_per_second
+ */
+
+#include "scallop/pipeline.h"
+#include "scallop/ring.h"
+#include "bench_clock.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEFAULT_MIB 1024
+#define READ_SIZE (64 * 1024)
+#define BATCH_SIZE (16 * 1024)
+
+enum TRANSPORT {
+	TRANSPORT_PIPE,
+	TRANSPORT_RING,
+	TRANSPORT_RING_BATCHED,
+};
+
+struct transport {
+	enum TRANSPORT kind;
+	struct scallop_ring ring;
+	int fds[2];
+	size_t message_size;
+	size_t bytes;
+};
+
+static void produce_batched(struct transport *transport)
+{
+	size_t sent = 0;
+	while (sent < transport->bytes) {
+		size_t room;
+		char *space = scallop_ring_reserve(&transport->ring, &room);
+		if (!space)
+			abort();
+		if (room > BATCH_SIZE)
+			room = BATCH_SIZE;
+		size_t batch = 0;
+		while (
+			batch + transport->message_size <= room
+			&& sent + batch < transport->bytes
+		) {
+			memset(space + batch, 0, transport->message_size);
+			batch += transport->message_size;
+		}
+		// Messages bigger than the room left go in pieces
+		if (!batch)
+			batch = room < transport->bytes - sent ? room : transport->bytes - sent;
+		scallop_ring_commit(&transport->ring, batch);
+		sent += batch;
+	}
+}
+
+static void *produce(void *param)
+{
+	struct transport *transport = param;
+	if (transport->kind == TRANSPORT_RING_BATCHED) {
+		produce_batched(transport);
+		scallop_ring_close_writer(&transport->ring);
+		return NULL;
+	}
+
+	char *message = calloc(1, transport->message_size);
+	if (!message)
+		abort();
+	for (size_t sent = 0; sent < transport->bytes; sent += transport->message_size) {
+		if (transport->kind == TRANSPORT_RING) {
+			scallop_ring_write(&transport->ring, message, transport->message_size);
+			continue;
+		}
+		for (size_t written = 0; written < transport->message_size;) {
+			const ssize_t result = write(
+				transport->fds[1],
+				message + written,
+				transport->message_size - written
+			);
+			if (result < 0)
+				abort();
+			written += result;
+		}
+	}
+	if (transport->kind == TRANSPORT_RING)
+		scallop_ring_close_writer(&transport->ring);
+	else
+		close(transport->fds[1]);
+	free(message);
+	return NULL;
+}
+
+// Reads whatever has arrived, up to READ_SIZE at once
+static size_t consume(struct transport *transport)
+{
+	static char buffer[READ_SIZE];
+	size_t total = 0;
+	for (;;) {
+		const ssize_t length = transport->kind != TRANSPORT_PIPE ?
+			scallop_ring_read(&transport->ring, buffer, sizeof(buffer)) :
+			read(transport->fds[0], buffer, sizeof(buffer));
+		if (length <= 0)
+			return total;
+		total += length;
+	}
+}
+
+static int run(
+	const char *name,
+	const char *workload,
+	enum TRANSPORT kind,
+	size_t message_size,
+	size_t bytes
+)
+{
+	struct transport transport = {
+		.kind = kind,
+		.message_size = message_size,
+		.bytes = bytes / message_size * message_size,
+	};
+	if (kind == TRANSPORT_PIPE ?
+		!scallop_pipe(transport.fds, SCALLOP_PIPE_SIZE) :
+		!scallop_ring_create(&transport.ring, SCALLOP_RING_SIZE)
+	)
+		return 0;
+
+	const double start = now();
+	pthread_t producer;
+	if (pthread_create(&producer, NULL, produce, &transport))
+		return 0;
+	const size_t received = consume(&transport);
+	pthread_join(producer, NULL);
+	const double seconds = now() - start;
+
+	if (kind == TRANSPORT_PIPE)
+		close(transport.fds[0]);
+	else
+		scallop_ring_unmap(&transport.ring);
+	if (received != transport.bytes)
+		return 0;
+
+	printf(
+		"%s,%s,%zu,%zu,%f,%f,%f\n",
+		name,
+		workload,
+		message_size,
+		received,
+		seconds,
+		received / seconds / 1e9,
+		received / message_size / seconds
+	);
+	fflush(stdout);
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	const size_t bytes = (size_t)(argc > 1 ? atol(argv[1]) : DEFAULT_MIB) * 1024 * 1024;
+	static const struct {
+		const char *workload;
+		size_t message_size;
+		// Small messages take much longer per byte
+		size_t divisor;
+	} workloads[] = {
+		{ "small_messages", 64, 16 },
+		{ "medium_messages", 4096, 1 },
+		{ "bulk", 1024 * 1024, 1 },
+	};
+
+	printf("name,workload,message_bytes,bytes,seconds,gb_per_second,messages_per_second\n");
+	for (size_t i = 0; i < sizeof(workloads) / sizeof(*workloads); i++) {
+		const char *workload = workloads[i].workload;
+		const size_t message_size = workloads[i].message_size;
+		const size_t workload_bytes = bytes / workloads[i].divisor;
+		if (
+			!run("binary_pipe_ring", workload, TRANSPORT_RING, message_size, workload_bytes)
+			|| !run("binary_pipe_ring_batched", workload, TRANSPORT_RING_BATCHED, message_size, workload_bytes)
+			|| !run("pipe", workload, TRANSPORT_PIPE, message_size, workload_bytes)
+		) {
+			perror(workload);
+			return EXIT_FAILURE;
+		}
+	}
+	return EXIT_SUCCESS;
+}
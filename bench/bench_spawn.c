@@ -0,0 +1,86 @@
+/*
+ * Measures how many commands a second each launch
+ * method can start and wait for, as the shell's
+ * resident memory grows - standing in for the token
+ * arrays and trees of a big script.
+ *
+ * Usage: bench_spawn [MAX_RSS_MB]
+ *
+ * Output is CSV: name,rss_mb,spawns,seconds,spawns_per_second,peak_rss_kb
+ */
+
+#include "scallop/launch.h"
+#include "bench_clock.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+
+#define DEFAULT_MAX_RSS_MB 1024
+// Each measurement runs for at least this long
+#define MIN_SECONDS 1.0
+
+static const struct {
+	const char *name;
+	enum SCALLOP_LAUNCH_METHOD method;
+} methods[] = {
+	{ "posix_spawn", SCALLOP_LAUNCH_SPAWN },
+	{ "fork_exec", SCALLOP_LAUNCH_FORK },
+};
+
+int main(int argc, char **argv)
+{
+	const long max_rss_mb = argc > 1 ? atol(argv[1]) : DEFAULT_MAX_RSS_MB;
+
+	char *const true_argv[] = { "/bin/true", NULL };
+	const struct scallop_redirect redirects[] = {
+		{ SCALLOP_REDIRECT_OPEN, 1, .path = "/dev/null", .flags = O_WRONLY },
+	};
+	const struct scallop_command command = { true_argv, NULL, redirects, 1 };
+
+	printf("name,rss_mb,spawns,seconds,spawns_per_second,peak_rss_kb\n");
+	char *memory = NULL;
+	for (long rss_mb = 0; rss_mb <= max_rss_mb; rss_mb = rss_mb ? rss_mb * 4 : 16) {
+		// Touch every page, so it really is resident
+		free(memory);
+		memory = rss_mb ? malloc(rss_mb * 1024 * 1024) : NULL;
+		if (rss_mb && !memory) {
+			perror("malloc");
+			return EXIT_FAILURE;
+		}
+		if (memory)
+			memset(memory, 1, rss_mb * 1024 * 1024);
+
+		for (size_t i = 0; i < sizeof(methods) / sizeof(*methods); i++) {
+			long spawns = 0;
+			const double start = now();
+			double seconds;
+			do {
+				const pid_t pid = scallop_launch(&command, methods[i].method);
+				if (pid < 0) {
+					perror(methods[i].name);
+					return EXIT_FAILURE;
+				}
+				waitpid(pid, NULL, 0);
+				spawns++;
+				seconds = now() - start;
+			} while (seconds < MIN_SECONDS);
+
+			printf(
+				"%s,%ld,%ld,%f,%f,%ld\n",
+				methods[i].name,
+				rss_mb,
+				spawns,
+				seconds,
+				spawns / seconds,
+				peak_rss_kb()
+			);
+			fflush(stdout);
+		}
+	}
+
+	free(memory);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,43 @@
+/*
+ * Scallop - a shell for executing tasks concurrently
+ * Copyright (C) <year>  Marcus Harrison
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "scallop/arena.h"
+
+#include <stddef.h>
+
+struct scallop_arena scallop_arena_make(void *buffer, ssize_t size)
+{
+	return (struct scallop_arena) {
+		.begin = buffer,
+		.current = buffer,
+		.end = (char *)buffer + size,
+	};
+}
+
+char *scallop_arena_alloc(struct scallop_arena *arena, ssize_t size)
+{
+	if (size < 0 || arena->end - arena->current < size)
+		return NULL;
+	char *allocation = arena->current;
+	arena->current += size;
+	return allocation;
+}
+
+void scallop_arena_reset(struct scallop_arena *arena)
+{
+	arena->current = arena->begin;
+}
@@ -0,0 +1,1710 @@
+/*
+ * Scallop - a shell for executing tasks concurrently
+ * Copyright (C) <year>  Marcus Harrison
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "scallop/builtin.h"
+#include "scallop/arena.h"
+#include "scallop/pipeline.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define OUTPUT_BUFFER_SIZE 4096
+#define MESSAGE_SIZE 512
+// Enough for any printf conversion's flags, width and
+// precision, as long as they're sensible
+#define SPEC_SIZE 32
+
+/*
+ * Tasks
+ */
+
+void scallop_task_init(struct scallop_task *task)
+{
+	for (int fd = 0; fd < SCALLOP_TASK_FDS; fd++)
+		task->fds[fd] = (struct scallop_vfd) {
+			fd < 3 ? SCALLOP_VFD_FD : SCALLOP_VFD_CLOSED,
+			fd < 3 ? fd : -1,
+		};
+	task->directory = NULL;
+	task->environment = NULL;
+}
+
+int scallop_task_inherit(struct scallop_task *task, const struct scallop_task *parent)
+{
+	for (int fd = 0; fd < SCALLOP_TASK_FDS; fd++) {
+		task->fds[fd] = parent->fds[fd];
+		task->fds[fd].owned = 0;
+	}
+	task->directory = NULL;
+	task->environment = parent->environment ?
+		scallop_environment_fork(parent->environment) :
+		NULL;
+	if (parent->directory) {
+		task->directory = strdup(parent->directory);
+		if (!task->directory) {
+			scallop_environment_release(task->environment);
+			task->environment = NULL;
+			return 0;
+		}
+	}
+	return 1;
+}
+
+void scallop_task_close(struct scallop_task *task, int fd)
+{
+	struct scallop_vfd *vfd = &task->fds[fd];
+	if (vfd->owned) {
+		switch (vfd->kind) {
+		case SCALLOP_VFD_FD:
+			close(vfd->fd);
+			break;
+		case SCALLOP_VFD_RING_READER:
+		case SCALLOP_VFD_RING_WRITER: {
+			int other = 0;
+			for (; other < SCALLOP_TASK_FDS; other++) {
+				struct scallop_vfd *copy = &task->fds[other];
+				if (other != fd && copy->kind == vfd->kind && copy->ring == vfd->ring)
+					break;
+			}
+			if (other < SCALLOP_TASK_FDS)
+				task->fds[other].owned = 1;
+			else if (vfd->kind == SCALLOP_VFD_RING_READER)
+				scallop_ring_close_reader(vfd->ring);
+			else
+				scallop_ring_close_writer(vfd->ring);
+			break;
+		}
+		default:
+			break;
+		}
+	}
+	*vfd = (struct scallop_vfd) { SCALLOP_VFD_CLOSED, -1 };
+}
+
+void scallop_task_free(struct scallop_task *task)
+{
+	for (int fd = 0; fd < SCALLOP_TASK_FDS; fd++)
+		scallop_task_close(task, fd);
+	free(task->directory);
+	task->directory = NULL;
+	scallop_environment_release(task->environment);
+	task->environment = NULL;
+}
+
+/*
+ * The value of the variable name in the task's
+ * environment, which it has to have one of its own
+ * for, or NULL if it's unset there.
+ */
+static const char *task_variable(const struct scallop_task *task, const char *name)
+{
+	const uint32_t symbol = scallop_symbols_find(
+		scallop_environment_symbols(task->environment),
+		name,
+		strlen(name)
+	);
+	return symbol ? scallop_environment_get(task->environment, symbol, NULL) : NULL;
+}
+
+/*
+ * Gives path as seen from the task's directory, in
+ * buffer if it has to be joined onto it, or NULL with
+ * errno set if it's too long.
+ */
+static const char *task_path(
+	const struct scallop_task *task,
+	const char *path,
+	char *buffer,
+	size_t size
+)
+{
+	if (!task->directory || path[0] == '/')
+		return path;
+	if ((size_t)snprintf(buffer, size, "%s/%s", task->directory, path) >= size) {
+		errno = ENAMETOOLONG;
+		return NULL;
+	}
+	return buffer;
+}
+
+static int valid_fd(int fd)
+{
+	if (fd >= 0 && fd < SCALLOP_TASK_FDS)
+		return 1;
+	errno = EBADF;
+	return 0;
+}
+
+static int redirect(struct scallop_task *task, const struct scallop_redirect *redirect)
+{
+	if (!valid_fd(redirect->fd))
+		return 0;
+
+	struct scallop_vfd vfd = { SCALLOP_VFD_CLOSED, -1 };
+	switch (redirect->kind) {
+	case SCALLOP_REDIRECT_OPEN: {
+		char buffer[PATH_MAX];
+		const char *path = task_path(task, redirect->path, buffer, sizeof(buffer));
+		if (!path)
+			return 0;
+		const int fd = open(path, redirect->flags | O_CLOEXEC, redirect->mode);
+		if (fd < 0)
+			return 0;
+		vfd = (struct scallop_vfd) { SCALLOP_VFD_FD, fd, NULL, 1 };
+		break;
+	}
+	case SCALLOP_REDIRECT_DUP:
+		if (!valid_fd(redirect->source))
+			return 0;
+		if (redirect->source == redirect->fd)
+			return 1;
+		vfd = task->fds[redirect->source];
+		if (vfd.kind == SCALLOP_VFD_CLOSED) {
+			errno = EBADF;
+			return 0;
+		}
+		// Real descriptors are duplicated, so each copy
+		// can be closed on its own; ring ends are shared,
+		// with only one copy closing it
+		if (vfd.kind == SCALLOP_VFD_FD) {
+			vfd.fd = fcntl(vfd.fd, F_DUPFD_CLOEXEC, SCALLOP_TASK_FDS);
+			if (vfd.fd < 0)
+				return 0;
+			vfd.owned = 1;
+		} else {
+			vfd.owned = 0;
+		}
+		break;
+	case SCALLOP_REDIRECT_CLOSE:
+		break;
+	default:
+		errno = EINVAL;
+		return 0;
+	}
+
+	scallop_task_close(task, redirect->fd);
+	task->fds[redirect->fd] = vfd;
+	return 1;
+}
+
+int scallop_task_redirect(
+	struct scallop_task *task,
+	const struct scallop_redirect *redirects,
+	ssize_t count
+)
+{
+	for (ssize_t i = 0; i < count; i++)
+		if (!redirect(task, &redirects[i]))
+			return 0;
+	return 1;
+}
+
+ssize_t scallop_task_write(
+	struct scallop_task *task,
+	int fd,
+	const void *buffer,
+	size_t length
+)
+{
+	if (!valid_fd(fd))
+		return -1;
+	const struct scallop_vfd *vfd = &task->fds[fd];
+	switch (vfd->kind) {
+	case SCALLOP_VFD_FD:
+		for (size_t written = 0; written < length;) {
+			const ssize_t result = write(vfd->fd, (const char *)buffer + written, length - written);
+			if (result < 0 && errno != EINTR)
+				return -1;
+			if (result > 0)
+				written += result;
+		}
+		return (ssize_t)length;
+	case SCALLOP_VFD_RING_WRITER:
+		return scallop_ring_write(vfd->ring, buffer, length);
+	default:
+		errno = EBADF;
+		return -1;
+	}
+}
+
+ssize_t scallop_task_read(struct scallop_task *task, int fd, void *buffer, size_t length)
+{
+	if (!valid_fd(fd))
+		return -1;
+	const struct scallop_vfd *vfd = &task->fds[fd];
+	switch (vfd->kind) {
+	case SCALLOP_VFD_FD: {
+		ssize_t result;
+		while ((result = read(vfd->fd, buffer, length)) < 0 && errno == EINTR)
+			;
+		return result;
+	}
+	case SCALLOP_VFD_RING_READER:
+		return scallop_ring_read(vfd->ring, buffer, length);
+	default:
+		errno = EBADF;
+		return -1;
+	}
+}
+
+__attribute__((format(printf, 2, 3)))
+static void complain(struct scallop_task *task, const char *format, ...)
+{
+	char message[MESSAGE_SIZE];
+	va_list arguments;
+	va_start(arguments, format);
+	int length = vsnprintf(message, sizeof(message), format, arguments);
+	va_end(arguments);
+	if (length < 0)
+		return;
+	if ((size_t)length >= sizeof(message))
+		length = sizeof(message) - 1;
+	scallop_task_write(task, 2, message, length);
+}
+
+/*
+ * Output
+ *
+ * Builtins collect their output and write it a buffer
+ * at a time, so echo costs one write however many
+ * arguments it has.
+ */
+
+struct output {
+	struct scallop_task *task;
+	int fd;
+	int failed;
+	size_t length;
+	char buffer[OUTPUT_BUFFER_SIZE];
+};
+
+static void flush(struct output *output)
+{
+	if (
+		output->length
+		&& !output->failed
+		&& scallop_task_write(output->task, output->fd, output->buffer, output->length) < 0
+	)
+		output->failed = errno;
+	output->length = 0;
+}
+
+static void put(struct output *output, const char *data, size_t length)
+{
+	if (output->length + length > sizeof(output->buffer)) {
+		flush(output);
+		if (length > sizeof(output->buffer)) {
+			if (!output->failed && scallop_task_write(output->task, output->fd, data, length) < 0)
+				output->failed = errno;
+			return;
+		}
+	}
+	memcpy(output->buffer + output->length, data, length);
+	output->length += length;
+}
+
+static void put_string(struct output *output, const char *string)
+{
+	put(output, string, strlen(string));
+}
+
+// Returns the builtin's status once its output is out
+static int finish(struct output *output, const char *name, int status)
+{
+	flush(output);
+	if (!output->failed)
+		return status;
+	complain(output->task, "%s: write error: %s\n", name, strerror(output->failed));
+	return 1;
+}
+
+/*
+ * echo and printf
+ */
+
+static int builtin_echo(struct scallop_task *task, int argc, char *const *argv)
+{
+	struct output output = { task, 1 };
+	int first = 1;
+	const int newline = argc < 2 || strcmp(argv[1], "-n");
+	if (!newline)
+		first = 2;
+	for (int i = first; i < argc; i++) {
+		if (i > first)
+			put(&output, " ", 1);
+		put_string(&output, argv[i]);
+	}
+	if (newline)
+		put(&output, "\n", 1);
+	return finish(&output, argv[0], 0);
+}
+
+/*
+ * Puts the character an escape after a backslash
+ * stands for, returning what comes after the escape.
+ * Octal escapes are \0NNN in %b's arguments, but \NNN
+ * in formats, where a leading 0 counts as a digit.
+ */
+static const char *put_escape(struct output *output, const char *escape, int zero_prefixed)
+{
+	static const char from[] = "\\abfnrtv\"";
+	static const char to[] = "\\\a\b\f\n\r\t\v\"";
+	const char *found = *escape ? strchr(from, *escape) : NULL;
+	if (found) {
+		put(output, &to[found - from], 1);
+		return escape + 1;
+	}
+
+	if (*escape >= '0' && *escape <= '7') {
+		if (zero_prefixed && *escape == '0')
+			escape++;
+		unsigned char character = 0;
+		for (int digits = 0; digits < 3 && *escape >= '0' && *escape <= '7'; digits++)
+			character = (unsigned char)(character * 8 + *escape++ - '0');
+		put(output, (const char *)&character, 1);
+		return escape;
+	}
+
+	put(output, "\\", 1);
+	return escape;
+}
+
+static void put_escapes(struct output *output, const char *string)
+{
+	while (*string) {
+		const char *backslash = strchr(string, '\\');
+		if (!backslash) {
+			put_string(output, string);
+			return;
+		}
+		put(output, string, backslash - string);
+		string = put_escape(output, backslash + 1, 1);
+	}
+}
+
+__attribute__((format(printf, 2, 3)))
+static void put_formatted(struct output *output, const char *format, ...)
+{
+	char small[256];
+	va_list arguments;
+	va_start(arguments, format);
+	const int length = vsnprintf(small, sizeof(small), format, arguments);
+	va_end(arguments);
+	if (length < 0)
+		return;
+	if ((size_t)length < sizeof(small)) {
+		put(output, small, length);
+		return;
+	}
+
+	char *large = malloc(length + 1);
+	if (!large) {
+		output->failed = ENOMEM;
+		return;
+	}
+	va_start(arguments, format);
+	vsnprintf(large, length + 1, format, arguments);
+	va_end(arguments);
+	put(output, large, length);
+	free(large);
+}
+
+struct printf_arguments {
+	char *const *next;
+	char *const *end;
+	int status;
+};
+
+static const char *next_argument(struct printf_arguments *arguments)
+{
+	return arguments->next < arguments->end ? *arguments->next++ : "";
+}
+
+static int parse_number(
+	struct scallop_task *task,
+	struct printf_arguments *arguments,
+	const char *argument,
+	int is_signed,
+	long long *value
+)
+{
+	char *end;
+	errno = 0;
+	*value = is_signed ?
+		strtoll(argument, &end, 0) :
+		(long long)strtoull(argument, &end, 0);
+	if (*argument && !*end && !errno)
+		return 1;
+	complain(task, "printf: %s: invalid number\n", argument);
+	arguments->status = 1;
+	return 0;
+}
+
+/*
+ * Puts one conversion, format pointing just past its
+ * %, returning what comes after it, or NULL if it's
+ * not one printf knows.
+ */
+static const char *put_conversion(
+	struct output *output,
+	const char *format,
+	struct printf_arguments *arguments
+)
+{
+	char spec[SPEC_SIZE] = "%";
+	size_t length = 1;
+	const char *current = format;
+	while (*current && strchr("-+ #0", *current))
+		current++;
+	while (*current >= '0' && *current <= '9')
+		current++;
+	if (*current == '.') {
+		current++;
+		while (*current >= '0' && *current <= '9')
+			current++;
+	}
+	// Room for ll, the conversion, and the null
+	if ((size_t)(current - format) + length + 4 > sizeof(spec))
+		return NULL;
+	memcpy(spec + length, format, current - format);
+	length += current - format;
+
+	const char conversion = *current;
+	long long number;
+	switch (conversion) {
+	case '%':
+		put(output, "%", 1);
+		break;
+	case 's':
+		spec[length++] = 's';
+		put_formatted(output, spec, next_argument(arguments));
+		break;
+	case 'b':
+		put_escapes(output, next_argument(arguments));
+		break;
+	case 'c': {
+		const char *argument = next_argument(arguments);
+		if (*argument) {
+			spec[length++] = 'c';
+			put_formatted(output, spec, *argument);
+		}
+		break;
+	}
+	case 'd':
+	case 'i':
+	case 'u':
+	case 'o':
+	case 'x':
+	case 'X': {
+		const int is_signed = conversion == 'd' || conversion == 'i';
+		parse_number(output->task, arguments, next_argument(arguments), is_signed, &number);
+		spec[length++] = 'l';
+		spec[length++] = 'l';
+		spec[length++] = conversion;
+		if (is_signed)
+			put_formatted(output, spec, number);
+		else
+			put_formatted(output, spec, (unsigned long long)number);
+		break;
+	}
+	default:
+		return NULL;
+	}
+	return current + 1;
+}
+
+static int builtin_printf(struct scallop_task *task, int argc, char *const *argv)
+{
+	if (argc < 2) {
+		complain(task, "printf: missing format\n");
+		return 2;
+	}
+
+	struct output output = { task, 1 };
+	struct printf_arguments arguments = { argv + 2, argv + argc, 0 };
+	// The format is used again for as long as each use
+	// takes up more arguments
+	for (;;) {
+		char *const *before = arguments.next;
+		const char *format = argv[1];
+		while (*format) {
+			const char *special = strpbrk(format, "\\%");
+			if (!special) {
+				put_string(&output, format);
+				break;
+			}
+			put(&output, format, special - format);
+			if (*special == '\\') {
+				format = put_escape(&output, special + 1, 0);
+				continue;
+			}
+			format = put_conversion(&output, special + 1, &arguments);
+			if (!format) {
+				complain(task, "printf: %s: invalid conversion\n", special);
+				return finish(&output, argv[0], 1);
+			}
+		}
+		if (arguments.next == arguments.end || arguments.next == before)
+			break;
+	}
+	return finish(&output, argv[0], arguments.status);
+}
+
+/*
+ * test and [
+ *
+ * Follows POSIX's rules for deciding what the
+ * arguments mean from how many there are, which covers
+ * up to four; anything longer is an error. Each
+ * evaluation returns an exit status: 0 for true, 1 for
+ * false, and 2 for an error.
+ */
+
+static int negate(int status)
+{
+	return status == 2 ? 2 : !status;
+}
+
+static int test_file(struct scallop_task *task, char operator, const char *operand)
+{
+	char buffer[PATH_MAX];
+	const char *path = task_path(task, operand, buffer, sizeof(buffer));
+	if (!path)
+		return 1;
+
+	struct stat status;
+	switch (operator) {
+	case 'r':
+		return access(path, R_OK) != 0;
+	case 'w':
+		return access(path, W_OK) != 0;
+	case 'x':
+		return access(path, X_OK) != 0;
+	case 'h':
+	case 'L':
+		return lstat(path, &status) != 0 || !S_ISLNK(status.st_mode);
+	}
+
+	if (stat(path, &status))
+		return 1;
+	switch (operator) {
+	case 'e':
+		return 0;
+	case 'f':
+		return !S_ISREG(status.st_mode);
+	case 'd':
+		return !S_ISDIR(status.st_mode);
+	case 's':
+		return status.st_size <= 0;
+	default:
+		return 2;
+	}
+}
+
+static int test_unary(struct scallop_task *task, const char *operator, const char *operand)
+{
+	if (operator[0] != '-' || !operator[1] || operator[2])
+		goto unknown;
+	switch (operator[1]) {
+	case 'n':
+		return !*operand;
+	case 'z':
+		return *operand != 0;
+	case 'e':
+	case 'f':
+	case 'd':
+	case 'r':
+	case 'w':
+	case 'x':
+	case 's':
+	case 'h':
+	case 'L':
+		return test_file(task, operator[1], operand);
+	}
+unknown:
+	complain(task, "test: %s: unary operator expected\n", operator);
+	return 2;
+}
+
+static int parse_integer(struct scallop_task *task, const char *string, long long *value)
+{
+	char *end;
+	errno = 0;
+	*value = strtoll(string, &end, 10);
+	if (*string && !*end && !errno)
+		return 1;
+	complain(task, "test: %s: integer expected\n", string);
+	return 0;
+}
+
+// Returns -1 if operator isn't a binary operator
+static int test_binary(
+	struct scallop_task *task,
+	const char *left,
+	const char *operator,
+	const char *right
+)
+{
+	if (!strcmp(operator, "="))
+		return strcmp(left, right) != 0;
+	if (!strcmp(operator, "!="))
+		return !strcmp(left, right);
+
+	static const char *const comparisons[] = { "-eq", "-ne", "-lt", "-le", "-gt", "-ge" };
+	size_t comparison = 0;
+	const size_t count = sizeof(comparisons) / sizeof(*comparisons);
+	while (comparison < count && strcmp(operator, comparisons[comparison]))
+		comparison++;
+	if (comparison == count)
+		return -1;
+
+	long long a, b;
+	if (!parse_integer(task, left, &a) || !parse_integer(task, right, &b))
+		return 2;
+	switch (comparison) {
+	case 0:
+		return !(a == b);
+	case 1:
+		return !(a != b);
+	case 2:
+		return !(a < b);
+	case 3:
+		return !(a <= b);
+	case 4:
+		return !(a > b);
+	default:
+		return !(a >= b);
+	}
+}
+
+static int test(struct scallop_task *task, int argc, char *const *argv)
+{
+	switch (argc) {
+	case 0:
+		return 1;
+	case 1:
+		return !*argv[0];
+	case 2:
+		if (!strcmp(argv[0], "!"))
+			return negate(test(task, 1, argv + 1));
+		return test_unary(task, argv[0], argv[1]);
+	case 3: {
+		const int status = test_binary(task, argv[0], argv[1], argv[2]);
+		if (status >= 0)
+			return status;
+		if (!strcmp(argv[0], "!"))
+			return negate(test(task, 2, argv + 1));
+		if (!strcmp(argv[0], "(") && !strcmp(argv[2], ")"))
+			return test(task, 1, argv + 1);
+		break;
+	}
+	case 4:
+		if (!strcmp(argv[0], "!"))
+			return negate(test(task, 3, argv + 1));
+		if (!strcmp(argv[0], "(") && !strcmp(argv[3], ")"))
+			return test(task, 2, argv + 1);
+		break;
+	}
+	complain(task, "test: too many arguments\n");
+	return 2;
+}
+
+static int builtin_test(struct scallop_task *task, int argc, char *const *argv)
+{
+	return test(task, argc - 1, argv + 1);
+}
+
+static int builtin_bracket(struct scallop_task *task, int argc, char *const *argv)
+{
+	if (strcmp(argv[argc - 1], "]")) {
+		complain(task, "[: missing ]\n");
+		return 2;
+	}
+	return test(task, argc - 2, argv + 1);
+}
+
+static int builtin_true(struct scallop_task *task, int argc, char *const *argv)
+{
+	(void)task;
+	(void)argc;
+	(void)argv;
+	return 0;
+}
+
+static int builtin_false(struct scallop_task *task, int argc, char *const *argv)
+{
+	(void)task;
+	(void)argc;
+	(void)argv;
+	return 1;
+}
+
+/*
+ * cd
+ *
+ * Only changes the task's directory, never the
+ * shell's, which every other task shares. Like other
+ * shells' cd without -P, .. takes off the last
+ * component of the path rather than following it.
+ */
+
+// Removes . and .. components, and repeated slashes,
+// from an absolute path
+static void normalize(char *path)
+{
+	char *out = path;
+	const char *in = path;
+	while (*in) {
+		while (*in == '/')
+			in++;
+		const char *component = in;
+		while (*in && *in != '/')
+			in++;
+		const size_t length = in - component;
+		if (!length || (length == 1 && component[0] == '.'))
+			continue;
+		if (length == 2 && component[0] == '.' && component[1] == '.') {
+			while (out > path && *--out != '/')
+				;
+			continue;
+		}
+		*out++ = '/';
+		memmove(out, component, length);
+		out += length;
+	}
+	if (out == path)
+		*out++ = '/';
+	*out = 0;
+}
+
+static char *join_directory(const struct scallop_task *task, const char *target)
+{
+	char *base = NULL;
+	if (target[0] != '/') {
+		base = task->directory ? strdup(task->directory) : getcwd(NULL, 0);
+		if (!base)
+			return NULL;
+	}
+	const size_t base_length = base ? strlen(base) : 0;
+	char *directory = malloc(base_length + strlen(target) + 2);
+	if (directory) {
+		sprintf(directory, "%s/%s", base ? base : "", target);
+		normalize(directory);
+	}
+	free(base);
+	return directory;
+}
+
+static int builtin_cd(struct scallop_task *task, int argc, char *const *argv)
+{
+	if (argc > 2) {
+		complain(task, "cd: too many arguments\n");
+		return 1;
+	}
+	const char *target = argv[1];
+	if (argc < 2)
+		target = task->environment ? task_variable(task, "HOME") : getenv("HOME");
+	if (!target || !*target) {
+		complain(task, "cd: HOME not set\n");
+		return 1;
+	}
+
+	char *directory = join_directory(task, target);
+	struct stat status;
+	int error = 0;
+	if (!directory)
+		error = errno;
+	else if (stat(directory, &status))
+		error = errno;
+	else if (!S_ISDIR(status.st_mode))
+		error = ENOTDIR;
+	else if (access(directory, X_OK))
+		error = errno;
+	if (error) {
+		complain(task, "cd: %s: %s\n", target, strerror(error));
+		free(directory);
+		return 1;
+	}
+
+	free(task->directory);
+	task->directory = directory;
+	return 0;
+}
+
+/*
+ * export and unset
+ *
+ * Variables live in the task's environment, which it
+ * shares with whatever it inherited it from; changing
+ * one gives the task a new environment of its own,
+ * leaving everyone else's alone.
+ */
+
+static int valid_name(const char *name, size_t length)
+{
+	if (!length || isdigit((unsigned char)name[0]))
+		return 0;
+	for (size_t i = 0; i < length; i++)
+		if (!isalnum((unsigned char)name[i]) && name[i] != '_')
+			return 0;
+	return 1;
+}
+
+// Returns the length of the name if assignment looks
+// like NAME=value, or 0
+static size_t assignment_name_length(const char *assignment)
+{
+	const char *equals = strchr(assignment, '=');
+	if (!equals || !valid_name(assignment, equals - assignment))
+		return 0;
+	return equals - assignment;
+}
+
+// Returns 1, or 0 with errno set
+static int replace_environment(
+	struct scallop_task *task,
+	struct scallop_environment *environment
+)
+{
+	if (!environment)
+		return 0;
+	scallop_environment_release(task->environment);
+	task->environment = environment;
+	return 1;
+}
+
+/*
+ * Sets the variable assignment names to what follows
+ * its =, returning 1, or 0 with errno set: EINVAL if it
+ * isn't NAME=value, or ENOTSUP if the task has no
+ * environment of its own to set it in.
+ */
+static int assign(struct scallop_task *task, const char *assignment)
+{
+	const size_t name_length = assignment_name_length(assignment);
+	if (!name_length || !task->environment) {
+		errno = name_length ? ENOTSUP : EINVAL;
+		return 0;
+	}
+	const uint32_t symbol = scallop_symbols_intern(
+		scallop_environment_symbols(task->environment),
+		assignment,
+		name_length
+	);
+	const char *value = assignment + name_length + 1;
+	return symbol && replace_environment(
+		task,
+		scallop_environment_set(task->environment, symbol, value, strlen(value))
+	);
+}
+
+static int builtin_export(struct scallop_task *task, int argc, char *const *argv)
+{
+	if (!task->environment) {
+		complain(task, "%s: %s\n", argv[0], strerror(ENOTSUP));
+		return 1;
+	}
+
+	// Without arguments, lists what processes would get
+	if (argc < 2) {
+		char *const *envp = scallop_environment_envp(task->environment);
+		if (!envp) {
+			complain(task, "%s: %s\n", argv[0], strerror(errno));
+			return 1;
+		}
+		struct output output = { task, 1 };
+		for (; *envp; envp++) {
+			put_string(&output, *envp);
+			put(&output, "\n", 1);
+		}
+		return finish(&output, argv[0], 0);
+	}
+
+	int status = 0;
+	for (int i = 1; i < argc; i++) {
+		if (assign(task, argv[i]))
+			continue;
+		if (errno == EINVAL)
+			complain(task, "%s: %s: not NAME=value\n", argv[0], argv[i]);
+		else
+			complain(task, "%s: %s: %s\n", argv[0], argv[i], strerror(errno));
+		status = 1;
+	}
+	return status;
+}
+
+static int builtin_unset(struct scallop_task *task, int argc, char *const *argv)
+{
+	int status = 0;
+	for (int i = 1; i < argc; i++) {
+		const size_t length = strlen(argv[i]);
+		if (!valid_name(argv[i], length)) {
+			complain(task, "%s: %s: not a valid name\n", argv[0], argv[i]);
+			status = 1;
+			continue;
+		}
+		if (!task->environment)
+			continue;
+		// A name that was never interned can't be set
+		const uint32_t symbol = scallop_symbols_find(
+			scallop_environment_symbols(task->environment),
+			argv[i],
+			length
+		);
+		if (
+			symbol
+			&& !replace_environment(task, scallop_environment_unset(task->environment, symbol))
+		) {
+			complain(task, "%s: %s: %s\n", argv[0], argv[i], strerror(errno));
+			status = 1;
+		}
+	}
+	return status;
+}
+
+/*
+ * The table
+ *
+ * Kept sorted by name, for a binary search; it's only
+ * written while it's being set up.
+ */
+
+struct builtin {
+	const char *name;
+	scallop_builtin_fn *run;
+};
+
+/*
+ * Sorted by name, for binary searches; once interned,
+ * by_symbol maps every symbol up to the highest
+ * builtin's straight to the builtin, if it's one.
+ */
+struct scallop_builtins {
+	struct builtin *entries;
+	ssize_t count;
+	ssize_t capacity;
+	struct scallop_symbols *symbols;
+	scallop_builtin_fn **by_symbol;
+	uint32_t symbol_count;
+};
+
+static ssize_t find_index(const struct scallop_builtins *builtins, const char *name, int *found)
+{
+	ssize_t low = 0, high = builtins->count;
+	while (low < high) {
+		const ssize_t middle = low + (high - low) / 2;
+		const int order = strcmp(builtins->entries[middle].name, name);
+		if (!order) {
+			*found = 1;
+			return middle;
+		}
+		if (order < 0)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	*found = 0;
+	return low;
+}
+
+int scallop_builtins_add(
+	struct scallop_builtins *builtins,
+	const char *name,
+	scallop_builtin_fn *run
+)
+{
+	int found;
+	const ssize_t index = find_index(builtins, name, &found);
+	if (found) {
+		builtins->entries[index].run = run;
+		return !builtins->symbols || scallop_builtins_intern(builtins, builtins->symbols);
+	}
+
+	if (builtins->count == builtins->capacity) {
+		const ssize_t capacity = builtins->capacity ? builtins->capacity * 2 : 16;
+		struct builtin *entries = realloc(builtins->entries, capacity * sizeof(*entries));
+		if (!entries)
+			return 0;
+		builtins->entries = entries;
+		builtins->capacity = capacity;
+	}
+	memmove(
+		&builtins->entries[index + 1],
+		&builtins->entries[index],
+		(builtins->count - index) * sizeof(*builtins->entries)
+	);
+	builtins->entries[index] = (struct builtin) { name, run };
+	builtins->count++;
+	return !builtins->symbols || scallop_builtins_intern(builtins, builtins->symbols);
+}
+
+scallop_builtin_fn *scallop_builtins_find(
+	const struct scallop_builtins *builtins,
+	const char *name
+)
+{
+	int found;
+	const ssize_t index = find_index(builtins, name, &found);
+	return found ? builtins->entries[index].run : NULL;
+}
+
+int scallop_builtins_intern(
+	struct scallop_builtins *builtins,
+	struct scallop_symbols *symbols
+)
+{
+	uint32_t *interned = malloc((builtins->count + 1) * sizeof(*interned));
+	if (!interned)
+		return 0;
+	uint32_t symbol_count = 0;
+	for (ssize_t i = 0; i < builtins->count; i++) {
+		const char *name = builtins->entries[i].name;
+		interned[i] = scallop_symbols_intern(symbols, name, strlen(name));
+		if (!interned[i]) {
+			free(interned);
+			return 0;
+		}
+		if (interned[i] >= symbol_count)
+			symbol_count = interned[i] + 1;
+	}
+
+	scallop_builtin_fn **by_symbol = calloc(symbol_count, sizeof(*by_symbol));
+	if (!by_symbol && symbol_count) {
+		free(interned);
+		return 0;
+	}
+	for (ssize_t i = 0; i < builtins->count; i++)
+		by_symbol[interned[i]] = builtins->entries[i].run;
+	free(interned);
+
+	free(builtins->by_symbol);
+	builtins->symbols = symbols;
+	builtins->by_symbol = by_symbol;
+	builtins->symbol_count = symbol_count;
+	return 1;
+}
+
+scallop_builtin_fn *scallop_builtins_find_symbol(
+	const struct scallop_builtins *builtins,
+	uint32_t symbol
+)
+{
+	return symbol < builtins->symbol_count ? builtins->by_symbol[symbol] : NULL;
+}
+
+void scallop_builtins_free(struct scallop_builtins *builtins)
+{
+	if (!builtins)
+		return;
+	free(builtins->by_symbol);
+	free(builtins->entries);
+	free(builtins);
+}
+
+struct scallop_builtins *scallop_builtins_create(void)
+{
+	static const struct builtin standard[] = {
+		{ "[", builtin_bracket },
+		{ "cd", builtin_cd },
+		{ "echo", builtin_echo },
+		{ "export", builtin_export },
+		{ "false", builtin_false },
+		{ "printf", builtin_printf },
+		{ "test", builtin_test },
+		{ "true", builtin_true },
+		{ "unset", builtin_unset },
+	};
+
+	struct scallop_builtins *builtins = calloc(1, sizeof(*builtins));
+	if (!builtins)
+		return NULL;
+	for (size_t i = 0; i < sizeof(standard) / sizeof(*standard); i++) {
+		if (!scallop_builtins_add(builtins, standard[i].name, standard[i].run)) {
+			scallop_builtins_free(builtins);
+			return NULL;
+		}
+	}
+	return builtins;
+}
+
+/*
+ * Pipelines
+ *
+ * Every stage gets a task, inheriting from the
+ * pipeline's, so the pipes between stages and each
+ * stage's redirections are worked out the same way
+ * for builtins and processes. A process then starts
+ * with its task's descriptors as its real ones.
+ */
+
+/*
+ * The NAME=value words a stage started with, which
+ * set variables in its task rather than being passed
+ * to it.
+ */
+struct assignments {
+	char *const *words;
+	ssize_t count;
+};
+
+struct stage {
+	const struct scallop_command *command;
+	const struct assignments *assignments;
+	scallop_builtin_fn *builtin;
+	struct scallop_task task;
+	pid_t pid;
+	int status;
+	pthread_t thread;
+	char threaded;
+};
+
+struct link {
+	struct scallop_ring ring;
+	char is_ring;
+};
+
+static int argument_count(const struct scallop_command *command)
+{
+	int count = 0;
+	while (command->argv[count])
+		count++;
+	return count;
+}
+
+static void run_stage(struct stage *stage)
+{
+	stage->status = stage->builtin(
+		&stage->task,
+		argument_count(stage->command),
+		stage->command->argv
+	);
+	// Lets the stages either side see EOF, or EPIPE
+	scallop_task_free(&stage->task);
+}
+
+static void *stage_thread(void *param)
+{
+	run_stage(param);
+	return NULL;
+}
+
+static int launch_status(int error)
+{
+	return error == ENOENT ? 127 : 126;
+}
+
+static int exit_status(int status)
+{
+	if (WIFSIGNALED(status))
+		return 128 + WTERMSIG(status);
+	return WEXITSTATUS(status);
+}
+
+/*
+ * Launches a stage with its task's descriptors as its
+ * real ones. Descriptors that are one of the task's
+ * numbers, but not their own, are moved out of the
+ * way first, so none gets replaced before it's used.
+ */
+static pid_t launch_stage(
+	struct stage *stage,
+	struct scallop_path_cache *paths,
+	enum SCALLOP_LAUNCH_METHOD method
+)
+{
+	// A task's own environment has its own PATH, which
+	// neither the cache nor posix_spawnp(), searching
+	// the shell's, can be trusted to match
+	const char *path = NULL;
+	if (!stage->command->envp && stage->task.environment) {
+		path = task_variable(&stage->task, "PATH");
+		if (!path)
+			path = SCALLOP_PATH_DEFAULT;
+		if (paths && scallop_path_cache_searches(paths, path))
+			path = NULL;
+		else
+			paths = NULL;
+	}
+	char file[PATH_MAX];
+	if (path && !scallop_path_search(path, stage->command->argv[0], file, sizeof(file)))
+		return -1;
+	if (paths && !scallop_path_cache_lookup(paths, stage->command->argv[0], file, sizeof(file)))
+		return -1;
+
+	struct scallop_redirect redirects[SCALLOP_TASK_FDS];
+	int moved[SCALLOP_TASK_FDS];
+	ssize_t count = 0;
+	pid_t pid = -1;
+	int error = 0;
+
+	for (int fd = 0; fd < SCALLOP_TASK_FDS; fd++) {
+		const struct scallop_vfd *vfd = &stage->task.fds[fd];
+		moved[fd] = -1;
+		switch (vfd->kind) {
+		case SCALLOP_VFD_FD: {
+			int source = vfd->fd;
+			if (source != fd && source < SCALLOP_TASK_FDS) {
+				source = moved[fd] = fcntl(source, F_DUPFD_CLOEXEC, SCALLOP_TASK_FDS);
+				if (source < 0) {
+					error = errno;
+					goto done;
+				}
+			}
+			redirects[count++] = (struct scallop_redirect) { SCALLOP_REDIRECT_DUP, fd, source };
+			break;
+		}
+		case SCALLOP_VFD_CLOSED:
+			if (fd < 3)
+				redirects[count++] = (struct scallop_redirect) { SCALLOP_REDIRECT_CLOSE, fd };
+			break;
+		default:
+			// Processes can't use a ring
+			error = EBADF;
+			goto done;
+		}
+	}
+
+	// The environment keeps the array it builds, so
+	// stages sharing one only build it once
+	char *const *envp = stage->command->envp;
+	if (!envp && stage->task.environment) {
+		envp = scallop_environment_envp(stage->task.environment);
+		if (!envp) {
+			error = errno;
+			goto done;
+		}
+	}
+
+	const struct scallop_command command = {
+		stage->command->argv,
+		envp,
+		redirects,
+		count,
+		stage->task.directory,
+		paths || path ? file : stage->command->path,
+	};
+	pid = scallop_launch(&command, method);
+	error = errno;
+
+done:
+	for (int fd = 0; fd < SCALLOP_TASK_FDS; fd++)
+		if (moved[fd] >= 0)
+			close(moved[fd]);
+	errno = error;
+	return pid;
+}
+
+// Returns 1, or 0 after saying which assignment failed
+static int assign_stage(struct scallop_task *task, const struct assignments *assignments)
+{
+	for (ssize_t i = 0; assignments && i < assignments->count; i++) {
+		if (!assign(task, assignments->words[i])) {
+			complain(task, "%s: %s\n", assignments->words[i], strerror(errno));
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static int run_alone(
+	scallop_builtin_fn *builtin,
+	struct scallop_task *task,
+	const struct scallop_command *command,
+	const struct assignments *assignments
+)
+{
+	struct scallop_task stage;
+	if (!scallop_task_inherit(&stage, task)) {
+		complain(task, "%s: %s\n", command->argv[0], strerror(errno));
+		return 126;
+	}
+
+	int status = 1;
+	struct scallop_environment *assigned = NULL;
+	if (!scallop_task_redirect(&stage, command->redirects, command->redirect_count)) {
+		complain(&stage, "%s: %s\n", command->argv[0], strerror(errno));
+	} else if (assign_stage(&stage, assignments)) {
+		// Held on to, so it can't be freed and its
+		// address reused for the builtin's own
+		assigned = stage.environment ? scallop_environment_fork(stage.environment) : NULL;
+		status = builtin(&stage, argument_count(command), command->argv);
+	}
+
+	// Only the redirections and assignments are the
+	// stage's own; but if the builtin changed the
+	// environment itself, the assignments come along,
+	// as for other shells' special builtins
+	char *directory = task->directory;
+	task->directory = stage.directory;
+	stage.directory = directory;
+	if (stage.environment != assigned) {
+		struct scallop_environment *environment = task->environment;
+		task->environment = stage.environment;
+		stage.environment = environment;
+	}
+	scallop_environment_release(assigned);
+	scallop_task_free(&stage);
+	return status;
+}
+
+// Joins stage index to the next one, returning 1, or 0
+// with errno set
+static int connect_stages(struct stage *stages, struct link *link, int binary)
+{
+	struct scallop_task *writer = &stages[0].task;
+	struct scallop_task *reader = &stages[1].task;
+	scallop_task_close(writer, 1);
+	scallop_task_close(reader, 0);
+
+	if (binary && stages[0].builtin && stages[1].builtin) {
+		if (!scallop_ring_create(&link->ring, SCALLOP_RING_SIZE))
+			return 0;
+		link->is_ring = 1;
+		writer->fds[1] = (struct scallop_vfd) { SCALLOP_VFD_RING_WRITER, -1, &link->ring, 1 };
+		reader->fds[0] = (struct scallop_vfd) { SCALLOP_VFD_RING_READER, -1, &link->ring, 1 };
+		return 1;
+	}
+
+	int fds[2];
+	if (!scallop_pipe(fds, binary ? SCALLOP_PIPE_SIZE : 0))
+		return 0;
+	writer->fds[1] = (struct scallop_vfd) { SCALLOP_VFD_FD, fds[1], NULL, 1 };
+	reader->fds[0] = (struct scallop_vfd) { SCALLOP_VFD_FD, fds[0], NULL, 1 };
+	return 1;
+}
+
+static void start_stage(
+	struct stage *stage,
+	struct scallop_path_cache *paths,
+	enum SCALLOP_LAUNCH_METHOD method,
+	int last_builtin
+)
+{
+	const char *name = stage->command->argv[0];
+	if (!scallop_task_redirect(&stage->task, stage->command->redirects, stage->command->redirect_count)) {
+		complain(&stage->task, "%s: %s\n", name, strerror(errno));
+		stage->status = 1;
+		scallop_task_free(&stage->task);
+		return;
+	}
+	if (!assign_stage(&stage->task, stage->assignments)) {
+		stage->status = 1;
+		scallop_task_free(&stage->task);
+		return;
+	}
+
+	if (!stage->builtin) {
+		stage->pid = launch_stage(stage, paths, method);
+		if (stage->pid < 0) {
+			complain(&stage->task, "%s: %s\n", name, strerror(errno));
+			stage->status = launch_status(errno);
+		}
+		scallop_task_free(&stage->task);
+		return;
+	}
+
+	if (last_builtin)
+		return;
+	const int error = pthread_create(&stage->thread, NULL, stage_thread, stage);
+	if (error) {
+		complain(&stage->task, "%s: %s\n", name, strerror(error));
+		stage->status = 126;
+		scallop_task_free(&stage->task);
+		return;
+	}
+	stage->threaded = 1;
+}
+
+/*
+ * Waits for the stages that are processes, all at once
+ * through the executor's event loop if there is one,
+ * or one by one otherwise.
+ */
+static void wait_processes(
+	struct scallop_executor *executor,
+	struct scallop_task *task,
+	struct stage *stages,
+	ssize_t count
+)
+{
+	pid_t *pids = executor ? malloc(count * sizeof(*pids)) : NULL;
+	int *statuses = pids ? malloc(count * sizeof(*statuses)) : NULL;
+	ssize_t processes = 0;
+	if (statuses) {
+		for (ssize_t i = 0; i < count; i++)
+			if (stages[i].pid > 0)
+				pids[processes++] = stages[i].pid;
+		scallop_executor_wait_children(executor, pids, processes, statuses);
+	}
+
+	processes = 0;
+	for (ssize_t i = 0; i < count; i++) {
+		struct stage *stage = &stages[i];
+		if (stage->pid <= 0)
+			continue;
+		int wait_status = 0;
+		if (statuses) {
+			wait_status = statuses[processes++];
+		} else {
+			pid_t result;
+			while ((result = waitpid(stage->pid, &wait_status, 0)) < 0 && errno == EINTR)
+				;
+			if (result < 0)
+				wait_status = -1;
+		}
+
+		if (wait_status < 0) {
+			// Reaped by someone else, if SIGCHLD is ignored
+			// say, so there's no status to give
+			complain(task, "%s: %s\n", stage->command->argv[0], strerror(ECHILD));
+			stage->status = 126;
+		} else {
+			stage->status = exit_status(wait_status);
+		}
+	}
+	free(pids);
+	free(statuses);
+}
+
+// assignments, if not NULL, has an entry per command
+static int run_pipeline(
+	const struct scallop_builtins *builtins,
+	struct scallop_path_cache *paths,
+	struct scallop_executor *executor,
+	struct scallop_task *task,
+	const struct scallop_command *commands,
+	const struct assignments *assignments,
+	const char *binary,
+	ssize_t count,
+	enum SCALLOP_LAUNCH_METHOD method
+)
+{
+	if (count <= 0)
+		return 0;
+	scallop_builtin_fn *first = builtins ? scallop_builtins_find(builtins, commands[0].argv[0]) : NULL;
+	if (count == 1 && first)
+		return run_alone(first, task, &commands[0], assignments);
+
+	struct stage *stages = calloc(count, sizeof(*stages));
+	struct link *links = calloc(count, sizeof(*links));
+	if (!stages || !links) {
+		free(stages);
+		free(links);
+		complain(task, "%s: %s\n", commands[0].argv[0], strerror(ENOMEM));
+		return 126;
+	}
+
+	ssize_t ready = 0;
+	ssize_t last_builtin = -1;
+	for (; ready < count; ready++) {
+		struct stage *stage = &stages[ready];
+		stage->command = &commands[ready];
+		stage->assignments = assignments ? &assignments[ready] : NULL;
+		stage->builtin = builtins ? scallop_builtins_find(builtins, stage->command->argv[0]) : NULL;
+		stage->pid = -1;
+		if (stage->builtin)
+			last_builtin = ready;
+		if (!scallop_task_inherit(&stage->task, task))
+			break;
+		if (ready && !connect_stages(stage - 1, &links[ready - 1], binary && binary[ready - 1])) {
+			scallop_task_free(&stage->task);
+			break;
+		}
+	}
+
+	int status;
+	if (ready < count) {
+		complain(task, "%s: %s\n", commands[ready].argv[0], strerror(errno));
+		for (ssize_t i = 0; i < ready; i++)
+			scallop_task_free(&stages[i].task);
+		status = 126;
+		goto done;
+	}
+
+	for (ssize_t i = 0; i < count; i++)
+		start_stage(&stages[i], paths, method, i == last_builtin);
+	// Every other stage is running by now, so this one
+	// can't hold any of them up by taking the thread
+	if (last_builtin >= 0 && !stages[last_builtin].status)
+		run_stage(&stages[last_builtin]);
+
+	wait_processes(executor, task, stages, count);
+	for (ssize_t i = 0; i < count; i++)
+		if (stages[i].threaded)
+			pthread_join(stages[i].thread, NULL);
+	status = stages[count - 1].status;
+
+done:
+	for (ssize_t i = 0; i + 1 < count; i++)
+		if (links[i].is_ring)
+			scallop_ring_unmap(&links[i].ring);
+	free(stages);
+	free(links);
+	return status;
+}
+
+int scallop_run_pipeline(
+	const struct scallop_builtins *builtins,
+	struct scallop_path_cache *paths,
+	struct scallop_executor *executor,
+	struct scallop_task *task,
+	const struct scallop_command *commands,
+	const char *binary,
+	ssize_t count,
+	enum SCALLOP_LAUNCH_METHOD method
+)
+{
+	return run_pipeline(builtins, paths, executor, task, commands, NULL, binary, count, method);
+}
+
+/*
+ * Statements
+ */
+
+int scallop_run_statement(
+	const struct scallop_ast *ast,
+	uint32_t statement,
+	void *context
+)
+{
+	const struct scallop_statement_context *shell = context;
+	const struct scallop_node *node = &ast->nodes[statement];
+
+	struct scallop_task task;
+	if (!scallop_task_inherit(&task, shell->task))
+		return 126;
+
+	ssize_t words = 0, stages = 1;
+	int status = 0;
+	for (uint32_t child = node->first_child; child != SCALLOP_NODE_NONE; child = ast->nodes[child].next_sibling) {
+		switch (ast->nodes[child].kind) {
+		case SCALLOP_NODE_WORD:
+			words++;
+			break;
+		case SCALLOP_NODE_PIPE:
+		case SCALLOP_NODE_BINARY_PIPE:
+			stages++;
+			break;
+		default:
+			status = 2;
+		}
+	}
+	if (status) {
+		complain(&task, "scallop: blocks and lists can't be run as arguments yet\n");
+		goto done;
+	}
+	if (!words)
+		goto done;
+
+	// Every value fits in the space its word takes in
+	// the source, plus a null
+	const size_t source_length = node->end_offset - node->start_offset;
+	const size_t size =
+		(words + stages) * sizeof(char *)
+		+ stages * sizeof(struct scallop_command)
+		+ stages * sizeof(struct assignments)
+		+ stages
+		+ 2 * source_length + words;
+	char *memory = malloc(size);
+	if (!memory) {
+		complain(&task, "scallop: %s\n", strerror(errno));
+		status = 126;
+		goto done;
+	}
+	char **argv = (char **)memory;
+	struct scallop_command *commands = (struct scallop_command *)(argv + words + stages);
+	struct assignments *assignments = (struct assignments *)(commands + stages);
+	char *binary = (char *)(assignments + stages);
+	struct scallop_arena arena = scallop_arena_make(binary + stages, source_length);
+	char *strings = binary + stages + source_length;
+
+	ssize_t stage = 0;
+	ssize_t assignment_count = 0;
+	char **stage_argv = argv;
+	char **next = argv;
+	for (uint32_t child = node->first_child; child != SCALLOP_NODE_NONE; child = ast->nodes[child].next_sibling) {
+		const struct scallop_node *argument = &ast->nodes[child];
+		if (argument->kind != SCALLOP_NODE_WORD) {
+			*next++ = NULL;
+			binary[stage] = argument->kind == SCALLOP_NODE_BINARY_PIPE;
+			assignments[stage] = (struct assignments) { stage_argv, assignment_count };
+			commands[stage++] = (struct scallop_command) { .argv = stage_argv + assignment_count };
+			stage_argv = next;
+			assignment_count = 0;
+			continue;
+		}
+
+		// Names can't be quoted or escaped, so they're
+		// checked in the source
+		if (next == stage_argv + assignment_count) {
+			const char *source = shell->begin + argument->start_offset;
+			const char *equals = memchr(source, '=', argument->end_offset - argument->start_offset);
+			assignment_count += equals && valid_name(source, equals - source);
+		}
+
+		const struct scallop_parse_token token = {
+			.token = SCALLOP_TOKEN_WORD,
+			.start_offset = argument->start_offset,
+			.end_offset = argument->end_offset,
+			.flags = argument->flags,
+		};
+		struct scallop_token_value value;
+		scallop_arena_reset(&arena);
+		scallop_token_value(shell->begin, shell->end, &token, &arena, &value);
+		memcpy(strings, value.begin, value.length);
+		strings[value.length] = 0;
+		*next++ = strings;
+		strings += value.length + 1;
+	}
+	*next = NULL;
+	assignments[stage] = (struct assignments) { stage_argv, assignment_count };
+	commands[stage] = (struct scallop_command) { .argv = stage_argv + assignment_count };
+
+	for (stage = 0; stage < stages && commands[stage].argv[0]; stage++)
+		;
+	if (stage < stages && stages > 1) {
+		complain(&task, "scallop: every stage of a pipeline needs a command\n");
+		status = 2;
+	} else if (stage == stages) {
+		status = run_pipeline(
+			shell->builtins,
+			shell->paths,
+			shell->executor,
+			&task,
+			commands,
+			assignments,
+			binary,
+			stages,
+			shell->method
+		);
+	}
+	free(memory);
+
+done:
+	scallop_task_free(&task);
+	return status;
+}
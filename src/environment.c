@@ -0,0 +1,530 @@
+/*
+ * Scallop - a shell for executing tasks concurrently
+ * Copyright (C) <year>  Marcus Harrison
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "scallop/environment.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern char **environ;
+
+// Bits of the symbol each level of the trie uses
+#define LEVEL_BITS 5
+#define LEVEL_MASK ((1u << LEVEL_BITS) - 1)
+
+/*
+ * Variables live in a trie keyed on their symbols,
+ * LEVEL_BITS bits a level from the lowest up. Each node
+ * only has room for the slots it uses, found by
+ * counting the bits below a slot's in used; a slot
+ * holds a variable if its bit is set in variables, or
+ * a node otherwise. A variable sits at the shallowest
+ * level where no other symbol shares its slot.
+ *
+ * Nodes and variables are never changed once they're
+ * reachable, only shared, counting their references;
+ * so a new environment copies the nodes on the path to
+ * the variable it changes, and takes a reference to
+ * everything else.
+ */
+struct variable {
+	atomic_uint references;
+	uint32_t symbol;
+	// Kept from the symbol table, so building envp
+	// doesn't have to go back to it for every name
+	const char *name;
+	size_t name_length;
+	size_t length;
+	char value[];
+};
+
+struct node {
+	atomic_uint references;
+	uint32_t used;
+	uint32_t variables;
+	void *children[];
+};
+
+struct scallop_environment {
+	atomic_uint references;
+	struct scallop_symbols *symbols;
+	// NULL when there are no variables
+	struct node *root;
+	size_t count;
+	// Built the first time someone asks for it
+	_Atomic(char **) envp;
+};
+
+static uint32_t slot_bit(uint32_t symbol, unsigned shift)
+{
+	return 1u << ((symbol >> shift) & LEVEL_MASK);
+}
+
+static unsigned slot_index(const struct node *node, uint32_t bit)
+{
+	return __builtin_popcount(node->used & (bit - 1));
+}
+
+static unsigned child_count(const struct node *node)
+{
+	return __builtin_popcount(node->used);
+}
+
+static void release_variable(struct variable *variable)
+{
+	if (atomic_fetch_sub_explicit(&variable->references, 1, memory_order_acq_rel) == 1)
+		free(variable);
+}
+
+static void release_node(struct node *node)
+{
+	if (!node || atomic_fetch_sub_explicit(&node->references, 1, memory_order_acq_rel) != 1)
+		return;
+	unsigned index = 0;
+	for (uint32_t rest = node->used; rest; rest &= rest - 1, index++) {
+		if (node->variables & rest & -rest)
+			release_variable(node->children[index]);
+		else
+			release_node(node->children[index]);
+	}
+	free(node);
+}
+
+static struct node *new_node(unsigned count, uint32_t used, uint32_t variables)
+{
+	struct node *node = malloc(sizeof(*node) + count * sizeof(*node->children));
+	if (!node)
+		return NULL;
+	atomic_init(&node->references, 1);
+	node->used = used;
+	node->variables = variables;
+	return node;
+}
+
+// Every child of a new node is another reference to it
+static void retain_children(struct node *node)
+{
+	const unsigned count = child_count(node);
+	for (unsigned i = 0; i < count; i++) {
+		// Both start with their reference count
+		atomic_uint *references = node->children[i];
+		atomic_fetch_add_explicit(references, 1, memory_order_relaxed);
+	}
+}
+
+/*
+ * Copies node with child in bit's slot, in place of
+ * whatever was there, if anything.
+ */
+static struct node *copy_with(
+	const struct node *node,
+	uint32_t bit,
+	void *child,
+	int is_variable
+)
+{
+	const int replacing = !!(node->used & bit);
+	struct node *copy = new_node(
+		child_count(node) + !replacing,
+		node->used | bit,
+		is_variable ? node->variables | bit : node->variables & ~bit
+	);
+	if (!copy)
+		return NULL;
+	const unsigned index = slot_index(node, bit);
+	const unsigned count = child_count(node);
+	memcpy(copy->children, node->children, index * sizeof(*node->children));
+	copy->children[index] = child;
+	memcpy(
+		copy->children + index + 1,
+		node->children + index + replacing,
+		(count - index - replacing) * sizeof(*node->children)
+	);
+	retain_children(copy);
+	return copy;
+}
+
+// Copies node without what's in bit's slot
+static struct node *copy_without(const struct node *node, uint32_t bit)
+{
+	struct node *copy = new_node(
+		child_count(node) - 1,
+		node->used & ~bit,
+		node->variables & ~bit
+	);
+	if (!copy)
+		return NULL;
+	const unsigned index = slot_index(node, bit);
+	const unsigned count = child_count(node);
+	memcpy(copy->children, node->children, index * sizeof(*node->children));
+	memcpy(
+		copy->children + index,
+		node->children + index + 1,
+		(count - index - 1) * sizeof(*node->children)
+	);
+	retain_children(copy);
+	return copy;
+}
+
+// Makes the nodes holding two variables whose symbols
+// share every slot up to shift
+static struct node *pair(struct variable *first, struct variable *second, unsigned shift)
+{
+	const uint32_t first_bit = slot_bit(first->symbol, shift);
+	const uint32_t second_bit = slot_bit(second->symbol, shift);
+	if (first_bit == second_bit) {
+		struct node *child = pair(first, second, shift + LEVEL_BITS);
+		if (!child)
+			return NULL;
+		struct node *node = new_node(1, first_bit, 0);
+		if (node)
+			node->children[0] = child;
+		else
+			release_node(child);
+		return node;
+	}
+
+	struct node *node = new_node(2, first_bit | second_bit, first_bit | second_bit);
+	if (!node)
+		return NULL;
+	node->children[first_bit > second_bit] = first;
+	node->children[first_bit < second_bit] = second;
+	retain_children(node);
+	return node;
+}
+
+/*
+ * Returns a copy of the trie at node with variable in
+ * it, setting *added if it wasn't replacing one, or
+ * NULL if there's no memory.
+ */
+static struct node *insert(
+	const struct node *node,
+	unsigned shift,
+	struct variable *variable,
+	int *added
+)
+{
+	const uint32_t bit = slot_bit(variable->symbol, shift);
+	if (!node) {
+		struct node *leaf = new_node(1, bit, bit);
+		if (!leaf)
+			return NULL;
+		leaf->children[0] = variable;
+		retain_children(leaf);
+		*added = 1;
+		return leaf;
+	}
+
+	if (!(node->used & bit)) {
+		*added = 1;
+		return copy_with(node, bit, variable, 1);
+	}
+
+	struct node *child;
+	void *const existing = node->children[slot_index(node, bit)];
+	if (node->variables & bit) {
+		struct variable *const other = existing;
+		if (other->symbol == variable->symbol)
+			return copy_with(node, bit, variable, 1);
+		*added = 1;
+		child = pair(other, variable, shift + LEVEL_BITS);
+	} else {
+		child = insert(existing, shift + LEVEL_BITS, variable, added);
+	}
+	if (!child)
+		return NULL;
+	struct node *copy = copy_with(node, bit, child, 0);
+	release_node(child);
+	return copy;
+}
+
+/*
+ * Stores a copy of the trie at node without the
+ * variable named by symbol in *out, which is NULL if
+ * that leaves it empty, and returns 1; or returns 0 if
+ * there's no memory. The variable has to be there.
+ */
+static int remove_symbol(
+	const struct node *node,
+	unsigned shift,
+	uint32_t symbol,
+	struct node **out
+)
+{
+	const uint32_t bit = slot_bit(symbol, shift);
+	struct node *child = NULL;
+	if (!(node->variables & bit)) {
+		if (!remove_symbol(
+			node->children[slot_index(node, bit)],
+			shift + LEVEL_BITS,
+			symbol,
+			&child
+		))
+			return 0;
+	}
+
+	if (!child) {
+		*out = child_count(node) == 1 ? NULL : copy_without(node, bit);
+		return !!*out || child_count(node) == 1;
+	}
+
+	// A node left with only a variable can be replaced
+	// by the variable
+	if (child_count(child) == 1 && child->variables)
+		*out = copy_with(node, bit, child->children[0], 1);
+	else
+		*out = copy_with(node, bit, child, 0);
+	release_node(child);
+	return !!*out;
+}
+
+static struct variable *find(const struct node *node, uint32_t symbol)
+{
+	for (unsigned shift = 0; node; shift += LEVEL_BITS) {
+		const uint32_t bit = slot_bit(symbol, shift);
+		if (!(node->used & bit))
+			return NULL;
+		void *const child = node->children[slot_index(node, bit)];
+		if (node->variables & bit) {
+			struct variable *variable = child;
+			return variable->symbol == symbol ? variable : NULL;
+		}
+		node = child;
+	}
+	return NULL;
+}
+
+/*
+ * Environments
+ */
+
+// Takes root's reference over, even if it fails
+static struct scallop_environment *wrap(
+	struct scallop_symbols *symbols,
+	struct node *root,
+	size_t count
+)
+{
+	struct scallop_environment *environment = malloc(sizeof(*environment));
+	if (!environment) {
+		release_node(root);
+		errno = ENOMEM;
+		return NULL;
+	}
+	atomic_init(&environment->references, 1);
+	environment->symbols = symbols;
+	environment->root = root;
+	environment->count = count;
+	atomic_init(&environment->envp, NULL);
+	return environment;
+}
+
+struct scallop_environment *scallop_environment_create(
+	struct scallop_symbols *symbols
+)
+{
+	return wrap(symbols, NULL, 0);
+}
+
+struct scallop_environment *scallop_environment_import(
+	struct scallop_symbols *symbols,
+	char *const *envp
+)
+{
+	if (!envp)
+		envp = environ;
+	struct scallop_environment *environment = scallop_environment_create(symbols);
+	for (; environment && *envp; envp++) {
+		const char *equals = strchr(*envp, '=');
+		if (!equals)
+			continue;
+		const uint32_t symbol = scallop_symbols_intern(symbols, *envp, equals - *envp);
+		struct scallop_environment *next = symbol ?
+			scallop_environment_set(environment, symbol, equals + 1, strlen(equals + 1)) :
+			NULL;
+		scallop_environment_release(environment);
+		environment = next;
+	}
+	return environment;
+}
+
+struct scallop_environment *scallop_environment_fork(
+	struct scallop_environment *environment
+)
+{
+	atomic_fetch_add_explicit(&environment->references, 1, memory_order_relaxed);
+	return environment;
+}
+
+void scallop_environment_release(struct scallop_environment *environment)
+{
+	if (
+		!environment
+		|| atomic_fetch_sub_explicit(&environment->references, 1, memory_order_acq_rel) != 1
+	)
+		return;
+	release_node(environment->root);
+	free(atomic_load(&environment->envp));
+	free(environment);
+}
+
+struct scallop_symbols *scallop_environment_symbols(
+	const struct scallop_environment *environment
+)
+{
+	return environment->symbols;
+}
+
+size_t scallop_environment_count(const struct scallop_environment *environment)
+{
+	return environment->count;
+}
+
+const char *scallop_environment_get(
+	const struct scallop_environment *environment,
+	uint32_t symbol,
+	size_t *length
+)
+{
+	const struct variable *variable = find(environment->root, symbol);
+	if (!variable)
+		return NULL;
+	if (length)
+		*length = variable->length;
+	return variable->value;
+}
+
+struct scallop_environment *scallop_environment_set(
+	struct scallop_environment *environment,
+	uint32_t symbol,
+	const char *value,
+	size_t length
+)
+{
+	size_t name_length;
+	const char *name = scallop_symbols_name(environment->symbols, symbol, &name_length);
+	if (!name) {
+		errno = EINVAL;
+		return NULL;
+	}
+	struct variable *variable = malloc(sizeof(*variable) + length + 1);
+	if (!variable) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	atomic_init(&variable->references, 1);
+	variable->symbol = symbol;
+	variable->name = name;
+	variable->name_length = name_length;
+	variable->length = length;
+	memcpy(variable->value, value, length);
+	variable->value[length] = 0;
+
+	int added = 0;
+	struct node *root = insert(environment->root, 0, variable, &added);
+	release_variable(variable);
+	if (!root) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	return wrap(environment->symbols, root, environment->count + added);
+}
+
+struct scallop_environment *scallop_environment_unset(
+	struct scallop_environment *environment,
+	uint32_t symbol
+)
+{
+	if (!find(environment->root, symbol))
+		return scallop_environment_fork(environment);
+	struct node *root;
+	if (!remove_symbol(environment->root, 0, symbol, &root)) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	return wrap(environment->symbols, root, environment->count - 1);
+}
+
+/*
+ * envp arrays are one allocation: the pointers, then
+ * the strings they point to.
+ */
+
+static size_t measure(const struct node *node)
+{
+	size_t size = 0;
+	unsigned index = 0;
+	for (uint32_t rest = node->used; rest; rest &= rest - 1, index++) {
+		if (!(node->variables & rest & -rest)) {
+			size += measure(node->children[index]);
+			continue;
+		}
+		const struct variable *variable = node->children[index];
+		size += variable->name_length + variable->length + 2;
+	}
+	return size;
+}
+
+static void fill(const struct node *node, char ***pointers, char **strings)
+{
+	unsigned index = 0;
+	for (uint32_t rest = node->used; rest; rest &= rest - 1, index++) {
+		if (!(node->variables & rest & -rest)) {
+			fill(node->children[index], pointers, strings);
+			continue;
+		}
+		const struct variable *variable = node->children[index];
+		char *string = *strings;
+		memcpy(string, variable->name, variable->name_length);
+		string[variable->name_length] = '=';
+		memcpy(string + variable->name_length + 1, variable->value, variable->length + 1);
+		*(*pointers)++ = string;
+		*strings += variable->name_length + variable->length + 2;
+	}
+}
+
+char *const *scallop_environment_envp(struct scallop_environment *environment)
+{
+	char **envp = atomic_load_explicit(&environment->envp, memory_order_acquire);
+	if (envp)
+		return envp;
+
+	const size_t pointers_size = (environment->count + 1) * sizeof(*envp);
+	const size_t size = pointers_size +
+		(environment->root ? measure(environment->root) : 0);
+	envp = malloc(size);
+	if (!envp) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	char **pointers = envp;
+	char *strings = (char *)envp + pointers_size;
+	if (environment->root)
+		fill(environment->root, &pointers, &strings);
+	*pointers = NULL;
+
+	// Whoever builds it first wins
+	char **built = NULL;
+	if (!atomic_compare_exchange_strong(&environment->envp, &built, envp)) {
+		free(envp);
+		return built;
+	}
+	return envp;
+}
@@ -0,0 +1,543 @@
+/*
+ * Scallop - a shell for executing tasks concurrently
+ * Copyright (C) <year>  Marcus Harrison
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "scallop/event_loop.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define EVENT_BATCH 256
+#define MIN_CHILD_SLOTS 64
+
+struct scallop_watch {
+	enum SCALLOP_EVENT kind;
+	// The pidfd, timerfd or watched fd, or -1 for
+	// children without a pidfd
+	int fd;
+	pid_t pid;
+	int status;
+	scallop_event_fn *fn;
+	void *context;
+	char dead;
+	// Live watches are in a list for freeing them all
+	// on destroy; dead ones are in another until the
+	// round that unwatched them is over
+	struct scallop_watch *previous;
+	struct scallop_watch *next;
+	struct scallop_watch *next_ready;
+};
+
+/*
+ * Without pidfds, children are found by pid in an
+ * open-addressed table. A slot with no watch holds the
+ * status of a child that was reaped before anyone
+ * watched it.
+ */
+struct child_slot {
+	pid_t pid;
+	int status;
+	struct scallop_watch *watch;
+};
+
+struct scallop_event_loop {
+	int epoll;
+	// -1 when using pidfds
+	int signal_fd;
+	struct scallop_watch *watches;
+	struct scallop_watch *dead;
+	// Children whose status was known when watched
+	struct scallop_watch *ready;
+	ssize_t watch_count;
+	struct child_slot *children;
+	ssize_t child_count;
+	ssize_t child_capacity;
+};
+
+static int pidfd_open(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+	return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+	(void)pid;
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/*
+ * Child table
+ */
+
+static size_t child_hash(const struct scallop_event_loop *loop, pid_t pid)
+{
+	return ((uint32_t)pid * 2654435761u) & (loop->child_capacity - 1);
+}
+
+static struct child_slot *find_child(struct scallop_event_loop *loop, pid_t pid)
+{
+	if (!loop->child_capacity)
+		return NULL;
+	for (size_t i = child_hash(loop, pid);; i = (i + 1) & (loop->child_capacity - 1)) {
+		if (loop->children[i].pid == pid)
+			return &loop->children[i];
+		if (!loop->children[i].pid)
+			return NULL;
+	}
+}
+
+static struct child_slot *insert_child_slot(
+	struct child_slot *children,
+	ssize_t capacity,
+	pid_t pid
+)
+{
+	size_t i = ((uint32_t)pid * 2654435761u) & (capacity - 1);
+	while (children[i].pid)
+		i = (i + 1) & (capacity - 1);
+	children[i].pid = pid;
+	return &children[i];
+}
+
+static struct child_slot *insert_child(struct scallop_event_loop *loop, pid_t pid)
+{
+	// Keep the table at most half full
+	if ((loop->child_count + 1) * 2 > loop->child_capacity) {
+		const ssize_t capacity = loop->child_capacity ?
+			loop->child_capacity * 2 :
+			MIN_CHILD_SLOTS;
+		struct child_slot *children = calloc(capacity, sizeof(*children));
+		if (!children)
+			return NULL;
+		for (ssize_t i = 0; i < loop->child_capacity; i++) {
+			const struct child_slot *old = &loop->children[i];
+			if (!old->pid)
+				continue;
+			*insert_child_slot(children, capacity, old->pid) = *old;
+		}
+		free(loop->children);
+		loop->children = children;
+		loop->child_capacity = capacity;
+	}
+	loop->child_count++;
+	struct child_slot *slot = insert_child_slot(loop->children, loop->child_capacity, pid);
+	slot->status = 0;
+	slot->watch = NULL;
+	return slot;
+}
+
+// Shifts back any slots that probed past this one, so
+// lookups never need tombstones
+static void remove_child(struct scallop_event_loop *loop, struct child_slot *slot)
+{
+	const size_t mask = loop->child_capacity - 1;
+	size_t hole = slot - loop->children;
+	for (size_t i = (hole + 1) & mask; loop->children[i].pid; i = (i + 1) & mask) {
+		const size_t home = child_hash(loop, loop->children[i].pid);
+		// Can the slot at i move back to the hole?
+		if (((i - home) & mask) >= ((i - hole) & mask)) {
+			loop->children[hole] = loop->children[i];
+			hole = i;
+		}
+	}
+	loop->children[hole] = (struct child_slot) { 0 };
+	loop->child_count--;
+}
+
+/*
+ * Watches
+ */
+
+struct scallop_event_loop *scallop_event_loop_create(int flags)
+{
+	struct scallop_event_loop *loop = calloc(1, sizeof(*loop));
+	if (!loop)
+		return NULL;
+	loop->signal_fd = -1;
+	loop->epoll = epoll_create1(EPOLL_CLOEXEC);
+	if (loop->epoll < 0)
+		goto error;
+
+	if (!(flags & SCALLOP_EVENT_LOOP_NO_PIDFD)) {
+		const int probe = pidfd_open(getpid());
+		if (probe >= 0) {
+			close(probe);
+			return loop;
+		}
+	}
+
+	sigset_t mask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	errno = pthread_sigmask(SIG_BLOCK, &mask, NULL);
+	if (errno)
+		goto error;
+	loop->signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (loop->signal_fd < 0)
+		goto error;
+	// The signalfd is the only thing without a watch
+	struct epoll_event event = { .events = EPOLLIN, .data.ptr = NULL };
+	if (epoll_ctl(loop->epoll, EPOLL_CTL_ADD, loop->signal_fd, &event) < 0)
+		goto error;
+	return loop;
+
+error:
+	{
+		const int error = errno;
+		scallop_event_loop_destroy(loop);
+		errno = error;
+	}
+	return NULL;
+}
+
+int scallop_event_loop_uses_pidfd(const struct scallop_event_loop *loop)
+{
+	return loop->signal_fd < 0;
+}
+
+static void close_watch(struct scallop_watch *watch)
+{
+	// Readable fds belong to whoever watched them
+	if (watch->kind != SCALLOP_EVENT_READABLE && watch->fd >= 0)
+		close(watch->fd);
+}
+
+static void free_dead(struct scallop_event_loop *loop)
+{
+	while (loop->dead) {
+		struct scallop_watch *next = loop->dead->next;
+		free(loop->dead);
+		loop->dead = next;
+	}
+}
+
+void scallop_event_loop_destroy(struct scallop_event_loop *loop)
+{
+	while (loop->watches) {
+		struct scallop_watch *next = loop->watches->next;
+		close_watch(loop->watches);
+		free(loop->watches);
+		loop->watches = next;
+	}
+	free_dead(loop);
+	free(loop->children);
+	if (loop->signal_fd >= 0)
+		close(loop->signal_fd);
+	if (loop->epoll >= 0)
+		close(loop->epoll);
+	free(loop);
+}
+
+static struct scallop_watch *make_watch(
+	struct scallop_event_loop *loop,
+	enum SCALLOP_EVENT kind,
+	scallop_event_fn *fn,
+	void *context
+)
+{
+	struct scallop_watch *watch = malloc(sizeof(*watch));
+	if (!watch)
+		return NULL;
+	*watch = (struct scallop_watch) {
+		.kind = kind,
+		.fd = -1,
+		.fn = fn,
+		.context = context,
+		.next = loop->watches,
+	};
+	if (loop->watches)
+		loop->watches->previous = watch;
+	loop->watches = watch;
+	loop->watch_count++;
+	return watch;
+}
+
+// Takes a watch that was never handed out back out of
+// the live list, keeping errno
+static struct scallop_watch *discard_watch(
+	struct scallop_event_loop *loop,
+	struct scallop_watch *watch
+)
+{
+	const int error = errno;
+	scallop_unwatch(loop, watch);
+	errno = error;
+	return NULL;
+}
+
+static int add_to_epoll(struct scallop_event_loop *loop, struct scallop_watch *watch)
+{
+	struct epoll_event event = { .events = EPOLLIN, .data.ptr = watch };
+	return epoll_ctl(loop->epoll, EPOLL_CTL_ADD, watch->fd, &event) >= 0;
+}
+
+static void make_ready(struct scallop_event_loop *loop, struct scallop_watch *watch)
+{
+	watch->next_ready = loop->ready;
+	loop->ready = watch;
+}
+
+struct scallop_watch *scallop_watch_child(
+	struct scallop_event_loop *loop,
+	pid_t pid,
+	scallop_event_fn *fn,
+	void *context
+)
+{
+	struct scallop_watch *watch = make_watch(loop, SCALLOP_EVENT_EXIT, fn, context);
+	if (!watch)
+		return NULL;
+	watch->pid = pid;
+
+	if (scallop_event_loop_uses_pidfd(loop)) {
+		// A child that has already exited but not been
+		// reaped gives a pidfd that's readable straight away
+		watch->fd = pidfd_open(pid);
+		if (watch->fd < 0 || !add_to_epoll(loop, watch))
+			return discard_watch(loop, watch);
+		return watch;
+	}
+
+	struct child_slot *slot = find_child(loop, pid);
+	if (slot) {
+		if (slot->watch) {
+			errno = EEXIST;
+			return discard_watch(loop, watch);
+		}
+		watch->status = slot->status;
+		remove_child(loop, slot);
+		make_ready(loop, watch);
+		return watch;
+	}
+
+	// Its SIGCHLD could have come before the loop
+	// blocked it, so check it hasn't exited already
+	const pid_t result = waitpid(pid, &watch->status, WNOHANG);
+	if (result < 0)
+		return discard_watch(loop, watch);
+	if (result) {
+		make_ready(loop, watch);
+		return watch;
+	}
+
+	slot = insert_child(loop, pid);
+	if (!slot)
+		return discard_watch(loop, watch);
+	slot->watch = watch;
+	return watch;
+}
+
+struct scallop_watch *scallop_watch_readable(
+	struct scallop_event_loop *loop,
+	int fd,
+	scallop_event_fn *fn,
+	void *context
+)
+{
+	struct scallop_watch *watch = make_watch(loop, SCALLOP_EVENT_READABLE, fn, context);
+	if (!watch)
+		return NULL;
+	watch->fd = fd;
+	if (!add_to_epoll(loop, watch)) {
+		// Not ours to close
+		watch->fd = -1;
+		return discard_watch(loop, watch);
+	}
+	return watch;
+}
+
+struct scallop_watch *scallop_watch_timer(
+	struct scallop_event_loop *loop,
+	int64_t nanoseconds,
+	scallop_event_fn *fn,
+	void *context
+)
+{
+	struct scallop_watch *watch = make_watch(loop, SCALLOP_EVENT_TIMER, fn, context);
+	if (!watch)
+		return NULL;
+	watch->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (watch->fd < 0)
+		return discard_watch(loop, watch);
+
+	// An all-zero time disarms the timer instead
+	if (nanoseconds < 1)
+		nanoseconds = 1;
+	const struct itimerspec time = {
+		.it_value = {
+			.tv_sec = nanoseconds / 1000000000,
+			.tv_nsec = nanoseconds % 1000000000,
+		},
+	};
+	if (timerfd_settime(watch->fd, 0, &time, NULL) < 0 || !add_to_epoll(loop, watch))
+		return discard_watch(loop, watch);
+	return watch;
+}
+
+void scallop_unwatch(struct scallop_event_loop *loop, struct scallop_watch *watch)
+{
+	if (watch->previous)
+		watch->previous->next = watch->next;
+	else
+		loop->watches = watch->next;
+	if (watch->next)
+		watch->next->previous = watch->previous;
+	loop->watch_count--;
+
+	// Closing isn't enough to take a pidfd or timerfd
+	// out of the epoll set: a child that's just been
+	// spawned holds a copy until its exec gets as far as
+	// closing it, and epoll only forgets the file once
+	// every copy is closed
+	if (watch->fd >= 0)
+		epoll_ctl(loop->epoll, EPOLL_CTL_DEL, watch->fd, NULL);
+	close_watch(watch);
+	if (watch->kind == SCALLOP_EVENT_EXIT && watch->fd < 0) {
+		struct child_slot *slot = find_child(loop, watch->pid);
+		if (slot && slot->watch == watch)
+			remove_child(loop, slot);
+	}
+
+	// Events for it might still be waiting in this round
+	watch->dead = 1;
+	watch->next = loop->dead;
+	loop->dead = watch;
+}
+
+ssize_t scallop_event_loop_watch_count(const struct scallop_event_loop *loop)
+{
+	return loop->watch_count;
+}
+
+/*
+ * Running
+ */
+
+static void dispatch(struct scallop_event_loop *loop, struct scallop_watch *watch)
+{
+	const struct scallop_event event = {
+		.kind = watch->kind,
+		.watch = watch,
+		.context = watch->context,
+		.pid = watch->pid,
+		.status = watch->status,
+		.fd = watch->fd,
+	};
+	// Exits and timers only happen once
+	if (watch->kind != SCALLOP_EVENT_READABLE)
+		scallop_unwatch(loop, watch);
+	watch->fn(loop, &event);
+}
+
+static ssize_t reap_children(struct scallop_event_loop *loop)
+{
+	struct signalfd_siginfo info;
+	while (read(loop->signal_fd, &info, sizeof(info)) == sizeof(info))
+		;
+
+	// One SIGCHLD can stand for any number of children
+	ssize_t handled = 0;
+	pid_t pid;
+	int status;
+	while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+		struct child_slot *slot = find_child(loop, pid);
+		if (!slot)
+			slot = insert_child(loop, pid);
+		if (!slot)
+			continue;
+		if (!slot->watch) {
+			// Not watched yet, so keep the status for later
+			slot->status = status;
+			continue;
+		}
+		struct scallop_watch *watch = slot->watch;
+		watch->status = status;
+		dispatch(loop, watch);
+		handled++;
+	}
+	return handled;
+}
+
+static ssize_t handle(struct scallop_event_loop *loop, struct scallop_watch *watch)
+{
+	if (!watch)
+		return reap_children(loop);
+	if (watch->dead)
+		return 0;
+
+	switch (watch->kind) {
+	case SCALLOP_EVENT_EXIT: {
+		const pid_t result = waitpid(watch->pid, &watch->status, WNOHANG);
+		if (!result)
+			return 0;
+		if (result < 0)
+			watch->status = -1;
+		break;
+	}
+	case SCALLOP_EVENT_TIMER: {
+		uint64_t expirations;
+		if (read(watch->fd, &expirations, sizeof(expirations)) < 0)
+			return 0;
+		break;
+	}
+	case SCALLOP_EVENT_READABLE:
+		break;
+	}
+	dispatch(loop, watch);
+	return 1;
+}
+
+ssize_t scallop_event_loop_run_once(struct scallop_event_loop *loop, int timeout_ms)
+{
+	ssize_t handled = 0;
+	struct scallop_watch *ready = loop->ready;
+	loop->ready = NULL;
+	for (; ready; ready = ready->next_ready) {
+		if (ready->dead)
+			continue;
+		dispatch(loop, ready);
+		handled++;
+	}
+	if (handled || loop->ready)
+		timeout_ms = 0;
+
+	struct epoll_event events[EVENT_BATCH];
+	const int count = epoll_wait(loop->epoll, events, EVENT_BATCH, timeout_ms);
+	if (count < 0 && errno != EINTR) {
+		free_dead(loop);
+		return -1;
+	}
+	for (int i = 0; i < count; i++)
+		handled += handle(loop, events[i].data.ptr);
+
+	free_dead(loop);
+	return handled;
+}
+
+int scallop_event_loop_run(struct scallop_event_loop *loop)
+{
+	while (loop->watch_count)
+		if (scallop_event_loop_run_once(loop, -1) < 0)
+			return 0;
+	return 1;
+}
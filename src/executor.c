@@ -0,0 +1,763 @@
+/*
+ * Scallop - a shell for executing tasks concurrently
+ * Copyright (C) <year>  Marcus Harrison
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "scallop/executor.h"
+#include "scallop/event_loop.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define DEQUE_CAPACITY 4096
+#define CACHE_LINE 64
+// Times a worker waiting for a group looks for work
+// before going to sleep
+#define HELP_SPINS 64
+
+struct task_group;
+
+struct task {
+	void (*run)(struct task *);
+	struct task_group *group;
+	// Only for tasks waiting to be picked up by a worker
+	struct task *next;
+};
+
+/*
+ * The tasks spawned together, and waited for together.
+ * Groups waited on from outside the pool wake their
+ * waiter through the executor's condition variable;
+ * workers run other tasks while they wait instead,
+ * and sleep with the idle workers when there are none.
+ */
+struct task_group {
+	atomic_long pending;
+	atomic_int status;
+	char external;
+};
+
+/*
+ * Chase and Lev's work-stealing deque, with the memory
+ * orderings from Lê et al., "Correct and Efficient
+ * Work-Stealing for Weak Memory Models". Only the
+ * owner pushes and pops, at the bottom; anyone can
+ * steal from the top.
+ *
+ * It doesn't grow: a task that doesn't fit is run
+ * straight away by whoever spawned it, which the other
+ * workers can't tell apart from a long-running task.
+ */
+struct deque {
+	_Alignas(CACHE_LINE) atomic_long top;
+	_Alignas(CACHE_LINE) atomic_long bottom;
+	_Atomic(struct task *) tasks[DEQUE_CAPACITY];
+};
+
+static int deque_push(struct deque *deque, struct task *task)
+{
+	const long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+	const long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+	if (bottom - top >= DEQUE_CAPACITY)
+		return 0;
+	atomic_store_explicit(
+		&deque->tasks[bottom % DEQUE_CAPACITY],
+		task,
+		memory_order_relaxed
+	);
+	atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_release);
+	return 1;
+}
+
+static struct task *deque_pop(struct deque *deque)
+{
+	const long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+	atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	long top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+	if (bottom < top) {
+		atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+		return NULL;
+	}
+
+	struct task *task = atomic_load_explicit(
+		&deque->tasks[bottom % DEQUE_CAPACITY],
+		memory_order_relaxed
+	);
+	if (bottom == top) {
+		// The last task, which a thief might be taking
+		if (!atomic_compare_exchange_strong_explicit(
+			&deque->top,
+			&top,
+			top + 1,
+			memory_order_seq_cst,
+			memory_order_relaxed
+		))
+			task = NULL;
+		atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+	}
+	return task;
+}
+
+static struct task *deque_steal(struct deque *deque)
+{
+	long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+	atomic_thread_fence(memory_order_seq_cst);
+	const long bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+	if (bottom <= top)
+		return NULL;
+
+	struct task *task = atomic_load_explicit(
+		&deque->tasks[top % DEQUE_CAPACITY],
+		memory_order_relaxed
+	);
+	if (!atomic_compare_exchange_strong_explicit(
+		&deque->top,
+		&top,
+		top + 1,
+		memory_order_seq_cst,
+		memory_order_relaxed
+	))
+		return NULL;
+	return task;
+}
+
+struct worker {
+	struct deque deque;
+	struct scallop_executor *executor;
+	pthread_t thread;
+	int index;
+	int victim;
+};
+
+struct child;
+
+/*
+ * Workers with nothing to do sleep on wake. Before
+ * going to sleep they note the epoch, which every
+ * spawn increments, and check for work once more; so
+ * a task spawned in between either gets found then,
+ * or changes the epoch and keeps them awake.
+ *
+ * Children being waited for are handed to the reaper
+ * thread, which owns the event loop, through the
+ * submitted list; writing to reaper_wake tells it to
+ * take them.
+ */
+struct scallop_executor {
+	int parallelism;
+	struct worker *workers;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	pthread_cond_t done;
+	// Tasks from outside the pool, for any worker
+	struct task *injected;
+	struct task *injected_tail;
+	atomic_int injected_count;
+	atomic_ulong epoch;
+	atomic_int sleepers;
+	atomic_int stopping;
+	struct scallop_event_loop *loop;
+	int reaper_wake;
+	pthread_t reaper;
+	char reaping;
+	struct child *submitted;
+};
+
+static _Thread_local struct worker *current_worker;
+
+static void notify(struct scallop_executor *executor)
+{
+	atomic_fetch_add(&executor->epoch, 1);
+	if (!atomic_load(&executor->sleepers))
+		return;
+	pthread_mutex_lock(&executor->lock);
+	pthread_cond_signal(&executor->wake);
+	pthread_mutex_unlock(&executor->lock);
+}
+
+/*
+ * Workers waiting for a group sleep alongside the idle
+ * ones, so when a group finishes, every sleeper gets
+ * woken to make sure its waiter is among them.
+ */
+static void wake_all(struct scallop_executor *executor)
+{
+	atomic_fetch_add(&executor->epoch, 1);
+	if (!atomic_load(&executor->sleepers))
+		return;
+	pthread_mutex_lock(&executor->lock);
+	pthread_cond_broadcast(&executor->wake);
+	pthread_mutex_unlock(&executor->lock);
+}
+
+static void inject(struct scallop_executor *executor, struct task *task)
+{
+	task->next = NULL;
+	pthread_mutex_lock(&executor->lock);
+	if (executor->injected_tail)
+		executor->injected_tail->next = task;
+	else
+		executor->injected = task;
+	executor->injected_tail = task;
+	atomic_fetch_add(&executor->injected_count, 1);
+	pthread_mutex_unlock(&executor->lock);
+	notify(executor);
+}
+
+static struct task *take_injected(struct scallop_executor *executor)
+{
+	if (!atomic_load_explicit(&executor->injected_count, memory_order_relaxed))
+		return NULL;
+
+	pthread_mutex_lock(&executor->lock);
+	struct task *task = executor->injected;
+	if (task) {
+		executor->injected = task->next;
+		if (!executor->injected)
+			executor->injected_tail = NULL;
+		atomic_fetch_sub(&executor->injected_count, 1);
+	}
+	pthread_mutex_unlock(&executor->lock);
+	return task;
+}
+
+static struct task *find_task(struct worker *worker)
+{
+	struct task *task = deque_pop(&worker->deque);
+	if (task)
+		return task;
+
+	struct scallop_executor *executor = worker->executor;
+	task = take_injected(executor);
+	if (task)
+		return task;
+
+	// Start with whoever had work last time
+	for (int i = 0; i < executor->parallelism; i++) {
+		const int victim = (worker->victim + i) % executor->parallelism;
+		if (victim == worker->index)
+			continue;
+		task = deque_steal(&executor->workers[victim].deque);
+		if (task) {
+			worker->victim = victim;
+			return task;
+		}
+	}
+	return NULL;
+}
+
+// The waiter can free the group as soon as pending
+// reaches 0, so nothing of it is read after that
+static void leave_group(struct scallop_executor *executor, struct task_group *group)
+{
+	if (!group->external) {
+		if (atomic_fetch_sub(&group->pending, 1) == 1)
+			wake_all(executor);
+		return;
+	}
+
+	// Waiters outside the pool only check pending with
+	// the lock held, so they can't go on to destroy the
+	// executor before it's unlocked again
+	pthread_mutex_lock(&executor->lock);
+	if (atomic_fetch_sub(&group->pending, 1) == 1)
+		pthread_cond_broadcast(&executor->done);
+	pthread_mutex_unlock(&executor->lock);
+}
+
+static void run_task(struct scallop_executor *executor, struct task *task)
+{
+	struct task_group *group = task->group;
+	task->run(task);
+	leave_group(executor, group);
+}
+
+static void spawn(struct worker *worker, struct task *task)
+{
+	if (!deque_push(&worker->deque, task)) {
+		run_task(worker->executor, task);
+		return;
+	}
+	notify(worker->executor);
+}
+
+/*
+ * Runs other tasks until the group is done. Once
+ * there's nothing left to run it spins a little, in
+ * case the group is about to finish, then sleeps like
+ * an idle worker until something is spawned or the
+ * group finishes, as its tasks could be waiting on
+ * anything.
+ */
+static void help_until_done(struct worker *worker, struct task_group *group)
+{
+	struct scallop_executor *executor = worker->executor;
+	int idle = 0;
+	while (atomic_load(&group->pending) > 0) {
+		struct task *task = find_task(worker);
+		if (task) {
+			run_task(executor, task);
+			idle = 0;
+			continue;
+		}
+		if (idle++ < HELP_SPINS) {
+			sched_yield();
+			continue;
+		}
+
+		const unsigned long epoch = atomic_load(&executor->epoch);
+		task = find_task(worker);
+		if (task) {
+			run_task(executor, task);
+			idle = 0;
+			continue;
+		}
+
+		pthread_mutex_lock(&executor->lock);
+		atomic_fetch_add(&executor->sleepers, 1);
+		while (atomic_load(&executor->epoch) == epoch && atomic_load(&group->pending) > 0)
+			pthread_cond_wait(&executor->wake, &executor->lock);
+		atomic_fetch_sub(&executor->sleepers, 1);
+		pthread_mutex_unlock(&executor->lock);
+	}
+}
+
+static void wait_outside(struct scallop_executor *executor, struct task_group *group)
+{
+	pthread_mutex_lock(&executor->lock);
+	while (atomic_load(&group->pending))
+		pthread_cond_wait(&executor->done, &executor->lock);
+	pthread_mutex_unlock(&executor->lock);
+}
+
+static void *worker_main(void *param)
+{
+	struct worker *worker = param;
+	struct scallop_executor *executor = worker->executor;
+	current_worker = worker;
+
+	for (;;) {
+		struct task *task = find_task(worker);
+		if (task) {
+			run_task(executor, task);
+			continue;
+		}
+
+		const unsigned long epoch = atomic_load(&executor->epoch);
+		task = find_task(worker);
+		if (task) {
+			run_task(executor, task);
+			continue;
+		}
+
+		pthread_mutex_lock(&executor->lock);
+		atomic_fetch_add(&executor->sleepers, 1);
+		while (atomic_load(&executor->epoch) == epoch && !atomic_load(&executor->stopping))
+			pthread_cond_wait(&executor->wake, &executor->lock);
+		atomic_fetch_sub(&executor->sleepers, 1);
+		const int stopping = atomic_load(&executor->stopping);
+		pthread_mutex_unlock(&executor->lock);
+		if (stopping)
+			return NULL;
+	}
+}
+
+/*
+ * A child being waited for, in the waiter's memory
+ * until the reaper thread has watched it and it's
+ * exited; or found it can't be watched, in which case
+ * the waiter waits for it itself.
+ */
+struct child {
+	pid_t pid;
+	int *status;
+	char watched;
+	struct task_group *group;
+	struct scallop_executor *executor;
+	struct child *next;
+};
+
+static void child_exited(struct scallop_event_loop *loop, const struct scallop_event *event)
+{
+	(void)loop;
+	struct child *child = event->context;
+	*child->status = event->status;
+	leave_group(child->executor, child->group);
+}
+
+static void take_children(struct scallop_event_loop *loop, const struct scallop_event *event)
+{
+	struct scallop_executor *executor = event->context;
+	uint64_t count;
+	if (read(executor->reaper_wake, &count, sizeof(count)) < 0)
+		return;
+
+	pthread_mutex_lock(&executor->lock);
+	struct child *child = executor->submitted;
+	executor->submitted = NULL;
+	pthread_mutex_unlock(&executor->lock);
+
+	while (child) {
+		// Gone as soon as its group is left
+		struct child *next = child->next;
+		if (!scallop_watch_child(loop, child->pid, child_exited, child)) {
+			child->watched = 0;
+			leave_group(executor, child->group);
+		}
+		child = next;
+	}
+}
+
+static void *reaper_main(void *param)
+{
+	struct scallop_executor *executor = param;
+	while (!atomic_load(&executor->stopping))
+		scallop_event_loop_run_once(executor->loop, -1);
+	return NULL;
+}
+
+static void stop_workers(struct scallop_executor *executor, int count)
+{
+	pthread_mutex_lock(&executor->lock);
+	atomic_store(&executor->stopping, 1);
+	pthread_cond_broadcast(&executor->wake);
+	pthread_mutex_unlock(&executor->lock);
+	for (int i = 0; i < count; i++)
+		pthread_join(executor->workers[i].thread, NULL);
+
+	if (executor->reaping) {
+		const uint64_t one = 1;
+		while (write(executor->reaper_wake, &one, sizeof(one)) < 0 && errno == EINTR)
+			;
+		pthread_join(executor->reaper, NULL);
+	}
+}
+
+static void free_executor(struct scallop_executor *executor)
+{
+	if (executor->loop)
+		scallop_event_loop_destroy(executor->loop);
+	if (executor->reaper_wake >= 0)
+		close(executor->reaper_wake);
+	pthread_mutex_destroy(&executor->lock);
+	pthread_cond_destroy(&executor->wake);
+	pthread_cond_destroy(&executor->done);
+	free(executor->workers);
+	free(executor);
+}
+
+struct scallop_executor *scallop_executor_create(int parallelism)
+{
+	if (parallelism <= 0)
+		parallelism = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (parallelism <= 0)
+		parallelism = 1;
+
+	struct scallop_executor *executor = calloc(1, sizeof(*executor));
+	if (!executor)
+		return NULL;
+	executor->workers = aligned_alloc(
+		_Alignof(struct worker),
+		parallelism * sizeof(*executor->workers)
+	);
+	if (!executor->workers) {
+		free(executor);
+		return NULL;
+	}
+	executor->parallelism = parallelism;
+	executor->reaper_wake = -1;
+	pthread_mutex_init(&executor->lock, NULL);
+	pthread_cond_init(&executor->wake, NULL);
+	pthread_cond_init(&executor->done, NULL);
+
+	// Before any threads, so if the loop has to block
+	// SIGCHLD, they all start with it blocked
+	executor->loop = scallop_event_loop_create(0);
+	if (executor->loop)
+		executor->reaper_wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (
+		executor->reaper_wake < 0
+		|| !scallop_watch_readable(executor->loop, executor->reaper_wake, take_children, executor)
+	) {
+		const int error = errno;
+		free_executor(executor);
+		errno = error;
+		return NULL;
+	}
+	int error = pthread_create(&executor->reaper, NULL, reaper_main, executor);
+	if (error) {
+		free_executor(executor);
+		errno = error;
+		return NULL;
+	}
+	executor->reaping = 1;
+
+	// Every deque has to be ready before the first
+	// worker starts, as it might try stealing from any
+	for (int i = 0; i < parallelism; i++) {
+		struct worker *worker = &executor->workers[i];
+		atomic_init(&worker->deque.top, 0);
+		atomic_init(&worker->deque.bottom, 0);
+		worker->executor = executor;
+		worker->index = i;
+		worker->victim = (i + 1) % parallelism;
+	}
+	for (int i = 0; i < parallelism; i++) {
+		struct worker *worker = &executor->workers[i];
+		error = pthread_create(&worker->thread, NULL, worker_main, worker);
+		if (error) {
+			stop_workers(executor, i);
+			free_executor(executor);
+			errno = error;
+			return NULL;
+		}
+	}
+	return executor;
+}
+
+int scallop_executor_parallelism(const struct scallop_executor *executor)
+{
+	return executor->parallelism;
+}
+
+void scallop_executor_destroy(struct scallop_executor *executor)
+{
+	stop_workers(executor, executor->parallelism);
+	free_executor(executor);
+}
+
+/*
+ * Statements
+ */
+
+struct statement_task {
+	struct task task;
+	const struct scallop_ast *ast;
+	uint32_t statement;
+	scallop_statement_fn *run;
+	void *context;
+};
+
+static void record_status(atomic_int *status, int statement_status)
+{
+	int expected = 0;
+	if (statement_status)
+		atomic_compare_exchange_strong(status, &expected, statement_status);
+}
+
+static void run_statement(struct task *task)
+{
+	struct statement_task *statement = (struct statement_task *)task;
+	record_status(
+		&task->group->status,
+		statement->run(statement->ast, statement->statement, statement->context)
+	);
+}
+
+static int run_serially(
+	const struct scallop_ast *ast,
+	uint32_t block,
+	scallop_statement_fn *run,
+	void *context
+)
+{
+	int status = 0;
+	for (
+		uint32_t statement = ast->nodes[block].first_child;
+		statement != SCALLOP_NODE_NONE;
+		statement = ast->nodes[statement].next_sibling
+	) {
+		const int statement_status = run(ast, statement, context);
+		if (!status)
+			status = statement_status;
+	}
+	return status;
+}
+
+/*
+ * Spawning is just a push onto the worker's own deque,
+ * so even blocks of thousands of statements take
+ * little time to hand out; idle workers steal from
+ * the oldest end while the rest are still going on.
+ */
+static int execute_on_worker(
+	struct worker *worker,
+	const struct scallop_ast *ast,
+	uint32_t block,
+	scallop_statement_fn *run,
+	void *context
+)
+{
+	long count = 0;
+	for (
+		uint32_t statement = ast->nodes[block].first_child;
+		statement != SCALLOP_NODE_NONE;
+		statement = ast->nodes[statement].next_sibling
+	)
+		count++;
+	if (!count)
+		return 0;
+
+	struct statement_task *tasks = malloc(count * sizeof(*tasks));
+	if (!tasks)
+		return run_serially(ast, block, run, context);
+
+	struct task_group group = { .external = 0 };
+	atomic_init(&group.pending, count);
+	atomic_init(&group.status, 0);
+
+	struct statement_task *task = tasks;
+	for (
+		uint32_t statement = ast->nodes[block].first_child;
+		statement != SCALLOP_NODE_NONE;
+		statement = ast->nodes[statement].next_sibling, task++
+	) {
+		*task = (struct statement_task) {
+			.task = { run_statement, &group, NULL },
+			.ast = ast,
+			.statement = statement,
+			.run = run,
+			.context = context,
+		};
+		spawn(worker, &task->task);
+	}
+
+	help_until_done(worker, &group);
+	free(tasks);
+	return atomic_load(&group.status);
+}
+
+struct block_task {
+	struct task task;
+	const struct scallop_ast *ast;
+	uint32_t block;
+	scallop_statement_fn *run;
+	void *context;
+	int status;
+};
+
+static void run_block(struct task *task)
+{
+	struct block_task *block = (struct block_task *)task;
+	block->status = execute_on_worker(
+		current_worker,
+		block->ast,
+		block->block,
+		block->run,
+		block->context
+	);
+}
+
+int scallop_execute_block(
+	struct scallop_executor *executor,
+	const struct scallop_ast *ast,
+	uint32_t block,
+	scallop_statement_fn *run,
+	void *context
+)
+{
+	if (current_worker && current_worker->executor == executor)
+		return execute_on_worker(current_worker, ast, block, run, context);
+
+	// From outside the pool, hand the whole block to a
+	// worker, which spawns the statements from there
+	struct task_group group = { .external = 1 };
+	atomic_init(&group.pending, 1);
+	atomic_init(&group.status, 0);
+	struct block_task task = {
+		.task = { run_block, &group, NULL },
+		.ast = ast,
+		.block = block,
+		.run = run,
+		.context = context,
+	};
+	inject(executor, &task.task);
+	wait_outside(executor, &group);
+	return task.status;
+}
+
+/*
+ * Children
+ */
+
+static void wait_directly(pid_t pid, int *status)
+{
+	pid_t result;
+	while ((result = waitpid(pid, status, 0)) < 0 && errno == EINTR)
+		;
+	if (result < 0)
+		*status = -1;
+}
+
+void scallop_executor_wait_children(
+	struct scallop_executor *executor,
+	const pid_t *pids,
+	ssize_t count,
+	int *statuses
+)
+{
+	if (count <= 0)
+		return;
+	struct child *children = malloc(count * sizeof(*children));
+	if (!children) {
+		for (ssize_t i = 0; i < count; i++)
+			wait_directly(pids[i], &statuses[i]);
+		return;
+	}
+
+	struct worker *worker = current_worker && current_worker->executor == executor ?
+		current_worker :
+		NULL;
+	struct task_group group = { .external = !worker };
+	atomic_init(&group.pending, count);
+	atomic_init(&group.status, 0);
+	for (ssize_t i = 0; i < count; i++) {
+		statuses[i] = -1;
+		children[i] = (struct child) {
+			.pid = pids[i],
+			.status = &statuses[i],
+			.watched = 1,
+			.group = &group,
+			.executor = executor,
+			.next = i + 1 < count ? &children[i + 1] : NULL,
+		};
+	}
+
+	pthread_mutex_lock(&executor->lock);
+	children[count - 1].next = executor->submitted;
+	executor->submitted = children;
+	pthread_mutex_unlock(&executor->lock);
+	const uint64_t one = 1;
+	while (write(executor->reaper_wake, &one, sizeof(one)) < 0 && errno == EINTR)
+		;
+
+	if (worker)
+		help_until_done(worker, &group);
+	else
+		wait_outside(executor, &group);
+
+	for (ssize_t i = 0; i < count; i++)
+		if (!children[i].watched)
+			wait_directly(pids[i], &statuses[i]);
+	free(children);
+}
@@ -0,0 +1,133 @@
+/*
+ * Scallop - a shell for executing tasks concurrently
+ * Copyright (C) 2022  Marcus Harrison
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Generates lexer_tables.h from the specification in
+ * lexer_spec.h, so the lexer can do table lookups
+ * instead of re-deriving everything at run-time.
+ */
+
+#include "lexer_spec.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static void print_char_types(FILE *out)
+{
+	fprintf(out, "static const unsigned char char_types[256] = {");
+	for (int byte = 0; byte < 256; byte++) {
+		if (byte % 16 == 0)
+			fprintf(out, "\n\t");
+		fprintf(out, "%d,", char_type_spec((char)byte));
+		if (byte % 16 != 15)
+			fprintf(out, " ");
+	}
+	fprintf(out, "\n};\n");
+}
+
+static void print_state_transitions(FILE *out)
+{
+	fprintf(
+		out,
+		"static const unsigned char state_transitions[%d][%d] = {\n",
+		LEX_STATE_COUNT,
+		CHAR_TYPE_COUNT
+	);
+	for (int state = 0; state < LEX_STATE_COUNT; state++) {
+		fprintf(out, "\t{ ");
+		for (int input = 0; input < CHAR_TYPE_COUNT; input++)
+			fprintf(out, "%d, ", transition_state_spec(state, input));
+		fprintf(out, "},\n");
+	}
+	fprintf(out, "};\n");
+}
+
+static void print_chars(FILE *out, const char *chars, int count)
+{
+	if (!count) {
+		fprintf(out, "{ 0 }");
+		return;
+	}
+	fprintf(out, "{ ");
+	for (int i = 0; i < count; i++)
+		fprintf(out, "%d, ", chars[i]);
+	fprintf(out, "}");
+}
+
+static void print_run_classes(FILE *out)
+{
+	fprintf(
+		out,
+		"static const struct run_class run_classes[%d] = {\n",
+		LEX_STATE_COUNT
+	);
+	for (int state = 0; state < LEX_STATE_COUNT; state++) {
+		const struct run_class run = run_class_spec(state);
+		if (!run.enabled)
+			continue;
+		fprintf(
+			out,
+			"\t[%d] = { %d, %d, %d, %d, %d, %d, %d, %d, %d, ",
+			state,
+			run.enabled,
+			run.utf8,
+			run.after_utf8,
+			run.ascii_state,
+			run.utf8_state,
+			run.low,
+			run.high,
+			run.excluded_count,
+			run.extra_count
+		);
+		print_chars(out, run.excluded, run.excluded_count);
+		fprintf(out, ", ");
+		print_chars(out, run.extra, run.extra_count);
+		fprintf(out, " },\n");
+	}
+	fprintf(out, "};\n");
+}
+
+int main(int argc, char **argv)
+{
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s <output file>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	FILE *out = fopen(argv[1], "w");
+	if (!out) {
+		perror(argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	fprintf(out, "// Generated by gen_lexer_tables, do not edit\n");
+	fprintf(out, "#ifndef SCALLOP_LEXER_TABLES_H\n");
+	fprintf(out, "#define SCALLOP_LEXER_TABLES_H\n\n");
+	print_char_types(out);
+	fprintf(out, "\n");
+	print_state_transitions(out);
+	fprintf(out, "\n");
+	print_run_classes(out);
+	fprintf(out, "\n#endif // SCALLOP_LEXER_TABLES_H\n");
+
+	if (fclose(out)) {
+		perror(argv[1]);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,270 @@
+/*
+ * Scallop - a shell for executing tasks concurrently
+ * Copyright (C) <year>  Marcus Harrison
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+// For execvpe(), pipe2() and
+// posix_spawn_file_actions_addchdir_np()
+#define _GNU_SOURCE
+
+#include "scallop/launch.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+static int has_slash(const char *path)
+{
+	return strchr(path, '/') != NULL;
+}
+
+static const char *command_file(const struct scallop_command *command)
+{
+	return command->path ? command->path : command->argv[0];
+}
+
+/*
+ * posix_spawn()
+ *
+ * glibc creates the child with clone(CLONE_VM |
+ * CLONE_VFORK), running the file actions on the
+ * parent's memory and stack, and reports a failed
+ * exec as posix_spawn()'s own result.
+ */
+
+static int add_redirects(
+	posix_spawn_file_actions_t *actions,
+	const struct scallop_command *command
+)
+{
+	for (ssize_t i = 0; i < command->redirect_count; i++) {
+		const struct scallop_redirect *redirect = &command->redirects[i];
+		int error = 0;
+		switch (redirect->kind) {
+		case SCALLOP_REDIRECT_OPEN:
+			error = posix_spawn_file_actions_addopen(
+				actions,
+				redirect->fd,
+				redirect->path,
+				redirect->flags,
+				redirect->mode
+			);
+			break;
+		case SCALLOP_REDIRECT_DUP:
+			// Duplicating onto itself clears FD_CLOEXEC, as
+			// of glibc 2.29, same as with fork
+			error = posix_spawn_file_actions_adddup2(
+				actions,
+				redirect->source,
+				redirect->fd
+			);
+			break;
+		case SCALLOP_REDIRECT_CLOSE:
+			error = posix_spawn_file_actions_addclose(actions, redirect->fd);
+			break;
+		default:
+			error = EINVAL;
+		}
+		if (error)
+			return error;
+	}
+	return 0;
+}
+
+static int set_signals(posix_spawnattr_t *attributes)
+{
+	sigset_t mask, defaults;
+	sigemptyset(&mask);
+	sigemptyset(&defaults);
+	sigaddset(&defaults, SIGPIPE);
+	int error = posix_spawnattr_setsigmask(attributes, &mask);
+	if (!error)
+		error = posix_spawnattr_setsigdefault(attributes, &defaults);
+	if (!error)
+		error = posix_spawnattr_setflags(
+			attributes,
+			POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF
+		);
+	return error;
+}
+
+static pid_t launch_spawn(const struct scallop_command *command)
+{
+	posix_spawn_file_actions_t actions;
+	posix_spawnattr_t attributes;
+	int error = posix_spawn_file_actions_init(&actions);
+	if (error) {
+		errno = error;
+		return -1;
+	}
+	error = posix_spawnattr_init(&attributes);
+	if (error) {
+		posix_spawn_file_actions_destroy(&actions);
+		errno = error;
+		return -1;
+	}
+
+	pid_t pid = -1;
+	if (command->directory)
+		error = posix_spawn_file_actions_addchdir_np(&actions, command->directory);
+	if (!error)
+		error = add_redirects(&actions, command);
+	if (!error)
+		error = set_signals(&attributes);
+	if (!error) {
+		char *const *envp = command->envp ? command->envp : environ;
+		const char *file = command_file(command);
+		error = has_slash(file) ?
+			posix_spawn(&pid, file, &actions, &attributes, command->argv, envp) :
+			posix_spawnp(&pid, file, &actions, &attributes, command->argv, envp);
+	}
+
+	posix_spawnattr_destroy(&attributes);
+	posix_spawn_file_actions_destroy(&actions);
+	if (error) {
+		errno = error;
+		return -1;
+	}
+	return pid;
+}
+
+/*
+ * fork()
+ *
+ * The child reports anything that goes wrong before
+ * it execs through a close-on-exec pipe, so the parent
+ * sees either EOF, once the exec succeeded, or an
+ * errno. Only async-signal-safe functions can be used
+ * in between.
+ */
+
+static int apply_redirect(const struct scallop_redirect *redirect)
+{
+	switch (redirect->kind) {
+	case SCALLOP_REDIRECT_OPEN: {
+		const int fd = open(redirect->path, redirect->flags, redirect->mode);
+		if (fd < 0)
+			return 0;
+		if (fd == redirect->fd)
+			return 1;
+		const int result = dup2(fd, redirect->fd);
+		close(fd);
+		return result >= 0;
+	}
+	case SCALLOP_REDIRECT_DUP:
+		if (redirect->source == redirect->fd)
+			return fcntl(redirect->fd, F_SETFD, 0) >= 0;
+		return dup2(redirect->source, redirect->fd) >= 0;
+	case SCALLOP_REDIRECT_CLOSE:
+		return close(redirect->fd) >= 0 || errno == EBADF;
+	default:
+		errno = EINVAL;
+		return 0;
+	}
+}
+
+__attribute__((noreturn))
+static void exec_child(const struct scallop_command *command, int report)
+{
+	if (command->directory && chdir(command->directory) < 0)
+		goto error;
+	for (ssize_t i = 0; i < command->redirect_count; i++) {
+		const struct scallop_redirect *redirect = &command->redirects[i];
+		// The report pipe has to survive being redirected over
+		if (redirect->fd == report) {
+			const int moved = fcntl(report, F_DUPFD_CLOEXEC, 3);
+			if (moved < 0)
+				goto error;
+			report = moved;
+		}
+		if (!apply_redirect(redirect))
+			goto error;
+	}
+
+	sigset_t mask;
+	sigemptyset(&mask);
+	signal(SIGPIPE, SIG_DFL);
+	sigprocmask(SIG_SETMASK, &mask, NULL);
+
+	char *const *envp = command->envp ? command->envp : environ;
+	const char *file = command_file(command);
+	if (has_slash(file))
+		execve(file, command->argv, envp);
+	else
+		execvpe(file, command->argv, envp);
+
+error:
+	{
+		const int error = errno;
+		while (write(report, &error, sizeof(error)) < 0 && errno == EINTR)
+			;
+	}
+	_exit(127);
+}
+
+static pid_t launch_fork(const struct scallop_command *command)
+{
+	int report[2];
+	if (pipe2(report, O_CLOEXEC) < 0)
+		return -1;
+
+	const pid_t pid = fork();
+	if (!pid) {
+		close(report[0]);
+		exec_child(command, report[1]);
+	}
+	const int fork_error = errno;
+	close(report[1]);
+	if (pid < 0) {
+		close(report[0]);
+		errno = fork_error;
+		return -1;
+	}
+
+	int error;
+	ssize_t result;
+	while ((result = read(report[0], &error, sizeof(error))) < 0 && errno == EINTR)
+		;
+	close(report[0]);
+	if (result != sizeof(error))
+		return pid;
+
+	while (waitpid(pid, NULL, 0) < 0 && errno == EINTR)
+		;
+	errno = error;
+	return -1;
+}
+
+pid_t scallop_launch(
+	const struct scallop_command *command,
+	enum SCALLOP_LAUNCH_METHOD method
+)
+{
+	switch (method) {
+	case SCALLOP_LAUNCH_SPAWN:
+		return launch_spawn(command);
+	case SCALLOP_LAUNCH_FORK:
+		return launch_fork(command);
+	default:
+		errno = EINVAL;
+		return -1;
+	}
+}
@@ -16,92 +16,153 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include "scallop/lexer.h"
+#include "scallop/symbols.h"
+#include "lexer_spec.h"
+#include "lexer_tables.h"
+#include "lexer_runs.h"
 
+#include <errno.h>
 #include <stdio.h> // EOF
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 #include <csalt/resources.h>
 #include <assert.h>
 
-// This is all probably horribly inefficient but whatever
+/*
+ * Bytes are read through a window, rather than one
+ * csalt_store_split() per byte. When we're given
+ * contiguous memory, the window is the whole buffer;
+ * otherwise it's refilled in chunks from the store,
+ * or moved to the other half of a stream's ring buffer.
+ *
+ * Offsets from available_end on haven't arrived yet,
+ * so lexing has to stop and wait for them; that only
+ * happens for streams.
+ */
+#define LEX_CHUNK_SIZE 4096
+#define LEX_TOKEN_CHUNK_SIZE 64
+
+struct lex_source {
+	const char *begin;
+	const char *end;
+	ssize_t offset;
+	ssize_t available_end;
+	int (*fill)(struct lex_source *, ssize_t index);
+	csalt_store *store;
+	const struct scallop_stream_lexer *stream;
+	ssize_t chunk_size;
+	// Only for memory sources scallop_validate_utf8() accepted
+	char utf8_validated;
+	char chunk[LEX_CHUNK_SIZE];
+};
 
-static int get_char_internal(csalt_store *store, void *param)
+static int fill_chunk(struct lex_source *source, ssize_t index);
+static int fill_ring(struct lex_source *source, ssize_t index);
+
+static struct lex_source lex_source_store(
+	csalt_store *store,
+	ssize_t chunk_size
+)
 {
-	return !!csalt_store_read(store, param, 1);
+	return (struct lex_source) {
+		.available_end = SSIZE_MAX,
+		.fill = fill_chunk,
+		.store = store,
+		.chunk_size = chunk_size,
+	};
 }
 
-static char get_char(csalt_store *store, ssize_t index)
+static struct lex_source lex_source_memory(
+	const char *begin,
+	const char *end
+)
 {
-	char result = 0;
-	int success = csalt_store_split(store, index, index + 1, get_char_internal, &result);
-	if (!success)
-		return 0;
-	return result;
+	return (struct lex_source) {
+		.begin = begin,
+		.end = end,
+		.available_end = SSIZE_MAX,
+	};
 }
 
-enum CHAR_TYPE {
-	CHAR_NULL,
-	CHAR_ASCII_PRINTABLE,
-	CHAR_UTF8_START,
-	CHAR_UTF8_CONT,
-	CHAR_OPEN_CURLY_BRACKET,
-	CHAR_CLOSE_CURLY_BRACKET,
-	CHAR_OPEN_SQUARE_BRACKET,
-	CHAR_CLOSE_SQUARE_BRACKET,
-	CHAR_QUOTE,
-	CHAR_DOUBLE_QUOTE,
-	CHAR_BACKSLASH,
-	CHAR_WORD_SEPARATOR,
-	CHAR_STATEMENT_SEPARATOR,
-	CHAR_PIPE,
-	CHAR_UNKNOWN,
-};
+static struct lex_source lex_source_stream(
+	const struct scallop_stream_lexer *stream
+)
+{
+	return (struct lex_source) {
+		.available_end = stream->finished ? SSIZE_MAX : stream->written,
+		.fill = fill_ring,
+		.stream = stream,
+	};
+}
 
-#define UTF8_FIRST_BIT (1 << 7)
-#define UTF8_SECOND_BIT (1 << 6)
+static int fill_chunk_internal(csalt_store *store, void *param)
+{
+	struct {
+		char *buffer;
+		ssize_t size;
+	} *params = param;
 
-static enum CHAR_TYPE char_type(char character)
+	params->size = csalt_store_read(store, params->buffer, params->size);
+	return params->size > 0;
+}
+
+static int fill_chunk(struct lex_source *source, ssize_t index)
 {
-	switch (character) {
-		case '{':
-			return CHAR_OPEN_CURLY_BRACKET;
-		case '}':
-			return CHAR_CLOSE_CURLY_BRACKET;
-		case '[':
-			return CHAR_OPEN_SQUARE_BRACKET;
-		case ']':
-			return CHAR_CLOSE_SQUARE_BRACKET;
-		case '\'':
-			return CHAR_QUOTE;
-		case '"':
-			return CHAR_DOUBLE_QUOTE;
-		case '\\':
-			return CHAR_BACKSLASH;
-		case ';':
-		case '\n':
-			return CHAR_STATEMENT_SEPARATOR;
-		case ' ':
-		case '\t':
-			return CHAR_WORD_SEPARATOR;
-		case '|':
-			return CHAR_PIPE;
-		case '\0':
-			return CHAR_NULL;
+	// Stores are allowed to refuse splits running past
+	// their end, so keep halving until one fits
+	for (ssize_t size = source->chunk_size; size > 0; size /= 2) {
+		struct {
+			char *buffer;
+			ssize_t size;
+		} params = { source->chunk, size };
+
+		if (csalt_store_split(
+			source->store,
+			index,
+			index + size,
+			fill_chunk_internal,
+			&params
+		)) {
+			source->begin = source->chunk;
+			source->end = source->chunk + params.size;
+			source->offset = index;
+			return 1;
+		}
 	}
+	return 0;
+}
 
-	if (' ' <= character && character <= '~')
-		return CHAR_ASCII_PRINTABLE;
-
-	unsigned char utf8_bits = UTF8_FIRST_BIT | UTF8_SECOND_BIT;
-	switch (character & utf8_bits) {
-		// UTF-8 continuation character
-		case UTF8_FIRST_BIT:
-			return CHAR_UTF8_CONT;
-		// UTF-8 start character
-		case UTF8_FIRST_BIT | UTF8_SECOND_BIT:
-			return CHAR_UTF8_START;
-	}
+static int fill_ring(struct lex_source *source, ssize_t index)
+{
+	const struct scallop_stream_lexer *stream = source->stream;
+	if (index < stream->released || stream->written <= index)
+		return 0;
+
+	const ssize_t ring_index = index % stream->capacity;
+	ssize_t length = stream->capacity - ring_index;
+	if (stream->written - index < length)
+		length = stream->written - index;
 
-	return CHAR_UNKNOWN;
+	source->begin = stream->buffer + ring_index;
+	source->end = source->begin + length;
+	source->offset = index;
+	return 1;
+}
+
+static char get_char(struct lex_source *source, ssize_t index)
+{
+	const ssize_t window_index = index - source->offset;
+	if (0 <= window_index && window_index < source->end - source->begin)
+		return source->begin[window_index];
+	if (!source->fill || index < 0 || !source->fill(source, index))
+		return 0;
+	return source->begin[0];
+}
+
+static enum CHAR_TYPE char_type(char character)
+{
+	return (enum CHAR_TYPE)char_types[(unsigned char)character];
 }
 
 struct next_char {
@@ -109,611 +170,787 @@ struct next_char {
 	struct scallop_parse_token token;
 };
 
-static struct next_char next_char(
-	csalt_store *store,
-	struct scallop_parse_token token
+static inline struct next_char next_char(
+	struct lex_source *source,
+	struct scallop_parse_token token,
+	const int track_position
 )
 {
-	char c = get_char(store, ++token.end_offset);
-	char is_newline = c == '\n';
+	char c = get_char(source, ++token.end_offset);
 	enum CHAR_TYPE type = char_type(c);
-	char is_utf8_cont = type == CHAR_UTF8_CONT;
-	token.row += is_newline;
-	token.col = is_newline ? 1 :
-		is_utf8_cont? token.col: token.col + 1;
+	if (track_position) {
+		char is_newline = c == '\n';
+		char is_utf8_cont = type == CHAR_UTF8_CONT;
+		token.row += is_newline;
+		token.col = is_newline ? 1 :
+			is_utf8_cont? token.col: token.col + 1;
+	}
 	return (struct next_char) {
 		type,
 		token,
 	};
 }
 
-typedef struct scallop_parse_token lex_fn(
-	csalt_store *,
-	struct scallop_parse_token
-);
-
-struct scallop_parse_token lex_error(
-	csalt_store *store,
+/*
+ * Only characters that aren't valid UTF-8, or that the
+ * lexer has no use for, get here. The error is an EOF
+ * token starting at -1, ending on the character.
+ */
+static struct scallop_parse_token lex_error(
+	struct lex_source *source,
 	struct scallop_parse_token token
 )
 {
-	(void)store;
-	(void)token;
-	assert(!"`lex_fn *lex_error` should never be called!");
+	(void)source;
 	return (struct scallop_parse_token) {
 		.token = SCALLOP_TOKEN_EOF,
 		.start_offset = -1,
-		.end_offset = -1,
+		.end_offset = token.end_offset,
+		.row = token.row,
+		.col = token.col,
 	};
 }
 
 /*
- * State-transition-table-lite
- *
- * While this struct and function might let
- * us use one large state transition table
- * for all transitions (and only need one
- * function), it's a slow run-time linear
- * search, so I've separated out the "initial
- * states" into separate functions.
- *
- * It's still a linear search at run-time,
- * but only for the states we know start from
- * the current state, instead of all states.
- *
- * Of course, C++ gives you constexpr, which
- * is the _correct_ way to solve this problem...
- * but I don't fancy going through macros or
- * code generation to do this "properly" in C.
+ * The token type that entering each state marks the
+ * current token as. States without an entry leave
+ * the token type alone.
  */
-struct state_transition_row {
-	enum CHAR_TYPE input;
-	lex_fn *new_state;
+static const struct {
+	char sets_token;
+	enum SCALLOP_TOKEN token;
+} state_tokens[LEX_STATE_COUNT] = {
+	[LEX_UTF8_START] = { 1, SCALLOP_TOKEN_WORD },
+	[LEX_QUOTED_STRING] = { 1, SCALLOP_TOKEN_WORD },
+	[LEX_DOUBLE_QUOTED_STRING] = { 1, SCALLOP_TOKEN_WORD },
+	[LEX_WORD] = { 1, SCALLOP_TOKEN_WORD },
+	[LEX_WORD_SEPARATOR] = { 1, SCALLOP_TOKEN_WORD_SEPARATOR },
+	[LEX_STATEMENT_SEPARATOR] = { 1, SCALLOP_TOKEN_STATEMENT_SEPARATOR },
+	[LEX_OPEN_CURLY_BRACKET] = { 1, SCALLOP_TOKEN_OPEN_CURLY_BRACKET },
+	[LEX_CLOSE_CURLY_BRACKET] = { 1, SCALLOP_TOKEN_CLOSE_CURLY_BRACKET },
+	[LEX_OPEN_SQUARE_BRACKET] = { 1, SCALLOP_TOKEN_OPEN_SQUARE_BRACKET },
+	[LEX_CLOSE_SQUARE_BRACKET] = { 1, SCALLOP_TOKEN_CLOSE_SQUARE_BRACKET },
+	[LEX_PIPE] = { 1, SCALLOP_TOKEN_PIPE },
+	[LEX_BINARY_PIPE] = { 1, SCALLOP_TOKEN_BINARY_PIPE },
 };
 
-static lex_fn *transition_state_bounds(
-	const struct state_transition_row *rows_begin,
-	const struct state_transition_row *rows_end,
-	const enum CHAR_TYPE input
-)
-{
-	for (
-		const struct state_transition_row *current = rows_begin;
-		current < rows_end;
-		current++
-	) {
-		if (input == current->input) {
-			return current->new_state;
-		}
-	}
-	return lex_error;
-}
-
-#define transition_state(array, input) \
-	transition_state_bounds((array), arrend(array), input)
-
-struct scallop_parse_token lex_end(
-	csalt_store *,
-	struct scallop_parse_token
-);
-struct scallop_parse_token lex_eof(
-	csalt_store *,
-	struct scallop_parse_token
-);
-struct scallop_parse_token lex_utf8_start(
-	csalt_store *,
-	struct scallop_parse_token
-);
-struct scallop_parse_token lex_utf8_cont(
-	csalt_store *,
-	struct scallop_parse_token
-);
-struct scallop_parse_token lex_quoted_utf8_start(
-	csalt_store *,
-	struct scallop_parse_token
-);
-struct scallop_parse_token lex_quoted_utf8_cont(
-	csalt_store *,
-	struct scallop_parse_token
-);
-struct scallop_parse_token lex_word_separator(
-	csalt_store *,
-	struct scallop_parse_token
-);
-struct scallop_parse_token lex_statement_separator(
-	csalt_store *,
-	struct scallop_parse_token
-);
-struct scallop_parse_token lex_quoted_string(
-	csalt_store *,
-	struct scallop_parse_token
-);
-struct scallop_parse_token lex_end_quoted_string(
-	csalt_store *,
-	struct scallop_parse_token
-);
-struct scallop_parse_token lex_double_quoted_utf8_start(
-	csalt_store *,
-	struct scallop_parse_token
-);
-struct scallop_parse_token lex_double_quoted_utf8_cont(
-	csalt_store *,
-	struct scallop_parse_token
-);
-struct scallop_parse_token lex_double_quoted_string(
-	csalt_store *,
-	struct scallop_parse_token
-);
-struct scallop_parse_token lex_end_double_quoted_string(
-	csalt_store *,
-	struct scallop_parse_token
-);
-struct scallop_parse_token lex_open_curly_bracket(
-	csalt_store *,
-	struct scallop_parse_token
-);
-struct scallop_parse_token lex_close_curly_bracket(
-	csalt_store *,
-	struct scallop_parse_token
-);
-struct scallop_parse_token lex_open_square_bracket(
-	csalt_store *,
-	struct scallop_parse_token
-);
-struct scallop_parse_token lex_close_square_bracket(
-	csalt_store *,
-	struct scallop_parse_token
-);
-struct scallop_parse_token lex_word(
-	csalt_store *,
-	struct scallop_parse_token
-);
-struct scallop_parse_token lex_escape_word(
-	csalt_store *,
-	struct scallop_parse_token
-);
-struct scallop_parse_token lex_escape_quoted_string(
-	csalt_store *,
-	struct scallop_parse_token
-);
-struct scallop_parse_token lex_escape_double_quoted_string(
-	csalt_store *,
-	struct scallop_parse_token
-);
-struct scallop_parse_token lex_begin(
-	csalt_store *,
-	struct scallop_parse_token
-);
+/*
+ * The flags entering each state adds to the current
+ * token. Runs can step over UTF-8 characters without
+ * entering their states, so they add
+ * SCALLOP_TOKEN_NON_ASCII themselves.
+ */
+static const uint32_t state_flags[LEX_STATE_COUNT] = {
+	[LEX_UTF8_START] = SCALLOP_TOKEN_NON_ASCII,
+	[LEX_QUOTED_UTF8_START] = SCALLOP_TOKEN_NON_ASCII,
+	[LEX_DOUBLE_QUOTED_UTF8_START] = SCALLOP_TOKEN_NON_ASCII,
+	[LEX_QUOTED_STRING] = SCALLOP_TOKEN_QUOTED,
+	[LEX_DOUBLE_QUOTED_STRING] = SCALLOP_TOKEN_DOUBLE_QUOTED,
+	[LEX_ESCAPE_WORD] = SCALLOP_TOKEN_ESCAPED,
+	[LEX_ESCAPE_QUOTED_STRING] = SCALLOP_TOKEN_ESCAPED,
+	[LEX_ESCAPE_DOUBLE_QUOTED_STRING] = SCALLOP_TOKEN_ESCAPED,
+};
 
 /*
- * Whichever token we're currently lexing, return it
+ * Skips the characters following the current one
+ * that wouldn't change the state, as far as the
+ * current window goes.
  */
-struct scallop_parse_token lex_end(
-	csalt_store *store,
-	struct scallop_parse_token token
+static inline struct scallop_parse_token skip_run(
+	struct lex_source *source,
+	enum LEX_STATE *state,
+	struct scallop_parse_token token,
+	const int track_position
 )
 {
+	const struct run_class *run_class = &run_classes[*state];
+	if (!lex_skip_run || !run_class->enabled)
+		return token;
+
+	const ssize_t window_index = token.end_offset + 1 - source->offset;
+	if (window_index < 0 || source->end - source->begin <= window_index)
+		return token;
+
+	int64_t row = token.row, col = token.col;
+	const struct lex_run run = lex_skip_run(
+		run_class,
+		source->begin + window_index,
+		source->end,
+		&row,
+		&col
+	);
+	if (track_position) {
+		token.row = row;
+		token.col = col;
+	}
+	if (run.has_utf8)
+		token.flags |= SCALLOP_TOKEN_NON_ASCII;
+	if (run.length) {
+		token.end_offset += run.length;
+		*state = run.ends_in_utf8 ?
+			run_class->utf8_state :
+			run_class->ascii_state;
+	}
 	return token;
 }
 
-struct scallop_parse_token lex_eof(
-	csalt_store *store,
+/*
+ * In a validated source, a UTF-8 start character is
+ * always followed by as many continuation characters
+ * as it says. Those move the state on once, and then
+ * keep it there, without counting towards col; so
+ * they can be skipped together, once the start
+ * character's state has had its say on the token.
+ */
+static inline struct scallop_parse_token skip_utf8_cont(
+	const struct lex_source *source,
+	enum LEX_STATE *state,
 	struct scallop_parse_token token
 )
 {
-	token.token = SCALLOP_TOKEN_EOF;
-	++token.end_offset;
+	if (*state == LEX_END || *state == LEX_ERROR)
+		return token;
+	if (state_tokens[*state].sets_token)
+		token.token = state_tokens[*state].token;
+	token.flags |= state_flags[*state];
+
+	const unsigned char start =
+		(unsigned char)source->begin[token.end_offset - source->offset];
+	token.end_offset += start >= 0xF0 ? 3 : start >= 0xE0 ? 2 : 1;
+	*state = state_transitions[*state][CHAR_UTF8_CONT];
 	return token;
 }
 
-struct scallop_parse_token lex_utf8_start(
-	csalt_store *store,
-	struct scallop_parse_token token
+/*
+ * Interning hashes plain words as they're scanned:
+ * every step folds in the characters it's just moved
+ * over, runs and all, while they're still in the
+ * window, so the word isn't read a second time once
+ * it's finished. Words that turn out to be quoted or
+ * escaped stop being hashed there, as their values
+ * aren't their bytes. Only memory sources are hashed,
+ * as they're the only ones whose window covers the
+ * whole token.
+ */
+#define UNINTERNED_FLAGS \
+	(SCALLOP_TOKEN_QUOTED | SCALLOP_TOKEN_DOUBLE_QUOTED | SCALLOP_TOKEN_ESCAPED)
+
+struct lex_hash {
+	uint32_t value;
+	// The offset of the first character not hashed yet
+	int64_t end;
+};
+
+static inline void hash_scanned(
+	const struct lex_source *source,
+	struct lex_hash *hash,
+	const struct scallop_parse_token *token
 )
 {
-	const struct next_char current_char = next_char(store, token);
-	const enum CHAR_TYPE input = current_char.type;
-	token = current_char.token;
-	token.token = SCALLOP_TOKEN_WORD;
-	static const struct state_transition_row transitions[] = {
-		{ CHAR_UTF8_CONT, lex_utf8_cont },
-	};
-
-	return transition_state(transitions, input)(store, token);
+	if (token->flags & UNINTERNED_FLAGS)
+		return;
+	const char *current = source->begin + hash->end;
+	const char *end = source->begin + token->end_offset + 1;
+	if (end > source->end)
+		end = source->end;
+	uint32_t value = hash->value;
+	for (; current < end; current++)
+		value = scallop_symbol_hash_step(value, *current);
+	hash->value = value;
+	hash->end = token->end_offset + 1;
 }
 
-struct scallop_parse_token lex_utf8_cont(
-	csalt_store *store,
-	struct scallop_parse_token token
+/*
+ * This used to be one function per state, each
+ * calling the next; but that only runs in constant
+ * stack space if the compiler turns them all into
+ * tail calls, which it won't at -O0 or under
+ * sanitizers. So the state is just a variable now,
+ * which also lets us stop part-way through a token
+ * when a stream runs dry, and carry on later.
+ *
+ * Every token is returned with its end_offset on the
+ * first character of the next token, with row/col
+ * already accounting for it, so to begin we only need
+ * to peek at that character.
+ *
+ * Returns 1 when the token is finished, or 0 if the
+ * source ran out first; state and token are updated
+ * either way.
+ *
+ * Without track_position, row and col are left alone,
+ * for callers that work them out later if at all.
+ * With a hash, it's restarted along with the token,
+ * and covers its characters as long as it's plain.
+ */
+__attribute__((always_inline))
+static inline int lex_resume_tracking(
+	struct lex_source *source,
+	enum LEX_STATE *state_out,
+	struct scallop_parse_token *token_out,
+	const int track_position,
+	struct lex_hash *hash
 )
 {
-	const struct next_char current_char = next_char(store, token);
-	const enum CHAR_TYPE input = current_char.type;
-	token = current_char.token;
-	static const struct state_transition_row transitions[] = {
-		{ CHAR_UTF8_START, lex_utf8_start },
-		{ CHAR_UTF8_CONT, lex_utf8_cont },
-		{ CHAR_ASCII_PRINTABLE, lex_word },
-		{ CHAR_BACKSLASH, lex_escape_word },
-		{ CHAR_WORD_SEPARATOR, lex_end },
-		{ CHAR_STATEMENT_SEPARATOR, lex_end },
-		{ CHAR_OPEN_CURLY_BRACKET, lex_end },
-		{ CHAR_CLOSE_CURLY_BRACKET, lex_end },
-		{ CHAR_OPEN_SQUARE_BRACKET, lex_end },
-		{ CHAR_CLOSE_SQUARE_BRACKET, lex_end },
-		{ CHAR_NULL, lex_end },
-	};
+	enum LEX_STATE state = *state_out;
+	struct scallop_parse_token token = *token_out;
+	int finished = 0;
+
+	if (state == LEX_BEGIN) {
+		token.flags = 0;
+		if (hash)
+			*hash = (struct lex_hash) { SCALLOP_SYMBOL_HASH_INIT, token.end_offset };
+		if (source->available_end <= token.end_offset)
+			goto pause;
+		const enum CHAR_TYPE input =
+			char_type(get_char(source, token.end_offset));
+		state = state_transitions[LEX_BEGIN][input];
+		if (input == CHAR_UTF8_START && source->utf8_validated)
+			token = skip_utf8_cont(source, &state, token);
+	}
+
+	for (;;) {
+		switch (state) {
+			case LEX_END:
+				finished = 1;
+				goto pause;
+			case LEX_EOF:
+				token.token = SCALLOP_TOKEN_EOF;
+				++token.end_offset;
+				finished = 1;
+				goto pause;
+			case LEX_ERROR:
+				token = lex_error(source, token);
+				finished = 1;
+				goto pause;
+			default:
+				break;
+		}
+
+		if (state_tokens[state].sets_token)
+			token.token = state_tokens[state].token;
+		token.flags |= state_flags[state];
+
+		token = skip_run(source, &state, token, track_position);
+		if (hash)
+			hash_scanned(source, hash, &token);
+		if (source->available_end <= token.end_offset + 1)
+			goto pause;
+		const struct next_char current_char =
+			next_char(source, token, track_position);
+		token = current_char.token;
+		state = state_transitions[state][current_char.type];
+		if (current_char.type == CHAR_UTF8_START && source->utf8_validated)
+			token = skip_utf8_cont(source, &state, token);
+	}
 
-	return transition_state(transitions, input)(store, token);
+pause:
+	*state_out = state;
+	*token_out = token;
+	return finished;
 }
 
-struct scallop_parse_token lex_quoted_utf8_start(
-	csalt_store *store,
-	struct scallop_parse_token token
+static int lex_resume(
+	struct lex_source *source,
+	enum LEX_STATE *state_out,
+	struct scallop_parse_token *token_out
 )
 {
-	const struct next_char current_char = next_char(store, token);
-	const enum CHAR_TYPE input = current_char.type;
-	token = current_char.token;
-	static const struct state_transition_row transitions[] = {
-		{ CHAR_UTF8_CONT, lex_quoted_utf8_cont },
-	};
-
-	return transition_state(transitions, input)(store, token);
+	return lex_resume_tracking(source, state_out, token_out, 1, NULL);
 }
 
-struct scallop_parse_token lex_quoted_utf8_cont(
-	csalt_store *store,
+static struct scallop_parse_token lex_begin(
+	struct lex_source *source,
 	struct scallop_parse_token token
 )
 {
-	const struct next_char current_char = next_char(store, token);
-	const enum CHAR_TYPE input = current_char.type;
-	token = current_char.token;
-	static const struct state_transition_row transitions[] = {
-		{ CHAR_ASCII_PRINTABLE, lex_quoted_string },
-		{ CHAR_WORD_SEPARATOR, lex_quoted_string },
-		{ CHAR_STATEMENT_SEPARATOR, lex_quoted_string },
-		{ CHAR_DOUBLE_QUOTE, lex_quoted_string },
-		{ CHAR_WORD_SEPARATOR, lex_quoted_string },
-		{ CHAR_OPEN_CURLY_BRACKET, lex_quoted_string },
-		{ CHAR_CLOSE_CURLY_BRACKET, lex_quoted_string },
-		{ CHAR_OPEN_SQUARE_BRACKET, lex_quoted_string },
-		{ CHAR_CLOSE_SQUARE_BRACKET, lex_quoted_string },
-		{ CHAR_UTF8_START, lex_quoted_utf8_start },
-		{ CHAR_UTF8_CONT, lex_quoted_utf8_cont },
-		{ CHAR_QUOTE, lex_end },
-	};
-
-	return transition_state(transitions, input)(store, token);
+	enum LEX_STATE state = LEX_BEGIN;
+	lex_resume(source, &state, &token);
+	return token;
 }
 
-struct scallop_parse_token lex_quoted_string(
-	csalt_store *store,
-	struct scallop_parse_token token
+static struct scallop_parse_token *lex_batch(
+	struct lex_source *source,
+	struct scallop_parse_token token,
+	struct scallop_parse_token *tokens_begin,
+	struct scallop_parse_token *tokens_end
 )
 {
-	const struct next_char current_char = next_char(store, token);
-	const enum CHAR_TYPE input = current_char.type;
-	token = current_char.token;
-	token.token = SCALLOP_TOKEN_WORD;
-	static const struct state_transition_row transitions[] = {
-		{ CHAR_ASCII_PRINTABLE, lex_quoted_string },
-		{ CHAR_UTF8_START, lex_quoted_utf8_start },
-		{ CHAR_WORD_SEPARATOR, lex_quoted_string },
-		{ CHAR_STATEMENT_SEPARATOR, lex_quoted_string },
-		{ CHAR_DOUBLE_QUOTE, lex_quoted_string },
-		{ CHAR_OPEN_CURLY_BRACKET, lex_quoted_string },
-		{ CHAR_CLOSE_CURLY_BRACKET, lex_quoted_string },
-		{ CHAR_OPEN_SQUARE_BRACKET, lex_quoted_string },
-		{ CHAR_CLOSE_SQUARE_BRACKET, lex_quoted_string },
-		{ CHAR_BACKSLASH, lex_escape_quoted_string },
-		{ CHAR_QUOTE, lex_end_quoted_string },
-	};
-
-	return transition_state(transitions, input)(store, token);
+	struct scallop_parse_token *current = tokens_begin;
+	while (current < tokens_end) {
+		token.start_offset = token.end_offset;
+		token = lex_begin(source, token);
+		*current++ = token;
+		if (token.token == SCALLOP_TOKEN_EOF)
+			break;
+	}
+	return current;
 }
 
-struct scallop_parse_token lex_end_quoted_string(
-	csalt_store *store,
+struct scallop_parse_token scallop_lex(
+	csalt_store *source,
 	struct scallop_parse_token token
 )
 {
-	const struct next_char current_char = next_char(store, token);
-	const enum CHAR_TYPE input = current_char.type;
-	token = current_char.token;
-	static const struct state_transition_row transitions[] = {
-		{ CHAR_WORD_SEPARATOR, lex_end },
-		{ CHAR_STATEMENT_SEPARATOR, lex_end },
-		{ CHAR_ASCII_PRINTABLE, lex_word },
-		{ CHAR_UTF8_START, lex_utf8_start },
-		{ CHAR_QUOTE, lex_quoted_string },
-		{ CHAR_DOUBLE_QUOTE, lex_double_quoted_string },
-		{ CHAR_BACKSLASH, lex_escape_word },
-		{ CHAR_OPEN_CURLY_BRACKET, lex_end },
-		{ CHAR_CLOSE_CURLY_BRACKET, lex_end },
-		{ CHAR_OPEN_SQUARE_BRACKET, lex_end },
-		{ CHAR_CLOSE_SQUARE_BRACKET, lex_end },
-		{ CHAR_NULL, lex_eof },
-	};
-
-	return transition_state(transitions, input)(store, token);
+	// Tokens are usually short, so don't read
+	// a whole chunk we're going to throw away
+	struct lex_source lex_source = lex_source_store(source, LEX_TOKEN_CHUNK_SIZE);
+	token.start_offset = token.end_offset;
+	return lex_begin(&lex_source, token);
 }
 
-struct scallop_parse_token lex_double_quoted_utf8_start(
-	csalt_store *store,
-	struct scallop_parse_token token
+struct scallop_parse_token *scallop_lex_batch(
+	csalt_store *source,
+	struct scallop_parse_token token,
+	struct scallop_parse_token *tokens_begin,
+	struct scallop_parse_token *tokens_end
 )
 {
-	const struct next_char current_char = next_char(store, token);
-	const enum CHAR_TYPE input = current_char.type;
-	token = current_char.token;
-	static const struct state_transition_row transitions[] = {
-		{ CHAR_UTF8_CONT, lex_double_quoted_utf8_cont },
-	};
-
-	return transition_state(transitions, input)(store, token);
+	struct lex_source lex_source = lex_source_store(source, LEX_CHUNK_SIZE);
+	return lex_batch(&lex_source, token, tokens_begin, tokens_end);
 }
 
-struct scallop_parse_token lex_double_quoted_utf8_cont(
-	csalt_store *store,
+struct scallop_parse_token scallop_lex_memory(
+	const char *begin,
+	const char *end,
 	struct scallop_parse_token token
 )
 {
-	const struct next_char current_char = next_char(store, token);
-	const enum CHAR_TYPE input = current_char.type;
-	token = current_char.token;
-	static const struct state_transition_row transitions[] = {
-		{ CHAR_ASCII_PRINTABLE, lex_double_quoted_string },
-		{ CHAR_WORD_SEPARATOR, lex_double_quoted_string },
-		{ CHAR_STATEMENT_SEPARATOR, lex_double_quoted_string },
-		{ CHAR_QUOTE, lex_double_quoted_string },
-		{ CHAR_OPEN_CURLY_BRACKET, lex_double_quoted_string },
-		{ CHAR_CLOSE_CURLY_BRACKET, lex_double_quoted_string },
-		{ CHAR_OPEN_SQUARE_BRACKET, lex_double_quoted_string },
-		{ CHAR_CLOSE_SQUARE_BRACKET, lex_double_quoted_string },
-		{ CHAR_UTF8_START, lex_double_quoted_utf8_start },
-		{ CHAR_UTF8_CONT, lex_double_quoted_utf8_cont },
-		{ CHAR_DOUBLE_QUOTE, lex_end },
-	};
-
-	return transition_state(transitions, input)(store, token);
+	struct lex_source lex_source = lex_source_memory(begin, end);
+	token.start_offset = token.end_offset;
+	return lex_begin(&lex_source, token);
 }
 
-struct scallop_parse_token lex_double_quoted_string(
-	csalt_store *store,
-	struct scallop_parse_token token
+struct scallop_parse_token *scallop_lex_memory_batch(
+	const char *begin,
+	const char *end,
+	struct scallop_parse_token token,
+	struct scallop_parse_token *tokens_begin,
+	struct scallop_parse_token *tokens_end
 )
 {
-	const struct next_char current_char = next_char(store, token);
-	const enum CHAR_TYPE input = current_char.type;
-	token = current_char.token;
-	token.token = SCALLOP_TOKEN_WORD;
-	static const struct state_transition_row transitions[] = {
-		{ CHAR_ASCII_PRINTABLE, lex_double_quoted_string },
-		{ CHAR_WORD_SEPARATOR, lex_double_quoted_string },
-		{ CHAR_STATEMENT_SEPARATOR, lex_double_quoted_string },
-		{ CHAR_QUOTE, lex_double_quoted_string },
-		{ CHAR_UTF8_START, lex_double_quoted_utf8_start },
-		{ CHAR_DOUBLE_QUOTE, lex_end_double_quoted_string },
-		{ CHAR_OPEN_CURLY_BRACKET, lex_double_quoted_string },
-		{ CHAR_CLOSE_CURLY_BRACKET, lex_double_quoted_string },
-		{ CHAR_OPEN_SQUARE_BRACKET, lex_double_quoted_string },
-		{ CHAR_CLOSE_SQUARE_BRACKET, lex_double_quoted_string },
-		{ CHAR_BACKSLASH, lex_escape_double_quoted_string },
-		{ CHAR_NULL, lex_end },
-	};
-
-	return transition_state(transitions, input)(store, token);
+	struct lex_source lex_source = lex_source_memory(begin, end);
+	return lex_batch(&lex_source, token, tokens_begin, tokens_end);
 }
 
-struct scallop_parse_token lex_end_double_quoted_string(
-	csalt_store *store,
-	struct scallop_parse_token token
+struct scallop_parse_token *scallop_lex_validated_batch(
+	const char *begin,
+	const char *end,
+	struct scallop_parse_token token,
+	struct scallop_parse_token *tokens_begin,
+	struct scallop_parse_token *tokens_end
 )
 {
-	// identical to quoted_string
-	return lex_end_quoted_string(store, token);
+	struct lex_source lex_source = lex_source_memory(begin, end);
+	lex_source.utf8_validated = 1;
+	return lex_batch(&lex_source, token, tokens_begin, tokens_end);
 }
 
-struct scallop_parse_token lex_word_separator(
-	csalt_store *store,
-	struct scallop_parse_token token
+struct scallop_parse_token *scallop_lex_memory_interned_batch(
+	const char *begin,
+	const char *end,
+	struct scallop_parse_token token,
+	struct scallop_symbols *symbols,
+	struct scallop_parse_token *tokens_begin,
+	struct scallop_parse_token *tokens_end,
+	uint32_t *symbols_out
 )
 {
-	const struct next_char current_char = next_char(store, token);
-	const enum CHAR_TYPE input = current_char.type;
-	token = current_char.token;
-	token.token = SCALLOP_TOKEN_WORD_SEPARATOR;
-	static const struct state_transition_row transitions[] = {
-		{ CHAR_WORD_SEPARATOR, lex_word_separator },
-		{ CHAR_BACKSLASH, lex_end },
-		{ CHAR_ASCII_PRINTABLE, lex_end },
-		{ CHAR_QUOTE, lex_end },
-		{ CHAR_DOUBLE_QUOTE, lex_end },
-		{ CHAR_UTF8_START, lex_end },
-		{ CHAR_OPEN_CURLY_BRACKET, lex_end },
-		{ CHAR_CLOSE_CURLY_BRACKET, lex_end },
-		{ CHAR_OPEN_SQUARE_BRACKET, lex_end },
-		{ CHAR_CLOSE_SQUARE_BRACKET, lex_end },
-		{ CHAR_NULL, lex_end },
-	};
+	struct lex_source lex_source = lex_source_memory(begin, end);
+	struct scallop_parse_token *current = tokens_begin;
+	while (current < tokens_end) {
+		enum LEX_STATE state = LEX_BEGIN;
+		struct lex_hash hash;
+		token.start_offset = token.end_offset;
+		lex_resume_tracking(&lex_source, &state, &token, 1, &hash);
+
+		uint32_t symbol = SCALLOP_SYMBOL_NONE;
+		if (
+			token.token == SCALLOP_TOKEN_WORD
+			&& !(token.flags & UNINTERNED_FLAGS)
+		) {
+			assert(hash.end == token.end_offset);
+			symbol = scallop_symbols_intern_hashed(
+				symbols,
+				begin + token.start_offset,
+				token.end_offset - token.start_offset,
+				hash.value
+			);
+		}
+		symbols_out[current - tokens_begin] = symbol;
+		*current++ = token;
+		if (token.token == SCALLOP_TOKEN_EOF)
+			break;
+	}
+	return current;
+}
 
-	return transition_state(transitions, input)(store, token);
+static int32_t opening_bracket(int32_t close)
+{
+	return close == SCALLOP_TOKEN_CLOSE_CURLY_BRACKET ?
+		SCALLOP_TOKEN_OPEN_CURLY_BRACKET :
+		SCALLOP_TOKEN_OPEN_SQUARE_BRACKET;
 }
 
-struct scallop_parse_token lex_word(
-	csalt_store *store,
-	struct scallop_parse_token token
+/*
+ * The brackets still open form a stack, which is kept
+ * in their own matches entries until they're closed:
+ * each holds -2 - the index of the bracket enclosing
+ * it, so the outermost one holds -1.
+ */
+struct scallop_parse_token *scallop_lex_memory_brackets(
+	const char *begin,
+	const char *end,
+	struct scallop_parse_token *tokens_begin,
+	struct scallop_parse_token *tokens_end,
+	ssize_t *matches,
+	struct scallop_bracket_match *unmatched
 )
 {
-	const struct next_char current_char = next_char(store, token);
-	const enum CHAR_TYPE input = current_char.type;
-	token = current_char.token;
-	token.token = SCALLOP_TOKEN_WORD;
-	static const struct state_transition_row transitions[] = {
-		{ CHAR_ASCII_PRINTABLE, lex_word },
-		{ CHAR_UTF8_START, lex_utf8_start },
-		{ CHAR_BACKSLASH, lex_escape_word },
-		{ CHAR_QUOTE, lex_quoted_string },
-		{ CHAR_DOUBLE_QUOTE, lex_double_quoted_string },
-		{ CHAR_WORD_SEPARATOR, lex_end },
-		{ CHAR_STATEMENT_SEPARATOR, lex_end },
-		{ CHAR_OPEN_CURLY_BRACKET, lex_end },
-		{ CHAR_CLOSE_CURLY_BRACKET, lex_end },
-		{ CHAR_OPEN_SQUARE_BRACKET, lex_end },
-		{ CHAR_CLOSE_SQUARE_BRACKET, lex_end },
-		{ CHAR_NULL, lex_end},
-	};
+	struct lex_source lex_source = lex_source_memory(begin, end);
+	struct scallop_parse_token token = { 0 };
+	ssize_t innermost = -1;
+	*unmatched = (struct scallop_bracket_match) { -1, -1 };
+
+	struct scallop_parse_token *current = tokens_begin;
+	while (current < tokens_end) {
+		token.start_offset = token.end_offset;
+		token = lex_begin(&lex_source, token);
+		const ssize_t index = current - tokens_begin;
+		*current++ = token;
+		matches[index] = -1;
+
+		switch (token.token) {
+			case SCALLOP_TOKEN_OPEN_CURLY_BRACKET:
+			case SCALLOP_TOKEN_OPEN_SQUARE_BRACKET:
+				matches[index] = -2 - innermost;
+				innermost = index;
+				continue;
+			case SCALLOP_TOKEN_CLOSE_CURLY_BRACKET:
+			case SCALLOP_TOKEN_CLOSE_SQUARE_BRACKET:
+				if (
+					innermost < 0
+					|| tokens_begin[innermost].token != opening_bracket(token.token)
+				)
+					break;
+				const ssize_t enclosing = -2 - matches[innermost];
+				matches[innermost] = index;
+				matches[index] = innermost;
+				innermost = enclosing;
+				continue;
+			case SCALLOP_TOKEN_EOF:
+				if (innermost < 0)
+					return current;
+				break;
+			default:
+				continue;
+		}
 
-	return transition_state(transitions, input)(store, token);
+		*unmatched = (struct scallop_bracket_match) { innermost, index };
+		break;
+	}
+
+	while (innermost >= 0) {
+		const ssize_t enclosing = -2 - matches[innermost];
+		matches[innermost] = -1;
+		innermost = enclosing;
+	}
+	return current;
 }
 
-struct scallop_parse_token lex_open_curly_bracket(
-	csalt_store *store,
-	struct scallop_parse_token token
+/*
+ * A token depends only on the characters from its
+ * start up to and including the one at its end_offset,
+ * so the first token that could have changed is the
+ * first one whose end_offset reaches the edit.
+ */
+static ssize_t first_edited_token(
+	const struct scallop_parse_token *tokens,
+	ssize_t count,
+	int64_t offset
 )
 {
-	token.token = SCALLOP_TOKEN_OPEN_CURLY_BRACKET;
-	++token.end_offset;
-	return token;
+	ssize_t low = 0, high = count;
+	while (low < high) {
+		const ssize_t middle = low + (high - low) / 2;
+		if (tokens[middle].end_offset < offset)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low;
 }
 
-struct scallop_parse_token lex_close_curly_bracket(
-	csalt_store *store,
-	struct scallop_parse_token token
+/*
+ * Every token begins in the same state, so once a new
+ * token starts where an old one did, past the edit,
+ * the rest are the same tokens moved along. Only the
+ * columns of tokens on the same line as that point
+ * can have changed, besides the rows of all of them.
+ */
+static void shift_tokens(
+	struct scallop_parse_token *tokens_begin,
+	struct scallop_parse_token *tokens_end,
+	int64_t offset_shift,
+	int64_t row_shift,
+	int64_t col_shift,
+	int64_t col_shift_row
 )
 {
-	token.token = SCALLOP_TOKEN_CLOSE_CURLY_BRACKET;
-	++token.end_offset;
-	return token;
+	for (
+		struct scallop_parse_token *current = tokens_begin;
+		current < tokens_end;
+		current++
+	) {
+		if (current->row == col_shift_row)
+			current->col += col_shift;
+		current->row += row_shift;
+		current->start_offset += offset_shift;
+		current->end_offset += offset_shift;
+	}
 }
 
-struct scallop_parse_token lex_open_square_bracket(
-	csalt_store *store,
-	struct scallop_parse_token token
+ssize_t scallop_relex_memory(
+	const char *begin,
+	const char *end,
+	struct scallop_parse_token *tokens,
+	ssize_t count,
+	ssize_t capacity,
+	struct scallop_edit edit
 )
 {
-	token.token = SCALLOP_TOKEN_OPEN_SQUARE_BRACKET;
-	++token.end_offset;
-	return token;
+	const ssize_t restart = first_edited_token(tokens, count, edit.offset);
+	const int64_t offset_shift = edit.inserted - edit.deleted;
+	const int64_t deleted_end = edit.offset + edit.deleted;
+
+	// Move the old tokens out of the way, to the end of
+	// the array, so new tokens can be written over them
+	const ssize_t old_count = count - restart;
+	struct scallop_parse_token *old = tokens + capacity - old_count;
+	struct scallop_parse_token * const old_end = tokens + capacity;
+	memmove(old, tokens + restart, old_count * sizeof(*tokens));
+
+	struct scallop_parse_token token = { 0 };
+	if (restart) {
+		token = tokens[restart - 1];
+		token.start_offset = token.end_offset;
+	} else if (old_count) {
+		token.end_offset = old->start_offset;
+	}
+	struct scallop_parse_token previous = token;
+
+	/*
+	 * Each new token is only stored once the old tokens
+	 * it replaces have been passed, so an edit which
+	 * keeps the number of tokens the same fits even
+	 * without any room to spare.
+	 */
+	struct lex_source source = lex_source_memory(begin, end);
+	struct scallop_parse_token *current = tokens + restart;
+	int unstored = 0;
+	for (;;) {
+		// Old tokens the edit reached, or the new ones have
+		// gone past, can't line up any more; the rest all
+		// start past the end of the edit
+		while (
+			old < old_end
+			&& (
+				old->start_offset < deleted_end
+				|| old->start_offset + offset_shift < token.end_offset
+			)
+		)
+			previous = *old++;
+		if (old < old_end && old->start_offset + offset_shift == token.end_offset)
+			break;
+
+		if (unstored) {
+			if (old <= current)
+				return -1;
+			*current++ = token;
+		}
+
+		token.start_offset = token.end_offset;
+		token = lex_begin(&source, token);
+		unstored = 1;
+		if (token.token == SCALLOP_TOKEN_EOF) {
+			// None of the old tokens are needed any more
+			if (old_end <= current)
+				return -1;
+			*current++ = token;
+			return current - tokens;
+		}
+	}
+	if (unstored) {
+		if (old <= current)
+			return -1;
+		*current++ = token;
+	}
+
+	// token is the last new token, and previous the
+	// old token it lines up with
+	const ssize_t tail_count = old_end - old;
+	shift_tokens(
+		old,
+		old_end,
+		offset_shift,
+		token.row - previous.row,
+		token.col - previous.col,
+		previous.row
+	);
+	memmove(current, old, tail_count * sizeof(*tokens));
+	return current - tokens + tail_count;
 }
 
-struct scallop_parse_token lex_close_square_bracket(
-	csalt_store *store,
-	struct scallop_parse_token token
-)
+int scallop_lex_memory_compact(struct scallop_token_list *list)
 {
-	token.token = SCALLOP_TOKEN_CLOSE_SQUARE_BRACKET;
-	++token.end_offset;
-	return token;
-}
+	if (list->end - list->begin >= UINT32_MAX)
+		return 0;
 
+	struct lex_source source = lex_source_memory(list->begin, list->end);
+	struct scallop_parse_token token = { 0 };
+	do {
+		enum LEX_STATE state = LEX_BEGIN;
+		token.start_offset = token.end_offset;
+		lex_resume_tracking(&source, &state, &token, 0, NULL);
+		if (!scallop_token_list_push(list, &token))
+			return 0;
+	} while (token.token != SCALLOP_TOKEN_EOF);
+	return 1;
+}
 
-struct scallop_parse_token lex_statement_separator(
-	csalt_store *store,
-	struct scallop_parse_token token
+struct scallop_stream_lexer scallop_stream_lexer_make(
+	char *buffer,
+	ssize_t capacity
 )
 {
-	const struct next_char current_char = next_char(store, token);
-	const enum CHAR_TYPE input = current_char.type;
-	token = current_char.token;
-	token.token = SCALLOP_TOKEN_STATEMENT_SEPARATOR;
-	static const struct state_transition_row transitions[] = {
-		{ CHAR_STATEMENT_SEPARATOR, lex_statement_separator },
-		{ CHAR_ASCII_PRINTABLE, lex_end },
-		{ CHAR_UTF8_START, lex_end },
-		{ CHAR_BACKSLASH, lex_end },
-		{ CHAR_QUOTE, lex_end },
-		{ CHAR_DOUBLE_QUOTE, lex_end },
-		{ CHAR_WORD_SEPARATOR, lex_end },
-		{ CHAR_OPEN_CURLY_BRACKET, lex_end },
-		{ CHAR_CLOSE_CURLY_BRACKET, lex_end },
-		{ CHAR_OPEN_SQUARE_BRACKET, lex_end },
-		{ CHAR_CLOSE_SQUARE_BRACKET, lex_end },
-		{ CHAR_NULL, lex_end },
+	// The lexer keeps the character it's on, so it needs
+	// room for at least one more to make any progress
+	if (capacity < 2) {
+		errno = EINVAL;
+		return (struct scallop_stream_lexer) { .state = LEX_BEGIN };
+	}
+	return (struct scallop_stream_lexer) {
+		.buffer = buffer,
+		.capacity = capacity,
+		.state = LEX_BEGIN,
 	};
+}
 
-	return transition_state(transitions, input)(store, token);
+ssize_t scallop_stream_space(const struct scallop_stream_lexer *lexer)
+{
+	return lexer->capacity - (lexer->written - lexer->released);
 }
 
-struct scallop_parse_token lex_escape_word(
-	csalt_store *store,
-	struct scallop_parse_token token
+ssize_t scallop_stream_write(
+	struct scallop_stream_lexer *lexer,
+	const void *data,
+	ssize_t size
 )
 {
-	const struct next_char escaped_char = next_char(store, token);
-	return lex_word(store, escaped_char.token);
+	if (!lexer->buffer) {
+		errno = EINVAL;
+		return -1;
+	}
+	const ssize_t space = scallop_stream_space(lexer);
+	if (space < size)
+		size = space;
+
+	const char *bytes = data;
+	for (ssize_t written = 0; written < size;) {
+		const ssize_t ring_index = lexer->written % lexer->capacity;
+		ssize_t length = lexer->capacity - ring_index;
+		if (size - written < length)
+			length = size - written;
+		memcpy(lexer->buffer + ring_index, bytes + written, length);
+		written += length;
+		lexer->written += length;
+	}
+	return size;
 }
 
-struct scallop_parse_token lex_escape_quoted_string(
-	csalt_store *store,
-	struct scallop_parse_token token
+ssize_t scallop_stream_read(
+	struct scallop_stream_lexer *lexer,
+	csalt_store *source
 )
 {
-	const struct next_char escaped_char = next_char(store, token);
-	return lex_quoted_string(store, escaped_char.token);
+	if (!lexer->buffer) {
+		errno = EINVAL;
+		return -1;
+	}
+	// Only up to the end of the ring, so we can read
+	// straight into it without an extra copy
+	const ssize_t ring_index = lexer->written % lexer->capacity;
+	ssize_t length = lexer->capacity - ring_index;
+	const ssize_t space = scallop_stream_space(lexer);
+	if (space < length)
+		length = space;
+	if (!length)
+		return 0;
+
+	const ssize_t result = csalt_store_read(
+		source,
+		lexer->buffer + ring_index,
+		length
+	);
+	if (result > 0)
+		lexer->written += result;
+	return result;
 }
 
-struct scallop_parse_token lex_escape_double_quoted_string(
-	csalt_store *store,
-	struct scallop_parse_token token
-)
+void scallop_stream_finish(struct scallop_stream_lexer *lexer)
 {
-	const struct next_char escaped_char = next_char(store, token);
-	return lex_double_quoted_string(store, escaped_char.token);
+	lexer->finished = 1;
 }
 
-static struct scallop_parse_token token_rewind(
-	csalt_store *store,
-	struct scallop_parse_token token
+int scallop_stream_next(
+	struct scallop_stream_lexer *lexer,
+	struct scallop_parse_token *token
 )
 {
-	--token.end_offset;
-	char c = get_char(store, token.end_offset);
-	char is_newline = c == '\n';
-	char is_utf8_cont = c & UTF8_FIRST_BIT;
-	token.row -= is_newline;
-	token.col = is_newline ? token.col :
-		is_utf8_cont ? token.col : token.col - 1;
-
-	return token;
+	struct lex_source source = lex_source_stream(lexer);
+	enum LEX_STATE state = lexer->state;
+	if (state == LEX_BEGIN)
+		lexer->token.start_offset = lexer->token.end_offset;
+
+	const int finished = lex_resume(&source, &state, &lexer->token);
+	lexer->state = finished ? LEX_BEGIN : state;
+	if (finished)
+		*token = lexer->token;
+	return finished;
 }
 
-struct scallop_parse_token lex_begin(
-	csalt_store *store,
-	struct scallop_parse_token token
+void scallop_stream_release(
+	struct scallop_stream_lexer *lexer,
+	ssize_t offset
 )
 {
-	// dirty hack to get the right char
-	token = token_rewind(store, token);
-	const struct next_char current_char = next_char(store, token);
-	const enum CHAR_TYPE input = current_char.type;
-	token = current_char.token;
-	static const struct state_transition_row transitions[] = {
-		{ CHAR_ASCII_PRINTABLE, lex_word },
-		{ CHAR_UTF8_START, lex_utf8_start },
-		{ CHAR_QUOTE, lex_quoted_string },
-		{ CHAR_DOUBLE_QUOTE, lex_double_quoted_string },
-		{ CHAR_WORD_SEPARATOR, lex_word_separator },
-		{ CHAR_BACKSLASH, lex_escape_word },
-		{ CHAR_STATEMENT_SEPARATOR, lex_statement_separator },
-		{ CHAR_OPEN_CURLY_BRACKET, lex_open_curly_bracket },
-		{ CHAR_CLOSE_CURLY_BRACKET, lex_close_curly_bracket },
-		{ CHAR_OPEN_SQUARE_BRACKET, lex_open_square_bracket },
-		{ CHAR_CLOSE_SQUARE_BRACKET, lex_close_square_bracket },
-		{ CHAR_NULL, lex_eof },
-	};
-
-	return transition_state(transitions, input)(store, token);
+	// The lexer still needs the character it's on
+	if (lexer->token.end_offset < offset)
+		offset = lexer->token.end_offset;
+	if (lexer->written < offset)
+		offset = lexer->written;
+	if (lexer->released < offset)
+		lexer->released = offset;
 }
 
-struct scallop_parse_token scallop_lex(
-	csalt_store *source,
-	struct scallop_parse_token token
+ssize_t scallop_stream_copy(
+	const struct scallop_stream_lexer *lexer,
+	ssize_t begin,
+	ssize_t end,
+	char *out
 )
 {
-	token.start_offset = token.end_offset;
-	return lex_begin(source, token);
+	if (begin < lexer->released || lexer->written < end || end < begin)
+		return -1;
+
+	for (ssize_t offset = begin; offset < end;) {
+		const ssize_t ring_index = offset % lexer->capacity;
+		ssize_t length = lexer->capacity - ring_index;
+		if (end - offset < length)
+			length = end - offset;
+		memcpy(out, lexer->buffer + ring_index, length);
+		out += length;
+		offset += length;
+	}
+	return end - begin;
 }
-
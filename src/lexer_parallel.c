@@ -0,0 +1,420 @@
+/*
+ * Scallop - a shell for executing tasks concurrently
+ * Copyright (C) 2022  Marcus Harrison
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "scallop/lexer.h"
+#include "lexer_spec.h"
+#include "lexer_tables.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+ * The input is cut into one chunk per thread, and
+ * lexed in three passes, each spread over the threads.
+ *
+ * First, we don't know what state the lexer will be in
+ * at the start of a chunk - it could be half-way
+ * through a quoted string, or just after a backslash -
+ * so each chunk is run through the state transitions
+ * from every state at once, noting where each one ends
+ * up, where its first token starts, and how many
+ * tokens finish from there on. Paths that land
+ * on the same state at the same character go the same
+ * way from then on, so they're merged; within a few
+ * characters, only the unquoted, single-quoted,
+ * double-quoted and escaped paths are usually left.
+ *
+ * Chaining those together from the start of the input
+ * is cheap, and gives the real state at the start of
+ * each chunk, and so how many tokens it has and where
+ * they go in the output. The second pass lexes each
+ * chunk's tokens for real, straight into place, from
+ * its first token up to the next chunk's first token.
+ * A chunk with no token starting in it, say in the
+ * middle of a long string, has its characters lexed by
+ * the chunk before.
+ */
+
+// Small inputs aren't worth starting threads for
+#define LEX_PARALLEL_MIN_CHUNK_SIZE (64 * 1024)
+
+typedef uint32_t state_set;
+_Static_assert(
+	LEX_STATE_COUNT <= sizeof(state_set) * 8,
+	"states don't fit in a state_set"
+);
+
+/*
+ * The state each state moves to on each byte, with
+ * LEX_END already taken through LEX_BEGIN, and the top
+ * bit set when that happens, as a new token starts.
+ */
+#define LEX_TOKEN_STARTS 0x80
+_Static_assert(LEX_STATE_COUNT < LEX_TOKEN_STARTS, "states overlap LEX_TOKEN_STARTS");
+
+static unsigned char byte_transitions[LEX_STATE_COUNT][256];
+static pthread_once_t byte_transitions_made = PTHREAD_ONCE_INIT;
+
+struct lex_chunk {
+	const char *script_begin;
+	const char *script_end;
+	ssize_t begin;
+	ssize_t end;
+
+	// For each state the chunk could start in, the state
+	// it ends up in, where its first token starts, or -1
+	// if none does, and how many tokens finish in the
+	// chunk from there on, that one included
+	unsigned char exit_state[LEX_STATE_COUNT];
+	ssize_t first_token[LEX_STATE_COUNT];
+	ssize_t finished_tokens[LEX_STATE_COUNT];
+
+	// How row and col change over the chunk, the first
+	// character of the input excepted, as next_char()
+	// never looks at it
+	int64_t rows;
+	int64_t cols;
+
+	// Where this chunk's tokens start and stop, once
+	// the entry state is known; tokens_from is -1 if the
+	// chunk has none of its own, and tokens_until is
+	// SSIZE_MAX if it has the last ones
+	struct scallop_parse_token token;
+	ssize_t tokens_from;
+	ssize_t tokens_until;
+	ssize_t token_count;
+
+	// Where in the caller's array its tokens go
+	struct scallop_parse_token *output;
+	struct scallop_parse_token *output_end;
+
+	pthread_t thread;
+	char started;
+};
+
+static void make_byte_transitions(void)
+{
+	for (int state = 0; state < LEX_STATE_COUNT; state++) {
+		for (int byte = 0; byte < 256; byte++) {
+			const enum CHAR_TYPE input = char_types[byte];
+			unsigned char next = state == LEX_END ?
+				LEX_END :
+				state_transitions[state][input];
+			if (next == LEX_END)
+				next = state_transitions[LEX_BEGIN][input] | LEX_TOKEN_STARTS;
+			byte_transitions[state][byte] = next;
+		}
+	}
+}
+
+struct lex_path {
+	enum LEX_STATE state;
+	state_set entries;
+	state_set waiting;
+	ssize_t finished_tokens;
+};
+
+/*
+ * A token finishing puts the character that finished
+ * it through LEX_BEGIN, so this only ever returns
+ * states that are part-way through a token, or
+ * LEX_ERROR; LEX_EOF goes straight to LEX_ERROR on
+ * the next character, which is just as final. Paths
+ * reaching LEX_ERROR are dropped, as that's where
+ * everything not followed to the end is left.
+ *
+ * A path counts the tokens finishing along it; an entry
+ * whose path was merged into another keeps the
+ * difference between the two counts at the time.
+ */
+static void find_exit_states(struct lex_chunk *chunk, state_set entries)
+{
+	struct lex_path paths[LEX_STATE_COUNT];
+	ssize_t merged_tokens[LEX_STATE_COUNT] = { 0 };
+	int path_count = 0;
+	for (int state = 0; state < LEX_STATE_COUNT; state++) {
+		chunk->exit_state[state] = LEX_ERROR;
+		chunk->first_token[state] = -1;
+		chunk->finished_tokens[state] = 0;
+		if (entries & (1u << state))
+			paths[path_count++] = (struct lex_path) {
+				state,
+				1u << state,
+				1u << state,
+				0,
+			};
+	}
+
+	const unsigned char *bytes = (const unsigned char *)chunk->script_begin;
+	for (ssize_t index = chunk->begin; index < chunk->end && path_count; index++) {
+		const unsigned char byte = bytes[index];
+		state_set seen = 0;
+		int owner[LEX_STATE_COUNT];
+
+		for (int i = 0; i < path_count; i++) {
+			struct lex_path *path = &paths[i];
+			unsigned char next = byte_transitions[path->state][byte];
+			// Tokens start too often to predict, but
+			// once every entry on a path has seen one,
+			// they don't matter
+			if (next & LEX_TOKEN_STARTS) {
+				for (state_set waiting = path->waiting; waiting; waiting &= waiting - 1)
+					chunk->first_token[__builtin_ctz(waiting)] = index;
+				path->waiting = 0;
+				path->finished_tokens++;
+			}
+			next &= ~LEX_TOKEN_STARTS;
+			path->state = next;
+
+			if (next == LEX_ERROR) {
+				paths[i--] = paths[--path_count];
+			} else if (seen & (1u << next)) {
+				struct lex_path *into = &paths[owner[next]];
+				for (state_set merged = path->entries; merged; merged &= merged - 1)
+					merged_tokens[__builtin_ctz(merged)] +=
+						path->finished_tokens - into->finished_tokens;
+				into->entries |= path->entries;
+				into->waiting |= path->waiting;
+				paths[i--] = paths[--path_count];
+			} else {
+				seen |= 1u << next;
+				owner[next] = i;
+			}
+		}
+	}
+
+	for (int i = 0; i < path_count; i++) {
+		for (state_set entries = paths[i].entries; entries; entries &= entries - 1) {
+			const int entry = __builtin_ctz(entries);
+			chunk->exit_state[entry] = paths[i].state;
+			chunk->finished_tokens[entry] =
+				paths[i].finished_tokens + merged_tokens[entry];
+		}
+	}
+}
+
+/*
+ * Moves row and col over the characters from begin to
+ * end the same way next_char() does.
+ */
+static void count_position(
+	const char *begin,
+	const char *end,
+	int64_t *row,
+	int64_t *col
+)
+{
+	for (const char *current = begin; current < end; current++) {
+		if (*current == '\n') {
+			++*row;
+			*col = 1;
+		} else if (char_types[(unsigned char)*current] != CHAR_UTF8_CONT) {
+			++*col;
+		}
+	}
+}
+
+static void *find_exit_states_thread(void *param)
+{
+	struct lex_chunk *chunk = param;
+
+	// The first chunk starts with nothing before it,
+	// which LEX_END stands in for; every other chunk
+	// could start in any state part-way through a token
+	state_set entries = 0;
+	if (!chunk->begin) {
+		entries = 1u << LEX_END;
+	} else {
+		for (int state = 0; state < LEX_STATE_COUNT; state++)
+			if (state != LEX_ERROR && state != LEX_END && state != LEX_EOF && state != LEX_BEGIN)
+				entries |= 1u << state;
+	}
+	find_exit_states(chunk, entries);
+
+	const ssize_t count_from = chunk->begin ? chunk->begin : 1;
+	chunk->rows = 0;
+	chunk->cols = 0;
+	count_position(
+		chunk->script_begin + count_from,
+		chunk->script_begin + chunk->end,
+		&chunk->rows,
+		&chunk->cols
+	);
+	return NULL;
+}
+
+/*
+ * Every chunk but the one with the last tokens lexes
+ * exactly as many as pass one counted, which fill its
+ * part of the output, up to the token the next chunk
+ * starts with.
+ */
+static void *lex_chunk_thread(void *param)
+{
+	struct lex_chunk *chunk = param;
+	if (chunk->output == chunk->output_end)
+		return NULL;
+
+	struct scallop_parse_token token = chunk->token;
+	count_position(
+		chunk->script_begin + (chunk->begin ? chunk->begin : 1),
+		chunk->script_begin + chunk->tokens_from + (chunk->tokens_from ? 1 : 0),
+		&token.row,
+		&token.col
+	);
+	token.end_offset = chunk->tokens_from;
+
+	struct scallop_parse_token *written = scallop_lex_memory_batch(
+		chunk->script_begin,
+		chunk->script_end,
+		token,
+		chunk->output,
+		chunk->output_end
+	);
+	assert(chunk->tokens_until == SSIZE_MAX || written == chunk->output_end);
+	assert(written[-1].end_offset <= chunk->tokens_until);
+	chunk->output_end = written;
+	return NULL;
+}
+
+/*
+ * Runs the function on every chunk, each on its own
+ * thread, apart from the first, which is run on this
+ * one. If a thread can't be started, its chunk is run
+ * here too.
+ */
+static void run_threads(
+	struct lex_chunk *chunks,
+	ssize_t chunk_count,
+	void *(*function)(void *)
+)
+{
+	for (ssize_t i = 1; i < chunk_count; i++)
+		chunks[i].started = !pthread_create(&chunks[i].thread, NULL, function, &chunks[i]);
+	function(&chunks[0]);
+	for (ssize_t i = 1; i < chunk_count; i++) {
+		if (chunks[i].started)
+			pthread_join(chunks[i].thread, NULL);
+		else
+			function(&chunks[i]);
+	}
+}
+
+/*
+ * Works out each chunk's real starting state from the
+ * one before it, and so which tokens it's responsible
+ * for, and how many.
+ */
+static void chain_chunks(struct lex_chunk *chunks, ssize_t chunk_count)
+{
+	enum LEX_STATE state = LEX_END;
+	int64_t row = 0, col = 0;
+	struct lex_chunk *last_with_tokens = NULL;
+	for (ssize_t i = 0; i < chunk_count; i++) {
+		struct lex_chunk *chunk = &chunks[i];
+		chunk->tokens_from = -1;
+		chunk->tokens_until = SSIZE_MAX;
+		chunk->token_count = 0;
+		if (state == LEX_ERROR)
+			continue;
+
+		chunk->token = (struct scallop_parse_token) {
+			.row = row,
+			.col = col,
+		};
+		chunk->tokens_from = chunk->first_token[state];
+		chunk->token_count = chunk->finished_tokens[state];
+		if (chunk->tokens_from >= 0) {
+			if (last_with_tokens)
+				last_with_tokens->tokens_until = chunk->tokens_from;
+			last_with_tokens = chunk;
+		}
+
+		state = chunk->exit_state[state];
+		if (chunk->rows) {
+			row += chunk->rows;
+			col = chunk->cols;
+		} else {
+			col += chunk->cols;
+		}
+	}
+}
+
+struct scallop_parse_token *scallop_lex_memory_parallel(
+	const char *begin,
+	const char *end,
+	int thread_count,
+	struct scallop_parse_token *tokens_begin,
+	struct scallop_parse_token *tokens_end
+)
+{
+	const ssize_t size = end - begin;
+	ssize_t chunk_count = thread_count;
+	if (size / LEX_PARALLEL_MIN_CHUNK_SIZE < chunk_count)
+		chunk_count = size / LEX_PARALLEL_MIN_CHUNK_SIZE;
+	if (chunk_count <= 1)
+		goto sequential;
+
+	struct lex_chunk *chunks = calloc(chunk_count, sizeof(*chunks));
+	if (!chunks)
+		goto sequential;
+	pthread_once(&byte_transitions_made, make_byte_transitions);
+	for (ssize_t i = 0; i < chunk_count; i++) {
+		chunks[i].script_begin = begin;
+		chunks[i].script_end = end;
+		chunks[i].begin = size * i / chunk_count;
+		chunks[i].end = size * (i + 1) / chunk_count;
+	}
+
+	run_threads(chunks, chunk_count, find_exit_states_thread);
+	chain_chunks(chunks, chunk_count);
+
+	// The last chunk with tokens gets the rest of the
+	// output, as only lexing finds where they end
+	struct scallop_parse_token *current = tokens_begin;
+	struct lex_chunk *last_with_tokens = NULL;
+	for (ssize_t i = 0; i < chunk_count; i++) {
+		struct lex_chunk *chunk = &chunks[i];
+		chunk->output = current;
+		chunk->output_end = current;
+		if (chunk->tokens_from < 0)
+			continue;
+		if (chunk->tokens_until == SSIZE_MAX || tokens_end - current < chunk->token_count)
+			chunk->output_end = tokens_end;
+		else
+			chunk->output_end = current + chunk->token_count;
+		current = chunk->output_end;
+		last_with_tokens = chunk;
+	}
+	run_threads(chunks, chunk_count, lex_chunk_thread);
+
+	current = last_with_tokens ? last_with_tokens->output_end : tokens_begin;
+	free(chunks);
+	return current;
+
+sequential:
+	return scallop_lex_memory_batch(
+		begin,
+		end,
+		(struct scallop_parse_token) { 0 },
+		tokens_begin,
+		tokens_end
+	);
+}
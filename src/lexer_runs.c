@@ -0,0 +1,403 @@
+/*
+ * Scallop - a shell for executing tasks concurrently
+ * Copyright (C) 2022  Marcus Harrison
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "lexer_runs.h"
+
+#include <stddef.h>
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define LEX_RUNS_X86
+#include <immintrin.h>
+#endif
+
+/*
+ * Kernels look at 32 characters at a time, turning
+ * them into bitmasks with one bit per character; the
+ * rest of the work is on those bitmasks, and is shared
+ * by all the kernels.
+ */
+#define RUN_BLOCK_SIZE 32
+
+struct run_masks {
+	uint32_t stays_ascii;
+	uint32_t high;
+	uint32_t cont;
+	uint32_t newline;
+};
+
+struct run_state {
+	ssize_t length;
+	int64_t row;
+	int64_t col;
+	int64_t pending_cols;
+	uint32_t prev_high;
+	char ends_in_utf8;
+	char has_utf8;
+};
+
+static inline int is_utf8_cont(char character)
+{
+	return (character & (UTF8_FIRST_BIT | UTF8_SECOND_BIT)) == UTF8_FIRST_BIT;
+}
+
+static inline uint32_t low_bits(int count)
+{
+	// count can be 32, so go via 64 bits
+	return (uint32_t)(((uint64_t)1 << count) - 1);
+}
+
+/*
+ * Returns 1 if every character in the block was part
+ * of the run, so the next block should be looked at.
+ *
+ * The run is only ever cut after an ASCII or UTF-8
+ * continuation character, since we'd need to know the
+ * next character to leave the lexer after a start
+ * character. Anything between the cut and the end of
+ * the block is "pending", and only counted if a later
+ * block extends the run past it.
+ */
+static inline int consume_masks(
+	struct run_state *state,
+	const struct run_class *run_class,
+	struct run_masks masks,
+	char next_is_cont,
+	ssize_t block_offset
+)
+{
+	uint32_t stays = masks.stays_ascii;
+	const uint32_t start = masks.high & ~masks.cont;
+	if (run_class->utf8) {
+		const uint32_t prev_high = (masks.high << 1) | state->prev_high;
+		const uint32_t next_cont =
+			(masks.cont >> 1) | ((uint32_t)next_is_cont << 31);
+		stays |= (masks.cont & prev_high) | (start & next_cont);
+	}
+
+	const uint32_t prefix = stays == UINT32_MAX ?
+		UINT32_MAX :
+		low_bits(__builtin_ctz(~stays));
+	const uint32_t counts_col = ~masks.cont;
+	const uint32_t committable = prefix & ~start;
+
+	if (committable) {
+		const int last = 31 - __builtin_clz(committable);
+		const uint32_t commit = low_bits(last + 1);
+		const uint32_t newlines = masks.newline & commit;
+
+		state->col += state->pending_cols;
+		if (newlines) {
+			const int last_newline = 31 - __builtin_clz(newlines);
+			const uint32_t after_newline = commit & ~low_bits(last_newline + 1);
+			state->row += __builtin_popcount(newlines);
+			state->col = 1 + __builtin_popcount(counts_col & after_newline);
+		} else {
+			state->col += __builtin_popcount(counts_col & commit);
+		}
+
+		state->pending_cols = __builtin_popcount(counts_col & prefix & ~commit);
+		state->length = block_offset + last + 1;
+		state->ends_in_utf8 = (masks.high >> last) & 1;
+		state->has_utf8 |= (masks.high & commit) != 0;
+	} else {
+		state->pending_cols += __builtin_popcount(counts_col & prefix);
+	}
+
+	state->prev_high = masks.high >> 31;
+	return prefix == UINT32_MAX;
+}
+
+static inline int stays_ascii(const struct run_class *run_class, char character)
+{
+	for (int i = 0; i < run_class->extra_count; i++)
+		if (character == run_class->extra[i])
+			return 1;
+	if (character < run_class->low || run_class->high < character)
+		return 0;
+	for (int i = 0; i < run_class->excluded_count; i++)
+		if (character == run_class->excluded[i])
+			return 0;
+	return 1;
+}
+
+/*
+ * Characters past lanes are treated as ending the run.
+ */
+static struct run_masks masks_scalar(
+	const struct run_class *run_class,
+	const char *block,
+	ssize_t lanes
+)
+{
+	struct run_masks masks = { 0 };
+	for (ssize_t i = 0; i < lanes; i++) {
+		const uint32_t bit = (uint32_t)1 << i;
+		const char character = block[i];
+		if (character & UTF8_FIRST_BIT) {
+			masks.high |= bit;
+			masks.cont |= is_utf8_cont(character) ? bit : 0;
+			continue;
+		}
+		masks.newline |= character == '\n' ? bit : 0;
+		masks.stays_ascii |= stays_ascii(run_class, character) ? bit : 0;
+	}
+	return masks;
+}
+
+static struct run_masks masks_scalar_block(
+	const struct run_class *run_class,
+	const char *block
+)
+{
+	return masks_scalar(run_class, block, RUN_BLOCK_SIZE);
+}
+
+typedef struct run_masks masks_fn(const struct run_class *, const char *);
+
+/*
+ * Full blocks are only used while the character after
+ * them is readable, so start characters at the end of
+ * a block can see their continuation character.
+ */
+__attribute__((always_inline))
+static inline struct lex_run skip_run(
+	const struct run_class *run_class,
+	const char *begin,
+	const char *end,
+	int64_t *row,
+	int64_t *col,
+	masks_fn *block_masks
+)
+{
+	struct run_state state = {
+		.row = *row,
+		.col = *col,
+		.prev_high = run_class->after_utf8,
+		.ends_in_utf8 = run_class->after_utf8,
+	};
+
+	const char *block = begin;
+	for (; end - block > RUN_BLOCK_SIZE; block += RUN_BLOCK_SIZE) {
+		if (!consume_masks(
+			&state,
+			run_class,
+			block_masks(run_class, block),
+			is_utf8_cont(block[RUN_BLOCK_SIZE]),
+			block - begin
+		))
+			goto done;
+	}
+	consume_masks(
+		&state,
+		run_class,
+		masks_scalar(run_class, block, end - block),
+		0,
+		block - begin
+	);
+
+done:
+	*row = state.row;
+	*col = state.col;
+	return (struct lex_run) {
+		state.length,
+		state.ends_in_utf8,
+		state.has_utf8,
+	};
+}
+
+static struct lex_run skip_run_scalar(
+	const struct run_class *run_class,
+	const char *begin,
+	const char *end,
+	int64_t *row,
+	int64_t *col
+)
+{
+	return skip_run(run_class, begin, end, row, col, masks_scalar_block);
+}
+
+#ifdef LEX_RUNS_X86
+
+static inline uint32_t masks_sse2_half(
+	const struct run_class *run_class,
+	__m128i characters,
+	uint32_t *high,
+	uint32_t *cont,
+	uint32_t *newline
+)
+{
+	const __m128i in_range = _mm_and_si128(
+		_mm_cmpgt_epi8(characters, _mm_set1_epi8(run_class->low - 1)),
+		_mm_cmplt_epi8(characters, _mm_set1_epi8(run_class->high + 1))
+	);
+	__m128i excluded = _mm_setzero_si128();
+	for (int i = 0; i < run_class->excluded_count; i++)
+		excluded = _mm_or_si128(
+			excluded,
+			_mm_cmpeq_epi8(characters, _mm_set1_epi8(run_class->excluded[i]))
+		);
+	__m128i extra = _mm_setzero_si128();
+	for (int i = 0; i < run_class->extra_count; i++)
+		extra = _mm_or_si128(
+			extra,
+			_mm_cmpeq_epi8(characters, _mm_set1_epi8(run_class->extra[i]))
+		);
+
+	*high = (uint32_t)_mm_movemask_epi8(characters);
+	// shifting moves the second-highest bit of each byte into the highest
+	const uint32_t second = (uint32_t)_mm_movemask_epi8(_mm_slli_epi16(characters, 1));
+	*cont = *high & ~second;
+	*newline = (uint32_t)_mm_movemask_epi8(
+		_mm_cmpeq_epi8(characters, _mm_set1_epi8('\n'))
+	);
+	return (uint32_t)_mm_movemask_epi8(
+		_mm_or_si128(_mm_andnot_si128(excluded, in_range), extra)
+	);
+}
+
+static struct run_masks masks_sse2(
+	const struct run_class *run_class,
+	const char *block
+)
+{
+	struct run_masks low, high;
+	low.stays_ascii = masks_sse2_half(
+		run_class,
+		_mm_loadu_si128((const __m128i *)block),
+		&low.high,
+		&low.cont,
+		&low.newline
+	);
+	high.stays_ascii = masks_sse2_half(
+		run_class,
+		_mm_loadu_si128((const __m128i *)(block + 16)),
+		&high.high,
+		&high.cont,
+		&high.newline
+	);
+	return (struct run_masks) {
+		.stays_ascii = low.stays_ascii | high.stays_ascii << 16,
+		.high = low.high | high.high << 16,
+		.cont = low.cont | high.cont << 16,
+		.newline = low.newline | high.newline << 16,
+	};
+}
+
+static struct lex_run skip_run_sse2(
+	const struct run_class *run_class,
+	const char *begin,
+	const char *end,
+	int64_t *row,
+	int64_t *col
+)
+{
+	return skip_run(run_class, begin, end, row, col, masks_sse2);
+}
+
+__attribute__((target("avx2")))
+static struct run_masks masks_avx2(
+	const struct run_class *run_class,
+	const char *block
+)
+{
+	const __m256i characters = _mm256_loadu_si256((const __m256i *)block);
+	const __m256i in_range = _mm256_and_si256(
+		_mm256_cmpgt_epi8(characters, _mm256_set1_epi8(run_class->low - 1)),
+		_mm256_cmpgt_epi8(_mm256_set1_epi8(run_class->high + 1), characters)
+	);
+	__m256i excluded = _mm256_setzero_si256();
+	for (int i = 0; i < run_class->excluded_count; i++)
+		excluded = _mm256_or_si256(
+			excluded,
+			_mm256_cmpeq_epi8(characters, _mm256_set1_epi8(run_class->excluded[i]))
+		);
+	__m256i extra = _mm256_setzero_si256();
+	for (int i = 0; i < run_class->extra_count; i++)
+		extra = _mm256_or_si256(
+			extra,
+			_mm256_cmpeq_epi8(characters, _mm256_set1_epi8(run_class->extra[i]))
+		);
+
+	const uint32_t high = (uint32_t)_mm256_movemask_epi8(characters);
+	const uint32_t second = (uint32_t)_mm256_movemask_epi8(
+		_mm256_slli_epi16(characters, 1)
+	);
+	return (struct run_masks) {
+		.stays_ascii = (uint32_t)_mm256_movemask_epi8(
+			_mm256_or_si256(_mm256_andnot_si256(excluded, in_range), extra)
+		),
+		.high = high,
+		.cont = high & ~second,
+		.newline = (uint32_t)_mm256_movemask_epi8(
+			_mm256_cmpeq_epi8(characters, _mm256_set1_epi8('\n'))
+		),
+	};
+}
+
+__attribute__((target("avx2")))
+static struct lex_run skip_run_avx2(
+	const struct run_class *run_class,
+	const char *begin,
+	const char *end,
+	int64_t *row,
+	int64_t *col
+)
+{
+	return skip_run(run_class, begin, end, row, col, masks_avx2);
+}
+
+#endif // LEX_RUNS_X86
+
+lex_skip_run_fn *lex_skip_run = NULL;
+
+int lex_use_run_kernel(enum LEX_RUN_KERNEL kernel)
+{
+	switch (kernel) {
+		case LEX_RUN_KERNEL_NONE:
+			lex_skip_run = NULL;
+			return 1;
+		case LEX_RUN_KERNEL_SCALAR:
+			lex_skip_run = skip_run_scalar;
+			return 1;
+#ifdef LEX_RUNS_X86
+		case LEX_RUN_KERNEL_SSE2:
+			lex_skip_run = skip_run_sse2;
+			return 1;
+		case LEX_RUN_KERNEL_AVX2:
+			__builtin_cpu_init();
+			if (!__builtin_cpu_supports("avx2"))
+				return 0;
+			lex_skip_run = skip_run_avx2;
+			return 1;
+#endif
+		default:
+			return 0;
+	}
+}
+
+/*
+ * The scalar kernel is slower than just running the
+ * state machine, so without SIMD we don't skip runs
+ * at all; it's only there for the ends of runs and
+ * for comparing against the other kernels.
+ */
+__attribute__((constructor))
+static void choose_run_kernel(void)
+{
+	if (!lex_use_run_kernel(LEX_RUN_KERNEL_AVX2) && !lex_use_run_kernel(LEX_RUN_KERNEL_SSE2))
+		lex_use_run_kernel(LEX_RUN_KERNEL_NONE);
+}
@@ -0,0 +1,75 @@
+/*
+ * Scallop - a shell for executing tasks concurrently
+ * Copyright (C) 2022  Marcus Harrison
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef SCALLOP_LEXER_RUNS_H
+#define SCALLOP_LEXER_RUNS_H
+
+#include "lexer_spec.h"
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Skipping runs of characters that don't change the
+ * lexer's state, see struct run_class in lexer_spec.h.
+ *
+ * The best SIMD kernel the CPU supports is picked when
+ * the library is loaded; lex_use_run_kernel() exists so
+ * the tests can compare every kernel against the
+ * plain state machine.
+ */
+
+enum LEX_RUN_KERNEL {
+	LEX_RUN_KERNEL_NONE,
+	LEX_RUN_KERNEL_SCALAR,
+	LEX_RUN_KERNEL_SSE2,
+	LEX_RUN_KERNEL_AVX2,
+};
+
+struct lex_run {
+	ssize_t length;
+	char ends_in_utf8;
+	char has_utf8;
+};
+
+/*
+ * Returns the length of the run starting at begin,
+ * which will stop before end, and whether it took in
+ * any UTF-8; and advances row and col over it the
+ * same way reading each character would have.
+ */
+typedef struct lex_run lex_skip_run_fn(
+	const struct run_class *run_class,
+	const char *begin,
+	const char *end,
+	int64_t *row,
+	int64_t *col
+);
+
+/*
+ * The kernel currently in use, or NULL if
+ * skipping runs is turned off.
+ */
+extern lex_skip_run_fn *lex_skip_run;
+
+/*
+ * Returns 0 if the CPU doesn't support the kernel,
+ * leaving the current one in place.
+ */
+int lex_use_run_kernel(enum LEX_RUN_KERNEL kernel);
+
+#endif // SCALLOP_LEXER_RUNS_H
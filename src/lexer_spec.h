@@ -0,0 +1,520 @@
+/*
+ * Scallop - a shell for executing tasks concurrently
+ * Copyright (C) 2022  Marcus Harrison
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef SCALLOP_LEXER_SPEC_H
+#define SCALLOP_LEXER_SPEC_H
+
+enum CHAR_TYPE {
+	CHAR_NULL,
+	CHAR_ASCII_PRINTABLE,
+	CHAR_UTF8_START,
+	CHAR_UTF8_CONT,
+	CHAR_OPEN_CURLY_BRACKET,
+	CHAR_CLOSE_CURLY_BRACKET,
+	CHAR_OPEN_SQUARE_BRACKET,
+	CHAR_CLOSE_SQUARE_BRACKET,
+	CHAR_QUOTE,
+	CHAR_DOUBLE_QUOTE,
+	CHAR_BACKSLASH,
+	CHAR_WORD_SEPARATOR,
+	CHAR_STATEMENT_SEPARATOR,
+	CHAR_PIPE,
+	CHAR_UNKNOWN,
+	CHAR_TYPE_COUNT,
+
+	// Only used in the transition specification below,
+	// matches any character
+	CHAR_ANY = CHAR_TYPE_COUNT,
+};
+
+#define UTF8_FIRST_BIT (1 << 7)
+#define UTF8_SECOND_BIT (1 << 6)
+
+/*
+ * This is the specification for classifying characters.
+ * The lexer doesn't call it directly: gen_lexer_tables
+ * runs it over every byte value at build time, and the
+ * lexer looks the result up in the generated char_types
+ * table instead.
+ */
+static inline enum CHAR_TYPE char_type_spec(char character)
+{
+	switch (character) {
+		case '{':
+			return CHAR_OPEN_CURLY_BRACKET;
+		case '}':
+			return CHAR_CLOSE_CURLY_BRACKET;
+		case '[':
+			return CHAR_OPEN_SQUARE_BRACKET;
+		case ']':
+			return CHAR_CLOSE_SQUARE_BRACKET;
+		case '\'':
+			return CHAR_QUOTE;
+		case '"':
+			return CHAR_DOUBLE_QUOTE;
+		case '\\':
+			return CHAR_BACKSLASH;
+		case ';':
+		case '\n':
+			return CHAR_STATEMENT_SEPARATOR;
+		case ' ':
+		case '\t':
+		// So scripts with CRLF line endings lex
+		case '\r':
+			return CHAR_WORD_SEPARATOR;
+		case '|':
+			return CHAR_PIPE;
+		case '\0':
+			return CHAR_NULL;
+	}
+
+	if (' ' <= character && character <= '~')
+		return CHAR_ASCII_PRINTABLE;
+
+	unsigned char utf8_bits = UTF8_FIRST_BIT | UTF8_SECOND_BIT;
+	switch (character & utf8_bits) {
+		// UTF-8 continuation character
+		case UTF8_FIRST_BIT:
+			return CHAR_UTF8_CONT;
+		// UTF-8 start character
+		case UTF8_FIRST_BIT | UTF8_SECOND_BIT:
+			return CHAR_UTF8_START;
+	}
+
+	return CHAR_UNKNOWN;
+}
+
+/*
+ * On entering a state, the lexer reads the next
+ * character, then moves to the next state based on
+ * the type of that character. LEX_BEGIN is the only
+ * exception, looking at the current character instead,
+ * and LEX_END, LEX_EOF and LEX_ERROR finish the token.
+ */
+enum LEX_STATE {
+	LEX_ERROR,
+	LEX_END,
+	LEX_EOF,
+	LEX_UTF8_START,
+	LEX_UTF8_CONT,
+	LEX_QUOTED_UTF8_START,
+	LEX_QUOTED_UTF8_CONT,
+	LEX_QUOTED_STRING,
+	LEX_END_QUOTED_STRING,
+	LEX_DOUBLE_QUOTED_UTF8_START,
+	LEX_DOUBLE_QUOTED_UTF8_CONT,
+	LEX_DOUBLE_QUOTED_STRING,
+	LEX_END_DOUBLE_QUOTED_STRING,
+	LEX_WORD_SEPARATOR,
+	LEX_WORD,
+	LEX_OPEN_CURLY_BRACKET,
+	LEX_CLOSE_CURLY_BRACKET,
+	LEX_OPEN_SQUARE_BRACKET,
+	LEX_CLOSE_SQUARE_BRACKET,
+	LEX_STATEMENT_SEPARATOR,
+	LEX_PIPE,
+	LEX_BINARY_PIPE,
+	LEX_ESCAPE_WORD,
+	LEX_ESCAPE_QUOTED_STRING,
+	LEX_ESCAPE_DOUBLE_QUOTED_STRING,
+	LEX_BEGIN,
+	LEX_STATE_COUNT,
+};
+
+/*
+ * State transition specification
+ *
+ * Writing the transitions out as a single table
+ * over every state would be unreadable, so each state
+ * lists the rows it can move from, and inputs with no
+ * row are errors. The first row matching an input wins.
+ *
+ * Searching these at run-time is a linear search for
+ * every character, so gen_lexer_tables expands them
+ * into a dense state_transitions[state][input] matrix
+ * at build-time, and the lexer only ever indexes that.
+ */
+struct state_transition_row {
+	enum CHAR_TYPE input;
+	enum LEX_STATE new_state;
+};
+
+struct state_transitions {
+	const struct state_transition_row *rows_begin;
+	const struct state_transition_row *rows_end;
+};
+
+#define spec_rows(array) \
+	{ (array), (array) + sizeof(array) / sizeof(*(array)) }
+
+static const struct state_transition_row utf8_start_transitions[] = {
+	{ CHAR_UTF8_CONT, LEX_UTF8_CONT },
+};
+
+static const struct state_transition_row utf8_cont_transitions[] = {
+	{ CHAR_UTF8_START, LEX_UTF8_START },
+	{ CHAR_UTF8_CONT, LEX_UTF8_CONT },
+	{ CHAR_ASCII_PRINTABLE, LEX_WORD },
+	{ CHAR_BACKSLASH, LEX_ESCAPE_WORD },
+	{ CHAR_QUOTE, LEX_QUOTED_STRING },
+	{ CHAR_DOUBLE_QUOTE, LEX_DOUBLE_QUOTED_STRING },
+	{ CHAR_WORD_SEPARATOR, LEX_END },
+	{ CHAR_STATEMENT_SEPARATOR, LEX_END },
+	{ CHAR_PIPE, LEX_END },
+	{ CHAR_OPEN_CURLY_BRACKET, LEX_END },
+	{ CHAR_CLOSE_CURLY_BRACKET, LEX_END },
+	{ CHAR_OPEN_SQUARE_BRACKET, LEX_END },
+	{ CHAR_CLOSE_SQUARE_BRACKET, LEX_END },
+	{ CHAR_NULL, LEX_END },
+};
+
+static const struct state_transition_row quoted_utf8_start_transitions[] = {
+	{ CHAR_UTF8_CONT, LEX_QUOTED_UTF8_CONT },
+};
+
+static const struct state_transition_row quoted_utf8_cont_transitions[] = {
+	{ CHAR_ASCII_PRINTABLE, LEX_QUOTED_STRING },
+	{ CHAR_WORD_SEPARATOR, LEX_QUOTED_STRING },
+	{ CHAR_STATEMENT_SEPARATOR, LEX_QUOTED_STRING },
+	{ CHAR_PIPE, LEX_QUOTED_STRING },
+	{ CHAR_DOUBLE_QUOTE, LEX_QUOTED_STRING },
+	{ CHAR_WORD_SEPARATOR, LEX_QUOTED_STRING },
+	{ CHAR_OPEN_CURLY_BRACKET, LEX_QUOTED_STRING },
+	{ CHAR_CLOSE_CURLY_BRACKET, LEX_QUOTED_STRING },
+	{ CHAR_OPEN_SQUARE_BRACKET, LEX_QUOTED_STRING },
+	{ CHAR_CLOSE_SQUARE_BRACKET, LEX_QUOTED_STRING },
+	{ CHAR_UTF8_START, LEX_QUOTED_UTF8_START },
+	{ CHAR_UTF8_CONT, LEX_QUOTED_UTF8_CONT },
+	{ CHAR_BACKSLASH, LEX_ESCAPE_QUOTED_STRING },
+	{ CHAR_QUOTE, LEX_END_QUOTED_STRING },
+	{ CHAR_NULL, LEX_END },
+};
+
+static const struct state_transition_row quoted_string_transitions[] = {
+	{ CHAR_ASCII_PRINTABLE, LEX_QUOTED_STRING },
+	{ CHAR_UTF8_START, LEX_QUOTED_UTF8_START },
+	{ CHAR_WORD_SEPARATOR, LEX_QUOTED_STRING },
+	{ CHAR_STATEMENT_SEPARATOR, LEX_QUOTED_STRING },
+	{ CHAR_PIPE, LEX_QUOTED_STRING },
+	{ CHAR_DOUBLE_QUOTE, LEX_QUOTED_STRING },
+	{ CHAR_OPEN_CURLY_BRACKET, LEX_QUOTED_STRING },
+	{ CHAR_CLOSE_CURLY_BRACKET, LEX_QUOTED_STRING },
+	{ CHAR_OPEN_SQUARE_BRACKET, LEX_QUOTED_STRING },
+	{ CHAR_CLOSE_SQUARE_BRACKET, LEX_QUOTED_STRING },
+	{ CHAR_BACKSLASH, LEX_ESCAPE_QUOTED_STRING },
+	{ CHAR_QUOTE, LEX_END_QUOTED_STRING },
+	{ CHAR_NULL, LEX_END },
+};
+
+static const struct state_transition_row end_quoted_string_transitions[] = {
+	{ CHAR_WORD_SEPARATOR, LEX_END },
+	{ CHAR_STATEMENT_SEPARATOR, LEX_END },
+	{ CHAR_PIPE, LEX_END },
+	{ CHAR_ASCII_PRINTABLE, LEX_WORD },
+	{ CHAR_UTF8_START, LEX_UTF8_START },
+	{ CHAR_QUOTE, LEX_QUOTED_STRING },
+	{ CHAR_DOUBLE_QUOTE, LEX_DOUBLE_QUOTED_STRING },
+	{ CHAR_BACKSLASH, LEX_ESCAPE_WORD },
+	{ CHAR_OPEN_CURLY_BRACKET, LEX_END },
+	{ CHAR_CLOSE_CURLY_BRACKET, LEX_END },
+	{ CHAR_OPEN_SQUARE_BRACKET, LEX_END },
+	{ CHAR_CLOSE_SQUARE_BRACKET, LEX_END },
+	{ CHAR_NULL, LEX_EOF },
+};
+
+static const struct state_transition_row double_quoted_utf8_start_transitions[] = {
+	{ CHAR_UTF8_CONT, LEX_DOUBLE_QUOTED_UTF8_CONT },
+};
+
+static const struct state_transition_row double_quoted_utf8_cont_transitions[] = {
+	{ CHAR_ASCII_PRINTABLE, LEX_DOUBLE_QUOTED_STRING },
+	{ CHAR_WORD_SEPARATOR, LEX_DOUBLE_QUOTED_STRING },
+	{ CHAR_STATEMENT_SEPARATOR, LEX_DOUBLE_QUOTED_STRING },
+	{ CHAR_PIPE, LEX_DOUBLE_QUOTED_STRING },
+	{ CHAR_QUOTE, LEX_DOUBLE_QUOTED_STRING },
+	{ CHAR_OPEN_CURLY_BRACKET, LEX_DOUBLE_QUOTED_STRING },
+	{ CHAR_CLOSE_CURLY_BRACKET, LEX_DOUBLE_QUOTED_STRING },
+	{ CHAR_OPEN_SQUARE_BRACKET, LEX_DOUBLE_QUOTED_STRING },
+	{ CHAR_CLOSE_SQUARE_BRACKET, LEX_DOUBLE_QUOTED_STRING },
+	{ CHAR_UTF8_START, LEX_DOUBLE_QUOTED_UTF8_START },
+	{ CHAR_UTF8_CONT, LEX_DOUBLE_QUOTED_UTF8_CONT },
+	{ CHAR_BACKSLASH, LEX_ESCAPE_DOUBLE_QUOTED_STRING },
+	{ CHAR_DOUBLE_QUOTE, LEX_END_DOUBLE_QUOTED_STRING },
+	{ CHAR_NULL, LEX_END },
+};
+
+static const struct state_transition_row double_quoted_string_transitions[] = {
+	{ CHAR_ASCII_PRINTABLE, LEX_DOUBLE_QUOTED_STRING },
+	{ CHAR_WORD_SEPARATOR, LEX_DOUBLE_QUOTED_STRING },
+	{ CHAR_STATEMENT_SEPARATOR, LEX_DOUBLE_QUOTED_STRING },
+	{ CHAR_PIPE, LEX_DOUBLE_QUOTED_STRING },
+	{ CHAR_QUOTE, LEX_DOUBLE_QUOTED_STRING },
+	{ CHAR_UTF8_START, LEX_DOUBLE_QUOTED_UTF8_START },
+	{ CHAR_DOUBLE_QUOTE, LEX_END_DOUBLE_QUOTED_STRING },
+	{ CHAR_OPEN_CURLY_BRACKET, LEX_DOUBLE_QUOTED_STRING },
+	{ CHAR_CLOSE_CURLY_BRACKET, LEX_DOUBLE_QUOTED_STRING },
+	{ CHAR_OPEN_SQUARE_BRACKET, LEX_DOUBLE_QUOTED_STRING },
+	{ CHAR_CLOSE_SQUARE_BRACKET, LEX_DOUBLE_QUOTED_STRING },
+	{ CHAR_BACKSLASH, LEX_ESCAPE_DOUBLE_QUOTED_STRING },
+	{ CHAR_NULL, LEX_END },
+};
+
+static const struct state_transition_row word_separator_transitions[] = {
+	{ CHAR_WORD_SEPARATOR, LEX_WORD_SEPARATOR },
+	{ CHAR_STATEMENT_SEPARATOR, LEX_END },
+	{ CHAR_BACKSLASH, LEX_END },
+	{ CHAR_ASCII_PRINTABLE, LEX_END },
+	{ CHAR_QUOTE, LEX_END },
+	{ CHAR_DOUBLE_QUOTE, LEX_END },
+	{ CHAR_UTF8_START, LEX_END },
+	{ CHAR_OPEN_CURLY_BRACKET, LEX_END },
+	{ CHAR_CLOSE_CURLY_BRACKET, LEX_END },
+	{ CHAR_OPEN_SQUARE_BRACKET, LEX_END },
+	{ CHAR_CLOSE_SQUARE_BRACKET, LEX_END },
+	{ CHAR_PIPE, LEX_END },
+	{ CHAR_NULL, LEX_END },
+};
+
+static const struct state_transition_row word_transitions[] = {
+	{ CHAR_ASCII_PRINTABLE, LEX_WORD },
+	{ CHAR_UTF8_START, LEX_UTF8_START },
+	{ CHAR_BACKSLASH, LEX_ESCAPE_WORD },
+	{ CHAR_QUOTE, LEX_QUOTED_STRING },
+	{ CHAR_DOUBLE_QUOTE, LEX_DOUBLE_QUOTED_STRING },
+	{ CHAR_WORD_SEPARATOR, LEX_END },
+	{ CHAR_STATEMENT_SEPARATOR, LEX_END },
+	{ CHAR_PIPE, LEX_END },
+	{ CHAR_OPEN_CURLY_BRACKET, LEX_END },
+	{ CHAR_CLOSE_CURLY_BRACKET, LEX_END },
+	{ CHAR_OPEN_SQUARE_BRACKET, LEX_END },
+	{ CHAR_CLOSE_SQUARE_BRACKET, LEX_END },
+	{ CHAR_NULL, LEX_END },
+};
+
+static const struct state_transition_row statement_separator_transitions[] = {
+	{ CHAR_STATEMENT_SEPARATOR, LEX_STATEMENT_SEPARATOR },
+	{ CHAR_ASCII_PRINTABLE, LEX_END },
+	{ CHAR_UTF8_START, LEX_END },
+	{ CHAR_BACKSLASH, LEX_END },
+	{ CHAR_QUOTE, LEX_END },
+	{ CHAR_DOUBLE_QUOTE, LEX_END },
+	{ CHAR_WORD_SEPARATOR, LEX_END },
+	{ CHAR_OPEN_CURLY_BRACKET, LEX_END },
+	{ CHAR_CLOSE_CURLY_BRACKET, LEX_END },
+	{ CHAR_OPEN_SQUARE_BRACKET, LEX_END },
+	{ CHAR_CLOSE_SQUARE_BRACKET, LEX_END },
+	{ CHAR_PIPE, LEX_END },
+	{ CHAR_NULL, LEX_END },
+};
+
+static const struct state_transition_row begin_transitions[] = {
+	{ CHAR_ASCII_PRINTABLE, LEX_WORD },
+	{ CHAR_UTF8_START, LEX_UTF8_START },
+	{ CHAR_QUOTE, LEX_QUOTED_STRING },
+	{ CHAR_DOUBLE_QUOTE, LEX_DOUBLE_QUOTED_STRING },
+	{ CHAR_WORD_SEPARATOR, LEX_WORD_SEPARATOR },
+	{ CHAR_BACKSLASH, LEX_ESCAPE_WORD },
+	{ CHAR_STATEMENT_SEPARATOR, LEX_STATEMENT_SEPARATOR },
+	{ CHAR_PIPE, LEX_PIPE },
+	{ CHAR_OPEN_CURLY_BRACKET, LEX_OPEN_CURLY_BRACKET },
+	{ CHAR_CLOSE_CURLY_BRACKET, LEX_CLOSE_CURLY_BRACKET },
+	{ CHAR_OPEN_SQUARE_BRACKET, LEX_OPEN_SQUARE_BRACKET },
+	{ CHAR_CLOSE_SQUARE_BRACKET, LEX_CLOSE_SQUARE_BRACKET },
+	{ CHAR_NULL, LEX_EOF },
+};
+
+static const struct state_transition_row single_character_transitions[] = {
+	{ CHAR_ANY, LEX_END },
+};
+
+// A second pipe makes it a binary pipe
+static const struct state_transition_row pipe_transitions[] = {
+	{ CHAR_PIPE, LEX_BINARY_PIPE },
+	{ CHAR_ANY, LEX_END },
+};
+
+static const struct state_transition_row escape_word_transitions[] = {
+	{ CHAR_ANY, LEX_WORD },
+};
+
+static const struct state_transition_row escape_quoted_string_transitions[] = {
+	{ CHAR_ANY, LEX_QUOTED_STRING },
+};
+
+static const struct state_transition_row escape_double_quoted_string_transitions[] = {
+	{ CHAR_ANY, LEX_DOUBLE_QUOTED_STRING },
+};
+
+static const struct state_transitions state_transitions_spec[LEX_STATE_COUNT] = {
+	[LEX_UTF8_START] = spec_rows(utf8_start_transitions),
+	[LEX_UTF8_CONT] = spec_rows(utf8_cont_transitions),
+	[LEX_QUOTED_UTF8_START] = spec_rows(quoted_utf8_start_transitions),
+	[LEX_QUOTED_UTF8_CONT] = spec_rows(quoted_utf8_cont_transitions),
+	[LEX_QUOTED_STRING] = spec_rows(quoted_string_transitions),
+	[LEX_END_QUOTED_STRING] = spec_rows(end_quoted_string_transitions),
+	[LEX_DOUBLE_QUOTED_UTF8_START] = spec_rows(double_quoted_utf8_start_transitions),
+	[LEX_DOUBLE_QUOTED_UTF8_CONT] = spec_rows(double_quoted_utf8_cont_transitions),
+	[LEX_DOUBLE_QUOTED_STRING] = spec_rows(double_quoted_string_transitions),
+	// identical to quoted_string
+	[LEX_END_DOUBLE_QUOTED_STRING] = spec_rows(end_quoted_string_transitions),
+	[LEX_WORD_SEPARATOR] = spec_rows(word_separator_transitions),
+	[LEX_WORD] = spec_rows(word_transitions),
+	[LEX_OPEN_CURLY_BRACKET] = spec_rows(single_character_transitions),
+	[LEX_CLOSE_CURLY_BRACKET] = spec_rows(single_character_transitions),
+	[LEX_OPEN_SQUARE_BRACKET] = spec_rows(single_character_transitions),
+	[LEX_CLOSE_SQUARE_BRACKET] = spec_rows(single_character_transitions),
+	[LEX_STATEMENT_SEPARATOR] = spec_rows(statement_separator_transitions),
+	[LEX_PIPE] = spec_rows(pipe_transitions),
+	[LEX_BINARY_PIPE] = spec_rows(single_character_transitions),
+	[LEX_ESCAPE_WORD] = spec_rows(escape_word_transitions),
+	[LEX_ESCAPE_QUOTED_STRING] = spec_rows(escape_quoted_string_transitions),
+	[LEX_ESCAPE_DOUBLE_QUOTED_STRING] = spec_rows(escape_double_quoted_string_transitions),
+	[LEX_BEGIN] = spec_rows(begin_transitions),
+};
+
+static inline enum LEX_STATE transition_state_spec(
+	enum LEX_STATE state,
+	enum CHAR_TYPE input
+)
+{
+	const struct state_transitions transitions = state_transitions_spec[state];
+	for (
+		const struct state_transition_row *current = transitions.rows_begin;
+		current < transitions.rows_end;
+		current++
+	) {
+		if (input == current->input || current->input == CHAR_ANY) {
+			return current->new_state;
+		}
+	}
+	return LEX_ERROR;
+}
+
+/*
+ * Run classes
+ *
+ * Most of the characters in a word or string don't
+ * change the state at all, so the lexer skips over
+ * runs of them 16 or 32 characters at a time. For
+ * that to be cheap, the ASCII characters that keep a
+ * state where it is are described as: any character
+ * between low and high that isn't excluded, plus the
+ * extra characters.
+ *
+ * utf8 is set when a UTF-8 start character followed by
+ * continuation characters leads back to this state
+ * after the next ASCII character in the run, so
+ * well-formed sequences don't end the run. States
+ * reached after a continuation character share the
+ * run class, with after_utf8 set.
+ *
+ * ascii_state and utf8_state are the states the run
+ * leaves us in, after an ASCII or a continuation
+ * character respectively.
+ */
+#define RUN_CLASS_MAX_EXCLUDED 12
+#define RUN_CLASS_MAX_EXTRA 4
+
+struct run_class {
+	char enabled;
+	char utf8;
+	char after_utf8;
+	unsigned char ascii_state;
+	unsigned char utf8_state;
+	char low;
+	char high;
+	unsigned char excluded_count;
+	unsigned char extra_count;
+	char excluded[RUN_CLASS_MAX_EXCLUDED];
+	char extra[RUN_CLASS_MAX_EXTRA];
+};
+
+static inline char stays_in_state_spec(enum LEX_STATE state, int character)
+{
+	return transition_state_spec(state, char_type_spec((char)character)) == state;
+}
+
+static inline struct run_class ascii_run_class_spec(enum LEX_STATE state)
+{
+	struct run_class result = {
+		.ascii_state = state,
+		.low = 1,
+		.high = 0,
+	};
+
+	int range_stays = 0;
+	for (int character = ' '; character <= '~'; character++)
+		range_stays += stays_in_state_spec(state, character);
+	if (range_stays * 2 > '~' - ' ' + 1) {
+		result.low = ' ';
+		result.high = '~';
+	}
+
+	for (int character = 1; character < 128; character++) {
+		const char in_range =
+			result.low <= character && character <= result.high;
+		const char stays = stays_in_state_spec(state, character);
+
+		if (in_range && !stays) {
+			if (result.excluded_count == RUN_CLASS_MAX_EXCLUDED)
+				return (struct run_class) { 0 };
+			result.excluded[result.excluded_count++] = (char)character;
+		} else if (!in_range && stays) {
+			if (result.extra_count == RUN_CLASS_MAX_EXTRA)
+				return (struct run_class) { 0 };
+			result.extra[result.extra_count++] = (char)character;
+		}
+		result.enabled |= stays;
+	}
+
+	if (!result.enabled)
+		return (struct run_class) { 0 };
+
+	const enum LEX_STATE start = transition_state_spec(state, CHAR_UTF8_START);
+	const enum LEX_STATE cont = transition_state_spec(start, CHAR_UTF8_CONT);
+	result.utf8_state = cont;
+	result.utf8 = start != LEX_ERROR
+		&& cont != LEX_ERROR
+		&& transition_state_spec(cont, CHAR_UTF8_CONT) == cont
+		&& transition_state_spec(cont, CHAR_UTF8_START) == start;
+	for (int character = 1; character < 128 && result.utf8; character++) {
+		if (!stays_in_state_spec(state, character))
+			continue;
+		result.utf8 =
+			transition_state_spec(cont, char_type_spec((char)character)) == state;
+	}
+
+	return result;
+}
+
+static inline struct run_class run_class_spec(enum LEX_STATE state)
+{
+	struct run_class result = ascii_run_class_spec(state);
+	if (result.enabled)
+		return result;
+
+	for (int other = 0; other < LEX_STATE_COUNT; other++) {
+		result = ascii_run_class_spec(other);
+		if (result.utf8 && result.utf8_state == state) {
+			result.after_utf8 = 1;
+			return result;
+		}
+	}
+	return (struct run_class) { 0 };
+}
+
+#endif // SCALLOP_LEXER_SPEC_H
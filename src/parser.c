@@ -0,0 +1,314 @@
+/*
+ * Scallop - a shell for executing tasks concurrently
+ * Copyright (C) <year>  Marcus Harrison
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "scallop/parser.h"
+
+#include <stdlib.h>
+
+#define PARSE_BATCH_SIZE 1024
+// Capacity doubles, and SCALLOP_NODE_NONE can't be used
+#define MAX_NODES (SCALLOP_NODE_NONE / 2 + 1)
+
+/*
+ * The containers still open, innermost last: the root
+ * block, then any brackets, and a statement if one has
+ * started. Each remembers its last child, so the next
+ * one can be linked on without walking its siblings.
+ */
+struct scallop_parse_frame {
+	uint32_t node;
+	uint32_t last_child;
+};
+
+void scallop_ast_free(struct scallop_ast *ast)
+{
+	free(ast->nodes);
+	*ast = (struct scallop_ast) { 0 };
+}
+
+struct scallop_parser scallop_parser_make(void)
+{
+	return (struct scallop_parser) {
+		.error = { .open_offset = -1 },
+	};
+}
+
+void scallop_parser_free(struct scallop_parser *parser)
+{
+	free(parser->stack);
+	parser->stack = NULL;
+	parser->depth = 0;
+	parser->stack_capacity = 0;
+}
+
+static int fail(
+	struct scallop_parser *parser,
+	enum SCALLOP_PARSE_ERROR error,
+	const struct scallop_parse_token *token
+)
+{
+	parser->error.error = error;
+	parser->error.token = *token;
+	parser->error.open_offset = -1;
+	for (ssize_t i = parser->depth - 1; i > 0; i--) {
+		const struct scallop_node *node = &parser->ast.nodes[parser->stack[i].node];
+		if (node->kind != SCALLOP_NODE_STATEMENT) {
+			parser->error.open_offset = node->start_offset;
+			break;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Returns the index of the new node, or
+ * SCALLOP_NODE_NONE if there's no room for it.
+ */
+static uint32_t new_node(
+	struct scallop_ast *ast,
+	enum SCALLOP_NODE kind,
+	const struct scallop_parse_token *token
+)
+{
+	if (ast->count == ast->capacity) {
+		if (ast->capacity >= MAX_NODES)
+			return SCALLOP_NODE_NONE;
+		const uint32_t capacity = ast->capacity ? ast->capacity * 2 : 256;
+		struct scallop_node *nodes = realloc(ast->nodes, capacity * sizeof(*nodes));
+		if (!nodes)
+			return SCALLOP_NODE_NONE;
+		ast->nodes = nodes;
+		ast->capacity = capacity;
+	}
+
+	ast->nodes[ast->count] = (struct scallop_node) {
+		.start_offset = (uint32_t)token->start_offset,
+		.end_offset = (uint32_t)token->end_offset,
+		.first_child = SCALLOP_NODE_NONE,
+		.next_sibling = SCALLOP_NODE_NONE,
+		.kind = (unsigned char)kind,
+		.flags = kind == SCALLOP_NODE_WORD ? (unsigned char)token->flags : 0,
+	};
+	return ast->count++;
+}
+
+static int push_frame(struct scallop_parser *parser, uint32_t node)
+{
+	if (parser->depth == parser->stack_capacity) {
+		const ssize_t capacity = parser->stack_capacity ? parser->stack_capacity * 2 : 16;
+		struct scallop_parse_frame *stack = realloc(
+			parser->stack,
+			capacity * sizeof(*stack)
+		);
+		if (!stack)
+			return 0;
+		parser->stack = stack;
+		parser->stack_capacity = capacity;
+	}
+	parser->stack[parser->depth++] = (struct scallop_parse_frame) {
+		node,
+		SCALLOP_NODE_NONE,
+	};
+	return 1;
+}
+
+static struct scallop_node *top(struct scallop_parser *parser)
+{
+	return &parser->ast.nodes[parser->stack[parser->depth - 1].node];
+}
+
+/*
+ * Closing a container stretches whatever holds it
+ * over it, since a statement ends wherever its last
+ * argument does.
+ */
+static void pop_frame(struct scallop_parser *parser)
+{
+	const uint32_t end_offset = top(parser)->end_offset;
+	parser->depth--;
+	struct scallop_node *parent = top(parser);
+	if (parent->kind == SCALLOP_NODE_STATEMENT)
+		parent->end_offset = end_offset;
+}
+
+static int is_pipe(enum SCALLOP_NODE kind)
+{
+	return kind == SCALLOP_NODE_PIPE || kind == SCALLOP_NODE_BINARY_PIPE;
+}
+
+static int add_child(
+	struct scallop_parser *parser,
+	enum SCALLOP_NODE kind,
+	const struct scallop_parse_token *token
+)
+{
+	// Blocks hold statements, which are started by
+	// their first argument
+	if (top(parser)->kind == SCALLOP_NODE_BLOCK && kind != SCALLOP_NODE_STATEMENT)
+		if (!add_child(parser, SCALLOP_NODE_STATEMENT, token))
+			return 0;
+
+	const uint32_t node = new_node(&parser->ast, kind, token);
+	if (node == SCALLOP_NODE_NONE)
+		return fail(
+			parser,
+			parser->ast.capacity >= MAX_NODES ?
+				SCALLOP_PARSE_TOO_BIG :
+				SCALLOP_PARSE_OUT_OF_MEMORY,
+			token
+		);
+
+	struct scallop_parse_frame *frame = &parser->stack[parser->depth - 1];
+	if (frame->last_child == SCALLOP_NODE_NONE)
+		parser->ast.nodes[frame->node].first_child = node;
+	else
+		parser->ast.nodes[frame->last_child].next_sibling = node;
+	frame->last_child = node;
+
+	if (kind == SCALLOP_NODE_WORD || is_pipe(kind)) {
+		top(parser)->end_offset = (uint32_t)token->end_offset;
+		return 1;
+	}
+	if (!push_frame(parser, node))
+		return fail(parser, SCALLOP_PARSE_OUT_OF_MEMORY, token);
+	return 1;
+}
+
+static int ends_with_pipe(struct scallop_parser *parser)
+{
+	const struct scallop_parse_frame *frame = &parser->stack[parser->depth - 1];
+	return top(parser)->kind == SCALLOP_NODE_STATEMENT
+		&& is_pipe(parser->ast.nodes[frame->last_child].kind);
+}
+
+// Pipes only go between the arguments of a statement
+static int add_pipe(
+	struct scallop_parser *parser,
+	enum SCALLOP_NODE kind,
+	const struct scallop_parse_token *token
+)
+{
+	if (top(parser)->kind != SCALLOP_NODE_STATEMENT || ends_with_pipe(parser))
+		return fail(parser, SCALLOP_PARSE_UNEXPECTED_TOKEN, token);
+	return add_child(parser, kind, token);
+}
+
+static void end_statement(struct scallop_parser *parser)
+{
+	if (top(parser)->kind == SCALLOP_NODE_STATEMENT)
+		pop_frame(parser);
+}
+
+static int close_bracket(
+	struct scallop_parser *parser,
+	enum SCALLOP_NODE kind,
+	const struct scallop_parse_token *token
+)
+{
+	if (ends_with_pipe(parser))
+		return fail(parser, SCALLOP_PARSE_UNEXPECTED_TOKEN, token);
+	end_statement(parser);
+	if (parser->depth == 1 || top(parser)->kind != kind)
+		return fail(parser, SCALLOP_PARSE_UNEXPECTED_CLOSE, token);
+	top(parser)->end_offset = (uint32_t)token->end_offset;
+	pop_frame(parser);
+	return 1;
+}
+
+int scallop_parser_push(
+	struct scallop_parser *parser,
+	const struct scallop_parse_token *token
+)
+{
+	if (token->end_offset > UINT32_MAX)
+		return fail(parser, SCALLOP_PARSE_TOO_BIG, token);
+
+	if (!parser->depth) {
+		const struct scallop_parse_token root = { 0 };
+		if (
+			new_node(&parser->ast, SCALLOP_NODE_BLOCK, &root) == SCALLOP_NODE_NONE
+			|| !push_frame(parser, 0)
+		)
+			return fail(parser, SCALLOP_PARSE_OUT_OF_MEMORY, token);
+	}
+
+	switch (token->token) {
+		case SCALLOP_TOKEN_WORD:
+			return add_child(parser, SCALLOP_NODE_WORD, token);
+		case SCALLOP_TOKEN_WORD_SEPARATOR:
+			return 1;
+		case SCALLOP_TOKEN_STATEMENT_SEPARATOR:
+			if (!ends_with_pipe(parser))
+				end_statement(parser);
+			return 1;
+		case SCALLOP_TOKEN_PIPE:
+			return add_pipe(parser, SCALLOP_NODE_PIPE, token);
+		case SCALLOP_TOKEN_BINARY_PIPE:
+			return add_pipe(parser, SCALLOP_NODE_BINARY_PIPE, token);
+		case SCALLOP_TOKEN_OPEN_CURLY_BRACKET:
+			return add_child(parser, SCALLOP_NODE_BLOCK, token);
+		case SCALLOP_TOKEN_OPEN_SQUARE_BRACKET:
+			return add_child(parser, SCALLOP_NODE_LIST, token);
+		case SCALLOP_TOKEN_CLOSE_CURLY_BRACKET:
+			return close_bracket(parser, SCALLOP_NODE_BLOCK, token);
+		case SCALLOP_TOKEN_CLOSE_SQUARE_BRACKET:
+			return close_bracket(parser, SCALLOP_NODE_LIST, token);
+		case SCALLOP_TOKEN_EOF:
+			if (token->start_offset < 0)
+				return fail(parser, SCALLOP_PARSE_INVALID_CHARACTER, token);
+			if (ends_with_pipe(parser))
+				return fail(parser, SCALLOP_PARSE_UNEXPECTED_TOKEN, token);
+			end_statement(parser);
+			if (parser->depth > 1)
+				return fail(parser, SCALLOP_PARSE_UNCLOSED, token);
+			// The EOF token ends past the null character
+			parser->ast.nodes[0].end_offset = (uint32_t)token->start_offset;
+			return 1;
+		default:
+			return fail(parser, SCALLOP_PARSE_UNEXPECTED_TOKEN, token);
+	}
+}
+
+int scallop_parse_memory(
+	const char *begin,
+	const char *end,
+	struct scallop_ast *ast,
+	struct scallop_parse_error *error
+)
+{
+	struct scallop_parser parser = scallop_parser_make();
+	struct scallop_parse_token tokens[PARSE_BATCH_SIZE];
+	struct scallop_parse_token token = { 0 };
+	int ok = 1;
+	do {
+		const struct scallop_parse_token *tokens_end = scallop_lex_memory_batch(
+			begin,
+			end,
+			token,
+			tokens,
+			tokens + PARSE_BATCH_SIZE
+		);
+		for (const struct scallop_parse_token *current = tokens; ok && current < tokens_end; current++)
+			ok = scallop_parser_push(&parser, current);
+		token = tokens_end[-1];
+	} while (ok && token.token != SCALLOP_TOKEN_EOF);
+
+	scallop_parser_free(&parser);
+	*ast = parser.ast;
+	*error = parser.error;
+	return ok;
+}
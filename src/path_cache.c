@@ -0,0 +1,493 @@
+/*
+ * Scallop - a shell for executing tasks concurrently
+ * Copyright (C) <year>  Marcus Harrison
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+// For PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP
+#define _GNU_SOURCE
+
+#include "scallop/path_cache.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define INITIAL_CAPACITY 64
+#define CACHE_LINE 64
+#define WATCH_MASK ( \
+	IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB \
+	| IN_DELETE_SELF | IN_MOVE_SELF \
+)
+#define EVENT_BUFFER_SIZE 4096
+
+struct entry {
+	uint64_t hash;
+	char *name;
+	// NULL if the command wasn't found
+	char *path;
+};
+
+/*
+ * An open-addressed table behind a read-write lock.
+ * Lookups only take it for reading; it's only taken
+ * for writing to add a command that's just been
+ * searched for, or to change PATH.
+ *
+ * Emptying the table just increments generation: the
+ * table only counts while table_generation matches it,
+ * and gets cleared by whoever adds to it next.
+ */
+struct scallop_path_cache {
+	pthread_rwlock_t lock;
+	struct entry *entries;
+	size_t capacity;
+	size_t count;
+	unsigned long table_generation;
+	char *path;
+	int *watches;
+	size_t watch_count;
+	int inotify;
+	// Whether every absolute directory in PATH has a
+	// watch, so a command turning up in one gets noticed
+	atomic_int watching_all;
+	atomic_ulong generation;
+	atomic_uint_fast64_t invalidations;
+	// Every lookup counts one or the other, so keep
+	// them away from the rest
+	_Alignas(CACHE_LINE) atomic_uint_fast64_t hits;
+	atomic_uint_fast64_t misses;
+};
+
+// FNV-1a
+static uint64_t hash_name(const char *name)
+{
+	uint64_t hash = 0xcbf29ce484222325;
+	for (; *name; name++)
+		hash = (hash ^ (unsigned char)*name) * 0x100000001b3;
+	return hash;
+}
+
+static int copy_path(const char *path, char *buffer, size_t size)
+{
+	const size_t length = strlen(path);
+	if (length >= size) {
+		errno = ENAMETOOLONG;
+		return 0;
+	}
+	memcpy(buffer, path, length + 1);
+	return 1;
+}
+
+static void clear_entries(struct scallop_path_cache *cache)
+{
+	for (size_t i = 0; i < cache->capacity; i++) {
+		free(cache->entries[i].name);
+		free(cache->entries[i].path);
+		cache->entries[i] = (struct entry) { 0 };
+	}
+	cache->count = 0;
+}
+
+static struct entry *find(struct scallop_path_cache *cache, uint64_t hash, const char *name)
+{
+	if (cache->table_generation != atomic_load(&cache->generation) || !cache->capacity)
+		return NULL;
+	for (size_t i = hash & (cache->capacity - 1);; i = (i + 1) & (cache->capacity - 1)) {
+		struct entry *entry = &cache->entries[i];
+		if (!entry->name)
+			return NULL;
+		if (entry->hash == hash && !strcmp(entry->name, name))
+			return entry;
+	}
+}
+
+static int grow(struct scallop_path_cache *cache)
+{
+	const size_t capacity = cache->capacity ? cache->capacity * 2 : INITIAL_CAPACITY;
+	struct entry *entries = calloc(capacity, sizeof(*entries));
+	if (!entries)
+		return 0;
+	for (size_t i = 0; i < cache->capacity; i++) {
+		const struct entry *entry = &cache->entries[i];
+		if (!entry->name)
+			continue;
+		size_t index = entry->hash & (capacity - 1);
+		while (entries[index].name)
+			index = (index + 1) & (capacity - 1);
+		entries[index] = *entry;
+	}
+	free(cache->entries);
+	cache->entries = entries;
+	cache->capacity = capacity;
+	return 1;
+}
+
+// Takes path over; it's freed if it isn't added
+static void insert(
+	struct scallop_path_cache *cache,
+	unsigned long generation,
+	uint64_t hash,
+	const char *name,
+	char *path
+)
+{
+	pthread_rwlock_wrlock(&cache->lock);
+	// Anything found before the cache was emptied might
+	// be out of date already
+	if (generation != atomic_load(&cache->generation))
+		goto done;
+	if (cache->table_generation != generation) {
+		clear_entries(cache);
+		cache->table_generation = generation;
+	}
+	if (find(cache, hash, name))
+		goto done;
+	if ((cache->count + 1) * 2 > cache->capacity && !grow(cache))
+		goto done;
+
+	char *name_copy = strdup(name);
+	if (!name_copy)
+		goto done;
+	size_t index = hash & (cache->capacity - 1);
+	while (cache->entries[index].name)
+		index = (index + 1) & (cache->capacity - 1);
+	cache->entries[index] = (struct entry) { hash, name_copy, path };
+	cache->count++;
+	path = NULL;
+
+done:
+	pthread_rwlock_unlock(&cache->lock);
+	free(path);
+}
+
+/*
+ * Searches PATH the way execvp() does, an empty
+ * directory meaning the current one. Only results that
+ * don't depend on the current directory can be kept,
+ * as every task has its own.
+ */
+static char *search(
+	const char *path,
+	const char *name,
+	int *keep,
+	int *error
+)
+{
+	char candidate[PATH_MAX];
+	const size_t name_length = strlen(name);
+	*keep = 1;
+	*error = ENOENT;
+	for (const char *directory = path;; directory++) {
+		const char *end = strchrnul(directory, ':');
+		size_t length = end - directory;
+		if (!length || directory[0] != '/')
+			*keep = 0;
+		if (!length) {
+			directory = ".";
+			length = 1;
+		}
+
+		if (length + 1 + name_length < sizeof(candidate)) {
+			memcpy(candidate, directory, length);
+			candidate[length] = '/';
+			memcpy(candidate + length + 1, name, name_length + 1);
+			struct stat status;
+			if (
+				!stat(candidate, &status)
+				&& S_ISREG(status.st_mode)
+				&& !access(candidate, X_OK)
+			)
+				return strdup(candidate);
+			if (errno == EACCES)
+				*error = EACCES;
+		}
+
+		if (!*end)
+			return NULL;
+		directory = end;
+	}
+}
+
+int scallop_path_cache_lookup(
+	struct scallop_path_cache *cache,
+	const char *name,
+	char *buffer,
+	size_t size
+)
+{
+	if (strchr(name, '/'))
+		return copy_path(name, buffer, size);
+
+	const uint64_t hash = hash_name(name);
+	pthread_rwlock_rdlock(&cache->lock);
+	const struct entry *entry = find(cache, hash, name);
+	if (entry) {
+		int result = 0;
+		if (entry->path)
+			result = copy_path(entry->path, buffer, size);
+		else
+			errno = ENOENT;
+		pthread_rwlock_unlock(&cache->lock);
+		atomic_fetch_add_explicit(&cache->hits, 1, memory_order_relaxed);
+		return result;
+	}
+
+	// Searching goes on outside the lock, over a copy of
+	// PATH: holding it for every stat() would leave any
+	// lookup queued behind another miss's insert()
+	// waiting too. If PATH changes meanwhile, so does
+	// the generation, and insert() drops the result.
+	atomic_fetch_add_explicit(&cache->misses, 1, memory_order_relaxed);
+	const unsigned long generation = atomic_load(&cache->generation);
+	const int watched = atomic_load(&cache->watching_all);
+	char *search_path = strdup(cache->path);
+	pthread_rwlock_unlock(&cache->lock);
+	if (!search_path)
+		return 0;
+	int keep, error;
+	char *path = search(search_path, name, &keep, &error);
+	free(search_path);
+
+	const int result = path ? copy_path(path, buffer, size) : 0;
+	if (!path)
+		errno = error;
+	if (keep && (path || (watched && error == ENOENT)))
+		insert(cache, generation, hash, name, path);
+	else
+		free(path);
+	return result;
+}
+
+int scallop_path_search(const char *path, const char *name, char *buffer, size_t size)
+{
+	if (strchr(name, '/'))
+		return copy_path(name, buffer, size);
+	int keep, error;
+	char *found = search(path, name, &keep, &error);
+	if (!found) {
+		errno = error;
+		return 0;
+	}
+	const int result = copy_path(found, buffer, size);
+	free(found);
+	return result;
+}
+
+/*
+ * Keeping up with PATH
+ */
+
+static void invalidate(struct scallop_path_cache *cache)
+{
+	atomic_fetch_add(&cache->generation, 1);
+	atomic_fetch_add_explicit(&cache->invalidations, 1, memory_order_relaxed);
+}
+
+void scallop_path_cache_invalidate(struct scallop_path_cache *cache)
+{
+	invalidate(cache);
+}
+
+// Directories that can't be watched - ones that don't
+// exist, say - are skipped, but then there's nothing
+// to say when a command appears there, so missing
+// commands stop being kept
+static void watch_path(struct scallop_path_cache *cache)
+{
+	atomic_store(&cache->watching_all, 0);
+	if (cache->inotify < 0)
+		return;
+	for (size_t i = 0; i < cache->watch_count; i++)
+		inotify_rm_watch(cache->inotify, cache->watches[i]);
+	cache->watch_count = 0;
+
+	size_t count = 1;
+	for (const char *colon = cache->path; (colon = strchr(colon, ':')); colon++)
+		count++;
+	int *watches = realloc(cache->watches, count * sizeof(*watches));
+	if (!watches)
+		return;
+	cache->watches = watches;
+
+	char directory[PATH_MAX];
+	int all = 1;
+	for (const char *begin = cache->path;; begin++) {
+		const char *end = strchrnul(begin, ':');
+		const size_t length = end - begin;
+		if (length && begin[0] == '/') {
+			int watch = -1;
+			if (length < sizeof(directory)) {
+				memcpy(directory, begin, length);
+				directory[length] = 0;
+				watch = inotify_add_watch(cache->inotify, directory, WATCH_MASK);
+			}
+			if (watch >= 0)
+				cache->watches[cache->watch_count++] = watch;
+			else
+				all = 0;
+		}
+		if (!*end)
+			break;
+		begin = end;
+	}
+	atomic_store(&cache->watching_all, all);
+}
+
+// A watch that's gone, or whose directory has moved
+// away, leaves part of PATH unwatched
+static void check_watch(struct scallop_path_cache *cache, const struct inotify_event *event)
+{
+	if (!(event->mask & (IN_IGNORED | IN_MOVE_SELF)))
+		return;
+	pthread_rwlock_rdlock(&cache->lock);
+	for (size_t i = 0; i < cache->watch_count; i++)
+		if (cache->watches[i] == event->wd)
+			atomic_store(&cache->watching_all, 0);
+	pthread_rwlock_unlock(&cache->lock);
+}
+
+int scallop_path_cache_set_path(struct scallop_path_cache *cache, const char *path)
+{
+	if (!path)
+		path = getenv("PATH");
+	if (!path)
+		path = SCALLOP_PATH_DEFAULT;
+
+	pthread_rwlock_wrlock(&cache->lock);
+	if (cache->path && !strcmp(cache->path, path)) {
+		pthread_rwlock_unlock(&cache->lock);
+		return 1;
+	}
+	char *copy = strdup(path);
+	if (!copy) {
+		pthread_rwlock_unlock(&cache->lock);
+		return 0;
+	}
+	free(cache->path);
+	cache->path = copy;
+	watch_path(cache);
+	invalidate(cache);
+	pthread_rwlock_unlock(&cache->lock);
+	return 1;
+}
+
+int scallop_path_cache_searches(struct scallop_path_cache *cache, const char *path)
+{
+	pthread_rwlock_rdlock(&cache->lock);
+	const int same = !strcmp(cache->path, path);
+	pthread_rwlock_unlock(&cache->lock);
+	return same;
+}
+
+int scallop_path_cache_fd(const struct scallop_path_cache *cache)
+{
+	return cache->inotify;
+}
+
+int scallop_path_cache_handle_events(struct scallop_path_cache *cache)
+{
+	// Which command changed doesn't matter: the whole
+	// cache goes, as that's as cheap as it gets
+	_Alignas(struct inotify_event) char buffer[EVENT_BUFFER_SIZE];
+	int changed = 0;
+	for (;;) {
+		const ssize_t length = read(cache->inotify, buffer, sizeof(buffer));
+		if (length > 0) {
+			for (ssize_t offset = 0; offset < length;) {
+				const struct inotify_event *event = (const struct inotify_event *)(buffer + offset);
+				check_watch(cache, event);
+				offset += sizeof(*event) + event->len;
+			}
+			changed = 1;
+			continue;
+		}
+		if (length < 0 && errno == EINTR)
+			continue;
+		if (changed)
+			invalidate(cache);
+		return length < 0 && errno == EAGAIN;
+	}
+}
+
+void scallop_path_cache_stats(
+	struct scallop_path_cache *cache,
+	struct scallop_path_cache_stats *stats
+)
+{
+	stats->hits = atomic_load_explicit(&cache->hits, memory_order_relaxed);
+	stats->misses = atomic_load_explicit(&cache->misses, memory_order_relaxed);
+	stats->invalidations = atomic_load_explicit(&cache->invalidations, memory_order_relaxed);
+	pthread_rwlock_rdlock(&cache->lock);
+	stats->entries = cache->table_generation == atomic_load(&cache->generation) ?
+		cache->count :
+		0;
+	pthread_rwlock_unlock(&cache->lock);
+}
+
+struct scallop_path_cache *scallop_path_cache_create(const char *path, int flags)
+{
+	struct scallop_path_cache *cache = calloc(1, sizeof(*cache));
+	if (!cache)
+		return NULL;
+	cache->inotify = -1;
+
+	pthread_rwlockattr_t attributes;
+	pthread_rwlockattr_init(&attributes);
+	// A steady stream of lookups mustn't keep a new
+	// command from being added
+	pthread_rwlockattr_setkind_np(&attributes, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+	const int error = pthread_rwlock_init(&cache->lock, &attributes);
+	pthread_rwlockattr_destroy(&attributes);
+	if (error) {
+		free(cache);
+		errno = error;
+		return NULL;
+	}
+
+	if (flags & SCALLOP_PATH_CACHE_INOTIFY) {
+		cache->inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (cache->inotify < 0) {
+			scallop_path_cache_destroy(cache);
+			return NULL;
+		}
+	}
+	if (!scallop_path_cache_set_path(cache, path)) {
+		scallop_path_cache_destroy(cache);
+		return NULL;
+	}
+	// Setting the path doesn't count as emptying it
+	atomic_store(&cache->invalidations, 0);
+	return cache;
+}
+
+void scallop_path_cache_destroy(struct scallop_path_cache *cache)
+{
+	const int error = errno;
+	clear_entries(cache);
+	free(cache->entries);
+	free(cache->path);
+	free(cache->watches);
+	if (cache->inotify >= 0)
+		close(cache->inotify);
+	pthread_rwlock_destroy(&cache->lock);
+	free(cache);
+	errno = error;
+}
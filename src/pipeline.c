@@ -0,0 +1,303 @@
+/*
+ * Scallop - a shell for executing tasks concurrently
+ * Copyright (C) <year>  Marcus Harrison
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+// For splice(), tee(), pipe2() and F_SETPIPE_SZ
+#define _GNU_SOURCE
+
+#include "scallop/pipeline.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// As much as a pipe can hold at its biggest, so each
+// call moves whatever's there
+#define RELAY_CHUNK SCALLOP_PIPE_SIZE
+#define COPY_BUFFER_SIZE (64 * 1024)
+// Room for the pipeline's redirections, ahead of a
+// stage's own
+#define STAGE_REDIRECTS 2
+
+int scallop_pipe(int fds[2], int size)
+{
+	if (pipe2(fds, O_CLOEXEC) < 0)
+		return 0;
+	// Only the write end needs resizing, as both share
+	// the one buffer
+	if (size)
+		fcntl(fds[1], F_SETPIPE_SZ, size);
+	return 1;
+}
+
+static void kill_stages(pid_t *pids, ssize_t count)
+{
+	for (ssize_t i = 0; i < count; i++) {
+		kill(pids[i], SIGKILL);
+		while (waitpid(pids[i], NULL, 0) < 0 && errno == EINTR)
+			;
+	}
+}
+
+static void close_pipe(int fds[2])
+{
+	if (fds[0] >= 0)
+		close(fds[0]);
+	if (fds[1] >= 0)
+		close(fds[1]);
+	fds[0] = fds[1] = -1;
+}
+
+int scallop_pipeline_launch(
+	const struct scallop_command *commands,
+	ssize_t count,
+	int pipe_size,
+	enum SCALLOP_LAUNCH_METHOD method,
+	pid_t *pids
+)
+{
+	// The read end of the pipe from the last stage
+	int input = -1;
+	ssize_t launched = 0;
+	int error = 0;
+
+	for (; launched < count; launched++) {
+		const struct scallop_command *command = &commands[launched];
+		int output[2] = { -1, -1 };
+		if (launched + 1 < count && !scallop_pipe(output, pipe_size)) {
+			error = errno;
+			break;
+		}
+
+		struct scallop_redirect *redirects = malloc(
+			(STAGE_REDIRECTS + command->redirect_count) * sizeof(*redirects)
+		);
+		if (!redirects) {
+			error = errno;
+			close_pipe(output);
+			break;
+		}
+		// Both pipes are close-on-exec, so only the copies
+		// made here reach the command
+		ssize_t redirect_count = 0;
+		if (input >= 0)
+			redirects[redirect_count++] = (struct scallop_redirect) {
+				SCALLOP_REDIRECT_DUP, 0, input,
+			};
+		if (output[1] >= 0)
+			redirects[redirect_count++] = (struct scallop_redirect) {
+				SCALLOP_REDIRECT_DUP, 1, output[1],
+			};
+		for (ssize_t i = 0; i < command->redirect_count; i++)
+			redirects[redirect_count++] = command->redirects[i];
+
+		const struct scallop_command stage = {
+			command->argv,
+			command->envp,
+			redirects,
+			redirect_count,
+			command->directory,
+			command->path,
+		};
+		pids[launched] = scallop_launch(&stage, method);
+		error = errno;
+		free(redirects);
+
+		if (input >= 0)
+			close(input);
+		input = output[0];
+		if (output[1] >= 0)
+			close(output[1]);
+		if (pids[launched] < 0)
+			break;
+	}
+
+	if (input >= 0)
+		close(input);
+	if (launched == count)
+		return 1;
+	kill_stages(pids, launched);
+	errno = error;
+	return 0;
+}
+
+/*
+ * Relaying
+ */
+
+static int is_pipe(int fd)
+{
+	struct stat status;
+	return fstat(fd, &status) == 0 && S_ISFIFO(status.st_mode);
+}
+
+static ssize_t splice_some(int in, int out, size_t length)
+{
+	ssize_t result;
+	while (
+		(result = splice(in, NULL, out, NULL, length, SPLICE_F_MOVE | SPLICE_F_MORE)) < 0
+		&& errno == EINTR
+	)
+		;
+	return result;
+}
+
+// Moves exactly length bytes out of a pipe that
+// already holds them
+static int splice_exactly(int in, int out, size_t length)
+{
+	while (length) {
+		const ssize_t moved = splice_some(in, out, length);
+		if (moved <= 0) {
+			if (!moved)
+				errno = EPIPE;
+			return 0;
+		}
+		length -= moved;
+	}
+	return 1;
+}
+
+static ssize_t copy_all(int in, int out, ssize_t total)
+{
+	char buffer[COPY_BUFFER_SIZE];
+	for (;;) {
+		ssize_t length = read(in, buffer, sizeof(buffer));
+		if (length < 0 && errno == EINTR)
+			continue;
+		if (length <= 0)
+			return length ? -1 : total;
+		for (ssize_t written = 0; written < length;) {
+			const ssize_t result = write(out, buffer + written, length - written);
+			if (result < 0 && errno != EINTR)
+				return -1;
+			if (result > 0)
+				written += result;
+		}
+		total += length;
+	}
+}
+
+static ssize_t splice_all(int in, int out)
+{
+	ssize_t total = 0;
+	for (;;) {
+		const ssize_t moved = splice_some(in, out, RELAY_CHUNK);
+		if (moved < 0 && errno == EINVAL && !total)
+			return copy_all(in, out, total);
+		if (moved <= 0)
+			return moved ? -1 : total;
+		total += moved;
+	}
+}
+
+ssize_t scallop_relay(int in, int out)
+{
+	if (is_pipe(in) || is_pipe(out))
+		return splice_all(in, out);
+
+	// Splicing needs a pipe on one side at least, so go
+	// through one of our own
+	int middle[2];
+	if (!scallop_pipe(middle, SCALLOP_PIPE_SIZE))
+		return -1;
+	ssize_t total = 0;
+	for (;;) {
+		const ssize_t moved = splice_some(in, middle[1], RELAY_CHUNK);
+		if (moved < 0 && errno == EINVAL && !total) {
+			close_pipe(middle);
+			return copy_all(in, out, 0);
+		}
+		if (moved <= 0) {
+			if (moved)
+				total = -1;
+			break;
+		}
+		if (!splice_exactly(middle[0], out, moved)) {
+			total = -1;
+			break;
+		}
+		total += moved;
+	}
+	const int error = errno;
+	close_pipe(middle);
+	errno = error;
+	return total;
+}
+
+ssize_t scallop_relay_tee(int in, int out, int copy)
+{
+	// tee() only goes from pipe to pipe, so anything
+	// else goes through pipes of our own
+	int staged_in[2] = { -1, -1 };
+	int staged_copy[2] = { -1, -1 };
+	if (
+		(!is_pipe(in) && !scallop_pipe(staged_in, SCALLOP_PIPE_SIZE))
+		|| (!is_pipe(copy) && !scallop_pipe(staged_copy, SCALLOP_PIPE_SIZE))
+	) {
+		close_pipe(staged_in);
+		return -1;
+	}
+	const int source = staged_in[0] >= 0 ? staged_in[0] : in;
+	const int copy_target = staged_copy[1] >= 0 ? staged_copy[1] : copy;
+
+	ssize_t total = 0;
+	for (;;) {
+		ssize_t pending = RELAY_CHUNK;
+		if (staged_in[0] >= 0) {
+			pending = splice_some(in, staged_in[1], RELAY_CHUNK);
+			if (pending <= 0) {
+				if (pending)
+					total = -1;
+				break;
+			}
+		}
+
+		// tee() returns 0 once a pipe with nothing left
+		// in it has no writers
+		ssize_t copied;
+		do {
+			while ((copied = tee(source, copy_target, pending, 0)) < 0 && errno == EINTR)
+				;
+			if (copied <= 0)
+				break;
+			if (
+				(staged_copy[0] >= 0 && !splice_exactly(staged_copy[0], copy, copied))
+				|| !splice_exactly(source, out, copied)
+			) {
+				copied = -1;
+				break;
+			}
+			total += copied;
+			pending = staged_in[0] >= 0 ? pending - copied : 0;
+		} while (pending > 0);
+
+		if (copied < 0)
+			total = -1;
+		if (copied <= 0)
+			break;
+	}
+
+	const int error = errno;
+	close_pipe(staged_in);
+	close_pipe(staged_copy);
+	errno = error;
+	return total;
+}
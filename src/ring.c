@@ -0,0 +1,328 @@
+/*
+ * Scallop - a shell for executing tasks concurrently
+ * Copyright (C) <year>  Marcus Harrison
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+// For memfd_create()
+#define _GNU_SOURCE
+
+#include "scallop/ring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define CACHE_LINE 64
+
+/*
+ * head and tail count every byte ever written and
+ * read, so they never wrap in practice, and the ring
+ * is empty when they're equal and full when they're
+ * capacity apart. Each is only written by one end, on
+ * its own cache line, so the two ends don't take the
+ * line from each other on every access.
+ *
+ * A waiter says it's waiting, reads the sequence it
+ * will sleep on, then checks once more whether to
+ * wait. The other end only bumps that sequence and
+ * wakes it if it said it was waiting, which, as both
+ * the flag and the index are sequentially consistent,
+ * it sees whenever the waiter's check missed the
+ * change. So the futex won't sleep through it, while
+ * a busy stream never touches the sequence at all.
+ */
+struct scallop_ring_header {
+	_Alignas(CACHE_LINE) atomic_uint_fast64_t head;
+	atomic_uint written_sequence;
+	atomic_uint writer_waiting;
+	atomic_uint writer_closed;
+	_Alignas(CACHE_LINE) atomic_uint_fast64_t tail;
+	atomic_uint read_sequence;
+	atomic_uint reader_waiting;
+	atomic_uint reader_closed;
+};
+
+static void futex_wait(atomic_uint *word, unsigned int expected)
+{
+	syscall(SYS_futex, word, FUTEX_WAIT, expected, NULL, NULL, 0);
+}
+
+static void futex_wake(atomic_uint *word)
+{
+	syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+// Polls this many times before sleeping, so a busy
+// stream of small messages rarely needs a system call.
+// With only one CPU, the other end can't run while
+// this one polls, so it goes straight to sleep.
+#define SPIN_LIMIT 2048
+
+static int spin_limit(void)
+{
+	static atomic_int limit = -1;
+	int current = atomic_load_explicit(&limit, memory_order_relaxed);
+	if (current < 0) {
+		current = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SPIN_LIMIT : 0;
+		atomic_store_explicit(&limit, current, memory_order_relaxed);
+	}
+	return current;
+}
+
+static void relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
+static size_t page_size(void)
+{
+	return (size_t)sysconf(_SC_PAGESIZE);
+}
+
+/*
+ * Maps the header page, then the data twice after it,
+ * into one reserved range, so the second copy follows
+ * the first exactly.
+ */
+static int map_ring(struct scallop_ring *ring, int fd, size_t capacity)
+{
+	const size_t header_size = page_size();
+	const size_t mapping_size = header_size + 2 * capacity;
+	char *base = mmap(NULL, mapping_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED)
+		return 0;
+	if (
+		mmap(base, header_size + capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED
+		|| mmap(
+			base + header_size + capacity,
+			capacity,
+			PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_FIXED,
+			fd,
+			header_size
+		) == MAP_FAILED
+	) {
+		const int error = errno;
+		munmap(base, mapping_size);
+		errno = error;
+		return 0;
+	}
+
+	ring->header = (struct scallop_ring_header *)base;
+	ring->data = base + header_size;
+	ring->capacity = capacity;
+	ring->mapping_size = mapping_size;
+	ring->fd = fd;
+	return 1;
+}
+
+int scallop_ring_create(struct scallop_ring *ring, size_t capacity)
+{
+	size_t rounded = page_size();
+	while (rounded < capacity)
+		rounded *= 2;
+
+	const int fd = memfd_create("scallop-ring", MFD_CLOEXEC);
+	if (fd < 0)
+		return 0;
+	// A new memfd is all zeroes, which is an empty ring
+	if (ftruncate(fd, page_size() + rounded) < 0 || !map_ring(ring, fd, rounded)) {
+		const int error = errno;
+		close(fd);
+		errno = error;
+		return 0;
+	}
+	return 1;
+}
+
+int scallop_ring_map(struct scallop_ring *ring, int fd)
+{
+	struct stat status;
+	if (fstat(fd, &status) < 0)
+		return 0;
+	const size_t header_size = page_size();
+	const size_t capacity = (size_t)status.st_size - header_size;
+	if ((size_t)status.st_size <= header_size || capacity & (capacity - 1)) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	const int own_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+	if (own_fd < 0)
+		return 0;
+	if (!map_ring(ring, own_fd, capacity)) {
+		const int error = errno;
+		close(own_fd);
+		errno = error;
+		return 0;
+	}
+	return 1;
+}
+
+void scallop_ring_unmap(struct scallop_ring *ring)
+{
+	munmap(ring->header, ring->mapping_size);
+	close(ring->fd);
+	*ring = (struct scallop_ring) { .fd = -1 };
+}
+
+static void notify(atomic_uint *sequence, atomic_uint *waiting)
+{
+	if (!atomic_load(waiting))
+		return;
+	atomic_fetch_add(sequence, 1);
+	futex_wake(sequence);
+}
+
+/*
+ * Writing
+ */
+
+char *scallop_ring_reserve(struct scallop_ring *ring, size_t *length)
+{
+	struct scallop_ring_header *header = ring->header;
+	const uint64_t head = atomic_load_explicit(&header->head, memory_order_relaxed);
+	const int limit = spin_limit();
+	for (int spins = 0;; spins++) {
+		if (atomic_load_explicit(&header->reader_closed, memory_order_relaxed)) {
+			errno = EPIPE;
+			return NULL;
+		}
+		const uint64_t tail = atomic_load_explicit(&header->tail, memory_order_acquire);
+		if (head - tail < ring->capacity) {
+			*length = ring->capacity - (head - tail);
+			return ring->data + (head & (ring->capacity - 1));
+		}
+		if (spins < limit) {
+			relax();
+			continue;
+		}
+
+		atomic_store(&header->writer_waiting, 1);
+		const unsigned int sequence = atomic_load(&header->read_sequence);
+		if (
+			atomic_load(&header->tail) == tail
+			&& !atomic_load(&header->reader_closed)
+		)
+			futex_wait(&header->read_sequence, sequence);
+		atomic_store(&header->writer_waiting, 0);
+	}
+}
+
+void scallop_ring_commit(struct scallop_ring *ring, size_t length)
+{
+	struct scallop_ring_header *header = ring->header;
+	atomic_store(&header->head, atomic_load_explicit(&header->head, memory_order_relaxed) + length);
+	notify(&header->written_sequence, &header->reader_waiting);
+}
+
+ssize_t scallop_ring_write(struct scallop_ring *ring, const void *buffer, size_t length)
+{
+	const char *current = buffer;
+	size_t remaining = length;
+	while (remaining) {
+		size_t room;
+		char *space = scallop_ring_reserve(ring, &room);
+		if (!space)
+			return -1;
+		const size_t count = remaining < room ? remaining : room;
+		memcpy(space, current, count);
+		scallop_ring_commit(ring, count);
+		current += count;
+		remaining -= count;
+	}
+	return (ssize_t)length;
+}
+
+void scallop_ring_close_writer(struct scallop_ring *ring)
+{
+	atomic_store(&ring->header->writer_closed, 1);
+	notify(&ring->header->written_sequence, &ring->header->reader_waiting);
+}
+
+/*
+ * Reading
+ */
+
+const char *scallop_ring_peek(struct scallop_ring *ring, size_t *length)
+{
+	struct scallop_ring_header *header = ring->header;
+	const uint64_t tail = atomic_load_explicit(&header->tail, memory_order_relaxed);
+	const int limit = spin_limit();
+	for (int spins = 0;; spins++) {
+		// Check closed first, so nothing written before
+		// closing gets missed
+		const unsigned int closed = atomic_load(&header->writer_closed);
+		const uint64_t head = atomic_load_explicit(&header->head, memory_order_acquire);
+		if (head != tail) {
+			*length = head - tail;
+			return ring->data + (tail & (ring->capacity - 1));
+		}
+		if (closed) {
+			*length = 0;
+			return NULL;
+		}
+		if (spins < limit) {
+			relax();
+			continue;
+		}
+
+		atomic_store(&header->reader_waiting, 1);
+		const unsigned int sequence = atomic_load(&header->written_sequence);
+		if (
+			atomic_load(&header->head) == head
+			&& !atomic_load(&header->writer_closed)
+		)
+			futex_wait(&header->written_sequence, sequence);
+		atomic_store(&header->reader_waiting, 0);
+	}
+}
+
+void scallop_ring_consume(struct scallop_ring *ring, size_t length)
+{
+	struct scallop_ring_header *header = ring->header;
+	atomic_store(&header->tail, atomic_load_explicit(&header->tail, memory_order_relaxed) + length);
+	notify(&header->read_sequence, &header->writer_waiting);
+}
+
+ssize_t scallop_ring_read(struct scallop_ring *ring, void *buffer, size_t length)
+{
+	size_t available;
+	const char *data = scallop_ring_peek(ring, &available);
+	if (!data)
+		return 0;
+	const size_t count = length < available ? length : available;
+	memcpy(buffer, data, count);
+	scallop_ring_consume(ring, count);
+	return (ssize_t)count;
+}
+
+void scallop_ring_close_reader(struct scallop_ring *ring)
+{
+	atomic_store(&ring->header->reader_closed, 1);
+	notify(&ring->header->read_sequence, &ring->header->writer_waiting);
+}
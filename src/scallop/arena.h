@@ -0,0 +1,58 @@
+/*
+ * Scallop - a shell for executing tasks concurrently
+ * Copyright (C) 2022  Marcus Harrison
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef SCALLOP_ARENA_H
+#define SCALLOP_ARENA_H
+
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief Hands out memory from a buffer the caller
+ * 	owns, one allocation after another, to be freed
+ * 	all at once by resetting it.
+ */
+struct scallop_arena {
+	char *begin;
+	char *current;
+	char *end;
+};
+
+/**
+ * \brief Creates an arena over size bytes at buffer.
+ */
+struct scallop_arena scallop_arena_make(void *buffer, ssize_t size);
+
+/**
+ * \brief Returns size bytes from the arena, or NULL
+ * 	if there isn't room; the memory isn't aligned.
+ */
+char *scallop_arena_alloc(struct scallop_arena *arena, ssize_t size);
+
+/**
+ * \brief Frees everything allocated from the arena.
+ */
+void scallop_arena_reset(struct scallop_arena *arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SCALLOP_ARENA_H
@@ -0,0 +1,337 @@
+/*
+ * Scallop - a shell for executing tasks concurrently
+ * Copyright (C) <year>  Marcus Harrison
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef SCALLOP_BUILTIN_H
+#define SCALLOP_BUILTIN_H
+
+#include "scallop/environment.h"
+#include "scallop/executor.h"
+#include "scallop/launch.h"
+#include "scallop/parser.h"
+#include "scallop/path_cache.h"
+#include "scallop/ring.h"
+#include "scallop/symbols.h"
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum SCALLOP_VFD {
+	SCALLOP_VFD_CLOSED,
+	// A real file descriptor
+	SCALLOP_VFD_FD,
+	// The ends of a binary pipe between two stages
+	// running in the shell
+	SCALLOP_VFD_RING_READER,
+	SCALLOP_VFD_RING_WRITER,
+};
+
+/**
+ * \brief One of a task's file descriptors.
+ *
+ * owned says whether the task closes it once it's
+ * done: the fd itself, or its end of the ring.
+ */
+struct scallop_vfd {
+	enum SCALLOP_VFD kind;
+	int fd;
+	struct scallop_ring *ring;
+	char owned;
+};
+
+/**
+ * \brief The number of file descriptors a task has.
+ */
+#define SCALLOP_TASK_FDS 10
+
+/**
+ * \brief What a command run by the shell starts with:
+ * 	its own table of file descriptors, its own
+ * 	working directory, and its own variables.
+ *
+ * Builtins run on the shell's threads, so redirecting
+ * one, or changing its directory, has to leave the
+ * shell's real ones alone; they go through the task
+ * instead. External commands start with the task's
+ * descriptors as their real ones.
+ *
+ * directory is NULL for the shell's own working
+ * directory, or otherwise belongs to the task.
+ * environment is NULL for the shell's own environment,
+ * which can't be changed, or otherwise a reference the
+ * task holds; setting a variable replaces it with a
+ * new one.
+ */
+struct scallop_task {
+	struct scallop_vfd fds[SCALLOP_TASK_FDS];
+	char *directory;
+	struct scallop_environment *environment;
+};
+
+/**
+ * \brief Starts a task with the shell's standard
+ * 	input, output, and error, its working directory,
+ * 	and its environment.
+ */
+void scallop_task_init(struct scallop_task *task);
+
+/**
+ * \brief Starts a task with the same file descriptors,
+ * 	directory, and environment as parent, without
+ * 	taking over any of parent's.
+ *
+ * The environment is shared rather than copied, until
+ * either task changes it. Returns 1, or 0 if there's
+ * no memory to copy the directory, in which case task
+ * holds nothing that needs freeing.
+ */
+int scallop_task_inherit(struct scallop_task *task, const struct scallop_task *parent);
+
+/**
+ * \brief Closes the task's file descriptors, and
+ * 	frees its directory and environment.
+ */
+void scallop_task_free(struct scallop_task *task);
+
+/**
+ * \brief Closes one of the task's file descriptors.
+ *
+ * If fd owned its end of a ring, and another of the
+ * task's descriptors is a copy of it, the copy takes
+ * it over instead, so the other end doesn't see it
+ * closed early.
+ */
+void scallop_task_close(struct scallop_task *task, int fd);
+
+/**
+ * \brief Applies redirections to the task's file
+ * 	descriptors, the same way scallop_launch() does
+ * 	to a process's.
+ *
+ * Relative paths are opened from the task's directory.
+ * Returns 1, or 0 with errno set at the first one
+ * that fails.
+ */
+int scallop_task_redirect(
+	struct scallop_task *task,
+	const struct scallop_redirect *redirects,
+	ssize_t count
+);
+
+/**
+ * \brief Writes all length bytes to the task's file
+ * 	descriptor fd, returning length, or -1 with errno
+ * 	set.
+ *
+ * The shell should ignore SIGPIPE, so a builtin whose
+ * reader has gone gets EPIPE here rather than taking
+ * the shell down with it.
+ */
+ssize_t scallop_task_write(
+	struct scallop_task *task,
+	int fd,
+	const void *buffer,
+	size_t length
+);
+
+/**
+ * \brief Reads up to length bytes from the task's file
+ * 	descriptor fd, returning how many, 0 at EOF, or
+ * 	-1 with errno set.
+ */
+ssize_t scallop_task_read(struct scallop_task *task, int fd, void *buffer, size_t length);
+
+/**
+ * \brief A command run in the shell itself, returning
+ * 	its exit status.
+ *
+ * It's called on whichever thread runs its statement,
+ * so anything it reads or writes has to go through
+ * task, and anything it keeps has to be thread-safe.
+ */
+typedef int scallop_builtin_fn(struct scallop_task *task, int argc, char *const *argv);
+
+/**
+ * \brief A table of builtins by name.
+ *
+ * Looking builtins up is safe from any number of
+ * threads, as long as none are being added.
+ */
+struct scallop_builtins;
+
+/**
+ * \brief Creates a table holding the standard
+ * 	builtins: cd, echo, export, false, printf, test
+ * 	and [, true, and unset.
+ *
+ * Returns NULL if there's no memory for it.
+ */
+struct scallop_builtins *scallop_builtins_create(void);
+
+/**
+ * \brief Adds a builtin, or replaces the one with the
+ * 	same name, returning 1, or 0 if there's no memory
+ * 	for it.
+ *
+ * name has to outlive the table.
+ */
+int scallop_builtins_add(
+	struct scallop_builtins *builtins,
+	const char *name,
+	scallop_builtin_fn *run
+);
+
+/**
+ * \brief Finds the builtin called name, or returns
+ * 	NULL if there isn't one.
+ */
+scallop_builtin_fn *scallop_builtins_find(
+	const struct scallop_builtins *builtins,
+	const char *name
+);
+
+/**
+ * \brief Interns every builtin's name in symbols, so
+ * 	scallop_builtins_find_symbol() can find them by
+ * 	symbol, returning 1, or 0 if there's no memory.
+ *
+ * Builtins added later are interned as they're added;
+ * symbols has to outlive the table.
+ */
+int scallop_builtins_intern(
+	struct scallop_builtins *builtins,
+	struct scallop_symbols *symbols
+);
+
+/**
+ * \brief Finds the builtin whose name has symbol in
+ * 	the table given to scallop_builtins_intern(), or
+ * 	returns NULL if there isn't one.
+ *
+ * It only has to index an array, rather than compare
+ * names. Pipelines still find their builtins with
+ * scallop_builtins_find(), as the parser doesn't keep
+ * the symbols the lexer gives words.
+ */
+scallop_builtin_fn *scallop_builtins_find_symbol(
+	const struct scallop_builtins *builtins,
+	uint32_t symbol
+);
+
+void scallop_builtins_free(struct scallop_builtins *builtins);
+
+/**
+ * \brief Runs a pipeline of commands, builtins in the
+ * 	shell and the rest as processes, returning the
+ * 	last one's exit status.
+ *
+ * Each stage starts with task's file descriptors and
+ * directory, then gets the pipes between stages, then
+ * its own redirections. binary, if not NULL, says for
+ * each pair of neighbouring stages whether they're
+ * joined by a binary pipe, which is a ring when both
+ * are builtins, or otherwise a pipe of
+ * SCALLOP_PIPE_SIZE.
+ *
+ * A builtin running alone runs in task itself, bar its
+ * redirections, so cd changes task's directory, and
+ * export and unset its environment. In a
+ * pipeline, each builtin gets a task of its own, the
+ * last running on the calling thread and the rest on
+ * threads of their own: a pool can't promise every
+ * stage a thread at once, and a stage blocked on a
+ * full pipe would wait forever for a reader that never
+ * got one.
+ *
+ * Processes are looked up in paths, if it isn't NULL,
+ * so they don't have to search PATH every time, unless
+ * their task has an environment of its own whose PATH
+ * isn't the one paths searches. They
+ * get the command's envp if it has one, or else their
+ * task's environment, if that isn't NULL. They're
+ * waited for with scallop_executor_wait_children(), if
+ * executor isn't NULL, so a worker of its can run
+ * other statements meanwhile; otherwise the calling
+ * thread waits for each in turn.
+ *
+ * A stage that can't be started says so on its
+ * standard error, and exits as in other shells: with
+ * 127 if the command isn't found, 1 if a redirection
+ * fails, or 126 for anything else, such as a process
+ * reaped by something else before it could be waited
+ * for. A process killed by a signal exits with 128
+ * plus the signal's number.
+ */
+int scallop_run_pipeline(
+	const struct scallop_builtins *builtins,
+	struct scallop_path_cache *paths,
+	struct scallop_executor *executor,
+	struct scallop_task *task,
+	const struct scallop_command *commands,
+	const char *binary,
+	ssize_t count,
+	enum SCALLOP_LAUNCH_METHOD method
+);
+
+/**
+ * \brief What scallop_run_statement() needs: the
+ * 	script's source, the builtins and PATH cache, the
+ * 	task every statement starts from, and the executor
+ * 	running them, for waiting on their processes.
+ */
+struct scallop_statement_context {
+	const char *begin;
+	const char *end;
+	const struct scallop_builtins *builtins;
+	struct scallop_path_cache *paths;
+	const struct scallop_task *task;
+	enum SCALLOP_LAUNCH_METHOD method;
+	struct scallop_executor *executor;
+};
+
+/**
+ * \brief Runs a statement's pipeline with
+ * 	scallop_run_pipeline(), in a task inheriting from
+ * 	the context's, for scallop_execute_block().
+ *
+ * context is a struct scallop_statement_context. Words
+ * become arguments with scallop_token_value(); blocks
+ * and lists aren't run as arguments yet, and make the
+ * statement exit with 2.
+ *
+ * Words starting a stage that look like NAME=value,
+ * with an unquoted name of letters, digits and
+ * underscores not starting with a digit, set variables
+ * in that stage's task instead, as in other shells. A
+ * statement of only those does nothing, as nothing
+ * outlives its task; in a longer pipeline, every stage
+ * needs a command after them.
+ */
+int scallop_run_statement(
+	const struct scallop_ast *ast,
+	uint32_t statement,
+	void *context
+);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // SCALLOP_BUILTIN_H
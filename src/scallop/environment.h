@@ -0,0 +1,159 @@
+/*
+ * Scallop - a shell for executing tasks concurrently
+ * Copyright (C) <year>  Marcus Harrison
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef SCALLOP_ENVIRONMENT_H
+#define SCALLOP_ENVIRONMENT_H
+
+#include "scallop/symbols.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief A set of variables, by the symbol of their
+ * 	name, that never changes once it's made.
+ *
+ * Setting or unsetting a variable makes a new
+ * environment, sharing everything but the few nodes
+ * on the way to that variable with the old one, so
+ * tasks running at once can each have their own
+ * without copying any. Handing one to another task is
+ * just taking a reference with
+ * scallop_environment_fork().
+ *
+ * References can be taken and released from any
+ * thread.
+ */
+struct scallop_environment;
+
+/**
+ * \brief Creates an empty environment, whose names are
+ * 	interned in symbols, or returns NULL with errno
+ * 	set.
+ *
+ * symbols has to outlive every environment made from
+ * this one.
+ */
+struct scallop_environment *scallop_environment_create(
+	struct scallop_symbols *symbols
+);
+
+/**
+ * \brief Creates an environment holding the NAME=value
+ * 	strings in envp, or the shell's own environment
+ * 	if envp is NULL, or returns NULL with errno set.
+ *
+ * Strings without an = are skipped, and later ones win
+ * over earlier ones with the same name.
+ */
+struct scallop_environment *scallop_environment_import(
+	struct scallop_symbols *symbols,
+	char *const *envp
+);
+
+/**
+ * \brief Takes another reference to environment,
+ * 	returning it.
+ */
+struct scallop_environment *scallop_environment_fork(
+	struct scallop_environment *environment
+);
+
+/**
+ * \brief Releases a reference to environment, freeing
+ * 	whatever no other environment shares once the
+ * 	last one goes. NULL is ignored.
+ */
+void scallop_environment_release(struct scallop_environment *environment);
+
+/**
+ * \brief The table the environment's names are
+ * 	interned in.
+ */
+struct scallop_symbols *scallop_environment_symbols(
+	const struct scallop_environment *environment
+);
+
+/**
+ * \brief The number of variables set.
+ */
+size_t scallop_environment_count(const struct scallop_environment *environment);
+
+/**
+ * \brief Returns the value of the variable named by
+ * 	symbol, null terminated, and stores its length in
+ * 	length if that isn't NULL; or returns NULL if it
+ * 	isn't set.
+ *
+ * The value lasts as long as environment does.
+ */
+const char *scallop_environment_get(
+	const struct scallop_environment *environment,
+	uint32_t symbol,
+	size_t *length
+);
+
+/**
+ * \brief Returns a new environment like environment,
+ * 	but with the variable named by symbol set to the
+ * 	length bytes at value; or NULL with errno set.
+ *
+ * symbol has to be from the environment's table;
+ * otherwise errno is EINVAL. environment is left as it
+ * was, and still has to be released.
+ */
+struct scallop_environment *scallop_environment_set(
+	struct scallop_environment *environment,
+	uint32_t symbol,
+	const char *value,
+	size_t length
+);
+
+/**
+ * \brief Returns a new environment like environment,
+ * 	but without the variable named by symbol; or NULL
+ * 	with errno set.
+ *
+ * If the variable isn't set, that's another reference
+ * to environment itself.
+ */
+struct scallop_environment *scallop_environment_unset(
+	struct scallop_environment *environment,
+	uint32_t symbol
+);
+
+/**
+ * \brief Returns the environment as NAME=value
+ * 	strings, ending with NULL, for scallop_launch();
+ * 	or NULL with errno set.
+ *
+ * The array is built the first time it's asked for,
+ * and kept with the environment, so launching any
+ * number of commands with it only builds it once. It
+ * lasts as long as environment does.
+ */
+char *const *scallop_environment_envp(struct scallop_environment *environment);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // SCALLOP_ENVIRONMENT_H
@@ -0,0 +1,190 @@
+/*
+ * Scallop - a shell for executing tasks concurrently
+ * Copyright (C) <year>  Marcus Harrison
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef SCALLOP_EVENT_LOOP_H
+#define SCALLOP_EVENT_LOOP_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief Waits on child processes, readable file
+ * 	descriptors and timers all at once.
+ *
+ * Everything is an fd in one epoll instance - a pidfd
+ * per child, a timerfd per timer - so each event costs
+ * the same however many tens of thousands are being
+ * waited on, and no signal handler is involved.
+ *
+ * Where pidfds aren't available, the loop reads
+ * SIGCHLD from a signalfd instead, reaping whichever
+ * children have exited. For that, SIGCHLD gets blocked
+ * in the thread creating the loop, and has to stay
+ * blocked in every other thread, so the loop should
+ * be created before any others are started. In that
+ * mode the loop reaps every child of the process, so
+ * any that are launched should be watched.
+ *
+ * A loop is only for one thread at a time.
+ */
+struct scallop_event_loop;
+
+/**
+ * \brief Something being waited on, for cancelling it
+ * 	with scallop_unwatch().
+ */
+struct scallop_watch;
+
+enum SCALLOP_EVENT {
+	SCALLOP_EVENT_EXIT,
+	SCALLOP_EVENT_READABLE,
+	SCALLOP_EVENT_TIMER,
+};
+
+/**
+ * \brief What happened to a watch.
+ *
+ * For SCALLOP_EVENT_EXIT, pid and status are the
+ * child's, status as from waitpid(), and the child has
+ * been reaped - or status is -1 if something else
+ * reaped it first. For SCALLOP_EVENT_READABLE, fd is the
+ * descriptor that can be read from, or that hit EOF
+ * or an error, which a read will tell apart.
+ */
+struct scallop_event {
+	enum SCALLOP_EVENT kind;
+	struct scallop_watch *watch;
+	void *context;
+	pid_t pid;
+	int status;
+	int fd;
+};
+
+typedef void scallop_event_fn(
+	struct scallop_event_loop *loop,
+	const struct scallop_event *event
+);
+
+enum SCALLOP_EVENT_LOOP_FLAG {
+	// Use the signalfd loop even if pidfds work
+	SCALLOP_EVENT_LOOP_NO_PIDFD = 1,
+};
+
+/**
+ * \brief Creates an event loop, with flags from
+ * 	SCALLOP_EVENT_LOOP_FLAG.
+ *
+ * Returns NULL with errno set on failure.
+ */
+struct scallop_event_loop *scallop_event_loop_create(int flags);
+
+/**
+ * \brief Returns 1 if the loop waits on pidfds, or 0
+ * 	if it fell back to a signalfd.
+ */
+int scallop_event_loop_uses_pidfd(const struct scallop_event_loop *loop);
+
+/**
+ * \brief Frees the loop, and anything still being
+ * 	watched. Children aren't reaped, and watched fds
+ * 	aren't closed.
+ */
+void scallop_event_loop_destroy(struct scallop_event_loop *loop);
+
+/**
+ * \brief Calls fn once pid, a child of this process,
+ * 	exits, then stops watching it.
+ *
+ * Returns NULL with errno set on failure, such as the
+ * child having been reaped already.
+ */
+struct scallop_watch *scallop_watch_child(
+	struct scallop_event_loop *loop,
+	pid_t pid,
+	scallop_event_fn *fn,
+	void *context
+);
+
+/**
+ * \brief Calls fn every time fd can be read from,
+ * 	until it's unwatched.
+ *
+ * fd should be non-blocking, if fn reads more than
+ * once. Returns NULL with errno set on failure.
+ */
+struct scallop_watch *scallop_watch_readable(
+	struct scallop_event_loop *loop,
+	int fd,
+	scallop_event_fn *fn,
+	void *context
+);
+
+/**
+ * \brief Calls fn once, after nanoseconds, then stops
+ * 	watching the timer.
+ *
+ * Returns NULL with errno set on failure.
+ */
+struct scallop_watch *scallop_watch_timer(
+	struct scallop_event_loop *loop,
+	int64_t nanoseconds,
+	scallop_event_fn *fn,
+	void *context
+);
+
+/**
+ * \brief Stops watching, without calling its function.
+ *
+ * Can be called from any function called by the loop,
+ * including for events still to be handled in the
+ * same round, which then won't be.
+ */
+void scallop_unwatch(struct scallop_event_loop *loop, struct scallop_watch *watch);
+
+/**
+ * \brief Returns the number of things being watched.
+ */
+ssize_t scallop_event_loop_watch_count(const struct scallop_event_loop *loop);
+
+/**
+ * \brief Waits up to timeout_ms, or forever if it's
+ * 	negative, for at least one event, then calls the
+ * 	functions for everything that's happened.
+ *
+ * Returns the number of events handled, or -1 with
+ * errno set on failure.
+ */
+ssize_t scallop_event_loop_run_once(struct scallop_event_loop *loop, int timeout_ms);
+
+/**
+ * \brief Handles events until nothing is left being
+ * 	watched.
+ *
+ * Returns 1 once nothing is, or 0 with errno set on
+ * failure.
+ */
+int scallop_event_loop_run(struct scallop_event_loop *loop);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // SCALLOP_EVENT_LOOP_H
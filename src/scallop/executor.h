@@ -0,0 +1,134 @@
+/*
+ * Scallop - a shell for executing tasks concurrently
+ * Copyright (C) 2022  Marcus Harrison
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef SCALLOP_EXECUTOR_H
+#define SCALLOP_EXECUTOR_H
+
+#include "scallop/parser.h"
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief Runs statements on a fixed pool of worker
+ * 	threads.
+ *
+ * Each worker keeps its own deque of tasks, taking
+ * the newest from its end while idle workers steal
+ * the oldest from the other, so the tasks a block
+ * spawns spread across the pool without going through
+ * a shared queue.
+ */
+struct scallop_executor;
+
+/**
+ * \brief Runs one statement, returning its status,
+ * 	0 meaning success.
+ *
+ * It's called on a worker thread, and may itself call
+ * scallop_execute_block(), for a block among the
+ * statement's arguments, say.
+ */
+typedef int scallop_statement_fn(
+	const struct scallop_ast *ast,
+	uint32_t statement,
+	void *context
+);
+
+/**
+ * \brief Starts an executor with up to parallelism
+ * 	worker threads, or one per online CPU if
+ * 	parallelism isn't positive.
+ *
+ * Besides the workers, a thread of its own waits on
+ * children for scallop_executor_wait_children(),
+ * through a scallop_event_loop. Where that loop has
+ * to fall back to a signalfd, SIGCHLD stays blocked
+ * in the calling thread, and the executor should be
+ * created before any other threads are started.
+ *
+ * Returns NULL with errno set if it can't be started.
+ */
+struct scallop_executor *scallop_executor_create(int parallelism);
+
+/**
+ * \brief Returns the number of worker threads.
+ */
+int scallop_executor_parallelism(const struct scallop_executor *executor);
+
+/**
+ * \brief Waits for the workers to finish what they're
+ * 	running, then stops them and frees the executor.
+ *
+ * No scallop_execute_block() calls may still be
+ * waiting.
+ */
+void scallop_executor_destroy(struct scallop_executor *executor);
+
+/**
+ * \brief Runs each statement of the block node at
+ * 	block concurrently, waiting for all of them.
+ *
+ * Returns 0 if every statement's status was 0, or the
+ * status of one that wasn't.
+ *
+ * Called from a worker, the statements go on its own
+ * deque, and it runs tasks while it waits, so nested
+ * blocks don't tie up a thread each. If there isn't
+ * memory for the statements' tasks, they're run one
+ * after another on the calling thread instead.
+ */
+int scallop_execute_block(
+	struct scallop_executor *executor,
+	const struct scallop_ast *ast,
+	uint32_t block,
+	scallop_statement_fn *run,
+	void *context
+);
+
+/**
+ * \brief Waits for count children of this process to
+ * 	exit, storing each one's status, as from
+ * 	waitpid(), in statuses.
+ *
+ * The children are watched by the executor's event
+ * loop, a pidfd each, all in one epoll instance.
+ * Called from a worker, it runs other tasks while it
+ * waits, as for a nested block, so children don't tie
+ * up a thread each; from anywhere else, it just waits.
+ *
+ * Children the loop can't watch, for want of fds or
+ * memory, are waited for on the calling thread. A
+ * status is -1 if something else reaped the child
+ * first.
+ */
+void scallop_executor_wait_children(
+	struct scallop_executor *executor,
+	const pid_t *pids,
+	ssize_t count,
+	int *statuses
+);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // SCALLOP_EXECUTOR_H
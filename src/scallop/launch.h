@@ -0,0 +1,111 @@
+/*
+ * Scallop - a shell for executing tasks concurrently
+ * Copyright (C) <year>  Marcus Harrison
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef SCALLOP_LAUNCH_H
+#define SCALLOP_LAUNCH_H
+
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum SCALLOP_REDIRECT {
+	// Opens path with flags and mode as fd
+	SCALLOP_REDIRECT_OPEN,
+	// Makes fd a copy of source
+	SCALLOP_REDIRECT_DUP,
+	SCALLOP_REDIRECT_CLOSE,
+};
+
+/**
+ * \brief One change to the file descriptors a command
+ * 	starts with.
+ *
+ * Redirections are applied in order, so later ones
+ * see the effects of earlier ones: redirecting 1 to a
+ * file, then duplicating 1 as 2, sends both to the
+ * file.
+ */
+struct scallop_redirect {
+	enum SCALLOP_REDIRECT kind;
+	int fd;
+	int source;
+	const char *path;
+	int flags;
+	mode_t mode;
+};
+
+/**
+ * \brief How a command's process gets created.
+ *
+ * SCALLOP_LAUNCH_SPAWN uses posix_spawn(), which on
+ * Linux shares the shell's memory with the child until
+ * it execs, so it costs the same however big the shell
+ * has grown. SCALLOP_LAUNCH_FORK copies the shell's
+ * page tables first, and is only there to compare
+ * against.
+ */
+enum SCALLOP_LAUNCH_METHOD {
+	SCALLOP_LAUNCH_SPAWN,
+	SCALLOP_LAUNCH_FORK,
+};
+
+/**
+ * \brief An external command, ready to launch.
+ *
+ * path is the file to execute, or NULL to use
+ * argv[0], which is looked up in PATH unless it
+ * contains a slash. envp is the command's whole
+ * environment, or NULL for the shell's own. directory
+ * is where it starts, or NULL for the shell's own
+ * working directory; relative paths in argv[0] and
+ * the redirections are looked up from there.
+ */
+struct scallop_command {
+	char *const *argv;
+	char *const *envp;
+	const struct scallop_redirect *redirects;
+	ssize_t redirect_count;
+	const char *directory;
+	const char *path;
+};
+
+/**
+ * \brief Starts command in a new process.
+ *
+ * Returns the process's pid, to be waited for as
+ * usual, or -1 with errno set if it couldn't be
+ * started. Failing to find or execute the command, or
+ * to apply a redirection, is reported here rather than
+ * as the child's exit status, whichever method is
+ * used.
+ *
+ * The child starts with no signals blocked and
+ * SIGPIPE at its default action, whatever the shell
+ * has set for itself.
+ */
+pid_t scallop_launch(
+	const struct scallop_command *command,
+	enum SCALLOP_LAUNCH_METHOD method
+);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // SCALLOP_LAUNCH_H
@@ -18,6 +18,9 @@
 #ifndef SCALLOP_LEXER_H
 #define SCALLOP_LEXER_H
 
+#include "scallop/arena.h"
+#include "scallop/symbols.h"
+
 #include <csalt/stores.h>
 #include <stdint.h>
 
@@ -39,6 +42,17 @@ enum SCALLOP_TOKEN {
 	SCALLOP_TOKEN_BINARY_PIPE,
 };
 
+/**
+ * \brief What the lexer came across in a token, which
+ * 	scallop_token_value() would have to undo.
+ */
+enum SCALLOP_TOKEN_FLAG {
+	SCALLOP_TOKEN_QUOTED = 1 << 0,
+	SCALLOP_TOKEN_DOUBLE_QUOTED = 1 << 1,
+	SCALLOP_TOKEN_ESCAPED = 1 << 2,
+	SCALLOP_TOKEN_NON_ASCII = 1 << 3,
+};
+
 /**
  * \brief Represents a single token.
  *
@@ -57,6 +71,10 @@ enum SCALLOP_TOKEN {
  * You are expected to use start_offset and
  * end_offset to read out the raw values from the
  * original store.
+ *
+ * flags holds the SCALLOP_TOKEN_FLAG values for
+ * what's in the token, so values that need no quotes
+ * or escapes removing can be used as they are.
  */
 struct scallop_parse_token {
 	int32_t token;
@@ -64,6 +82,7 @@ struct scallop_parse_token {
 	int64_t end_offset;
 	int64_t row;
 	int64_t col;
+	uint32_t flags;
 };
 
 /**
@@ -72,12 +91,480 @@ struct scallop_parse_token {
  *
  * Pass a zero-initialized token for the beginning of
  * lexing; to continue lexing, pass the previously-returned token.
+ *
+ * A character that isn't valid UTF-8, or is a control
+ * character the lexer has no use for, ends lexing with
+ * an EOF token whose start_offset is -1, and whose
+ * end_offset is the character's.
  */
 struct scallop_parse_token scallop_lex(
 	csalt_store *source,
 	struct scallop_parse_token token
 );
 
+/**
+ * \brief Lexes tokens from the source into the array
+ * 	between tokens_begin and tokens_end.
+ *
+ * Lexing stops after an EOF token is written, or when
+ * the array is full. Returns a pointer one past the
+ * last token written.
+ *
+ * Pass a zero-initialized token to lex from the beginning
+ * of the source; to continue lexing after filling an
+ * array, pass the last token written to it.
+ */
+struct scallop_parse_token *scallop_lex_batch(
+	csalt_store *source,
+	struct scallop_parse_token token,
+	struct scallop_parse_token *tokens_begin,
+	struct scallop_parse_token *tokens_end
+);
+
+/**
+ * \brief Like scallop_lex(), but reads the UTF-8
+ * 	source code directly from the memory between
+ * 	begin and end.
+ *
+ * This avoids going through the store interface for
+ * every character, and should be preferred when the
+ * source is already in memory. Reading past end
+ * behaves as if a null character was read.
+ */
+struct scallop_parse_token scallop_lex_memory(
+	const char *begin,
+	const char *end,
+	struct scallop_parse_token token
+);
+
+/**
+ * \brief Like scallop_lex_batch(), but reads the UTF-8
+ * 	source code directly from the memory between
+ * 	begin and end.
+ */
+struct scallop_parse_token *scallop_lex_memory_batch(
+	const char *begin,
+	const char *end,
+	struct scallop_parse_token token,
+	struct scallop_parse_token *tokens_begin,
+	struct scallop_parse_token *tokens_end
+);
+
+/**
+ * \brief Where scallop_validate_utf8() found the first
+ * 	character it rejected.
+ *
+ * row and col are what a token ending on that
+ * character would have, or -1 if memory ran out
+ * working them out.
+ */
+struct scallop_utf8_error {
+	int64_t offset;
+	int64_t row;
+	int64_t col;
+};
+
+/**
+ * \brief Checks the source between begin and end is
+ * 	valid UTF-8, returning 1 if so, or 0 after filling
+ * 	in error if not.
+ *
+ * Control characters the lexer has no use for are
+ * rejected too, leaving null, tab, newline, and
+ * carriage return; so a validated source never
+ * reaches a character the lexer doesn't know what to
+ * do with.
+ */
+int scallop_validate_utf8(
+	const char *begin,
+	const char *end,
+	struct scallop_utf8_error *error
+);
+
+/**
+ * \brief Like scallop_lex_memory_batch(), but for a
+ * 	source scallop_validate_utf8() has accepted.
+ *
+ * Multibyte characters are stepped over whole, rather
+ * than one continuation character at a time. The
+ * tokens are the same; lexing a source that hasn't
+ * been validated this way is undefined.
+ */
+struct scallop_parse_token *scallop_lex_validated_batch(
+	const char *begin,
+	const char *end,
+	struct scallop_parse_token token,
+	struct scallop_parse_token *tokens_begin,
+	struct scallop_parse_token *tokens_end
+);
+
+/**
+ * \brief Like scallop_lex_memory_batch(), but also
+ * 	interns every plain word in symbols, storing each
+ * 	token's symbol in symbols_out, at the same index
+ * 	as the token.
+ *
+ * Plain words are those without the
+ * SCALLOP_TOKEN_QUOTED, SCALLOP_TOKEN_DOUBLE_QUOTED, or
+ * SCALLOP_TOKEN_ESCAPED flags, whose values are their
+ * bytes. They're hashed as they're lexed, so interning
+ * one only reads it again to compare it with the name
+ * it's matched to. Every other token gets
+ * SCALLOP_SYMBOL_NONE, as do words there wasn't memory
+ * to intern.
+ */
+struct scallop_parse_token *scallop_lex_memory_interned_batch(
+	const char *begin,
+	const char *end,
+	struct scallop_parse_token token,
+	struct scallop_symbols *symbols,
+	struct scallop_parse_token *tokens_begin,
+	struct scallop_parse_token *tokens_end,
+	uint32_t *symbols_out
+);
+
+/**
+ * \brief A pair of bracket token indices, either of
+ * 	which may be -1.
+ */
+struct scallop_bracket_match {
+	ssize_t open;
+	ssize_t close;
+};
+
+/**
+ * \brief Like scallop_lex_memory_batch(), always lexing
+ * 	from the beginning, but pairing up brackets as it
+ * 	goes.
+ *
+ * matches needs room for as many entries as tokens.
+ * Each bracket's entry is the index of the bracket it
+ * pairs with, so a whole block can be skipped at once;
+ * every other entry is -1.
+ *
+ * Lexing stops after the first token that leaves a
+ * bracket unpaired: a close bracket with nothing open,
+ * or the wrong kind open, or an EOF token with
+ * brackets still open. unmatched holds its index as
+ * close, and the innermost open bracket's as open, or
+ * -1 if there isn't one; otherwise both are -1.
+ *
+ * Returns one past the last token written. If the
+ * array fills up before an EOF token, brackets that
+ * are still open have an entry of -1.
+ */
+struct scallop_parse_token *scallop_lex_memory_brackets(
+	const char *begin,
+	const char *end,
+	struct scallop_parse_token *tokens_begin,
+	struct scallop_parse_token *tokens_end,
+	ssize_t *matches,
+	struct scallop_bracket_match *unmatched
+);
+
+/**
+ * \brief A token's value, which may point into the
+ * 	source or into an arena; either way, it isn't
+ * 	null-terminated.
+ */
+struct scallop_token_value {
+	const char *begin;
+	ssize_t length;
+};
+
+/**
+ * \brief Gives the value of a token lexed from the
+ * 	source between begin and end, with its quotes and
+ * 	escapes removed, returning 1, or 0 if the arena
+ * 	runs out of space.
+ *
+ * Tokens without the SCALLOP_TOKEN_QUOTED,
+ * SCALLOP_TOKEN_DOUBLE_QUOTED, or SCALLOP_TOKEN_ESCAPED
+ * flags are given as they are in the source, without
+ * touching the arena. Other tokens are copied into it,
+ * a backslash making the character after it literal,
+ * and quotes only counting outside the other kind.
+ * That needs as much room as the token takes up in
+ * the source, though only the value's length is kept.
+ */
+int scallop_token_value(
+	const char *begin,
+	const char *end,
+	const struct scallop_parse_token *token,
+	struct scallop_arena *arena,
+	struct scallop_token_value *value
+);
+
+/**
+ * \brief Tokens from an in-memory source, stored in
+ * 	about a tenth of the space of an array of
+ * 	struct scallop_parse_token.
+ *
+ * Only each token's type, flags, and start_offset
+ * are kept, in separate arrays, the type and flags
+ * sharing a byte; a token ends where the next one
+ * starts. Offsets are 32-bit, so sources must be
+ * under 4GiB.
+ *
+ * Row and col aren't kept at all. The first time
+ * they're asked for, the source is scanned once for
+ * newlines, and from then on they're looked up with a
+ * binary search over where each line starts. Cols
+ * are counted from the last one worked out, if it was
+ * earlier on the same line, or else from the start of
+ * the line; so going through the tokens in order costs
+ * one pass over the source, even all on one line.
+ *
+ * The fields are for the functions below only.
+ */
+struct scallop_token_list {
+	const char *begin;
+	const char *end;
+	unsigned char *kinds;
+	uint32_t *starts;
+	ssize_t count;
+	ssize_t capacity;
+	uint32_t last_end;
+	uint32_t *newlines;
+	ssize_t newline_count;
+	ssize_t newline_capacity;
+	ssize_t col_offset;
+	int64_t col;
+};
+
+/**
+ * \brief Creates an empty token list for the source
+ * 	between begin and end, which must outlive it.
+ */
+struct scallop_token_list scallop_token_list_make(
+	const char *begin,
+	const char *end
+);
+
+/**
+ * \brief Frees the token list's memory.
+ */
+void scallop_token_list_free(struct scallop_token_list *list);
+
+/**
+ * \brief Adds a token lexed after the last one added,
+ * 	returning 1, or 0 if memory runs out.
+ */
+int scallop_token_list_push(
+	struct scallop_token_list *list,
+	const struct scallop_parse_token *token
+);
+
+/**
+ * \brief Lexes the whole source into the list,
+ * 	without keeping track of row and col while doing so.
+ *
+ * Returns 1 on success, or 0 if the source is too big
+ * or memory runs out.
+ */
+int scallop_lex_memory_compact(struct scallop_token_list *list);
+
+/**
+ * \brief Returns the token at index, as the other
+ * 	lexing functions would have, row and col included.
+ *
+ * If memory runs out building the line index, row and
+ * col are -1.
+ */
+struct scallop_parse_token scallop_token_list_get(
+	struct scallop_token_list *list,
+	ssize_t index
+);
+
+/**
+ * \brief Works out the row and col a token ending at
+ * 	offset would have, returning 1, or 0 if memory
+ * 	runs out building the line index.
+ */
+int scallop_token_list_position(
+	struct scallop_token_list *list,
+	ssize_t offset,
+	int64_t *row,
+	int64_t *col
+);
+
+/**
+ * \brief Like scallop_lex_memory_batch(), but splits
+ * 	the source between up to thread_count threads,
+ * 	always lexing from the beginning.
+ *
+ * The tokens are the same as lexing sequentially
+ * would give, and are lexed straight into the array.
+ * Sources too small to be worth it, or running out of
+ * memory for the threads' bookkeeping, are lexed
+ * sequentially instead.
+ */
+struct scallop_parse_token *scallop_lex_memory_parallel(
+	const char *begin,
+	const char *end,
+	int thread_count,
+	struct scallop_parse_token *tokens_begin,
+	struct scallop_parse_token *tokens_end
+);
+
+/**
+ * \brief Describes replacing deleted bytes at offset
+ * 	with inserted bytes.
+ */
+struct scallop_edit {
+	int64_t offset;
+	int64_t deleted;
+	int64_t inserted;
+};
+
+/**
+ * \brief Updates tokens after an edit, re-lexing only
+ * 	the part of the source the edit could affect.
+ *
+ * tokens must hold the count tokens lexed from the
+ * source before the edit, up to and including the EOF
+ * token, in an array with room for capacity tokens.
+ * begin and end are the source after the edit.
+ *
+ * Lexing restarts at the last token unaffected by the
+ * edit, and stops as soon as it lines up with the old
+ * tokens again; the rest are moved along instead of
+ * being lexed again.
+ *
+ * The old tokens are moved to the end of the array
+ * while new ones are lexed over them, so an edit which
+ * adds tokens needs that much spare capacity, even if
+ * it also removes as many later on; one which keeps or
+ * lowers the number of tokens as it goes needs none.
+ *
+ * Returns the new number of tokens, or -1 if they
+ * won't fit, in which case the array's contents are
+ * unspecified and the source should be lexed again
+ * from the beginning.
+ */
+ssize_t scallop_relex_memory(
+	const char *begin,
+	const char *end,
+	struct scallop_parse_token *tokens,
+	ssize_t count,
+	ssize_t capacity,
+	struct scallop_edit edit
+);
+
+/**
+ * \brief Lexes a read-once source, such as a pipe or
+ * 	a socket, through a fixed-size ring buffer.
+ *
+ * Input is added with scallop_stream_write() or
+ * scallop_stream_read(), and tokens are taken out with
+ * scallop_stream_next() as soon as they're complete.
+ * When the input runs dry part-way through a token, it
+ * is picked up again from the same place - even in the
+ * middle of a UTF-8 sequence or an escape - once more
+ * input arrives.
+ *
+ * Input stays in the buffer until it's released with
+ * scallop_stream_release(), so that token values can be
+ * copied out with scallop_stream_copy(); memory use is
+ * the size of the buffer, however long the input is.
+ *
+ * The fields are for the functions below only.
+ */
+struct scallop_stream_lexer {
+	char *buffer;
+	ssize_t capacity;
+	ssize_t released;
+	ssize_t written;
+	char finished;
+	int32_t state;
+	struct scallop_parse_token token;
+};
+
+/**
+ * \brief Creates a stream lexer using the buffer of
+ * 	capacity bytes, which it doesn't take ownership of.
+ *
+ * The capacity has to be at least 2, since the lexer
+ * holds on to the character it's on. Given less, it
+ * sets errno to EINVAL and returns a lexer with a NULL
+ * buffer, which every write and read fails on.
+ */
+struct scallop_stream_lexer scallop_stream_lexer_make(
+	char *buffer,
+	ssize_t capacity
+);
+
+/**
+ * \brief Returns how many bytes can be written before
+ * 	more need releasing.
+ */
+ssize_t scallop_stream_space(const struct scallop_stream_lexer *lexer);
+
+/**
+ * \brief Copies as much of data into the buffer as
+ * 	fits, returning the number of bytes copied, or -1
+ * 	if the lexer has no buffer.
+ */
+ssize_t scallop_stream_write(
+	struct scallop_stream_lexer *lexer,
+	const void *data,
+	ssize_t size
+);
+
+/**
+ * \brief Reads from the source straight into the
+ * 	buffer, returning the result of csalt_store_read().
+ *
+ * Returns 0 without reading if the buffer is full, or
+ * -1 if the lexer has no buffer.
+ */
+ssize_t scallop_stream_read(
+	struct scallop_stream_lexer *lexer,
+	csalt_store *source
+);
+
+/**
+ * \brief Marks the end of the input, so the last
+ * 	token can finish and an EOF token follows.
+ */
+void scallop_stream_finish(struct scallop_stream_lexer *lexer);
+
+/**
+ * \brief Writes the next token and returns 1 if it's
+ * 	complete, otherwise returns 0 and waits for more
+ * 	input.
+ *
+ * After the EOF token, EOF tokens keep being returned.
+ */
+int scallop_stream_next(
+	struct scallop_stream_lexer *lexer,
+	struct scallop_parse_token *token
+);
+
+/**
+ * \brief Allows bytes before offset to be overwritten.
+ *
+ * Bytes the lexer still needs aren't released, so
+ * passing SSIZE_MAX releases everything it's done with.
+ */
+void scallop_stream_release(
+	struct scallop_stream_lexer *lexer,
+	ssize_t offset
+);
+
+/**
+ * \brief Copies the bytes between the begin and end
+ * 	offsets into out, returning the number copied, or
+ * 	-1 if some of them have been released or haven't
+ * 	been written yet.
+ */
+ssize_t scallop_stream_copy(
+	const struct scallop_stream_lexer *lexer,
+	ssize_t begin,
+	ssize_t end,
+	char *out
+);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -0,0 +1,176 @@
+/*
+ * Scallop - a shell for executing tasks concurrently
+ * Copyright (C) 2022  Marcus Harrison
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef SCALLOP_PARSER_H
+#define SCALLOP_PARSER_H
+
+#include "scallop/lexer.h"
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum SCALLOP_NODE {
+	// Statements, either the whole script's or
+	// between curly brackets
+	SCALLOP_NODE_BLOCK,
+	// Words, blocks, and lists, up to a statement
+	// separator
+	SCALLOP_NODE_STATEMENT,
+	// Words, blocks, and lists between square brackets
+	SCALLOP_NODE_LIST,
+	SCALLOP_NODE_WORD,
+	// Splits a statement into the stages of a pipeline.
+	// Always between two arguments; a statement
+	// separator straight after one is skipped, so
+	// pipelines can carry on over several lines
+	SCALLOP_NODE_PIPE,
+	// The same, for a binary pipe
+	SCALLOP_NODE_BINARY_PIPE,
+};
+
+/**
+ * \brief Stands in for a missing child or sibling.
+ */
+#define SCALLOP_NODE_NONE UINT32_MAX
+
+/**
+ * \brief A node of the syntax tree.
+ *
+ * Children are linked through their next_sibling, in
+ * the order they appear, by index into the tree's
+ * nodes. start_offset and end_offset cover the node's
+ * source, brackets included; words keep their token's
+ * flags, so scallop_token_value() can be used on them.
+ */
+struct scallop_node {
+	uint32_t start_offset;
+	uint32_t end_offset;
+	uint32_t first_child;
+	uint32_t next_sibling;
+	unsigned char kind;
+	unsigned char flags;
+};
+
+/**
+ * \brief A syntax tree, the root being nodes[0], a
+ * 	block holding the whole script.
+ *
+ * Every node lives in the one nodes array, which is
+ * bump-allocated from the front and grown by doubling.
+ * Nodes refer to each other by index, so moving the
+ * array doesn't matter, and freeing the tree is a
+ * single free().
+ */
+struct scallop_ast {
+	struct scallop_node *nodes;
+	uint32_t count;
+	uint32_t capacity;
+};
+
+/**
+ * \brief Frees the tree's nodes.
+ */
+void scallop_ast_free(struct scallop_ast *ast);
+
+enum SCALLOP_PARSE_ERROR {
+	SCALLOP_PARSE_OK,
+	// A close bracket with nothing open, or the wrong
+	// kind open
+	SCALLOP_PARSE_UNEXPECTED_CLOSE,
+	// The end of the script with a bracket still open
+	SCALLOP_PARSE_UNCLOSED,
+	// A token the parser has no use for, or a pipe
+	// without an argument on both sides
+	SCALLOP_PARSE_UNEXPECTED_TOKEN,
+	// A character the lexer couldn't make a token of;
+	// the token's end_offset is where it is
+	SCALLOP_PARSE_INVALID_CHARACTER,
+	// Offsets past 4GiB, or too many nodes to index
+	SCALLOP_PARSE_TOO_BIG,
+	SCALLOP_PARSE_OUT_OF_MEMORY,
+};
+
+/**
+ * \brief Where parsing went wrong: the token it
+ * 	stopped at, and the offset of the innermost
+ * 	bracket still open, or -1 if there isn't one.
+ */
+struct scallop_parse_error {
+	enum SCALLOP_PARSE_ERROR error;
+	struct scallop_parse_token token;
+	int64_t open_offset;
+};
+
+/**
+ * \brief Builds a tree from tokens fed to it one at a
+ * 	time, from any of the lexing functions.
+ *
+ * The fields are for the functions below only, apart
+ * from ast and error.
+ */
+struct scallop_parser {
+	struct scallop_ast ast;
+	struct scallop_parse_error error;
+	struct scallop_parse_frame *stack;
+	ssize_t depth;
+	ssize_t stack_capacity;
+};
+
+/**
+ * \brief Creates a parser with an empty tree.
+ */
+struct scallop_parser scallop_parser_make(void);
+
+/**
+ * \brief Adds the next token to the tree, returning 1,
+ * 	or 0 after filling in the parser's error.
+ *
+ * Once an EOF token has been pushed, the tree is
+ * complete, and can be taken from the parser's ast.
+ */
+int scallop_parser_push(
+	struct scallop_parser *parser,
+	const struct scallop_parse_token *token
+);
+
+/**
+ * \brief Frees the parser's working memory, but not
+ * 	its tree.
+ */
+void scallop_parser_free(struct scallop_parser *parser);
+
+/**
+ * \brief Lexes and parses the source between begin and
+ * 	end, returning 1, or 0 after filling in error.
+ *
+ * ast must be freed with scallop_ast_free() either way.
+ */
+int scallop_parse_memory(
+	const char *begin,
+	const char *end,
+	struct scallop_ast *ast,
+	struct scallop_parse_error *error
+);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // SCALLOP_PARSER_H
@@ -0,0 +1,154 @@
+/*
+ * Scallop - a shell for executing tasks concurrently
+ * Copyright (C) <year>  Marcus Harrison
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef SCALLOP_PATH_CACHE_H
+#define SCALLOP_PATH_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief Remembers where in PATH each command was
+ * 	found, so running it again costs no system calls.
+ *
+ * Any number of threads can look commands up at once;
+ * they only wait for each other while a command that
+ * isn't there yet gets added.
+ */
+struct scallop_path_cache;
+
+// What execvp() searches when there's no PATH
+#define SCALLOP_PATH_DEFAULT "/bin:/usr/bin"
+
+enum SCALLOP_PATH_CACHE_FLAGS {
+	// Watches PATH's directories with inotify, so
+	// commands added, removed, or moved there take the
+	// cache's contents with them
+	SCALLOP_PATH_CACHE_INOTIFY = 1,
+};
+
+/**
+ * \brief Creates a cache over path, a list of
+ * 	directories split by colons, or the PATH
+ * 	environment variable if path is NULL.
+ *
+ * flags are from enum SCALLOP_PATH_CACHE_FLAGS.
+ * Returns NULL with errno set if it can't be created.
+ */
+struct scallop_path_cache *scallop_path_cache_create(const char *path, int flags);
+
+void scallop_path_cache_destroy(struct scallop_path_cache *cache);
+
+/**
+ * \brief Changes the directories searched, emptying
+ * 	the cache only if they're different.
+ *
+ * Returns 1, or 0 with errno set if there's no memory
+ * for them, in which case the old ones are kept.
+ */
+int scallop_path_cache_set_path(struct scallop_path_cache *cache, const char *path);
+
+/**
+ * \brief Empties the cache, which only takes a
+ * 	counter being incremented; the entries are
+ * 	replaced as commands get looked up again.
+ */
+void scallop_path_cache_invalidate(struct scallop_path_cache *cache);
+
+/**
+ * \brief Finds the executable name refers to, copying
+ * 	its path to buffer, and returns 1, or 0 with errno
+ * 	set.
+ *
+ * Names containing a slash are copied as they are. As
+ * with execvp(), the first regular file in PATH the
+ * shell can execute wins, and errno is ENOENT if
+ * there's none, or ENAMETOOLONG if the path doesn't
+ * fit in size bytes.
+ *
+ * Commands that aren't found are only remembered while
+ * inotify is watching every directory in PATH, to say
+ * when they appear; a directory that doesn't exist, or
+ * has been removed or moved, stops that.
+ */
+int scallop_path_cache_lookup(
+	struct scallop_path_cache *cache,
+	const char *name,
+	char *buffer,
+	size_t size
+);
+
+/**
+ * \brief Whether the cache searches path, so it can
+ * 	look commands up for a task whose PATH it is.
+ */
+int scallop_path_cache_searches(struct scallop_path_cache *cache, const char *path);
+
+/**
+ * \brief Finds name in path the way
+ * 	scallop_path_cache_lookup() does, but without a
+ * 	cache, for a PATH that isn't the cache's.
+ */
+int scallop_path_search(const char *path, const char *name, char *buffer, size_t size);
+
+/**
+ * \brief The inotify descriptor to wait on, or -1 if
+ * 	the cache doesn't use one.
+ *
+ * When it's readable, call
+ * scallop_path_cache_handle_events(); it's made for
+ * scallop_watch_readable().
+ */
+int scallop_path_cache_fd(const struct scallop_path_cache *cache);
+
+/**
+ * \brief Reads whatever inotify has to say, emptying
+ * 	the cache if any of PATH's directories changed.
+ *
+ * Returns 1, or 0 with errno set if reading failed.
+ */
+int scallop_path_cache_handle_events(struct scallop_path_cache *cache);
+
+/**
+ * \brief Counts of what the cache has done since it
+ * 	was created.
+ */
+struct scallop_path_cache_stats {
+	// Lookups answered from the cache, and those that
+	// had to search PATH
+	uint64_t hits;
+	uint64_t misses;
+	// Times it was emptied, whatever the reason
+	uint64_t invalidations;
+	// Commands remembered now
+	uint64_t entries;
+};
+
+void scallop_path_cache_stats(
+	struct scallop_path_cache *cache,
+	struct scallop_path_cache_stats *stats
+);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // SCALLOP_PATH_CACHE_H
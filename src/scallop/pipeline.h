@@ -0,0 +1,102 @@
+/*
+ * Scallop - a shell for executing tasks concurrently
+ * Copyright (C) <year>  Marcus Harrison
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef SCALLOP_PIPELINE_H
+#define SCALLOP_PIPELINE_H
+
+#include "scallop/launch.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief The pipe size asked for between stages that
+ * 	move a lot of data.
+ *
+ * Linux lets unprivileged processes go up to
+ * /proc/sys/fs/pipe-max-size, 1MiB by default; every
+ * extra page is a page more a writer can get ahead of
+ * its reader before either has to be woken up.
+ */
+#define SCALLOP_PIPE_SIZE (1024 * 1024)
+
+/**
+ * \brief Creates a close-on-exec pipe holding size
+ * 	bytes, or the default if size is 0.
+ *
+ * Resizing is only a hint: if size is over the limit,
+ * the pipe keeps its default size. Returns 1 on
+ * success, or 0 with errno set if there's no pipe.
+ */
+int scallop_pipe(int fds[2], int size);
+
+/**
+ * \brief Launches a pipeline, each command's standard
+ * 	output connected to the next one's standard input.
+ *
+ * The pipes are made with scallop_pipe() and
+ * pipe_size. Each command's own redirections are
+ * applied after the pipeline's, so they can send a
+ * stage somewhere else. The first command's standard
+ * input and the last's standard output are left as
+ * they are.
+ *
+ * pids gets the pid of each stage. Returns 1 on
+ * success, or 0 with errno set if a stage couldn't be
+ * launched, in which case the stages already launched
+ * have been killed and reaped.
+ */
+int scallop_pipeline_launch(
+	const struct scallop_command *commands,
+	ssize_t count,
+	int pipe_size,
+	enum SCALLOP_LAUNCH_METHOD method,
+	pid_t *pids
+);
+
+/**
+ * \brief Moves everything from in to out until in
+ * 	reaches EOF, without copying it through the shell.
+ *
+ * Data moves with splice(), through a pipe of the
+ * shell's own if neither end is one; it's only read
+ * and written where the kernel can't splice them. Both
+ * fds should be blocking.
+ *
+ * Returns the number of bytes moved, or -1 with errno
+ * set on failure.
+ */
+ssize_t scallop_relay(int in, int out);
+
+/**
+ * \brief Moves everything from in to out, like
+ * 	scallop_relay(), and copies it to copy as well.
+ *
+ * The copy is made with tee(), which only references
+ * the pages in the pipe rather than copying them, so
+ * duplicating output costs no more than moving it.
+ * Unlike scallop_relay(), there's no fallback if the
+ * kernel can't splice to out or copy.
+ */
+ssize_t scallop_relay_tee(int in, int out, int copy);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // SCALLOP_PIPELINE_H
@@ -0,0 +1,159 @@
+/*
+ * Scallop - a shell for executing tasks concurrently
+ * Copyright (C) <year>  Marcus Harrison
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef SCALLOP_RING_H
+#define SCALLOP_RING_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief The ring size binary pipes get by default.
+ */
+#define SCALLOP_RING_SIZE (1024 * 1024)
+
+struct scallop_ring_header;
+
+/**
+ * \brief The channel behind a binary pipe: a
+ * 	single-producer, single-consumer ring buffer in
+ * 	a memfd.
+ *
+ * When both ends of a binary pipe run in the shell's
+ * own process, or in processes sharing the memfd, data
+ * goes straight from one to the other through shared
+ * memory, with no system calls at all unless one end
+ * has to wait for the other.
+ *
+ * The data is mapped twice, back to back, so any span
+ * of it is contiguous in memory even where it wraps
+ * around the end of the ring. That lets
+ * scallop_ring_reserve() and scallop_ring_peek() hand
+ * out spans to be written or read in place, in
+ * batches as big as the ring.
+ *
+ * A ring is full when capacity bytes are waiting to
+ * be read; writing to a full ring waits for the reader
+ * to catch up. Waiting is on a futex, so either end
+ * can be in another process.
+ */
+struct scallop_ring {
+	struct scallop_ring_header *header;
+	char *data;
+	size_t capacity;
+	size_t mapping_size;
+	int fd;
+};
+
+/**
+ * \brief Creates a ring holding at least capacity
+ * 	bytes.
+ *
+ * capacity is rounded up to a power of two pages.
+ * Returns 1 on success, or 0 with errno set on
+ * failure.
+ */
+int scallop_ring_create(struct scallop_ring *ring, size_t capacity);
+
+/**
+ * \brief Maps the ring in fd, from another ring's fd
+ * 	passed to this process.
+ *
+ * The fd is duplicated, so the caller can close its
+ * own. Returns 1 on success, or 0 with errno set on
+ * failure.
+ */
+int scallop_ring_map(struct scallop_ring *ring, int fd);
+
+/**
+ * \brief Unmaps the ring and closes its fd. The ring
+ * 	itself lasts until every end has unmapped it.
+ */
+void scallop_ring_unmap(struct scallop_ring *ring);
+
+/**
+ * \brief Waits for room to write, then returns where
+ * 	to write to, with the number of contiguous bytes
+ * 	there are room for in length.
+ *
+ * Nothing written there can be read until
+ * scallop_ring_commit(). Returns NULL with errno set
+ * to EPIPE if the reader has closed its end.
+ */
+char *scallop_ring_reserve(struct scallop_ring *ring, size_t *length);
+
+/**
+ * \brief Makes length bytes written to the space from
+ * 	scallop_ring_reserve() available to the reader.
+ */
+void scallop_ring_commit(struct scallop_ring *ring, size_t length);
+
+/**
+ * \brief Waits for something to read, then returns
+ * 	where it starts, with the number of bytes that can
+ * 	be read there in length.
+ *
+ * Returns NULL with length set to 0 once the writer
+ * has closed its end and everything has been read.
+ */
+const char *scallop_ring_peek(struct scallop_ring *ring, size_t *length);
+
+/**
+ * \brief Frees length bytes returned by
+ * 	scallop_ring_peek() for the writer to use again.
+ */
+void scallop_ring_consume(struct scallop_ring *ring, size_t length);
+
+/**
+ * \brief Writes all of buffer, waiting for room as
+ * 	needed.
+ *
+ * Returns length, or -1 with errno set to EPIPE if
+ * the reader closes its end first.
+ */
+ssize_t scallop_ring_write(struct scallop_ring *ring, const void *buffer, size_t length);
+
+/**
+ * \brief Reads up to length bytes into buffer,
+ * 	waiting until there's at least one.
+ *
+ * Returns the number of bytes read, which is 0 only
+ * at EOF.
+ */
+ssize_t scallop_ring_read(struct scallop_ring *ring, void *buffer, size_t length);
+
+/**
+ * \brief Closes the writing end, so the reader gets
+ * 	EOF once it has read everything.
+ */
+void scallop_ring_close_writer(struct scallop_ring *ring);
+
+/**
+ * \brief Closes the reading end, so the writer gets
+ * 	EPIPE from then on.
+ */
+void scallop_ring_close_reader(struct scallop_ring *ring);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // SCALLOP_RING_H
@@ -0,0 +1,70 @@
+/*
+ * Scallop - a shell for executing tasks concurrently
+ * Copyright (C) 2022  Marcus Harrison
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef SCALLOP_SCRIPT_H
+#define SCALLOP_SCRIPT_H
+
+#include <csalt/stores.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief A script file mapped read-only into memory.
+ *
+ * Nothing is read or copied up-front; pages are read
+ * in by the kernel as the lexer reaches them, so
+ * opening a script takes the same time however big
+ * it is, and pages already lexed can be dropped again
+ * under memory pressure.
+ *
+ * begin and end can be passed straight to
+ * scallop_lex_memory() and friends, and token offsets
+ * index into them. store is the same bytes as a
+ * read-only csalt_store, for anything that wants one.
+ */
+struct scallop_script {
+	struct csalt_cmemory store;
+	const char *begin;
+	const char *end;
+};
+
+/**
+ * \brief Maps the file at path into script.
+ *
+ * Returns 1 on success, or 0 with errno set if the
+ * file can't be opened or mapped. Files that can't
+ * be mapped, such as pipes, should be lexed with a
+ * scallop_stream_lexer instead.
+ */
+int scallop_script_open(struct scallop_script *script, const char *path);
+
+/**
+ * \brief Unmaps a script opened with
+ * 	scallop_script_open().
+ *
+ * Tokens can still be used afterwards, but nothing
+ * should be read from begin or end any more.
+ */
+void scallop_script_close(struct scallop_script *script);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // SCALLOP_SCRIPT_H
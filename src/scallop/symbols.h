@@ -0,0 +1,130 @@
+/*
+ * Scallop - a shell for executing tasks concurrently
+ * Copyright (C) 2022  Marcus Harrison
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef SCALLOP_SYMBOLS_H
+#define SCALLOP_SYMBOLS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief Gives every distinct name a number, so names
+ * 	can be compared, or used to index tables, without
+ * 	reading their bytes again.
+ *
+ * A name's symbol never changes for as long as the
+ * table lives. Any number of threads can intern names
+ * at once; they only wait for each other while a name
+ * that isn't there yet gets added.
+ */
+struct scallop_symbols;
+
+/**
+ * \brief Stands in for a token or name without a
+ * 	symbol. Real symbols count up from 1.
+ */
+#define SCALLOP_SYMBOL_NONE 0
+
+/**
+ * \brief Creates an empty table, or returns NULL with
+ * 	errno set.
+ */
+struct scallop_symbols *scallop_symbols_create(void);
+
+void scallop_symbols_destroy(struct scallop_symbols *symbols);
+
+/**
+ * \brief The hash the table files a name under, 32 bit
+ * 	FNV-1a.
+ *
+ * Exposed so the lexer can work it out a character at
+ * a time as it scans; scallop_symbol_hash_step() adds
+ * one character to a hash begun at
+ * SCALLOP_SYMBOL_HASH_INIT.
+ */
+#define SCALLOP_SYMBOL_HASH_INIT UINT32_C(0x811C9DC5)
+
+static inline uint32_t scallop_symbol_hash_step(uint32_t hash, char character)
+{
+	return (hash ^ (unsigned char)character) * UINT32_C(0x01000193);
+}
+
+uint32_t scallop_symbol_hash(const char *name, size_t length);
+
+/**
+ * \brief Returns the symbol for the length bytes at
+ * 	name, adding it if it's new, or SCALLOP_SYMBOL_NONE
+ * 	with errno set if there's no memory for it.
+ *
+ * Names can hold any bytes, null characters included.
+ */
+uint32_t scallop_symbols_intern(
+	struct scallop_symbols *symbols,
+	const char *name,
+	size_t length
+);
+
+/**
+ * \brief Like scallop_symbols_intern(), for a name
+ * 	whose scallop_symbol_hash() is already known.
+ */
+uint32_t scallop_symbols_intern_hashed(
+	struct scallop_symbols *symbols,
+	const char *name,
+	size_t length,
+	uint32_t hash
+);
+
+/**
+ * \brief Returns the symbol for a name without adding
+ * 	it, or SCALLOP_SYMBOL_NONE if it hasn't been
+ * 	interned.
+ */
+uint32_t scallop_symbols_find(
+	struct scallop_symbols *symbols,
+	const char *name,
+	size_t length
+);
+
+/**
+ * \brief Returns the name of symbol, null terminated,
+ * 	and stores its length in length if that isn't NULL;
+ * 	or returns NULL if there's no such symbol.
+ *
+ * The name lasts as long as the table does.
+ */
+const char *scallop_symbols_name(
+	struct scallop_symbols *symbols,
+	uint32_t symbol,
+	size_t *length
+);
+
+/**
+ * \brief The number of symbols interned so far, so
+ * 	every symbol is below it plus one.
+ */
+uint32_t scallop_symbols_count(struct scallop_symbols *symbols);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // SCALLOP_SYMBOLS_H
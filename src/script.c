@@ -0,0 +1,81 @@
+/*
+ * Scallop - a shell for executing tasks concurrently
+ * Copyright (C) 2022  Marcus Harrison
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "scallop/script.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+int scallop_script_open(struct scallop_script *script, const char *path)
+{
+	const int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return 0;
+
+	struct stat status;
+	if (fstat(fd, &status) < 0)
+		goto error;
+	if (!S_ISREG(status.st_mode)) {
+		errno = ENODEV;
+		goto error;
+	}
+
+	// mmap() refuses empty mappings, but an empty
+	// script is still a script
+	const char *begin = NULL;
+	if (status.st_size) {
+		void *mapping = mmap(
+			NULL,
+			status.st_size,
+			PROT_READ,
+			MAP_PRIVATE,
+			fd,
+			0
+		);
+		if (mapping == MAP_FAILED)
+			goto error;
+		// Only a hint, so failing doesn't matter: read
+		// ahead aggressively and drop pages behind us
+		madvise(mapping, status.st_size, MADV_SEQUENTIAL);
+		begin = mapping;
+	}
+
+	// The mapping keeps its own reference to the file
+	close(fd);
+	script->begin = begin;
+	script->end = begin ? begin + status.st_size : NULL;
+	script->store = csalt_cmemory_make(script->begin, script->end);
+	return 1;
+
+error:
+	{
+		const int error = errno;
+		close(fd);
+		errno = error;
+	}
+	return 0;
+}
+
+void scallop_script_close(struct scallop_script *script)
+{
+	if (script->begin)
+		munmap((void *)script->begin, script->end - script->begin);
+	*script = (struct scallop_script) { 0 };
+}
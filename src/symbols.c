@@ -0,0 +1,256 @@
+/*
+ * Scallop - a shell for executing tasks concurrently
+ * Copyright (C) <year>  Marcus Harrison
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+// For PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP
+#define _GNU_SOURCE
+
+#include "scallop/symbols.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_CAPACITY 64
+
+struct symbol {
+	char *name;
+	uint32_t length;
+	uint32_t hash;
+};
+
+/*
+ * Symbols are indices into names, which is only ever
+ * appended to; slots is an open-addressed table of
+ * them, kept under half full. Both sit behind a
+ * read-write lock, only taken for writing to add a
+ * name, as in the PATH cache.
+ */
+struct scallop_symbols {
+	pthread_rwlock_t lock;
+	// names[0] stands for SCALLOP_SYMBOL_NONE
+	struct symbol *names;
+	uint32_t name_capacity;
+	atomic_uint count;
+	uint32_t *slots;
+	size_t slot_capacity;
+};
+
+uint32_t scallop_symbol_hash(const char *name, size_t length)
+{
+	uint32_t hash = SCALLOP_SYMBOL_HASH_INIT;
+	for (size_t i = 0; i < length; i++)
+		hash = scallop_symbol_hash_step(hash, name[i]);
+	return hash;
+}
+
+struct scallop_symbols *scallop_symbols_create(void)
+{
+	struct scallop_symbols *symbols = calloc(1, sizeof(*symbols));
+	if (!symbols)
+		return NULL;
+	symbols->names = calloc(INITIAL_CAPACITY, sizeof(*symbols->names));
+	symbols->slots = calloc(INITIAL_CAPACITY, sizeof(*symbols->slots));
+	if (!symbols->names || !symbols->slots) {
+		free(symbols->names);
+		free(symbols->slots);
+		free(symbols);
+		errno = ENOMEM;
+		return NULL;
+	}
+	symbols->name_capacity = INITIAL_CAPACITY;
+	symbols->slot_capacity = INITIAL_CAPACITY;
+
+	pthread_rwlockattr_t attributes;
+	pthread_rwlockattr_init(&attributes);
+	pthread_rwlockattr_setkind_np(
+		&attributes,
+		PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP
+	);
+	pthread_rwlock_init(&symbols->lock, &attributes);
+	pthread_rwlockattr_destroy(&attributes);
+	return symbols;
+}
+
+void scallop_symbols_destroy(struct scallop_symbols *symbols)
+{
+	if (!symbols)
+		return;
+	const uint32_t count = atomic_load(&symbols->count);
+	for (uint32_t i = 1; i <= count; i++)
+		free(symbols->names[i].name);
+	free(symbols->names);
+	free(symbols->slots);
+	pthread_rwlock_destroy(&symbols->lock);
+	free(symbols);
+}
+
+// Returns the slot holding the name, or the empty one
+// it would go in
+static uint32_t *find_slot(
+	const struct scallop_symbols *symbols,
+	const char *name,
+	size_t length,
+	uint32_t hash
+)
+{
+	const size_t mask = symbols->slot_capacity - 1;
+	for (size_t i = hash & mask;; i = (i + 1) & mask) {
+		uint32_t *slot = &symbols->slots[i];
+		if (!*slot)
+			return slot;
+		const struct symbol *symbol = &symbols->names[*slot];
+		if (
+			symbol->hash == hash
+			&& symbol->length == length
+			&& !memcmp(symbol->name, name, length)
+		)
+			return slot;
+	}
+}
+
+static int grow_slots(struct scallop_symbols *symbols)
+{
+	const size_t capacity = symbols->slot_capacity * 2;
+	uint32_t *slots = calloc(capacity, sizeof(*slots));
+	if (!slots)
+		return 0;
+	for (size_t i = 0; i < symbols->slot_capacity; i++) {
+		const uint32_t symbol = symbols->slots[i];
+		if (!symbol)
+			continue;
+		size_t index = symbols->names[symbol].hash & (capacity - 1);
+		while (slots[index])
+			index = (index + 1) & (capacity - 1);
+		slots[index] = symbol;
+	}
+	free(symbols->slots);
+	symbols->slots = slots;
+	symbols->slot_capacity = capacity;
+	return 1;
+}
+
+static uint32_t add(
+	struct scallop_symbols *symbols,
+	const char *name,
+	size_t length,
+	uint32_t hash
+)
+{
+	const uint32_t count = atomic_load_explicit(&symbols->count, memory_order_relaxed);
+	if (length > UINT32_MAX || count == UINT32_MAX - 1)
+		goto no_memory;
+	if (((size_t)count + 1) * 2 > symbols->slot_capacity && !grow_slots(symbols))
+		goto no_memory;
+	if (count + 1 == symbols->name_capacity) {
+		struct symbol *names = realloc(
+			symbols->names,
+			symbols->name_capacity * 2 * sizeof(*names)
+		);
+		if (!names)
+			goto no_memory;
+		symbols->names = names;
+		symbols->name_capacity *= 2;
+	}
+
+	char *copy = malloc(length + 1);
+	if (!copy)
+		goto no_memory;
+	memcpy(copy, name, length);
+	copy[length] = 0;
+
+	const uint32_t symbol = count + 1;
+	symbols->names[symbol] = (struct symbol) { copy, (uint32_t)length, hash };
+	*find_slot(symbols, name, length, hash) = symbol;
+	atomic_store(&symbols->count, symbol);
+	return symbol;
+
+no_memory:
+	errno = ENOMEM;
+	return SCALLOP_SYMBOL_NONE;
+}
+
+uint32_t scallop_symbols_intern_hashed(
+	struct scallop_symbols *symbols,
+	const char *name,
+	size_t length,
+	uint32_t hash
+)
+{
+	pthread_rwlock_rdlock(&symbols->lock);
+	uint32_t symbol = *find_slot(symbols, name, length, hash);
+	pthread_rwlock_unlock(&symbols->lock);
+	if (symbol)
+		return symbol;
+
+	// Someone else might have added it in between
+	pthread_rwlock_wrlock(&symbols->lock);
+	symbol = *find_slot(symbols, name, length, hash);
+	if (!symbol)
+		symbol = add(symbols, name, length, hash);
+	pthread_rwlock_unlock(&symbols->lock);
+	return symbol;
+}
+
+uint32_t scallop_symbols_intern(
+	struct scallop_symbols *symbols,
+	const char *name,
+	size_t length
+)
+{
+	return scallop_symbols_intern_hashed(
+		symbols,
+		name,
+		length,
+		scallop_symbol_hash(name, length)
+	);
+}
+
+uint32_t scallop_symbols_find(
+	struct scallop_symbols *symbols,
+	const char *name,
+	size_t length
+)
+{
+	const uint32_t hash = scallop_symbol_hash(name, length);
+	pthread_rwlock_rdlock(&symbols->lock);
+	const uint32_t symbol = *find_slot(symbols, name, length, hash);
+	pthread_rwlock_unlock(&symbols->lock);
+	return symbol;
+}
+
+const char *scallop_symbols_name(
+	struct scallop_symbols *symbols,
+	uint32_t symbol,
+	size_t *length
+)
+{
+	if (symbol == SCALLOP_SYMBOL_NONE || symbol > atomic_load(&symbols->count))
+		return NULL;
+	pthread_rwlock_rdlock(&symbols->lock);
+	const struct symbol entry = symbols->names[symbol];
+	pthread_rwlock_unlock(&symbols->lock);
+	if (length)
+		*length = entry.length;
+	return entry.name;
+}
+
+uint32_t scallop_symbols_count(struct scallop_symbols *symbols)
+{
+	return atomic_load(&symbols->count);
+}
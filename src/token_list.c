@@ -0,0 +1,296 @@
+/*
+ * Scallop - a shell for executing tasks concurrently
+ * Copyright (C) 2022  Marcus Harrison
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "scallop/lexer.h"
+#include "lexer_spec.h"
+
+#include <stdlib.h>
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define TOKEN_LIST_X86
+#include <immintrin.h>
+#endif
+
+#define NEWLINE_BLOCK_SIZE 32
+
+// Token types fit in the low half of each kinds byte,
+// leaving the high half for the flags
+#define TOKEN_FLAGS_SHIFT 4
+#define TOKEN_KIND_MASK 0x0F
+
+struct scallop_token_list scallop_token_list_make(
+	const char *begin,
+	const char *end
+)
+{
+	return (struct scallop_token_list) {
+		.begin = begin,
+		.end = end,
+		.newline_count = -1,
+		.col_offset = -1,
+	};
+}
+
+void scallop_token_list_free(struct scallop_token_list *list)
+{
+	free(list->kinds);
+	free(list->starts);
+	free(list->newlines);
+	*list = scallop_token_list_make(list->begin, list->end);
+}
+
+int scallop_token_list_push(
+	struct scallop_token_list *list,
+	const struct scallop_parse_token *token
+)
+{
+	if (token->end_offset > UINT32_MAX)
+		return 0;
+
+	if (list->count == list->capacity) {
+		const ssize_t capacity = list->capacity ? list->capacity * 2 : 256;
+		unsigned char *kinds = realloc(list->kinds, capacity * sizeof(*kinds));
+		if (!kinds)
+			return 0;
+		list->kinds = kinds;
+		uint32_t *starts = realloc(list->starts, capacity * sizeof(*starts));
+		if (!starts)
+			return 0;
+		list->starts = starts;
+		list->capacity = capacity;
+	}
+
+	list->kinds[list->count] =
+		(unsigned char)(token->token | token->flags << TOKEN_FLAGS_SHIFT);
+	list->starts[list->count] = (uint32_t)token->start_offset;
+	list->last_end = (uint32_t)token->end_offset;
+	list->count++;
+	return 1;
+}
+
+/*
+ * Line index
+ *
+ * Holds the offset of every newline but the first
+ * character's, as the lexer never counts that one.
+ * It's built a block at a time, with room made for a
+ * whole block of newlines beforehand, so the kernels
+ * don't need to check for space on every one.
+ */
+
+static int reserve_newlines(struct scallop_token_list *list)
+{
+	if (list->newline_capacity - list->newline_count >= NEWLINE_BLOCK_SIZE)
+		return 1;
+
+	ssize_t capacity = list->newline_capacity * 2;
+	if (capacity < list->newline_count + NEWLINE_BLOCK_SIZE)
+		capacity = list->newline_count + NEWLINE_BLOCK_SIZE;
+	uint32_t *newlines = realloc(list->newlines, capacity * sizeof(*newlines));
+	if (!newlines)
+		return 0;
+	list->newlines = newlines;
+	list->newline_capacity = capacity;
+	return 1;
+}
+
+static void push_newline_mask(
+	struct scallop_token_list *list,
+	uint32_t offset,
+	uint32_t mask
+)
+{
+	for (; mask; mask &= mask - 1)
+		list->newlines[list->newline_count++] = offset + __builtin_ctz(mask);
+}
+
+static ssize_t find_newlines_scalar(
+	struct scallop_token_list *list,
+	ssize_t offset,
+	ssize_t end
+)
+{
+	for (; offset < end; offset++) {
+		if (list->begin[offset] != '\n')
+			continue;
+		if (!reserve_newlines(list))
+			return -1;
+		list->newlines[list->newline_count++] = (uint32_t)offset;
+	}
+	return offset;
+}
+
+#ifdef TOKEN_LIST_X86
+
+static ssize_t find_newlines_sse2(
+	struct scallop_token_list *list,
+	ssize_t offset,
+	ssize_t end
+)
+{
+	const __m128i newline = _mm_set1_epi8('\n');
+	for (; end - offset >= NEWLINE_BLOCK_SIZE; offset += NEWLINE_BLOCK_SIZE) {
+		const char *block = list->begin + offset;
+		const uint32_t mask =
+			(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(
+				_mm_loadu_si128((const __m128i *)block),
+				newline
+			))
+			| (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(
+				_mm_loadu_si128((const __m128i *)(block + 16)),
+				newline
+			)) << 16;
+		if (!mask)
+			continue;
+		if (!reserve_newlines(list))
+			return -1;
+		push_newline_mask(list, (uint32_t)offset, mask);
+	}
+	return offset;
+}
+
+__attribute__((target("avx2")))
+static ssize_t find_newlines_avx2(
+	struct scallop_token_list *list,
+	ssize_t offset,
+	ssize_t end
+)
+{
+	const __m256i newline = _mm256_set1_epi8('\n');
+	for (; end - offset >= NEWLINE_BLOCK_SIZE; offset += NEWLINE_BLOCK_SIZE) {
+		const uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+			_mm256_loadu_si256((const __m256i *)(list->begin + offset)),
+			newline
+		));
+		if (!mask)
+			continue;
+		if (!reserve_newlines(list))
+			return -1;
+		push_newline_mask(list, (uint32_t)offset, mask);
+	}
+	return offset;
+}
+
+#endif // TOKEN_LIST_X86
+
+static int index_lines(struct scallop_token_list *list)
+{
+	if (list->newline_count >= 0)
+		return 1;
+
+	list->newline_count = 0;
+	const ssize_t end = list->end - list->begin;
+	ssize_t offset = end ? 1 : 0;
+#ifdef TOKEN_LIST_X86
+	__builtin_cpu_init();
+	offset = __builtin_cpu_supports("avx2") ?
+		find_newlines_avx2(list, offset, end) :
+		find_newlines_sse2(list, offset, end);
+#endif
+	if (offset >= 0)
+		offset = find_newlines_scalar(list, offset, end);
+
+	if (offset < 0) {
+		free(list->newlines);
+		list->newlines = NULL;
+		list->newline_count = -1;
+		list->newline_capacity = 0;
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * Gives the row and col the lexer would have after
+ * reading the character at offset: a newline starts
+ * the next row at col 1, every other character but a
+ * UTF-8 continuation adds one to col, and the first
+ * character, which is only ever peeked at, counts for
+ * nothing. Past the end counts as a null character.
+ */
+int scallop_token_list_position(
+	struct scallop_token_list *list,
+	ssize_t offset,
+	int64_t *row,
+	int64_t *col
+)
+{
+	if (!index_lines(list))
+		return 0;
+
+	// Find the number of newlines at or before offset
+	ssize_t low = 0, high = list->newline_count;
+	while (low < high) {
+		const ssize_t middle = low + (high - low) / 2;
+		if (list->newlines[middle] <= offset)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	*row = low;
+	ssize_t line_start = 1;
+	*col = 0;
+	if (low) {
+		line_start = list->newlines[low - 1] + 1;
+		*col = 1;
+	}
+	// Carry on from the last col if it's on the way
+	if (line_start <= list->col_offset && list->col_offset <= offset) {
+		line_start = list->col_offset + 1;
+		*col = list->col;
+	}
+
+	const ssize_t size = list->end - list->begin;
+	for (ssize_t current = line_start; current <= offset; current++) {
+		if (current >= size) {
+			*col += offset - current + 1;
+			break;
+		}
+		*col += (list->begin[current] & (UTF8_FIRST_BIT | UTF8_SECOND_BIT))
+			!= UTF8_FIRST_BIT;
+	}
+	list->col_offset = offset;
+	list->col = *col;
+	return 1;
+}
+
+struct scallop_parse_token scallop_token_list_get(
+	struct scallop_token_list *list,
+	ssize_t index
+)
+{
+	struct scallop_parse_token token = {
+		.token = list->kinds[index] & TOKEN_KIND_MASK,
+		.start_offset = list->starts[index],
+		.end_offset = index + 1 < list->count ?
+			list->starts[index + 1] :
+			list->last_end,
+		.flags = list->kinds[index] >> TOKEN_FLAGS_SHIFT,
+	};
+
+	// EOF tokens step past the null character they
+	// read, rather than reading another
+	const ssize_t last_read = token.token == SCALLOP_TOKEN_EOF ?
+		token.end_offset - 1 :
+		token.end_offset;
+	if (!scallop_token_list_position(list, last_read, &token.row, &token.col)) {
+		token.row = -1;
+		token.col = -1;
+	}
+	return token;
+}
@@ -0,0 +1,163 @@
+/*
+ * Scallop - a shell for executing tasks concurrently
+ * Copyright (C) <year>  Marcus Harrison
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "scallop/lexer.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define TOKEN_VALUE_X86
+#include <immintrin.h>
+#endif
+
+#define UNESCAPE_FLAGS \
+	(SCALLOP_TOKEN_QUOTED | SCALLOP_TOKEN_DOUBLE_QUOTED | SCALLOP_TOKEN_ESCAPED)
+
+/*
+ * Finding the next quote or backslash
+ *
+ * Everything between them is copied as it is, so
+ * unescaping is mostly a matter of finding them.
+ */
+
+static inline int is_special(char character)
+{
+	return character == '\'' || character == '"' || character == '\\';
+}
+
+static const char *find_special_scalar(const char *current, const char *end)
+{
+	while (current < end && !is_special(*current))
+		current++;
+	return current;
+}
+
+#ifdef TOKEN_VALUE_X86
+
+static const char *find_special_sse2(const char *current, const char *end)
+{
+	for (; end - current >= 16; current += 16) {
+		const __m128i characters = _mm_loadu_si128((const __m128i *)current);
+		const uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_or_si128(
+			_mm_or_si128(
+				_mm_cmpeq_epi8(characters, _mm_set1_epi8('\'')),
+				_mm_cmpeq_epi8(characters, _mm_set1_epi8('"'))
+			),
+			_mm_cmpeq_epi8(characters, _mm_set1_epi8('\\'))
+		));
+		if (mask)
+			return current + __builtin_ctz(mask);
+	}
+	return find_special_scalar(current, end);
+}
+
+__attribute__((target("avx2")))
+static const char *find_special_avx2(const char *current, const char *end)
+{
+	for (; end - current >= 32; current += 32) {
+		const __m256i characters = _mm256_loadu_si256((const __m256i *)current);
+		const uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(
+			_mm256_or_si256(
+				_mm256_cmpeq_epi8(characters, _mm256_set1_epi8('\'')),
+				_mm256_cmpeq_epi8(characters, _mm256_set1_epi8('"'))
+			),
+			_mm256_cmpeq_epi8(characters, _mm256_set1_epi8('\\'))
+		));
+		if (mask)
+			return current + __builtin_ctz(mask);
+	}
+	return find_special_sse2(current, end);
+}
+
+#endif // TOKEN_VALUE_X86
+
+static const char *(*find_special)(const char *, const char *) = find_special_scalar;
+
+__attribute__((constructor))
+static void choose_find_special(void)
+{
+#ifdef TOKEN_VALUE_X86
+	__builtin_cpu_init();
+	find_special = __builtin_cpu_supports("avx2") ?
+		find_special_avx2 :
+		find_special_sse2;
+#endif
+}
+
+/*
+ * Writes the value between begin and end to out,
+ * which is never longer, returning its length.
+ */
+static ssize_t unescape(const char *begin, const char *end, char *out)
+{
+	char *const out_begin = out;
+	char quote = 0;
+	while (begin < end) {
+		const char *special = find_special(begin, end);
+		memcpy(out, begin, special - begin);
+		out += special - begin;
+		if (special == end)
+			break;
+
+		const char character = *special;
+		begin = special + 1;
+		if (character == '\\') {
+			if (begin < end)
+				*out++ = *begin++;
+		} else if (!quote) {
+			quote = character;
+		} else if (quote == character) {
+			quote = 0;
+		} else {
+			*out++ = character;
+		}
+	}
+	return out - out_begin;
+}
+
+int scallop_token_value(
+	const char *begin,
+	const char *end,
+	const struct scallop_parse_token *token,
+	struct scallop_arena *arena,
+	struct scallop_token_value *value
+)
+{
+	// EOF tokens end past the null character they read
+	const ssize_t size = end - begin;
+	const ssize_t token_end = token->end_offset < size ? token->end_offset : size;
+	const ssize_t token_start = token->start_offset < token_end ?
+		token->start_offset :
+		token_end;
+
+	if (!(token->flags & UNESCAPE_FLAGS)) {
+		*value = (struct scallop_token_value) {
+			begin + token_start,
+			token_end - token_start,
+		};
+		return 1;
+	}
+
+	char *buffer = scallop_arena_alloc(arena, token_end - token_start);
+	if (!buffer)
+		return 0;
+	const ssize_t length = unescape(begin + token_start, begin + token_end, buffer);
+	// Give back what unescaping didn't need
+	arena->current = buffer + length;
+	*value = (struct scallop_token_value) { buffer, length };
+	return 1;
+}
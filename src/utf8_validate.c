@@ -0,0 +1,475 @@
+/*
+ * Scallop - a shell for executing tasks concurrently
+ * Copyright (C) 2022  Marcus Harrison
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "utf8_validate.h"
+#include "scallop/lexer.h"
+#include "lexer_spec.h"
+#include "lexer_tables.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define UTF8_X86
+#include <immintrin.h>
+#endif
+
+static inline int is_utf8_cont(char character)
+{
+	return (character & (UTF8_FIRST_BIT | UTF8_SECOND_BIT)) == UTF8_FIRST_BIT;
+}
+
+/*
+ * Scalar kernel
+ *
+ * Checks a character at a time against the table of
+ * well-formed byte sequences in the Unicode standard:
+ * the start character gives the length, and the range
+ * the second character has to be in to rule out
+ * overlong encodings, surrogates, and anything past
+ * U+10FFFF.
+ */
+
+static ssize_t find_error_scalar_from(
+	const char *begin,
+	const char *current,
+	const char *end
+)
+{
+	while (current < end) {
+		const unsigned char start = (unsigned char)*current;
+		if (start < 0x80) {
+			if (char_types[start] == CHAR_UNKNOWN)
+				break;
+			current++;
+			continue;
+		}
+
+		int length;
+		unsigned char second_min = 0x80, second_max = 0xBF;
+		if (0xC2 <= start && start <= 0xDF) {
+			length = 2;
+		} else if (0xE0 <= start && start <= 0xEF) {
+			length = 3;
+			if (start == 0xE0)
+				second_min = 0xA0;
+			else if (start == 0xED)
+				second_max = 0x9F;
+		} else if (0xF0 <= start && start <= 0xF4) {
+			length = 4;
+			if (start == 0xF0)
+				second_min = 0x90;
+			else if (start == 0xF4)
+				second_max = 0x8F;
+		} else {
+			break;
+		}
+
+		if (end - current < length)
+			break;
+		const unsigned char second = (unsigned char)current[1];
+		if (second < second_min || second_max < second)
+			break;
+		int i = 2;
+		while (i < length && is_utf8_cont(current[i]))
+			i++;
+		if (i < length)
+			break;
+		current += length;
+	}
+	return current - begin;
+}
+
+static ssize_t find_error_scalar(const char *begin, const char *end)
+{
+	return find_error_scalar_from(begin, begin, end);
+}
+
+#ifdef UTF8_X86
+
+/*
+ * SIMD kernels
+ *
+ * These follow Keiser and Lemire's "Validating UTF-8 In
+ * Less Than One Instruction Per Byte": each character
+ * is classified by looking up its high nibble, and the
+ * previous character's high and low nibbles, in three
+ * 16-entry tables, one bit per kind of error. ANDing
+ * the three leaves a bit set only where the pair of
+ * characters is in error; whether the third and fourth
+ * characters of a sequence are continuations is checked
+ * separately, from the characters two and three back.
+ *
+ * They only say whether a block has an error. When one
+ * does, the scalar kernel finds exactly where, starting
+ * from the beginning of the character that was being
+ * read when the block began, which is at most three
+ * characters back, the rest having been checked.
+ */
+
+#define TOO_SHORT (1 << 0)
+#define TOO_LONG (1 << 1)
+#define OVERLONG_3 (1 << 2)
+#define TOO_LARGE (1 << 3)
+#define SURROGATE (1 << 4)
+#define OVERLONG_2 (1 << 5)
+#define TOO_LARGE_1000 (1 << 6)
+#define OVERLONG_4 (1 << 6)
+#define TWO_CONTS (1 << 7)
+#define CARRY (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+#define PREV_HIGH_TABLE \
+	TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, \
+	TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, \
+	TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS, \
+	TOO_SHORT | OVERLONG_2, \
+	TOO_SHORT, \
+	TOO_SHORT | OVERLONG_3 | SURROGATE, \
+	TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+
+#define PREV_LOW_TABLE \
+	CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4, \
+	CARRY | OVERLONG_2, \
+	CARRY, \
+	CARRY, \
+	CARRY | TOO_LARGE, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000
+
+#define HIGH_TABLE \
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, \
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, \
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4, \
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE, \
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE, \
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE, \
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+
+/*
+ * Where to pick up with the scalar kernel after a
+ * block starting at block was found to have an error.
+ */
+static const char *character_start(const char *begin, const char *block)
+{
+	for (const char *current = block - 1; begin <= current && block - current <= 3; current--)
+		if (!is_utf8_cont(*current))
+			return current;
+	return block;
+}
+
+#define UTF8_SSSE3_BLOCK_SIZE 16
+
+struct utf8_ssse3 {
+	__m128i prev_input;
+	__m128i prev_incomplete;
+};
+
+__attribute__((target("ssse3")))
+static inline __m128i control_chars_ssse3(__m128i input)
+{
+	// Below space, besides null, tab, newline, and
+	// carriage return; or delete
+	const __m128i low = _mm_cmpeq_epi8(_mm_min_epu8(input, _mm_set1_epi8(0x1F)), input);
+	const __m128i allowed = _mm_or_si128(
+		_mm_or_si128(
+			_mm_cmpeq_epi8(input, _mm_setzero_si128()),
+			_mm_cmpeq_epi8(input, _mm_set1_epi8('\r'))
+		),
+		_mm_or_si128(
+			_mm_cmpeq_epi8(input, _mm_set1_epi8('\t')),
+			_mm_cmpeq_epi8(input, _mm_set1_epi8('\n'))
+		)
+	);
+	return _mm_or_si128(
+		_mm_andnot_si128(allowed, low),
+		_mm_cmpeq_epi8(input, _mm_set1_epi8(0x7F))
+	);
+}
+
+__attribute__((target("ssse3")))
+static inline __m128i check_block_ssse3(struct utf8_ssse3 *state, __m128i input)
+{
+	__m128i error = control_chars_ssse3(input);
+	if (!_mm_movemask_epi8(input)) {
+		error = _mm_or_si128(error, state->prev_incomplete);
+		state->prev_incomplete = _mm_setzero_si128();
+		state->prev_input = input;
+		return error;
+	}
+
+	const __m128i nibble = _mm_set1_epi8(0x0F);
+	const __m128i prev1 = _mm_alignr_epi8(input, state->prev_input, 15);
+	const __m128i special_cases = _mm_and_si128(
+		_mm_and_si128(
+			_mm_shuffle_epi8(
+				_mm_setr_epi8(PREV_HIGH_TABLE),
+				_mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)
+			),
+			_mm_shuffle_epi8(
+				_mm_setr_epi8(PREV_LOW_TABLE),
+				_mm_and_si128(prev1, nibble)
+			)
+		),
+		_mm_shuffle_epi8(
+			_mm_setr_epi8(HIGH_TABLE),
+			_mm_and_si128(_mm_srli_epi16(input, 4), nibble)
+		)
+	);
+
+	// Only characters two after a 3 or 4 character
+	// start, or three after a 4 character one, end up
+	// with their top bit set
+	const __m128i prev2 = _mm_alignr_epi8(input, state->prev_input, 14);
+	const __m128i prev3 = _mm_alignr_epi8(input, state->prev_input, 13);
+	const __m128i must_be_cont = _mm_and_si128(
+		_mm_or_si128(
+			_mm_subs_epu8(prev2, _mm_set1_epi8((char)(0xE0 - 0x80))),
+			_mm_subs_epu8(prev3, _mm_set1_epi8((char)(0xF0 - 0x80)))
+		),
+		_mm_set1_epi8((char)0x80)
+	);
+	error = _mm_or_si128(error, _mm_xor_si128(must_be_cont, special_cases));
+
+	// Whether the block ends part-way through a character
+	state->prev_incomplete = _mm_subs_epu8(
+		input,
+		_mm_setr_epi8(
+			-1, -1, -1, -1, -1, -1, -1, -1,
+			-1, -1, -1, -1, -1,
+			(char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1)
+		)
+	);
+	state->prev_input = input;
+	return error;
+}
+
+__attribute__((target("ssse3")))
+static ssize_t find_error_ssse3(const char *begin, const char *end)
+{
+	struct utf8_ssse3 state = {
+		_mm_setzero_si128(),
+		_mm_setzero_si128(),
+	};
+	const char *block = begin;
+	for (; end - block >= UTF8_SSSE3_BLOCK_SIZE; block += UTF8_SSSE3_BLOCK_SIZE) {
+		const __m128i error = check_block_ssse3(
+			&state,
+			_mm_loadu_si128((const __m128i *)block)
+		);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) != 0xFFFF)
+			return find_error_scalar_from(begin, character_start(begin, block), end);
+	}
+
+	// The tail is padded with null characters, which
+	// also shows up a character cut off at the end
+	char tail[UTF8_SSSE3_BLOCK_SIZE] = { 0 };
+	if (block < end)
+		memcpy(tail, block, end - block);
+	const __m128i error = _mm_or_si128(
+		check_block_ssse3(&state, _mm_loadu_si128((const __m128i *)tail)),
+		state.prev_incomplete
+	);
+	if (_mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) != 0xFFFF)
+		return find_error_scalar_from(begin, character_start(begin, block), end);
+	return end - begin;
+}
+
+#define UTF8_AVX2_BLOCK_SIZE 32
+
+struct utf8_avx2 {
+	__m256i prev_input;
+	__m256i prev_incomplete;
+};
+
+__attribute__((target("avx2")))
+static inline __m256i control_chars_avx2(__m256i input)
+{
+	const __m256i low = _mm256_cmpeq_epi8(
+		_mm256_min_epu8(input, _mm256_set1_epi8(0x1F)),
+		input
+	);
+	const __m256i allowed = _mm256_or_si256(
+		_mm256_or_si256(
+			_mm256_cmpeq_epi8(input, _mm256_setzero_si256()),
+			_mm256_cmpeq_epi8(input, _mm256_set1_epi8('\r'))
+		),
+		_mm256_or_si256(
+			_mm256_cmpeq_epi8(input, _mm256_set1_epi8('\t')),
+			_mm256_cmpeq_epi8(input, _mm256_set1_epi8('\n'))
+		)
+	);
+	return _mm256_or_si256(
+		_mm256_andnot_si256(allowed, low),
+		_mm256_cmpeq_epi8(input, _mm256_set1_epi8(0x7F))
+	);
+}
+
+/*
+ * AVX2 shuffles and shifts only work within each
+ * 16-character lane, so the tables are repeated, and
+ * the characters from before the block are put
+ * together from the upper lane of the previous input
+ * and the lower lane of this one.
+ */
+__attribute__((target("avx2")))
+static inline __m256i check_block_avx2(struct utf8_avx2 *state, __m256i input)
+{
+	__m256i error = control_chars_avx2(input);
+	if (!_mm256_movemask_epi8(input)) {
+		error = _mm256_or_si256(error, state->prev_incomplete);
+		state->prev_incomplete = _mm256_setzero_si256();
+		state->prev_input = input;
+		return error;
+	}
+
+	const __m256i before = _mm256_permute2x128_si256(state->prev_input, input, 0x21);
+	const __m256i nibble = _mm256_set1_epi8(0x0F);
+	const __m256i prev1 = _mm256_alignr_epi8(input, before, 15);
+	const __m256i special_cases = _mm256_and_si256(
+		_mm256_and_si256(
+			_mm256_shuffle_epi8(
+				_mm256_setr_epi8(PREV_HIGH_TABLE, PREV_HIGH_TABLE),
+				_mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)
+			),
+			_mm256_shuffle_epi8(
+				_mm256_setr_epi8(PREV_LOW_TABLE, PREV_LOW_TABLE),
+				_mm256_and_si256(prev1, nibble)
+			)
+		),
+		_mm256_shuffle_epi8(
+			_mm256_setr_epi8(HIGH_TABLE, HIGH_TABLE),
+			_mm256_and_si256(_mm256_srli_epi16(input, 4), nibble)
+		)
+	);
+
+	const __m256i prev2 = _mm256_alignr_epi8(input, before, 14);
+	const __m256i prev3 = _mm256_alignr_epi8(input, before, 13);
+	const __m256i must_be_cont = _mm256_and_si256(
+		_mm256_or_si256(
+			_mm256_subs_epu8(prev2, _mm256_set1_epi8((char)(0xE0 - 0x80))),
+			_mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xF0 - 0x80)))
+		),
+		_mm256_set1_epi8((char)0x80)
+	);
+	error = _mm256_or_si256(error, _mm256_xor_si256(must_be_cont, special_cases));
+
+	state->prev_incomplete = _mm256_subs_epu8(
+		input,
+		_mm256_setr_epi8(
+			-1, -1, -1, -1, -1, -1, -1, -1,
+			-1, -1, -1, -1, -1, -1, -1, -1,
+			-1, -1, -1, -1, -1, -1, -1, -1,
+			-1, -1, -1, -1, -1,
+			(char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1)
+		)
+	);
+	state->prev_input = input;
+	return error;
+}
+
+__attribute__((target("avx2")))
+static ssize_t find_error_avx2(const char *begin, const char *end)
+{
+	struct utf8_avx2 state = {
+		_mm256_setzero_si256(),
+		_mm256_setzero_si256(),
+	};
+	const char *block = begin;
+	for (; end - block >= UTF8_AVX2_BLOCK_SIZE; block += UTF8_AVX2_BLOCK_SIZE) {
+		const __m256i error = check_block_avx2(
+			&state,
+			_mm256_loadu_si256((const __m256i *)block)
+		);
+		if (!_mm256_testz_si256(error, error))
+			return find_error_scalar_from(begin, character_start(begin, block), end);
+	}
+
+	char tail[UTF8_AVX2_BLOCK_SIZE] = { 0 };
+	if (block < end)
+		memcpy(tail, block, end - block);
+	const __m256i error = _mm256_or_si256(
+		check_block_avx2(&state, _mm256_loadu_si256((const __m256i *)tail)),
+		state.prev_incomplete
+	);
+	if (!_mm256_testz_si256(error, error))
+		return find_error_scalar_from(begin, character_start(begin, block), end);
+	return end - begin;
+}
+
+#endif // UTF8_X86
+
+utf8_find_error_fn *utf8_find_error = find_error_scalar;
+
+int utf8_use_kernel(enum UTF8_KERNEL kernel)
+{
+	switch (kernel) {
+		case UTF8_KERNEL_SCALAR:
+			utf8_find_error = find_error_scalar;
+			return 1;
+#ifdef UTF8_X86
+		case UTF8_KERNEL_SSSE3:
+			__builtin_cpu_init();
+			if (!__builtin_cpu_supports("ssse3"))
+				return 0;
+			utf8_find_error = find_error_ssse3;
+			return 1;
+		case UTF8_KERNEL_AVX2:
+			__builtin_cpu_init();
+			if (!__builtin_cpu_supports("avx2"))
+				return 0;
+			utf8_find_error = find_error_avx2;
+			return 1;
+#endif
+		default:
+			return 0;
+	}
+}
+
+__attribute__((constructor))
+static void choose_utf8_kernel(void)
+{
+	if (!utf8_use_kernel(UTF8_KERNEL_AVX2) && !utf8_use_kernel(UTF8_KERNEL_SSSE3))
+		utf8_use_kernel(UTF8_KERNEL_SCALAR);
+}
+
+int scallop_validate_utf8(
+	const char *begin,
+	const char *end,
+	struct scallop_utf8_error *error
+)
+{
+	const ssize_t offset = utf8_find_error(begin, end);
+	if (offset == end - begin)
+		return 1;
+
+	error->offset = offset;
+	struct scallop_token_list list = scallop_token_list_make(begin, end);
+	if (!scallop_token_list_position(&list, offset, &error->row, &error->col)) {
+		error->row = -1;
+		error->col = -1;
+	}
+	scallop_token_list_free(&list);
+	return 0;
+}
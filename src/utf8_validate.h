@@ -0,0 +1,54 @@
+/*
+ * Scallop - a shell for executing tasks concurrently
+ * Copyright (C) 2022  Marcus Harrison
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef SCALLOP_UTF8_VALIDATE_H
+#define SCALLOP_UTF8_VALIDATE_H
+
+#include <sys/types.h>
+
+/*
+ * Finding the first byte scallop_validate_utf8() would
+ * reject.
+ *
+ * As with the run kernels, the best one the CPU
+ * supports is picked when the library is loaded, and
+ * utf8_use_kernel() lets the tests try each of them.
+ */
+
+enum UTF8_KERNEL {
+	UTF8_KERNEL_SCALAR,
+	UTF8_KERNEL_SSSE3,
+	UTF8_KERNEL_AVX2,
+};
+
+/*
+ * Returns the offset from begin of the first character
+ * that isn't valid UTF-8, or is a control character
+ * the lexer has no use for; or end - begin if there
+ * aren't any.
+ */
+typedef ssize_t utf8_find_error_fn(const char *begin, const char *end);
+
+extern utf8_find_error_fn *utf8_find_error;
+
+/*
+ * Returns 0 if the CPU doesn't support the kernel,
+ * leaving the current one in place.
+ */
+int utf8_use_kernel(enum UTF8_KERNEL kernel);
+
+#endif // SCALLOP_UTF8_VALIDATE_H
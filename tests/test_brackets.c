@@ -0,0 +1,94 @@
+#include "test_macros.h"
+
+#include <string.h>
+
+static struct scallop_parse_token tokens[64];
+static ssize_t matches[64];
+
+static ssize_t lex(const char *script, ssize_t capacity, struct scallop_bracket_match *unmatched)
+{
+	return scallop_lex_memory_brackets(
+		script,
+		script + strlen(script),
+		tokens,
+		tokens + capacity,
+		matches,
+		unmatched
+	) - tokens;
+}
+
+static void expect_balanced(const char *script, const ssize_t *expected, ssize_t count)
+{
+	struct scallop_bracket_match unmatched;
+	assert(lex(script, arrend(tokens) - tokens, &unmatched) == count);
+	assert(tokens[count - 1].token == SCALLOP_TOKEN_EOF);
+	assert(unmatched.open == -1 && unmatched.close == -1);
+	for (ssize_t i = 0; i < count; i++) {
+		if (matches[i] != expected[i]) {
+			print_error("%s: token %zd expected %zd, got %zd", script, i, expected[i], matches[i]);
+			assert(matches[i] == expected[i]);
+		}
+	}
+}
+
+static void expect_unbalanced(const char *script, ssize_t open, ssize_t close)
+{
+	struct scallop_bracket_match unmatched;
+	const ssize_t count = lex(script, arrend(tokens) - tokens, &unmatched);
+	assert(unmatched.open == open);
+	assert(unmatched.close == close);
+	assert(count == close + 1);
+	// Nothing is left half-paired
+	for (ssize_t i = 0; i < count; i++)
+		assert(matches[i] == -1 || matches[matches[i]] == i);
+}
+
+int main()
+{
+	// {a [b] c}
+	// 0123 4 5678
+	static const ssize_t nested[] = { 8, -1, -1, 5, -1, 3, -1, -1, 0, -1 };
+	expect_balanced("{a [b] c}", nested, arrend(nested) - nested);
+
+	static const ssize_t siblings[] = { 1, 0, 3, 2, -1, 6, 5, -1, -1 };
+	expect_balanced("{}[] [];", siblings, arrend(siblings) - siblings);
+
+	static const ssize_t none[] = { -1, -1, -1, -1 };
+	expect_balanced("echo hi", none, arrend(none) - none);
+
+	expect_unbalanced("]", -1, 0);
+	expect_unbalanced("{a]", 0, 2);
+	expect_unbalanced("{[}]", 1, 2);
+	expect_unbalanced("{a {b}", 0, 6);
+	expect_unbalanced("[[[]]", 0, 5);
+
+	// Running out of room leaves open brackets unpaired
+	struct scallop_bracket_match unmatched;
+	assert(lex("{[x] {y}}", 6, &unmatched) == 6);
+	assert(unmatched.open == -1 && unmatched.close == -1);
+	assert(matches[0] == -1 && matches[5] == -1);
+	assert(matches[1] == 3 && matches[3] == 1);
+
+	// Deep nesting, pairing every bracket with the
+	// one mirroring it
+	static char deep[4096];
+	static struct scallop_parse_token deep_tokens[4096];
+	static ssize_t deep_matches[4096];
+	const ssize_t depth = 2000;
+	for (ssize_t i = 0; i < depth; i++) {
+		deep[i] = i % 3 ? '{' : '[';
+		deep[2 * depth - 1 - i] = i % 3 ? '}' : ']';
+	}
+	const ssize_t count = scallop_lex_memory_brackets(
+		deep,
+		deep + 2 * depth,
+		deep_tokens,
+		arrend(deep_tokens),
+		deep_matches,
+		&unmatched
+	) - deep_tokens;
+	assert(count == 2 * depth + 1);
+	assert(unmatched.open == -1 && unmatched.close == -1);
+	for (ssize_t i = 0; i < 2 * depth; i++)
+		assert(deep_matches[i] == 2 * depth - 1 - i);
+}
@@ -0,0 +1,591 @@
+#include "test_macros.h"
+#include "scallop/builtin.h"
+#include "scallop/executor.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_STAGES 4
+#define MAX_ARGUMENTS 8
+#define BIG_SIZE (3 * 1024 * 1024 + 12345)
+
+static struct scallop_builtins *builtins;
+static struct scallop_path_cache *paths;
+static struct scallop_executor *executor;
+
+static int temp_file(void)
+{
+	char path[] = "/tmp/scallop_test_builtinsXXXXXX";
+	const int fd = mkstemp(path);
+	assert(fd >= 0);
+	unlink(path);
+	return fd;
+}
+
+static void read_back(int fd, char *buffer, size_t size)
+{
+	const off_t length = lseek(fd, 0, SEEK_CUR);
+	assert(length >= 0 && (size_t)length < size);
+	assert(pread(fd, buffer, length, 0) == length);
+	buffer[length] = 0;
+}
+
+static void expect_text(const char *label, const char *expected, const char *actual)
+{
+	if (strcmp(expected, actual)) {
+		print_error("%s expected: %s", label, expected);
+		print_error("%s actual: %s", label, actual);
+		assert(!"wrong output");
+	}
+}
+
+/*
+ * Runs a pipeline of stages split by "|" or "||"
+ * arguments, with the task's output and error going
+ * to files, and checks what they got.
+ */
+static void expect_pipeline(
+	struct scallop_task *task,
+	char *const *words,
+	const struct scallop_redirect *redirects,
+	ssize_t redirect_count,
+	const char *expected_output,
+	const char *expected_error,
+	int expected_status
+)
+{
+	const int output = temp_file();
+	const int error = temp_file();
+	struct scallop_task stage;
+	assert(scallop_task_inherit(&stage, task));
+	stage.fds[1] = (struct scallop_vfd) { SCALLOP_VFD_FD, output };
+	stage.fds[2] = (struct scallop_vfd) { SCALLOP_VFD_FD, error };
+
+	char *argv[MAX_STAGES * MAX_ARGUMENTS];
+	struct scallop_command commands[MAX_STAGES] = { { argv } };
+	char binary[MAX_STAGES] = { 0 };
+	ssize_t count = 1, next = 0;
+	for (; *words; words++) {
+		if (strcmp(*words, "|") && strcmp(*words, "||")) {
+			argv[next++] = *words;
+			continue;
+		}
+		argv[next++] = NULL;
+		binary[count - 1] = !strcmp(*words, "||");
+		commands[count++].argv = argv + next;
+	}
+	argv[next] = NULL;
+	commands[count - 1].redirects = redirects;
+	commands[count - 1].redirect_count = redirect_count;
+
+	const int status = scallop_run_pipeline(
+		builtins,
+		paths,
+		executor,
+		&stage,
+		commands,
+		binary,
+		count,
+		SCALLOP_LAUNCH_SPAWN
+	);
+	// Hands back a directory changed by cd, and
+	// variables changed by export and unset
+	free(task->directory);
+	task->directory = stage.directory;
+	stage.directory = NULL;
+	scallop_environment_release(task->environment);
+	task->environment = stage.environment;
+	stage.environment = NULL;
+	scallop_task_free(&stage);
+
+	char actual[4096];
+	read_back(output, actual, sizeof(actual));
+	expect_text(words[-1], expected_output, actual);
+	read_back(error, actual, sizeof(actual));
+	expect_text(words[-1], expected_error, actual);
+	if (status != expected_status) {
+		print_error("%s expected status %d, got %d", words[-1], expected_status, status);
+		assert(!"wrong status");
+	}
+	close(output);
+	close(error);
+}
+
+#define expect_run(task, expected_output, expected_error, expected_status, ...) \
+	expect_pipeline( \
+		(task), \
+		(char *[]) { __VA_ARGS__, NULL }, \
+		NULL, \
+		0, \
+		(expected_output), \
+		(expected_error), \
+		(expected_status) \
+	)
+
+static void test_builtins(struct scallop_task *task)
+{
+	expect_run(task, "", "", 0, "true");
+	expect_run(task, "", "", 1, "false");
+	expect_run(task, "hello world\n", "", 0, "echo", "hello", "world");
+	expect_run(task, "\n", "", 0, "echo");
+	expect_run(task, "no newline", "", 0, "echo", "-n", "no", "newline");
+
+	expect_run(task, "a=1, b=-2\n", "", 0, "printf", "%s=%d, %s=%i\\n", "a", "1", "b", "-2");
+	expect_run(task, "[  x] [y  ] ff 17 41 %\n", "", 0, "printf", "[%3s] [%-3s] %x %o %X %%\\n", "x", "y", "255", "15", "0x41");
+	expect_run(task, "1\n2\n3\n", "", 0, "printf", "%s\\n", "1", "2", "3");
+	expect_run(task, "tab\there\n", "", 0, "printf", "%b", "tab\\there\\n");
+	expect_run(task, "A\n", "", 0, "printf", "\\101%c\\n", "");
+	expect_run(task, "\b1 A\n", "", 0, "printf", "\\0101 %b\\n", "\\0101");
+	expect_run(task, "0\n", "printf: nope: invalid number\n", 1, "printf", "%d\\n", "nope");
+	expect_run(task, "", "printf: %q: invalid conversion\n", 1, "printf", "%q");
+
+	expect_run(task, "", "", 0, "test", "abc");
+	expect_run(task, "", "", 1, "test", "");
+	expect_run(task, "", "", 1, "test");
+	expect_run(task, "", "", 0, "test", "-n", "abc");
+	expect_run(task, "", "", 0, "test", "-z", "");
+	expect_run(task, "", "", 0, "test", "a", "=", "a");
+	expect_run(task, "", "", 0, "test", "a", "!=", "b");
+	expect_run(task, "", "", 0, "test", "!", "a", "=", "b");
+	expect_run(task, "", "", 0, "test", "3", "-lt", "10");
+	expect_run(task, "", "", 1, "test", "10", "-le", "3");
+	expect_run(task, "", "", 0, "test", "(", "-d", "/", ")");
+	expect_run(task, "", "", 0, "[", "-d", "/tmp", "]");
+	expect_run(task, "", "", 0, "[", "-f", "/etc/hosts", "]");
+	expect_run(task, "", "", 1, "[", "-e", "/nonexistent", "]");
+	expect_run(task, "", "[: missing ]\n", 2, "[", "-e", "/");
+	expect_run(task, "", "test: x: integer expected\n", 2, "test", "x", "-eq", "1");
+	expect_run(task, "", "test: -q: unary operator expected\n", 2, "test", "-q", "x");
+}
+
+static void test_cd(struct scallop_task *task)
+{
+	expect_run(task, "", "", 0, "cd", "/etc");
+	assert(!strcmp(task->directory, "/etc"));
+	expect_run(task, "", "", 0, "test", "-f", "hosts");
+	expect_run(task, "/etc\n", "", 0, "pwd");
+
+	expect_run(task, "", "", 0, "cd", "../tmp/./");
+	assert(!strcmp(task->directory, "/tmp"));
+	expect_run(task, "", "", 0, "cd", "..");
+	assert(!strcmp(task->directory, "/"));
+
+	expect_run(task, "", "cd: /nonexistent: No such file or directory\n", 1, "cd", "/nonexistent");
+	expect_run(task, "", "cd: /etc/hosts: Not a directory\n", 1, "cd", "/etc/hosts");
+	assert(!strcmp(task->directory, "/"));
+
+	// Only a lone cd changes the pipeline's directory
+	expect_run(task, "", "", 0, "cd", "/etc", "|", "true");
+	assert(!strcmp(task->directory, "/"));
+	free(task->directory);
+	task->directory = NULL;
+}
+
+static int count_input(struct scallop_task *task, int argc, char *const *argv)
+{
+	(void)argc;
+	(void)argv;
+	char buffer[4096];
+	long long total = 0;
+	ssize_t length;
+	while ((length = scallop_task_read(task, 0, buffer, sizeof(buffer))) > 0)
+		total += length;
+	if (length < 0)
+		return 1;
+	char message[32];
+	const int message_length = snprintf(message, sizeof(message), "%lld\n", total);
+	return scallop_task_write(task, 1, message, message_length) < 0;
+}
+
+// Writes more than any pipe or ring holds
+static int write_big(struct scallop_task *task, int argc, char *const *argv)
+{
+	(void)argc;
+	(void)argv;
+	char *buffer = calloc(1, BIG_SIZE);
+	assert(buffer);
+	const int status = scallop_task_write(task, 1, buffer, BIG_SIZE) < 0;
+	free(buffer);
+	return status;
+}
+
+static void test_pipelines(struct scallop_task *task)
+{
+	assert(scallop_builtins_add(builtins, "count_input", count_input));
+	assert(scallop_builtins_add(builtins, "write_big", write_big));
+	assert(scallop_builtins_find(builtins, "count_input") == count_input);
+	assert(!scallop_builtins_find(builtins, "cat"));
+
+	// Builtins into processes, and the other way round
+	expect_run(task, "hello\n", "", 0, "echo", "hello", "|", "cat");
+	expect_run(task, "5\n", "", 0, "printf", "hello", "|", "cat", "|", "count_input");
+	expect_run(task, "2\n", "", 0, "echo", "a", "|", "tr", "a", "b", "|", "count_input");
+	expect_run(task, "3145728\n", "", 0, "head", "-c", "3145728", "/dev/zero", "|", "count_input");
+
+	// Builtin to builtin, through a pipe and a ring
+	expect_run(task, "3158073\n", "", 0, "write_big", "|", "count_input");
+	expect_run(task, "3158073\n", "", 0, "write_big", "||", "count_input");
+	expect_run(task, "3158073\n", "", 0, "write_big", "||", "count_input", "||", "cat");
+	expect_run(task, "3158073\n", "", 0, "write_big", "||", "cat", "||", "count_input");
+
+	// The last stage's status counts
+	expect_run(task, "", "", 1, "true", "|", "false");
+	expect_run(task, "", "", 0, "false", "|", "true");
+
+	// A reader that goes early gives the writer EPIPE
+	expect_run(task, "", "", 0, "write_big", "||", "true");
+	expect_run(task, "", "", 0, "write_big", "|", "true");
+
+	expect_run(
+		task,
+		"",
+		"scallop-no-such-command: No such file or directory\n"
+		"echo: write error: Broken pipe\n",
+		127,
+		"echo", "hello", "|", "scallop-no-such-command"
+	);
+
+	// With SIGCHLD ignored, processes reap themselves,
+	// leaving no status to wait for
+	signal(SIGCHLD, SIG_IGN);
+	expect_run(task, "", "cat: No child processes\n", 126, "true", "|", "cat");
+	signal(SIGCHLD, SIG_DFL);
+}
+
+static void test_redirects(struct scallop_task *task)
+{
+	char path[] = "/tmp/scallop_test_builtinsXXXXXX";
+	const int fd = mkstemp(path);
+	assert(fd >= 0);
+	close(fd);
+
+	const struct scallop_redirect to_file[] = {
+		{ SCALLOP_REDIRECT_OPEN, 1, .path = path, .flags = O_WRONLY | O_TRUNC },
+	};
+	expect_pipeline(task, (char *[]) { "echo", "into", "the", "file", NULL }, to_file, 1, "", "", 0);
+	const struct scallop_redirect appending[] = {
+		{ SCALLOP_REDIRECT_OPEN, 1, .path = path, .flags = O_WRONLY | O_APPEND },
+	};
+	expect_pipeline(task, (char *[]) { "printf", "again\\n", NULL }, appending, 1, "", "", 0);
+	const struct scallop_redirect from_file[] = {
+		{ SCALLOP_REDIRECT_OPEN, 0, .path = path, .flags = O_RDONLY },
+	};
+	expect_pipeline(task, (char *[]) { "cat", NULL }, from_file, 1, "into the file\nagain\n", "", 0);
+	expect_pipeline(task, (char *[]) { "count_input", NULL }, from_file, 1, "20\n", "", 0);
+
+	// Relative to the task's directory
+	expect_run(task, "", "", 0, "cd", "/tmp");
+	const struct scallop_redirect relative[] = {
+		{ SCALLOP_REDIRECT_OPEN, 0, .path = path + strlen("/tmp/"), .flags = O_RDONLY },
+	};
+	expect_pipeline(task, (char *[]) { "count_input", NULL }, relative, 1, "20\n", "", 0);
+	free(task->directory);
+	task->directory = NULL;
+	unlink(path);
+
+	// Output to error, and error to output
+	const struct scallop_redirect swapped[] = {
+		{ SCALLOP_REDIRECT_DUP, 3, 1 },
+		{ SCALLOP_REDIRECT_DUP, 1, 2 },
+		{ SCALLOP_REDIRECT_DUP, 2, 3 },
+		{ SCALLOP_REDIRECT_CLOSE, 3 },
+	};
+	expect_pipeline(task, (char *[]) { "printf", "%d", "x", NULL }, swapped, 4, "printf: x: invalid number\n", "0", 1);
+	expect_pipeline(task, (char *[]) { "sh", "-c", "echo out; echo err >&2", NULL }, swapped, 4, "err\n", "out\n", 0);
+
+	const struct scallop_redirect unopenable[] = {
+		{ SCALLOP_REDIRECT_OPEN, 0, .path = "/nonexistent/input", .flags = O_RDONLY },
+	};
+	expect_pipeline(
+		task,
+		(char *[]) { "echo", NULL },
+		unopenable,
+		1,
+		"",
+		"echo: No such file or directory\n",
+		1
+	);
+	expect_pipeline(
+		task,
+		(char *[]) { "true", "|", "cat", NULL },
+		unopenable,
+		1,
+		"",
+		"cat: No such file or directory\n",
+		1
+	);
+}
+
+static void test_ring_copies(void)
+{
+	struct scallop_ring ring;
+	assert(scallop_ring_create(&ring, SCALLOP_RING_SIZE));
+	struct scallop_task task;
+	scallop_task_init(&task);
+	task.fds[1] = (struct scallop_vfd) { SCALLOP_VFD_RING_WRITER, -1, &ring, 1 };
+
+	// A copy of the writer takes it over when the
+	// original's closed, so the reader sees no EOF yet
+	const struct scallop_redirect moved[] = {
+		{ SCALLOP_REDIRECT_DUP, 5, 1 },
+		{ SCALLOP_REDIRECT_CLOSE, 1 },
+		{ SCALLOP_REDIRECT_DUP, 1, 5 },
+		{ SCALLOP_REDIRECT_CLOSE, 5 },
+	};
+	assert(scallop_task_redirect(&task, moved, 4));
+	assert(task.fds[1].kind == SCALLOP_VFD_RING_WRITER && task.fds[1].owned);
+	assert(scallop_task_write(&task, 1, "abc", 3) == 3);
+	assert(scallop_task_write(&task, 5, "abc", 3) < 0 && errno == EBADF);
+	assert(scallop_task_write(&task, SCALLOP_TASK_FDS, "abc", 3) < 0 && errno == EBADF);
+
+	char buffer[8];
+	assert(scallop_ring_read(&ring, buffer, sizeof(buffer)) == 3);
+	scallop_task_free(&task);
+	assert(scallop_ring_read(&ring, buffer, sizeof(buffer)) == 0);
+	scallop_ring_unmap(&ring);
+}
+
+static void test_statements(struct scallop_task *task)
+{
+	const char script[] =
+		"echo one\n"
+		"printf '%s\\\\n' 'two words' | cat\n"
+		"write_big || count_input\n"
+		"test -d /";
+	struct scallop_ast ast;
+	struct scallop_parse_error error;
+	assert(scallop_parse_memory(script, script + strlen(script), &ast, &error));
+
+	const int output = temp_file();
+	struct scallop_task shell;
+	assert(scallop_task_inherit(&shell, task));
+	shell.fds[1] = (struct scallop_vfd) { SCALLOP_VFD_FD, output };
+	const int errors = temp_file();
+	shell.fds[2] = (struct scallop_vfd) { SCALLOP_VFD_FD, errors };
+	struct scallop_executor *statements = scallop_executor_create(4);
+	assert(statements);
+	struct scallop_statement_context context = {
+		script,
+		script + strlen(script),
+		builtins,
+		paths,
+		&shell,
+		SCALLOP_LAUNCH_SPAWN,
+		statements,
+	};
+	assert(!scallop_execute_block(statements, &ast, 0, scallop_run_statement, &context));
+
+	char actual[256];
+	read_back(output, actual, sizeof(actual));
+	// The statements run concurrently, so only the
+	// lines are certain, not their order
+	assert(strlen(actual) == strlen("one\ntwo words\n3158073\n"));
+	assert(strstr(actual, "one\n"));
+	assert(strstr(actual, "two words\n"));
+	assert(strstr(actual, "3158073\n"));
+	scallop_ast_free(&ast);
+
+	const char failing[] = "true; {echo nested}; false";
+	assert(scallop_parse_memory(failing, failing + strlen(failing), &ast, &error));
+	context.begin = failing;
+	context.end = failing + strlen(failing);
+	const int status = scallop_execute_block(statements, &ast, 0, scallop_run_statement, &context);
+	assert(status == 1 || status == 2);
+	read_back(errors, actual, sizeof(actual));
+	expect_text(failing, "scallop: blocks and lists can't be run as arguments yet\n", actual);
+	scallop_ast_free(&ast);
+
+	scallop_executor_destroy(statements);
+	scallop_task_free(&shell);
+	close(output);
+	close(errors);
+}
+
+/*
+ * Processes are waited for through the executor, so a
+ * single worker keeps on starting statements while
+ * the ones before are still running.
+ */
+static void test_waiting(struct scallop_task *task)
+{
+	const char script[] =
+		"sleep 0.3; sleep 0.3; sleep 0.3; sleep 0.3;"
+		"sleep 0.3; sleep 0.3; sleep 0.3; sleep 0.3 | true";
+	struct scallop_ast ast;
+	struct scallop_parse_error error;
+	assert(scallop_parse_memory(script, script + strlen(script), &ast, &error));
+	struct scallop_executor *statements = scallop_executor_create(1);
+	assert(statements);
+	struct scallop_statement_context context = {
+		script,
+		script + strlen(script),
+		builtins,
+		paths,
+		task,
+		SCALLOP_LAUNCH_SPAWN,
+		statements,
+	};
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	assert(!scallop_execute_block(statements, &ast, 0, scallop_run_statement, &context));
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	const double seconds = end.tv_sec - start.tv_sec + (end.tv_nsec - start.tv_nsec) / 1e9;
+	if (seconds > 1.2) {
+		print_error("took %f seconds", seconds);
+		assert(!"processes were waited for one at a time");
+	}
+
+	scallop_executor_destroy(statements);
+	scallop_ast_free(&ast);
+}
+
+static void test_variables(struct scallop_task *task)
+{
+	expect_run(task, "", "export: Operation not supported\n", 1, "export", "A=1");
+	expect_run(task, "", "", 0, "unset", "A");
+
+	struct scallop_symbols *symbols = scallop_symbols_create();
+	assert(symbols);
+	task->environment = scallop_environment_create(symbols);
+	assert(task->environment);
+	expect_run(task, "", "", 0, "export");
+	expect_run(task, "", "", 0, "export", "A=1", "B=two words");
+	expect_run(task, "A=1\nB=two words\n", "", 0, "export");
+	expect_run(task, "", "export: 1x=2: not NAME=value\n", 1, "export", "1x=2");
+	expect_run(task, "", "export: B: not NAME=value\n", 1, "export", "B");
+	expect_run(task, "1two words\n", "", 0, "/bin/sh", "-c", "echo $A$B");
+	expect_run(task, "", "", 0, "export", "A=one");
+	expect_run(task, "one\n", "", 0, "/bin/sh", "-c", "echo $A", "|", "cat");
+	expect_run(task, "", "", 0, "unset", "A", "never_set");
+	expect_run(task, "B=two words\n", "", 0, "export");
+	expect_run(task, "", "unset: 1x: not a valid name\n", 1, "unset", "1x");
+
+	// cd goes to the task's HOME, not the shell's
+	expect_run(task, "", "", 0, "export", "HOME=/etc");
+	expect_run(task, "", "", 0, "cd");
+	assert(!strcmp(task->directory, "/etc"));
+	free(task->directory);
+	task->directory = NULL;
+	expect_run(task, "", "", 0, "unset", "HOME");
+	expect_run(task, "", "cd: HOME not set\n", 1, "cd");
+
+	// Commands are found through the task's PATH too
+	char directory[] = "/tmp/scallop_test_builtinsXXXXXX";
+	assert(mkdtemp(directory));
+	char command[PATH_MAX];
+	snprintf(command, sizeof(command), "%s/scallop-test-command", directory);
+	const int script_fd = open(command, O_WRONLY | O_CREAT | O_EXCL, 0755);
+	assert(script_fd >= 0);
+	assert(write(script_fd, "#!/bin/sh\necho found\n", 22) == 22);
+	close(script_fd);
+	char assignment[PATH_MAX];
+	snprintf(assignment, sizeof(assignment), "PATH=%s", directory);
+	expect_run(task, "", "", 0, "export", assignment);
+	expect_run(task, "found\n", "", 0, "scallop-test-command");
+	expect_run(task, "", "cat: No such file or directory\n", 127, "cat");
+	// Without one, it's what execvp() would search
+	expect_run(task, "", "", 0, "unset", "PATH");
+	expect_run(task, "", "scallop-test-command: No such file or directory\n", 127, "scallop-test-command");
+	expect_run(task, "hi\n", "", 0, "echo", "hi", "|", "cat");
+	unlink(command);
+	rmdir(directory);
+
+	// Stages of a longer pipeline have tasks of their own
+	expect_run(task, "", "", 0, "export", "C=3", "|", "true");
+	expect_run(task, "", "", 0, "true", "|", "unset", "B");
+	expect_run(task, "B=two words\n", "", 0, "export");
+
+	const char script[] =
+		"X=1 /bin/sh -c 'echo x$X$B'\n"
+		"X=2 Y=3 /bin/sh -c 'echo y$X$Y' | cat\n"
+		"Z=4\n"
+		"echo W=5\n"
+		"X=6 | cat";
+	struct scallop_ast ast;
+	struct scallop_parse_error error;
+	assert(scallop_parse_memory(script, script + strlen(script), &ast, &error));
+	const int output = temp_file();
+	const int errors = temp_file();
+	struct scallop_task shell;
+	assert(scallop_task_inherit(&shell, task));
+	shell.fds[1] = (struct scallop_vfd) { SCALLOP_VFD_FD, output };
+	shell.fds[2] = (struct scallop_vfd) { SCALLOP_VFD_FD, errors };
+	struct scallop_executor *statements = scallop_executor_create(4);
+	assert(statements);
+	struct scallop_statement_context context = {
+		script,
+		script + strlen(script),
+		builtins,
+		paths,
+		&shell,
+		SCALLOP_LAUNCH_SPAWN,
+		statements,
+	};
+	assert(scallop_execute_block(statements, &ast, 0, scallop_run_statement, &context) == 2);
+
+	char actual[256];
+	read_back(output, actual, sizeof(actual));
+	assert(strlen(actual) == strlen("x1two words\ny23\nW=5\n"));
+	assert(strstr(actual, "x1two words\n"));
+	assert(strstr(actual, "y23\n"));
+	assert(strstr(actual, "W=5\n"));
+	read_back(errors, actual, sizeof(actual));
+	expect_text(script, "scallop: every stage of a pipeline needs a command\n", actual);
+	// None of it outlives the statements
+	assert(scallop_environment_count(task->environment) == 1);
+	assert(scallop_environment_count(shell.environment) == 1);
+
+	scallop_executor_destroy(statements);
+	scallop_ast_free(&ast);
+	scallop_task_free(&shell);
+	close(output);
+	close(errors);
+	scallop_environment_release(task->environment);
+	task->environment = NULL;
+	scallop_symbols_destroy(symbols);
+}
+
+int main()
+{
+	signal(SIGPIPE, SIG_IGN);
+	builtins = scallop_builtins_create();
+	assert(builtins);
+
+	struct scallop_task task;
+	scallop_task_init(&task);
+	test_builtins(&task);
+	test_cd(&task);
+	test_pipelines(&task);
+	test_redirects(&task);
+	test_ring_copies();
+	test_statements(&task);
+	test_waiting(&task);
+	test_variables(&task);
+
+	// Again, finding processes through a PATH cache,
+	// and waiting on them through an executor
+	paths = scallop_path_cache_create(NULL, 0);
+	assert(paths);
+	executor = scallop_executor_create(2);
+	assert(executor);
+	test_cd(&task);
+	test_pipelines(&task);
+	test_statements(&task);
+	test_waiting(&task);
+	test_variables(&task);
+	struct scallop_path_cache_stats stats;
+	scallop_path_cache_stats(paths, &stats);
+	assert(stats.hits && stats.misses && stats.entries);
+	scallop_executor_destroy(executor);
+	scallop_path_cache_destroy(paths);
+
+	scallop_task_free(&task);
+	scallop_builtins_free(builtins);
+	return 0;
+}
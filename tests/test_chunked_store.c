@@ -0,0 +1,60 @@
+#include "test_macros.h"
+
+#include <csalt/stores.h>
+#include <string.h>
+
+#define assert_positions_equal(expected, actual) \
+{ \
+	assert_tokens_equal(expected, actual); \
+	assert((expected).row == (actual).row); \
+	assert((expected).col == (actual).col); \
+}
+
+// Long enough to cross several chunk boundaries
+// mid-token, and not a multiple of the chunk size,
+// so the final chunk is short
+static char script[10007];
+
+int main()
+{
+	static const char phrase[] = "foo 'bar\nbaz' {\"qu💩x\"};\n";
+	const size_t phrase_length = sizeof(phrase) - 1;
+	const size_t script_length =
+		(sizeof(script) - 1) / phrase_length * phrase_length;
+	for (size_t i = 0; i < script_length; i++)
+		script[i] = phrase[i % phrase_length];
+
+	struct csalt_cmemory csalt_script = csalt_cmemory_array(script);
+	csalt_store * const store = (csalt_store *)&csalt_script;
+
+	static struct scallop_parse_token batch[sizeof(script)];
+	static struct scallop_parse_token memory_batch[sizeof(script)];
+	const struct scallop_parse_token *batch_end = scallop_lex_batch(
+		store,
+		(struct scallop_parse_token) { 0 },
+		batch,
+		arrend(batch)
+	);
+	const struct scallop_parse_token *memory_batch_end = scallop_lex_memory_batch(
+		script,
+		arrend(script),
+		(struct scallop_parse_token) { 0 },
+		memory_batch,
+		arrend(memory_batch)
+	);
+
+	assert(batch_end - batch == memory_batch_end - memory_batch);
+	assert(batch_end[-1].token == SCALLOP_TOKEN_EOF);
+
+	struct scallop_parse_token actual = { 0 };
+	struct scallop_parse_token memory_actual = { 0 };
+	for (ssize_t i = 0; i < batch_end - batch; i++) {
+		actual = scallop_lex(store, actual);
+		memory_actual = scallop_lex_memory(script, arrend(script), memory_actual);
+		assert_positions_equal(batch[i], actual);
+		assert_positions_equal(batch[i], memory_actual);
+		assert_positions_equal(batch[i], memory_batch[i]);
+	}
+	assert(actual.end_offset == (ssize_t)script_length + 1);
+}
+
@@ -0,0 +1,259 @@
+#include "test_macros.h"
+#include "scallop/environment.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define THREADS 8
+#define VARIABLES_PER_THREAD 500
+
+static struct scallop_symbols *symbols;
+
+static uint32_t symbol(const char *name)
+{
+	const uint32_t result = scallop_symbols_intern(symbols, name, strlen(name));
+	assert(result);
+	return result;
+}
+
+static void expect_value(
+	const struct scallop_environment *environment,
+	uint32_t name,
+	const char *expected
+)
+{
+	size_t length;
+	const char *actual = scallop_environment_get(environment, name, &length);
+	if (!expected) {
+		assert(!actual);
+		return;
+	}
+	if (!actual || strcmp(actual, expected) || length != strlen(expected)) {
+		print_error("expected: %s", expected);
+		print_error("actual: %s", actual ? actual : "(unset)");
+		assert(!"wrong value");
+	}
+}
+
+// Takes environment over, returning the new one
+static struct scallop_environment *set(
+	struct scallop_environment *environment,
+	uint32_t name,
+	const char *value
+)
+{
+	struct scallop_environment *next =
+		scallop_environment_set(environment, name, value, strlen(value));
+	assert(next);
+	scallop_environment_release(environment);
+	return next;
+}
+
+static struct scallop_environment *unset(
+	struct scallop_environment *environment,
+	uint32_t name
+)
+{
+	struct scallop_environment *next = scallop_environment_unset(environment, name);
+	assert(next);
+	scallop_environment_release(environment);
+	return next;
+}
+
+static void test_versions(void)
+{
+	const uint32_t home = symbol("HOME"), path = symbol("PATH"), term = symbol("TERM");
+	struct scallop_environment *empty = scallop_environment_create(symbols);
+	assert(empty);
+	assert(scallop_environment_count(empty) == 0);
+	expect_value(empty, home, NULL);
+	char *const *envp = scallop_environment_envp(empty);
+	assert(envp && !envp[0]);
+
+	struct scallop_environment *first = scallop_environment_set(empty, home, "/root", 5);
+	assert(first);
+	struct scallop_environment *second = set(scallop_environment_fork(first), path, "/bin");
+	second = set(second, home, "/home");
+	struct scallop_environment *third = unset(scallop_environment_fork(second), home);
+
+	// Every version keeps what it had
+	assert(scallop_environment_count(empty) == 0);
+	assert(scallop_environment_count(first) == 1);
+	assert(scallop_environment_count(second) == 2);
+	assert(scallop_environment_count(third) == 1);
+	expect_value(empty, home, NULL);
+	expect_value(first, home, "/root");
+	expect_value(first, path, NULL);
+	expect_value(second, home, "/home");
+	expect_value(second, path, "/bin");
+	expect_value(third, home, NULL);
+	expect_value(third, path, "/bin");
+
+	// Unsetting what isn't there changes nothing
+	struct scallop_environment *same = scallop_environment_unset(third, term);
+	assert(same == third);
+	scallop_environment_release(same);
+
+	// envp is built once per version
+	envp = scallop_environment_envp(second);
+	assert(envp && scallop_environment_envp(second) == envp);
+	assert(!strcmp(envp[0], "HOME=/home"));
+	assert(!strcmp(envp[1], "PATH=/bin"));
+	assert(!envp[2]);
+	envp = scallop_environment_envp(third);
+	assert(!strcmp(envp[0], "PATH=/bin") && !envp[1]);
+
+	// Values can hold anything
+	struct scallop_environment *binary = scallop_environment_set(third, term, "a\0b", 3);
+	assert(binary);
+	size_t length;
+	assert(!memcmp(scallop_environment_get(binary, term, &length), "a\0b", 4));
+	assert(length == 3);
+	assert(!scallop_environment_set(third, SCALLOP_SYMBOL_NONE, "x", 1));
+	assert(!scallop_environment_set(third, scallop_symbols_count(symbols) + 1, "x", 1));
+	assert(errno == EINVAL);
+
+	scallop_environment_release(binary);
+	scallop_environment_release(third);
+	scallop_environment_release(second);
+	scallop_environment_release(first);
+	scallop_environment_release(empty);
+}
+
+/*
+ * Symbols sharing their lowest bits have to go
+ * through several levels of the trie before they part,
+ * and join back up as they're unset. Symbols count up
+ * from 1, so enough names have to be interned to get
+ * to the ones that share with 1.
+ */
+static void test_deep(void)
+{
+	static const uint32_t deep_symbols[] = {
+		1,
+		1 + (1u << 5),
+		1 + (1u << 10),
+		1 + (1u << 15),
+		1 + (1u << 5) + (1u << 10),
+		2,
+	};
+	while (scallop_symbols_count(symbols) < 1 + (1u << 15) + (1u << 10)) {
+		char name[32];
+		snprintf(name, sizeof(name), "FILLER_%u", scallop_symbols_count(symbols));
+		symbol(name);
+	}
+	const size_t count = sizeof(deep_symbols) / sizeof(*deep_symbols);
+	struct scallop_environment *versions[sizeof(deep_symbols) / sizeof(*deep_symbols) + 1];
+	versions[0] = scallop_environment_create(symbols);
+	assert(versions[0]);
+	for (size_t i = 0; i < count; i++) {
+		char value[16];
+		snprintf(value, sizeof(value), "%zu", i);
+		versions[i + 1] = scallop_environment_set(versions[i], deep_symbols[i], value, strlen(value));
+		assert(versions[i + 1]);
+	}
+
+	for (size_t version = 0; version <= count; version++) {
+		assert(scallop_environment_count(versions[version]) == version);
+		for (size_t i = 0; i < count; i++) {
+			char value[16];
+			snprintf(value, sizeof(value), "%zu", i);
+			expect_value(versions[version], deep_symbols[i], i < version ? value : NULL);
+		}
+	}
+	char *const *envp = scallop_environment_envp(versions[count]);
+	assert(envp);
+	for (size_t i = 0; i < count; i++)
+		assert(envp[i] && strchr(envp[i], '='));
+	assert(!envp[count]);
+
+	// Unset them in a different order from setting them
+	struct scallop_environment *environment = scallop_environment_fork(versions[count]);
+	for (size_t i = 0; i < count; i++) {
+		const size_t index = (i * 5) % count;
+		environment = unset(environment, deep_symbols[index]);
+		expect_value(environment, deep_symbols[index], NULL);
+		assert(scallop_environment_count(environment) == count - i - 1);
+		for (size_t j = i + 1; j < count; j++)
+			assert(scallop_environment_get(environment, deep_symbols[(j * 5) % count], NULL));
+	}
+	scallop_environment_release(environment);
+	for (size_t i = 0; i <= count; i++)
+		scallop_environment_release(versions[i]);
+}
+
+static void test_import(void)
+{
+	char *const envp[] = { "A=1", "B=", "junk", "C=x=y", "A=2", NULL };
+	struct scallop_environment *environment = scallop_environment_import(symbols, envp);
+	assert(environment);
+	assert(scallop_environment_count(environment) == 3);
+	expect_value(environment, symbol("A"), "2");
+	expect_value(environment, symbol("B"), "");
+	expect_value(environment, symbol("C"), "x=y");
+	scallop_environment_release(environment);
+
+	environment = scallop_environment_import(symbols, NULL);
+	assert(environment);
+	if (getenv("PATH"))
+		expect_value(environment, symbol("PATH"), getenv("PATH"));
+	scallop_environment_release(environment);
+}
+
+/*
+ * Threads all start from the same environment, each
+ * setting its own variables over it; none of them can
+ * see the others', or change the one they started
+ * from.
+ */
+static struct scallop_environment *base;
+static uint32_t shared_name;
+
+static void *set_variables(void *param)
+{
+	const int thread = (int)(intptr_t)param;
+	struct scallop_environment *environment = scallop_environment_fork(base);
+	char value[32];
+	for (int i = 0; i < VARIABLES_PER_THREAD; i++) {
+		char name[32];
+		snprintf(name, sizeof(name), "T%d_%d", thread, i);
+		snprintf(value, sizeof(value), "%d", i);
+		environment = set(environment, symbol(name), value);
+		if (i % 100 == 0)
+			environment = set(environment, shared_name, name);
+	}
+	assert(scallop_environment_count(environment) == VARIABLES_PER_THREAD + 1);
+	assert(scallop_environment_envp(environment));
+	snprintf(value, sizeof(value), "T%d_400", thread);
+	expect_value(environment, shared_name, value);
+	expect_value(base, shared_name, "base");
+	scallop_environment_release(environment);
+	return NULL;
+}
+
+static void test_threads(void)
+{
+	shared_name = symbol("SHARED");
+	base = set(scallop_environment_create(symbols), shared_name, "base");
+	pthread_t threads[THREADS];
+	for (int i = 0; i < THREADS; i++)
+		assert(!pthread_create(&threads[i], NULL, set_variables, (void *)(intptr_t)i));
+	for (int i = 0; i < THREADS; i++)
+		pthread_join(threads[i], NULL);
+	assert(scallop_environment_count(base) == 1);
+	scallop_environment_release(base);
+}
+
+int main()
+{
+	symbols = scallop_symbols_create();
+	assert(symbols);
+	test_versions();
+	test_deep();
+	test_import();
+	test_threads();
+	scallop_symbols_destroy(symbols);
+	return 0;
+}
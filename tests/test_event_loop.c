@@ -0,0 +1,211 @@
+#include "test_macros.h"
+#include "scallop/event_loop.h"
+#include "scallop/launch.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define CHILDREN 500
+
+static pid_t launch_shell(const char *script, const struct scallop_redirect *redirects, ssize_t redirect_count)
+{
+	char *const argv[] = { "sh", "-c", (char *)script, NULL };
+	const struct scallop_command command = { argv, NULL, redirects, redirect_count };
+	const pid_t pid = scallop_launch(&command, SCALLOP_LAUNCH_SPAWN);
+	assert(pid > 0);
+	return pid;
+}
+
+/*
+ * Children
+ */
+
+struct exits {
+	int statuses[CHILDREN];
+	int count;
+};
+
+static void note_exit(struct scallop_event_loop *loop, const struct scallop_event *event)
+{
+	(void)loop;
+	assert(event->kind == SCALLOP_EVENT_EXIT);
+	struct exits *exits = event->context;
+	assert(WIFEXITED(event->status));
+	exits->statuses[exits->count++] = WEXITSTATUS(event->status);
+}
+
+static void test_children(int flags)
+{
+	struct scallop_event_loop *loop = scallop_event_loop_create(flags);
+	assert(loop);
+	static struct exits exits;
+	memset(&exits, 0, sizeof(exits));
+
+	int expected[8] = { 0 };
+	for (int i = 0; i < CHILDREN; i++) {
+		char script[32];
+		sprintf(script, "exit %d", i % 8);
+		assert(scallop_watch_child(loop, launch_shell(script, NULL, 0), note_exit, &exits));
+		expected[i % 8]++;
+	}
+	assert(scallop_event_loop_watch_count(loop) == CHILDREN);
+	assert(scallop_event_loop_run(loop));
+	assert(exits.count == CHILDREN);
+	for (int i = 0; i < CHILDREN; i++)
+		expected[exits.statuses[i]]--;
+	for (int i = 0; i < 8; i++)
+		assert(expected[i] == 0);
+
+	// Exiting before being watched still gets noticed
+	const pid_t early = launch_shell("exit 5", NULL, 0);
+	siginfo_t info;
+	assert(!waitid(P_PID, early, &info, WEXITED | WNOWAIT));
+	exits.count = 0;
+	assert(scallop_watch_child(loop, early, note_exit, &exits));
+	assert(scallop_event_loop_run(loop));
+	assert(exits.count == 1);
+	assert(exits.statuses[0] == 5);
+
+	// Unwatched children aren't reported, but are gone
+	// from the loop
+	const pid_t ignored = launch_shell("exit 1", NULL, 0);
+	struct scallop_watch *watch = scallop_watch_child(loop, ignored, note_exit, &exits);
+	assert(watch);
+	scallop_unwatch(loop, watch);
+	assert(scallop_event_loop_watch_count(loop) == 0);
+	int status;
+	if (scallop_event_loop_uses_pidfd(loop))
+		assert(waitpid(ignored, &status, 0) == ignored);
+	exits.count = 0;
+	assert(scallop_event_loop_run(loop));
+	assert(exits.count == 0);
+
+	scallop_event_loop_destroy(loop);
+}
+
+/*
+ * Output pipes
+ */
+
+struct output {
+	char buffer[256];
+	size_t length;
+	int done;
+};
+
+static void read_output(struct scallop_event_loop *loop, const struct scallop_event *event)
+{
+	assert(event->kind == SCALLOP_EVENT_READABLE);
+	struct output *output = event->context;
+	const ssize_t result = read(
+		event->fd,
+		output->buffer + output->length,
+		sizeof(output->buffer) - output->length - 1
+	);
+	assert(result >= 0);
+	output->length += result;
+	if (!result) {
+		scallop_unwatch(loop, event->watch);
+		close(event->fd);
+		output->done = 1;
+	}
+}
+
+static void count_exit(struct scallop_event_loop *loop, const struct scallop_event *event)
+{
+	(void)loop;
+	assert(WIFEXITED(event->status) && !WEXITSTATUS(event->status));
+	(*(int *)event->context)++;
+}
+
+static void test_output(int flags)
+{
+	struct scallop_event_loop *loop = scallop_event_loop_create(flags);
+	assert(loop);
+
+	struct output outputs[16] = { 0 };
+	int exited = 0;
+	for (int i = 0; i < 16; i++) {
+		int pipe_fds[2];
+		assert(!pipe(pipe_fds));
+		fcntl(pipe_fds[0], F_SETFD, FD_CLOEXEC);
+		fcntl(pipe_fds[0], F_SETFL, O_NONBLOCK);
+		const struct scallop_redirect redirects[] = {
+			{ SCALLOP_REDIRECT_DUP, 1, pipe_fds[1] },
+			{ SCALLOP_REDIRECT_CLOSE, pipe_fds[1] },
+		};
+		char script[64];
+		sprintf(script, "echo child %d; sleep 0.0%d; echo done", i, i % 10);
+		assert(scallop_watch_child(loop, launch_shell(script, redirects, 2), count_exit, &exited));
+		close(pipe_fds[1]);
+		assert(scallop_watch_readable(loop, pipe_fds[0], read_output, &outputs[i]));
+	}
+	assert(scallop_event_loop_run(loop));
+	assert(exited == 16);
+	for (int i = 0; i < 16; i++) {
+		char expected[64];
+		sprintf(expected, "child %d\ndone\n", i);
+		assert(outputs[i].done);
+		assert(!strcmp(outputs[i].buffer, expected));
+	}
+	scallop_event_loop_destroy(loop);
+}
+
+/*
+ * Timers
+ */
+
+struct timers {
+	int order[4];
+	int count;
+	struct scallop_watch *cancel;
+};
+
+static struct timers timers;
+static int timer_ids[4] = { 0, 1, 2, 3 };
+
+static void fire(struct scallop_event_loop *loop, const struct scallop_event *event)
+{
+	assert(event->kind == SCALLOP_EVENT_TIMER);
+	timers.order[timers.count++] = *(int *)event->context;
+	if (timers.cancel) {
+		scallop_unwatch(loop, timers.cancel);
+		timers.cancel = NULL;
+	}
+}
+
+static void test_timers(void)
+{
+	struct scallop_event_loop *loop = scallop_event_loop_create(0);
+	assert(loop);
+	assert(scallop_watch_timer(loop, 30000000, fire, &timer_ids[2]));
+	assert(scallop_watch_timer(loop, 10000000, fire, &timer_ids[0]));
+	assert(scallop_watch_timer(loop, 20000000, fire, &timer_ids[1]));
+	// Cancelled by the first to fire
+	timers.cancel = scallop_watch_timer(loop, 40000000, fire, &timer_ids[3]);
+	assert(timers.cancel);
+	assert(scallop_event_loop_run(loop));
+	assert(timers.count == 3);
+	for (int i = 0; i < 3; i++)
+		assert(timers.order[i] == i);
+
+	// Nothing happening within the timeout
+	assert(scallop_event_loop_run_once(loop, 1) == 0);
+	scallop_event_loop_destroy(loop);
+}
+
+int main()
+{
+	test_timers();
+	test_children(0);
+	test_output(0);
+	// Once the signalfd loop has blocked SIGCHLD, it stays
+	// blocked, so these come last
+	test_children(SCALLOP_EVENT_LOOP_NO_PIDFD);
+	test_output(SCALLOP_EVENT_LOOP_NO_PIDFD);
+	return 0;
+}
@@ -0,0 +1,236 @@
+#include "test_macros.h"
+#include "scallop/executor.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static struct scallop_ast parse(const char *script)
+{
+	struct scallop_ast ast;
+	struct scallop_parse_error error;
+	assert(scallop_parse_memory(script, script + strlen(script), &ast, &error));
+	return ast;
+}
+
+static char *repeat(const char *statement, int count)
+{
+	const size_t length = strlen(statement);
+	char *script = malloc(length * count + 1);
+	assert(script);
+	for (int i = 0; i < count; i++)
+		memcpy(script + i * length, statement, length);
+	script[length * count] = 0;
+	return script;
+}
+
+struct counter {
+	atomic_int count;
+	// Bit per statement, to catch any run twice
+	atomic_uchar seen[16384];
+};
+
+static int count_statement(const struct scallop_ast *ast, uint32_t statement, void *context)
+{
+	(void)ast;
+	struct counter *counter = context;
+	atomic_fetch_add(&counter->count, 1);
+	assert(!atomic_exchange(&counter->seen[statement], 1));
+	return 0;
+}
+
+static void test_runs_every_statement(int parallelism)
+{
+	struct scallop_executor *executor = scallop_executor_create(parallelism);
+	assert(executor);
+	assert(scallop_executor_parallelism(executor) == (parallelism > 0 ? parallelism : (int)sysconf(_SC_NPROCESSORS_ONLN)));
+
+	char *script = repeat("echo hi;", 5000);
+	struct scallop_ast ast = parse(script);
+	static struct counter counter;
+	for (int round = 0; round < 3; round++) {
+		memset(&counter, 0, sizeof(counter));
+		assert(scallop_execute_block(executor, &ast, 0, count_statement, &counter) == 0);
+		assert(atomic_load(&counter.count) == 5000);
+	}
+
+	// Nothing to run
+	struct scallop_ast empty = parse("");
+	assert(scallop_execute_block(executor, &empty, 0, count_statement, &counter) == 0);
+
+	scallop_ast_free(&empty);
+	scallop_ast_free(&ast);
+	free(script);
+	scallop_executor_destroy(executor);
+}
+
+static int fail_on_b(const struct scallop_ast *ast, uint32_t statement, void *context)
+{
+	(void)context;
+	const struct scallop_node *word = &ast->nodes[ast->nodes[statement].first_child];
+	return word->end_offset - word->start_offset == 1 && ((const char *)context)[word->start_offset] == 'b' ?
+		3 :
+		0;
+}
+
+static void test_status(void)
+{
+	struct scallop_executor *executor = scallop_executor_create(4);
+	assert(executor);
+	const char *script = "a; a; b; a\na";
+	struct scallop_ast ast = parse(script);
+	assert(scallop_execute_block(executor, &ast, 0, fail_on_b, (void *)script) == 3);
+	scallop_ast_free(&ast);
+
+	script = "a; a";
+	ast = parse(script);
+	assert(scallop_execute_block(executor, &ast, 0, fail_on_b, (void *)script) == 0);
+	scallop_ast_free(&ast);
+	scallop_executor_destroy(executor);
+}
+
+/*
+ * Statements whose first word is a block run that
+ * block from within the pool, as a shell would.
+ */
+struct nested {
+	struct scallop_executor *executor;
+	atomic_int count;
+};
+
+static int run_nested(const struct scallop_ast *ast, uint32_t statement, void *context)
+{
+	struct nested *nested = context;
+	const uint32_t first = ast->nodes[statement].first_child;
+	if (ast->nodes[first].kind == SCALLOP_NODE_BLOCK)
+		return scallop_execute_block(nested->executor, ast, first, run_nested, nested);
+	atomic_fetch_add(&nested->count, 1);
+	return 0;
+}
+
+static void test_nested(void)
+{
+	struct nested nested = { scallop_executor_create(4) };
+	assert(nested.executor);
+	atomic_init(&nested.count, 0);
+	char *inner = repeat("{a; a; {a; a; a}; a};", 200);
+	struct scallop_ast ast = parse(inner);
+	assert(scallop_execute_block(nested.executor, &ast, 0, run_nested, &nested) == 0);
+	assert(atomic_load(&nested.count) == 200 * 6);
+	scallop_ast_free(&ast);
+	free(inner);
+	scallop_executor_destroy(nested.executor);
+}
+
+/*
+ * Statements that sleep get spread over the workers,
+ * even when every one is spawned by the same worker.
+ */
+struct threads {
+	pthread_mutex_t lock;
+	pthread_t seen[64];
+	int count;
+};
+
+static int note_thread(const struct scallop_ast *ast, uint32_t statement, void *context)
+{
+	(void)ast;
+	(void)statement;
+	struct threads *threads = context;
+	usleep(2000);
+	const pthread_t self = pthread_self();
+	pthread_mutex_lock(&threads->lock);
+	int i = 0;
+	while (i < threads->count && !pthread_equal(threads->seen[i], self))
+		i++;
+	if (i == threads->count && threads->count < 64)
+		threads->seen[threads->count++] = self;
+	pthread_mutex_unlock(&threads->lock);
+	return 0;
+}
+
+static void test_spreads_work(void)
+{
+	struct scallop_executor *executor = scallop_executor_create(4);
+	assert(executor);
+	struct threads threads = { .lock = PTHREAD_MUTEX_INITIALIZER };
+	char *script = repeat("sleep;", 64);
+	struct scallop_ast ast = parse(script);
+	assert(scallop_execute_block(executor, &ast, 0, note_thread, &threads) == 0);
+	assert(threads.count >= 2);
+	for (int i = 0; i < threads.count; i++)
+		assert(!pthread_equal(threads.seen[i], pthread_self()));
+	scallop_ast_free(&ast);
+	free(script);
+	scallop_executor_destroy(executor);
+}
+
+/*
+ * A worker waiting on a nested block, whose statement
+ * got stolen and takes a while, sleeps rather than
+ * spinning until it's done.
+ */
+struct waiting {
+	struct scallop_executor *executor;
+	pthread_t waiter;
+	atomic_int stolen;
+};
+
+static int run_waiting(const struct scallop_ast *ast, uint32_t statement, void *context)
+{
+	struct waiting *waiting = context;
+	const uint32_t first = ast->nodes[statement].first_child;
+	if (ast->nodes[first].kind == SCALLOP_NODE_BLOCK) {
+		waiting->waiter = pthread_self();
+		return scallop_execute_block(waiting->executor, ast, first, run_waiting, waiting);
+	}
+	if (!pthread_equal(pthread_self(), waiting->waiter)) {
+		atomic_store(&waiting->stolen, 1);
+		usleep(300000);
+		return 0;
+	}
+	// Hold the waiter up until one's been stolen
+	for (int i = 0; i < 1000 && !atomic_load(&waiting->stolen); i++)
+		usleep(1000);
+	return 0;
+}
+
+static double cpu_seconds(void)
+{
+	struct timespec time;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+	return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static void test_waits_without_spinning(void)
+{
+	struct waiting waiting = { scallop_executor_create(2) };
+	assert(waiting.executor);
+	atomic_init(&waiting.stolen, 0);
+	struct scallop_ast ast = parse("{a; a; a; a}");
+	const double start = cpu_seconds();
+	assert(scallop_execute_block(waiting.executor, &ast, 0, run_waiting, &waiting) == 0);
+	const double used = cpu_seconds() - start;
+	assert(atomic_load(&waiting.stolen));
+	if (used > 0.1) {
+		print_error("used %f seconds of CPU waiting", used);
+		assert(!"spun while waiting");
+	}
+	scallop_ast_free(&ast);
+	scallop_executor_destroy(waiting.executor);
+}
+
+int main()
+{
+	test_runs_every_statement(1);
+	test_runs_every_statement(4);
+	test_runs_every_statement(0);
+	test_status();
+	test_nested();
+	test_spreads_work();
+	test_waits_without_spinning();
+	return 0;
+}
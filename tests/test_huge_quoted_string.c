@@ -0,0 +1,55 @@
+#include "test_macros.h"
+
+#include <csalt/stores.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Deep enough to overflow the stack if every
+// character costs a stack frame
+#define BODY_SIZE (64 * 1024 * 1024)
+
+int main()
+{
+	// 'body' followed by a word separator
+	const ssize_t script_size = BODY_SIZE + 3;
+	char *script = malloc(script_size);
+	assert(script);
+	memset(script, 'a', script_size);
+	script[0] = '\'';
+	script[BODY_SIZE + 1] = '\'';
+	script[BODY_SIZE + 2] = ' ';
+
+	const struct scallop_parse_token expected[] = {
+		{ SCALLOP_TOKEN_WORD, 0, BODY_SIZE + 2 },
+		{ SCALLOP_TOKEN_WORD_SEPARATOR, BODY_SIZE + 2, BODY_SIZE + 3 },
+		{ SCALLOP_TOKEN_EOF, BODY_SIZE + 3, BODY_SIZE + 4 },
+	};
+
+	struct scallop_parse_token actual = { 0 };
+	for (
+		const struct scallop_parse_token *current = expected;
+		current < arrend(expected);
+		current++
+	) {
+		actual = scallop_lex_memory(script, script + script_size, actual);
+		assert_tokens_equal(*current, actual);
+	}
+
+	struct csalt_cmemory csalt_script = csalt_cmemory_make(
+		script,
+		script + script_size
+	);
+	csalt_store * const store = (csalt_store *)&csalt_script;
+	actual = (struct scallop_parse_token) { 0 };
+	for (
+		const struct scallop_parse_token *current = expected;
+		current < arrend(expected);
+		current++
+	) {
+		actual = scallop_lex(store, actual);
+		assert_tokens_equal(*current, actual);
+	}
+
+	free(script);
+}
+
@@ -0,0 +1,177 @@
+#include "test_macros.h"
+#include "scallop/launch.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static int wait_for(pid_t pid)
+{
+	int status;
+	assert(waitpid(pid, &status, 0) == pid);
+	assert(WIFEXITED(status));
+	return WEXITSTATUS(status);
+}
+
+static void read_all(int fd, char *buffer, size_t size)
+{
+	size_t length = 0;
+	ssize_t result;
+	while ((result = read(fd, buffer + length, size - length - 1)) > 0)
+		length += result;
+	assert(result == 0);
+	buffer[length] = 0;
+}
+
+/*
+ * Runs a shell command with its output going into a
+ * pipe, and checks what comes out.
+ */
+static void expect_output(
+	enum SCALLOP_LAUNCH_METHOD method,
+	const char *script,
+	char *const *envp,
+	const struct scallop_redirect *extra,
+	ssize_t extra_count,
+	const char *expected,
+	int expected_status
+)
+{
+	int output[2];
+	assert(!pipe(output));
+
+	struct scallop_redirect redirects[8] = {
+		{ SCALLOP_REDIRECT_DUP, 1, output[1] },
+		{ SCALLOP_REDIRECT_DUP, 2, 1 },
+		{ SCALLOP_REDIRECT_CLOSE, output[0] },
+		{ SCALLOP_REDIRECT_CLOSE, output[1] },
+	};
+	memcpy(redirects + 4, extra, extra_count * sizeof(*extra));
+	char *const argv[] = { "sh", "-c", (char *)script, NULL };
+	const struct scallop_command command = {
+		argv,
+		envp,
+		redirects,
+		4 + extra_count,
+	};
+
+	const pid_t pid = scallop_launch(&command, method);
+	assert(pid > 0);
+	close(output[1]);
+
+	char actual[256];
+	read_all(output[0], actual, sizeof(actual));
+	close(output[0]);
+	if (strcmp(expected, actual)) {
+		print_error("expected: %s", expected);
+		print_error("actual: %s", actual);
+		assert(!"wrong output");
+	}
+	assert(wait_for(pid) == expected_status);
+}
+
+static void expect_directory(enum SCALLOP_LAUNCH_METHOD method)
+{
+	int output[2];
+	assert(!pipe(output));
+	const struct scallop_redirect redirects[] = {
+		{ SCALLOP_REDIRECT_DUP, 1, output[1] },
+		{ SCALLOP_REDIRECT_CLOSE, output[0] },
+		{ SCALLOP_REDIRECT_CLOSE, output[1] },
+		// Relative to the new directory
+		{ SCALLOP_REDIRECT_OPEN, 0, .path = "hosts", .flags = O_RDONLY },
+	};
+	char *const argv[] = { "sh", "-c", "pwd && cat >/dev/null", NULL };
+	const struct scallop_command command = { argv, NULL, redirects, 4, "/etc" };
+	const pid_t pid = scallop_launch(&command, method);
+	assert(pid > 0);
+	close(output[1]);
+
+	char actual[256];
+	read_all(output[0], actual, sizeof(actual));
+	close(output[0]);
+	assert(!strcmp(actual, "/etc\n"));
+	assert(wait_for(pid) == 0);
+
+	const struct scallop_command missing = { argv, NULL, NULL, 0, "/nonexistent/directory" };
+	errno = 0;
+	assert(scallop_launch(&missing, method) == -1);
+	assert(errno == ENOENT);
+}
+
+static void test_method(enum SCALLOP_LAUNCH_METHOD method)
+{
+	expect_output(method, "echo out; echo err >&2", NULL, NULL, 0, "out\nerr\n", 0);
+	expect_output(method, "exit 3", NULL, NULL, 0, "", 3);
+
+	char *const envp[] = { "GREETING=hello", NULL };
+	expect_output(method, "echo $GREETING; echo ${HOME:-unset}", envp, NULL, 0, "hello\nunset\n", 0);
+
+	// Redirecting to and from files
+	char path[] = "/tmp/scallop_test_launchXXXXXX";
+	const int fd = mkstemp(path);
+	assert(fd >= 0);
+	close(fd);
+	const struct scallop_redirect to_file[] = {
+		{ SCALLOP_REDIRECT_OPEN, 1, .path = path, .flags = O_WRONLY | O_TRUNC },
+	};
+	expect_output(method, "echo into the file", NULL, to_file, 1, "", 0);
+	const struct scallop_redirect from_file[] = {
+		{ SCALLOP_REDIRECT_OPEN, 0, .path = path, .flags = O_RDONLY },
+	};
+	expect_output(method, "cat", NULL, from_file, 1, "into the file\n", 0);
+	const struct scallop_redirect appending[] = {
+		{ SCALLOP_REDIRECT_OPEN, 7, .path = path, .flags = O_WRONLY | O_APPEND },
+	};
+	expect_output(method, "echo again >&7", NULL, appending, 1, "", 0);
+	expect_output(method, "cat", NULL, from_file, 1, "into the file\nagain\n", 0);
+	unlink(path);
+
+	// Closing stdin
+	const struct scallop_redirect closed[] = {
+		{ SCALLOP_REDIRECT_CLOSE, 0 },
+	};
+	expect_output(method, "cat 2>/dev/null || echo closed", NULL, closed, 1, "closed\n", 0);
+
+	// Failures come back from scallop_launch() itself
+	char *const missing[] = { "scallop-no-such-command", NULL };
+	const struct scallop_command missing_command = { missing };
+	errno = 0;
+	assert(scallop_launch(&missing_command, method) == -1);
+	assert(errno == ENOENT);
+
+	char *const absolute[] = { "/nonexistent/scallop", NULL };
+	const struct scallop_command absolute_command = { absolute };
+	errno = 0;
+	assert(scallop_launch(&absolute_command, method) == -1);
+	assert(errno == ENOENT);
+
+	char *const true_argv[] = { "true", NULL };
+	const struct scallop_redirect unopenable[] = {
+		{ SCALLOP_REDIRECT_OPEN, 0, .path = "/nonexistent/input", .flags = O_RDONLY },
+	};
+	const struct scallop_command unopenable_command = { true_argv, NULL, unopenable, 1 };
+	errno = 0;
+	assert(scallop_launch(&unopenable_command, method) == -1);
+	assert(errno == ENOENT);
+
+	expect_directory(method);
+
+	// argv[0] needn't name the file
+	char *const renamed[] = { "renamed", "-c", "exit 4", NULL };
+	const struct scallop_command renamed_command = {
+		renamed,
+		.path = "/bin/sh",
+	};
+	assert(wait_for(scallop_launch(&renamed_command, method)) == 4);
+}
+
+int main()
+{
+	test_method(SCALLOP_LAUNCH_SPAWN);
+	test_method(SCALLOP_LAUNCH_FORK);
+	return 0;
+}
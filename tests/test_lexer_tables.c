@@ -0,0 +1,29 @@
+#include "lexer_spec.h"
+#include "lexer_tables.h"
+
+#include <assert.h>
+
+int main()
+{
+	for (int byte = 0; byte < 256; byte++)
+		assert(char_types[byte] == char_type_spec((char)byte));
+
+	for (int state = 0; state < LEX_STATE_COUNT; state++) {
+		for (int input = 0; input < CHAR_TYPE_COUNT; input++) {
+			assert(
+				state_transitions[state][input]
+				== transition_state_spec(state, input)
+			);
+		}
+	}
+
+	// Validated sources skip continuation characters
+	// together, which relies on the state only moving
+	// on for the first of them
+	for (int state = 0; state < LEX_STATE_COUNT; state++) {
+		const int start = state_transitions[state][CHAR_UTF8_START];
+		const int cont = state_transitions[start][CHAR_UTF8_CONT];
+		assert(state_transitions[cont][CHAR_UTF8_CONT] == cont);
+	}
+}
+
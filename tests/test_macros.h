@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <assert.h>
+#include <limits.h>
 
 #include "scallop/util.h"
 #include "scallop/lexer.h"
@@ -27,6 +28,178 @@ static const char *token_types[] = {
 	"SCALLOP_TOKEN_BINARY_PIPE",
 };
 
+#define MAX_TEST_TOKENS 64
+
+/*
+ * Compares lexed tokens against the expectations, up to
+ * the first EOF token, the same way the scallop_lex()
+ * loop in expect() does.
+ */
+static void expect_tokens(
+	const char *label,
+	const struct scallop_parse_token *actual,
+	const struct scallop_parse_token *actual_end,
+	const struct scallop_parse_token *expected,
+	const struct scallop_parse_token *expected_end
+)
+{
+	for (; actual < actual_end; ++actual, ++expected) {
+		if (actual->token == SCALLOP_TOKEN_EOF)
+			return;
+		assert(expected < expected_end);
+		print_error(
+			"%s expected: %s %ld -> %ld",
+			label,
+			token_types[expected->token],
+			expected->start_offset,
+			expected->end_offset
+		);
+		print_error(
+			"%s actual: %s %ld -> %ld",
+			label,
+			token_types[actual->token],
+			actual->start_offset,
+			actual->end_offset
+		);
+		assert_tokens_equal(*expected, *actual);
+	}
+	assert(!"lexing stopped before an EOF token");
+}
+
+/*
+ * These lex batch_size tokens at a time, so resuming
+ * from a previous batch is covered too.
+ */
+static struct scallop_parse_token *lex_store_batches(
+	csalt_store *store,
+	struct scallop_parse_token *tokens,
+	struct scallop_parse_token *tokens_end,
+	ssize_t batch_size
+)
+{
+	struct scallop_parse_token last = { 0 };
+	for (;;) {
+		struct scallop_parse_token *batch_end = tokens + batch_size;
+		assert(batch_end <= tokens_end);
+		struct scallop_parse_token *written = scallop_lex_batch(
+			store,
+			last,
+			tokens,
+			batch_end
+		);
+		assert(tokens < written);
+		last = written[-1];
+		tokens = written;
+		if (last.token == SCALLOP_TOKEN_EOF)
+			return tokens;
+	}
+}
+
+static struct scallop_parse_token *lex_memory_batches(
+	const char *begin,
+	const char *end,
+	struct scallop_parse_token *tokens,
+	struct scallop_parse_token *tokens_end,
+	ssize_t batch_size
+)
+{
+	struct scallop_parse_token last = { 0 };
+	for (;;) {
+		struct scallop_parse_token *batch_end = tokens + batch_size;
+		assert(batch_end <= tokens_end);
+		struct scallop_parse_token *written = scallop_lex_memory_batch(
+			begin,
+			end,
+			last,
+			tokens,
+			batch_end
+		);
+		assert(tokens < written);
+		last = written[-1];
+		tokens = written;
+		if (last.token == SCALLOP_TOKEN_EOF)
+			return tokens;
+	}
+}
+
+/*
+ * Feeds the script in one byte at a time through the
+ * smallest ring buffer allowed, so tokens are paused at
+ * every character.
+ */
+static struct scallop_parse_token *lex_stream(
+	const char *script,
+	const char *script_end,
+	struct scallop_parse_token *tokens,
+	struct scallop_parse_token *tokens_end
+)
+{
+	char buffer[2];
+	struct scallop_stream_lexer lexer = scallop_stream_lexer_make(
+		buffer,
+		sizeof(buffer)
+	);
+
+	while (tokens < tokens_end) {
+		if (scallop_stream_next(&lexer, tokens)) {
+			if (tokens++->token == SCALLOP_TOKEN_EOF)
+				return tokens;
+			continue;
+		}
+
+		scallop_stream_release(&lexer, SSIZE_MAX);
+		if (script == script_end)
+			scallop_stream_finish(&lexer);
+		else
+			script += scallop_stream_write(&lexer, script, 1);
+	}
+	return tokens;
+}
+
+static inline void expect_batches(
+	const char *script,
+	const char *script_end,
+	const struct scallop_parse_token *expected,
+	const struct scallop_parse_token *expected_end
+)
+{
+	static const ssize_t batch_sizes[] = { 1, 3, 16 };
+	struct csalt_cmemory csalt_script = csalt_cmemory_make(script, script_end);
+	csalt_store * const store = (csalt_store *)&csalt_script;
+	struct scallop_parse_token actual[MAX_TEST_TOKENS];
+
+	for (
+		const ssize_t *batch_size = batch_sizes;
+		batch_size < arrend(batch_sizes);
+		++batch_size
+	) {
+		struct scallop_parse_token *actual_end = lex_store_batches(
+			store,
+			actual,
+			arrend(actual),
+			*batch_size
+		);
+		expect_tokens("batch", actual, actual_end, expected, expected_end);
+
+		actual_end = lex_memory_batches(
+			script,
+			script_end,
+			actual,
+			arrend(actual),
+			*batch_size
+		);
+		expect_tokens("memory batch", actual, actual_end, expected, expected_end);
+	}
+
+	struct scallop_parse_token *actual_end = lex_stream(
+		script,
+		script_end,
+		actual,
+		arrend(actual)
+	);
+	expect_tokens("stream", actual, actual_end, expected, expected_end);
+}
+
 // This upsets the syntax highlighter of (n)vim.
 // Not gonna lie, it kinda upsets me too.
 #define expect(script, ...) \
@@ -57,6 +230,7 @@ static const char *token_types[] = {
 		); \
 		assert_tokens_equal(*expected, actual); \
 	} \
+	expect_batches(script, arrend(script), expects, arrend(expects)); \
 }
 
 
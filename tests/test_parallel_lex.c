@@ -0,0 +1,99 @@
+#include "test_macros.h"
+#include "test_scripts.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SCRIPT_SIZE (2 * 1024 * 1024)
+#define MAX_TOKENS SCRIPT_SIZE
+
+#define assert_positions_equal(expected, actual) \
+{ \
+	assert_tokens_equal(expected, actual); \
+	assert((expected).row == (actual).row); \
+	assert((expected).col == (actual).col); \
+}
+
+static struct scallop_parse_token expected[MAX_TOKENS];
+static struct scallop_parse_token actual[MAX_TOKENS];
+static char script[SCRIPT_SIZE];
+
+static void expect_parallel(const char *end, ssize_t expected_count)
+{
+	static const int thread_counts[] = { 1, 2, 3, 7, 16 };
+	for (
+		const int *threads = thread_counts;
+		threads < arrend(thread_counts);
+		threads++
+	) {
+		const struct scallop_parse_token *actual_end =
+			scallop_lex_memory_parallel(
+				script,
+				end,
+				*threads,
+				actual,
+				actual + MAX_TOKENS
+			);
+		assert(actual_end - actual == expected_count);
+		for (ssize_t i = 0; i < expected_count; i++)
+			assert_positions_equal(expected[i], actual[i]);
+	}
+}
+
+static ssize_t lex_sequential(const char *end)
+{
+	const struct scallop_parse_token *expected_end = scallop_lex_memory_batch(
+		script,
+		end,
+		(struct scallop_parse_token) { 0 },
+		expected,
+		expected + MAX_TOKENS
+	);
+	assert(expected_end[-1].token == SCALLOP_TOKEN_EOF);
+	return expected_end - expected;
+}
+
+int main()
+{
+	for (uint64_t seed = 1; seed <= 2; seed++) {
+		random_state = seed * 0x9E3779B97F4A7C15;
+		generate(script, arrend(script));
+		const char *end = script + strlen(script);
+		expect_parallel(end, lex_sequential(end));
+	}
+
+	// A full array stops lexing, as with a batch,
+	// whichever chunk's tokens it stops in
+	{
+		const char *end = script + strlen(script);
+		const ssize_t expected_count = lex_sequential(end);
+		assert(expected_count > 100);
+		const ssize_t limits[] = { 100, expected_count / 2, expected_count - 1 };
+		for (size_t i = 0; i < sizeof(limits) / sizeof(*limits); i++) {
+			const struct scallop_parse_token *actual_end = scallop_lex_memory_parallel(
+				script,
+				end,
+				8,
+				actual,
+				actual + limits[i]
+			);
+			assert(actual_end - actual == limits[i]);
+			for (ssize_t j = 0; j < limits[i]; j++)
+				assert_positions_equal(expected[j], actual[j]);
+		}
+	}
+
+	// Chunks with no tokens starting in them at all
+	{
+		struct script builder = { script, arrend(script) - 1 };
+		put(&builder, "echo ");
+		put(&builder, "'");
+		while (builder.end - builder.current > 1024 * 1024)
+			put(&builder, "a very long string, \\\"with\" [things] in it\n");
+		put(&builder, "' more words\n");
+		*builder.current = 0;
+		const char *end = builder.current;
+		expect_parallel(end, lex_sequential(end));
+	}
+}
@@ -0,0 +1,151 @@
+#include "test_macros.h"
+#include "scallop/parser.h"
+
+#include <string.h>
+
+/*
+ * Writes the tree out as nested brackets, words as
+ * they are in the source, to compare against.
+ */
+static char *print_node(
+	const struct scallop_ast *ast,
+	uint32_t index,
+	const char *script,
+	char *out
+)
+{
+	static const char *const names[] = { "block", "statement", "list" };
+	const struct scallop_node *node = &ast->nodes[index];
+	if (node->kind >= SCALLOP_NODE_WORD) {
+		const size_t length = node->end_offset - node->start_offset;
+		memcpy(out, script + node->start_offset, length);
+		return out + length;
+	}
+
+	out += sprintf(out, "(%s", names[node->kind]);
+	for (uint32_t child = node->first_child; child != SCALLOP_NODE_NONE; child = ast->nodes[child].next_sibling) {
+		*out++ = ' ';
+		out = print_node(ast, child, script, out);
+	}
+	*out++ = ')';
+	*out = 0;
+	return out;
+}
+
+static void expect_tree(const char *script, const char *expected)
+{
+	struct scallop_ast ast;
+	struct scallop_parse_error error;
+	assert(scallop_parse_memory(script, script + strlen(script), &ast, &error));
+	assert(ast.nodes[0].start_offset == 0);
+	assert(ast.nodes[0].end_offset == strlen(script));
+
+	char actual[1024];
+	print_node(&ast, 0, script, actual);
+	if (strcmp(expected, actual)) {
+		print_error("expected: %s", expected);
+		print_error("actual: %s", actual);
+		assert(!"wrong tree");
+	}
+	scallop_ast_free(&ast);
+}
+
+static void expect_error(
+	const char *script,
+	enum SCALLOP_PARSE_ERROR expected,
+	int64_t offset,
+	int64_t open_offset
+)
+{
+	struct scallop_ast ast;
+	struct scallop_parse_error error;
+	assert(!scallop_parse_memory(script, script + strlen(script), &ast, &error));
+	assert(error.error == expected);
+	assert(error.token.start_offset == offset);
+	assert(error.open_offset == open_offset);
+	scallop_ast_free(&ast);
+}
+
+int main()
+{
+	expect_tree("", "(block)");
+	expect_tree("echo hi", "(block (statement echo hi))");
+	expect_tree("a;;\n b c\n", "(block (statement a) (statement b c))");
+	expect_tree(
+		"if [x] {echo 'a b'; c}\nd",
+		"(block (statement if (list x) (block (statement echo 'a b') (statement c))) (statement d))"
+	);
+	expect_tree("[a\n[b c] {}]", "(block (statement (list a (list b c) (block))))");
+	expect_tree("{a}{b}", "(block (statement (block (statement a)) (block (statement b))))");
+
+	expect_tree("a b|c | {d|e}", "(block (statement a b | c | (block (statement d | e))))");
+	expect_tree("a |\n\tb;c", "(block (statement a | b) (statement c))");
+	expect_tree("a||b | c ||\nd", "(block (statement a || b | c || d))");
+
+	expect_error("}", SCALLOP_PARSE_UNEXPECTED_CLOSE, 0, -1);
+	expect_error("| a", SCALLOP_PARSE_UNEXPECTED_TOKEN, 0, -1);
+	expect_error("a;|b", SCALLOP_PARSE_UNEXPECTED_TOKEN, 2, -1);
+	expect_error("a| |b", SCALLOP_PARSE_UNEXPECTED_TOKEN, 3, -1);
+	expect_error("a|||b", SCALLOP_PARSE_UNEXPECTED_TOKEN, 3, -1);
+	expect_error("a |", SCALLOP_PARSE_UNEXPECTED_TOKEN, 3, -1);
+	expect_error("{a |}", SCALLOP_PARSE_UNEXPECTED_TOKEN, 4, 0);
+	expect_error("[a | b]", SCALLOP_PARSE_UNEXPECTED_TOKEN, 3, 0);
+	expect_error("{a]", SCALLOP_PARSE_UNEXPECTED_CLOSE, 2, 0);
+	expect_error("x [a {b}", SCALLOP_PARSE_UNCLOSED, 8, 2);
+	expect_error("{a \x01}", SCALLOP_PARSE_INVALID_CHARACTER, -1, 0);
+
+	// A character the lexer can't take stops parsing,
+	// rather than ending the script there
+	static const char invalid[] = "echo a\x01\nrm x";
+	struct scallop_ast invalid_ast;
+	struct scallop_parse_error invalid_error;
+	assert(!scallop_parse_memory(invalid, invalid + strlen(invalid), &invalid_ast, &invalid_error));
+	assert(invalid_error.error == SCALLOP_PARSE_INVALID_CHARACTER);
+	assert(invalid_error.token.end_offset == 6);
+	scallop_ast_free(&invalid_ast);
+
+	// Statements and brackets cover their source, and
+	// words keep their flags
+	static const char script[] = "x {a 'b'} [c]";
+	struct scallop_ast ast;
+	struct scallop_parse_error error;
+	assert(scallop_parse_memory(script, script + strlen(script), &ast, &error));
+	const struct scallop_node *statement = &ast.nodes[ast.nodes[0].first_child];
+	assert(statement->kind == SCALLOP_NODE_STATEMENT);
+	assert(statement->start_offset == 0 && statement->end_offset == 13);
+	const struct scallop_node *block = &ast.nodes[ast.nodes[statement->first_child].next_sibling];
+	assert(block->kind == SCALLOP_NODE_BLOCK);
+	assert(block->start_offset == 2 && block->end_offset == 9);
+	const struct scallop_node *quoted = &ast.nodes[
+		ast.nodes[ast.nodes[block->first_child].first_child].next_sibling
+	];
+	assert(quoted->flags == SCALLOP_TOKEN_QUOTED);
+	assert(block->next_sibling != SCALLOP_NODE_NONE);
+	assert(ast.nodes[block->next_sibling].end_offset == 13);
+	scallop_ast_free(&ast);
+
+	// Tokens can come from any lexer, such as scallop_lex()
+	struct csalt_cmemory store = csalt_cmemory_array(script);
+	struct scallop_parser parser = scallop_parser_make();
+	struct scallop_parse_token token = { 0 };
+	do {
+		token = scallop_lex((csalt_store *)&store, token);
+		assert(scallop_parser_push(&parser, &token));
+	} while (token.token != SCALLOP_TOKEN_EOF);
+	assert(parser.ast.count == 9);
+	scallop_parser_free(&parser);
+	scallop_ast_free(&parser.ast);
+
+	// Deep enough to grow the nodes and the stack
+	static char deep[20000];
+	for (size_t i = 0; i < 5000; i++) {
+		memcpy(deep + 2 * i, "{a", 2);
+		deep[sizeof(deep) - 1 - i] = '}';
+	}
+	memset(deep + 10000, ' ', sizeof(deep) - 10000 - 5000);
+	assert(scallop_parse_memory(deep, deep + sizeof(deep), &ast, &error));
+	// A statement, block, and word for each level, plus
+	// the root and the innermost statement
+	assert(ast.count == 2 + 5000 * 3);
+	scallop_ast_free(&ast);
+}
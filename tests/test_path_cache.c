@@ -0,0 +1,315 @@
+#include "test_macros.h"
+#include "scallop/path_cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define THREADS 8
+#define LOOKUPS_PER_THREAD 20000
+
+static char first[] = "/tmp/scallop_test_path_cacheXXXXXX";
+static char second[] = "/tmp/scallop_test_path_cacheXXXXXX";
+
+static void create(const char *directory, const char *name, mode_t mode)
+{
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/%s", directory, name);
+	const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, mode);
+	assert(fd >= 0);
+	close(fd);
+	assert(!chmod(path, mode));
+}
+
+static void remove_file(const char *directory, const char *name)
+{
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/%s", directory, name);
+	assert(!unlink(path));
+}
+
+static void expect_found(
+	struct scallop_path_cache *cache,
+	const char *name,
+	const char *directory
+)
+{
+	char expected[PATH_MAX];
+	snprintf(expected, sizeof(expected), "%s/%s", directory, name);
+	char actual[PATH_MAX];
+	if (!scallop_path_cache_lookup(cache, name, actual, sizeof(actual))) {
+		print_error("%s not found", name);
+		assert(!"not found");
+	}
+	if (strcmp(expected, actual)) {
+		print_error("expected: %s", expected);
+		print_error("actual: %s", actual);
+		assert(!"wrong path");
+	}
+}
+
+static void expect_missing(struct scallop_path_cache *cache, const char *name, int error)
+{
+	char actual[PATH_MAX];
+	errno = 0;
+	assert(!scallop_path_cache_lookup(cache, name, actual, sizeof(actual)));
+	assert(errno == error);
+}
+
+static void expect_stats(
+	struct scallop_path_cache *cache,
+	uint64_t hits,
+	uint64_t misses,
+	uint64_t invalidations,
+	uint64_t entries
+)
+{
+	struct scallop_path_cache_stats stats;
+	scallop_path_cache_stats(cache, &stats);
+	if (
+		stats.hits != hits
+		|| stats.misses != misses
+		|| stats.invalidations != invalidations
+		|| stats.entries != entries
+	) {
+		print_error(
+			"expected %llu hits, %llu misses, %llu invalidations, %llu entries",
+			(unsigned long long)hits,
+			(unsigned long long)misses,
+			(unsigned long long)invalidations,
+			(unsigned long long)entries
+		);
+		print_error(
+			"actual %llu hits, %llu misses, %llu invalidations, %llu entries",
+			(unsigned long long)stats.hits,
+			(unsigned long long)stats.misses,
+			(unsigned long long)stats.invalidations,
+			(unsigned long long)stats.entries
+		);
+		assert(!"wrong stats");
+	}
+}
+
+static void test_lookups(const char *path)
+{
+	struct scallop_path_cache *cache = scallop_path_cache_create(path, 0);
+	assert(cache);
+	assert(scallop_path_cache_fd(cache) == -1);
+
+	expect_found(cache, "tool", first);
+	expect_found(cache, "tool", first);
+	expect_stats(cache, 1, 1, 0, 1);
+
+	// Only executable regular files count
+	expect_found(cache, "script", second);
+	expect_found(cache, "script", second);
+	expect_stats(cache, 2, 2, 0, 2);
+
+	// Without inotify, missing commands aren't kept, in
+	// case they turn up
+	expect_missing(cache, "scallop-no-such-command", ENOENT);
+	expect_missing(cache, "scallop-no-such-command", ENOENT);
+	expect_missing(cache, "data", EACCES);
+	expect_stats(cache, 2, 5, 0, 2);
+
+	// Paths are passed through, without counting
+	char buffer[8];
+	assert(scallop_path_cache_lookup(cache, "./a", buffer, sizeof(buffer)));
+	assert(!strcmp(buffer, "./a"));
+	errno = 0;
+	assert(!scallop_path_cache_lookup(cache, "/too/long", buffer, sizeof(buffer)));
+	assert(errno == ENAMETOOLONG);
+	errno = 0;
+	assert(!scallop_path_cache_lookup(cache, "tool", buffer, sizeof(buffer)));
+	assert(errno == ENAMETOOLONG);
+	expect_stats(cache, 3, 5, 0, 2);
+
+	// The same path changes nothing; a new one empties it
+	assert(scallop_path_cache_set_path(cache, path));
+	expect_stats(cache, 3, 5, 0, 2);
+	char reversed[2 * PATH_MAX];
+	snprintf(reversed, sizeof(reversed), "%s:%s", second, first);
+	assert(scallop_path_cache_set_path(cache, reversed));
+	expect_stats(cache, 3, 5, 1, 0);
+	expect_found(cache, "tool", second);
+	expect_found(cache, "script", second);
+	expect_stats(cache, 3, 7, 1, 2);
+
+	scallop_path_cache_invalidate(cache);
+	expect_stats(cache, 3, 7, 2, 0);
+	expect_found(cache, "tool", second);
+	expect_stats(cache, 3, 8, 2, 1);
+
+	// Lots of commands, to make the table grow
+	for (int i = 0; i < 200; i++) {
+		char name[32];
+		snprintf(name, sizeof(name), "generated%d", i);
+		create(first, name, 0755);
+	}
+	for (int round = 0; round < 2; round++)
+		for (int i = 0; i < 200; i++) {
+			char name[32];
+			snprintf(name, sizeof(name), "generated%d", i);
+			expect_found(cache, name, first);
+		}
+	expect_stats(cache, 203, 208, 2, 201);
+	for (int i = 0; i < 200; i++) {
+		char name[32];
+		snprintf(name, sizeof(name), "generated%d", i);
+		remove_file(first, name);
+	}
+
+	scallop_path_cache_destroy(cache);
+}
+
+static void wait_for_events(struct scallop_path_cache *cache)
+{
+	struct pollfd poll_fd = { scallop_path_cache_fd(cache), POLLIN };
+	assert(poll(&poll_fd, 1, 5000) == 1);
+	assert(scallop_path_cache_handle_events(cache));
+}
+
+static void test_inotify(const char *path)
+{
+	struct scallop_path_cache *cache = scallop_path_cache_create(path, SCALLOP_PATH_CACHE_INOTIFY);
+	assert(cache);
+	assert(scallop_path_cache_fd(cache) >= 0);
+	assert(scallop_path_cache_handle_events(cache));
+	expect_stats(cache, 0, 0, 0, 0);
+
+	// With inotify, missing commands are kept too
+	expect_missing(cache, "later", ENOENT);
+	expect_missing(cache, "later", ENOENT);
+	expect_found(cache, "tool", first);
+	expect_stats(cache, 1, 2, 0, 2);
+
+	create(second, "later", 0755);
+	wait_for_events(cache);
+	expect_stats(cache, 1, 2, 1, 0);
+	expect_found(cache, "later", second);
+
+	// Something earlier in PATH takes over
+	create(first, "later", 0755);
+	wait_for_events(cache);
+	expect_found(cache, "later", first);
+	remove_file(first, "later");
+	wait_for_events(cache);
+	expect_found(cache, "later", second);
+	remove_file(second, "later");
+	wait_for_events(cache);
+	expect_missing(cache, "later", ENOENT);
+
+	scallop_path_cache_destroy(cache);
+}
+
+/*
+ * A directory in PATH without a watch could get the
+ * command at any time, so missing commands aren't kept
+ * while there's one.
+ */
+static void test_unwatched(void)
+{
+	char extra[PATH_MAX];
+	snprintf(extra, sizeof(extra), "%s/extra", second);
+	char path[2 * PATH_MAX + 32];
+	snprintf(path, sizeof(path), "%s:%s", extra, first);
+	struct scallop_path_cache *cache = scallop_path_cache_create(path, SCALLOP_PATH_CACHE_INOTIFY);
+	assert(cache);
+	expect_missing(cache, "later", ENOENT);
+	expect_missing(cache, "later", ENOENT);
+	expect_stats(cache, 0, 2, 0, 0);
+
+	// Nothing watches second, so nothing says extra is there
+	assert(!mkdir(extra, 0755));
+	create(extra, "later", 0755);
+	expect_found(cache, "later", extra);
+	remove_file(extra, "later");
+	scallop_path_cache_destroy(cache);
+
+	// Once every directory is watched they're kept,
+	// until one of them goes
+	cache = scallop_path_cache_create(path, SCALLOP_PATH_CACHE_INOTIFY);
+	assert(cache);
+	assert(scallop_path_cache_handle_events(cache));
+	expect_missing(cache, "later", ENOENT);
+	expect_missing(cache, "later", ENOENT);
+	expect_stats(cache, 1, 1, 0, 1);
+	assert(!rmdir(extra));
+	wait_for_events(cache);
+	expect_missing(cache, "later", ENOENT);
+	expect_missing(cache, "later", ENOENT);
+	expect_stats(cache, 1, 3, 1, 0);
+	scallop_path_cache_destroy(cache);
+}
+
+static struct scallop_path_cache *shared;
+
+static void *look_up(void *param)
+{
+	(void)param;
+	static const char *const names[] = { "tool", "script", "missing" };
+	char buffer[PATH_MAX];
+	for (int i = 0; i < LOOKUPS_PER_THREAD; i++) {
+		const int found = scallop_path_cache_lookup(shared, names[i % 3], buffer, sizeof(buffer));
+		assert(found == (i % 3 != 2));
+		if (i % 5000 == 0)
+			scallop_path_cache_invalidate(shared);
+	}
+	return NULL;
+}
+
+static void test_threads(const char *path)
+{
+	shared = scallop_path_cache_create(path, SCALLOP_PATH_CACHE_INOTIFY);
+	assert(shared);
+	pthread_t threads[THREADS];
+	for (int i = 0; i < THREADS; i++)
+		assert(!pthread_create(&threads[i], NULL, look_up, NULL));
+	for (int i = 0; i < THREADS; i++)
+		pthread_join(threads[i], NULL);
+
+	struct scallop_path_cache_stats stats;
+	scallop_path_cache_stats(shared, &stats);
+	assert(stats.hits + stats.misses == THREADS * LOOKUPS_PER_THREAD);
+	assert(stats.hits > stats.misses);
+	assert(stats.invalidations == THREADS * (LOOKUPS_PER_THREAD / 5000));
+	scallop_path_cache_destroy(shared);
+}
+
+int main()
+{
+	assert(mkdtemp(first));
+	assert(mkdtemp(second));
+	create(first, "tool", 0755);
+	create(second, "tool", 0755);
+	create(first, "script", 0644);
+	create(second, "script", 0755);
+	create(first, "data", 0644);
+	char subdirectory[PATH_MAX];
+	snprintf(subdirectory, sizeof(subdirectory), "%s/subdirectory", first);
+	assert(!mkdir(subdirectory, 0755));
+
+	char path[2 * PATH_MAX + 32];
+	snprintf(path, sizeof(path), "/nonexistent:%s:%s", first, second);
+	test_lookups(path);
+	char watched[2 * PATH_MAX + 32];
+	snprintf(watched, sizeof(watched), "%s:%s", first, second);
+	test_inotify(watched);
+	test_unwatched();
+	test_threads(path);
+
+	assert(!rmdir(subdirectory));
+	remove_file(first, "tool");
+	remove_file(second, "tool");
+	remove_file(first, "script");
+	remove_file(second, "script");
+	remove_file(first, "data");
+	assert(!rmdir(first));
+	assert(!rmdir(second));
+	return 0;
+}
@@ -0,0 +1,180 @@
+// For F_GETPIPE_SZ
+#define _GNU_SOURCE
+#include "test_macros.h"
+#include "scallop/pipeline.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define BIG_SIZE (3 * 1024 * 1024 + 12345)
+
+static void read_exactly(int fd, char *buffer, size_t length)
+{
+	size_t total = 0;
+	while (total < length) {
+		const ssize_t result = read(fd, buffer + total, length - total);
+		assert(result > 0);
+		total += result;
+	}
+}
+
+static void expect_eof(int fd)
+{
+	char c;
+	assert(read(fd, &c, 1) == 0);
+}
+
+static int temp_file(void)
+{
+	char path[] = "/tmp/scallop_test_pipelineXXXXXX";
+	const int fd = mkstemp(path);
+	assert(fd >= 0);
+	unlink(path);
+	return fd;
+}
+
+static void fill(char *buffer, size_t length)
+{
+	for (size_t i = 0; i < length; i++)
+		buffer[i] = (char)(i * 7 + i / 4096);
+}
+
+static void test_pipeline(enum SCALLOP_LAUNCH_METHOD method)
+{
+	int output[2];
+	assert(scallop_pipe(output, SCALLOP_PIPE_SIZE));
+
+	char *const first[] = { "printf", "b\\na\\nc\\n", NULL };
+	char *const second[] = { "sort", NULL };
+	char *const third[] = { "tr", "a-z", "A-Z", NULL };
+	const struct scallop_redirect to_output[] = {
+		{ SCALLOP_REDIRECT_DUP, 1, output[1] },
+	};
+	const struct scallop_command commands[] = {
+		{ first },
+		{ second },
+		{ third, NULL, to_output, 1 },
+	};
+	pid_t pids[3];
+	assert(scallop_pipeline_launch(commands, 3, SCALLOP_PIPE_SIZE, method, pids));
+	close(output[1]);
+
+	char actual[7];
+	read_exactly(output[0], actual, 6);
+	actual[6] = 0;
+	assert(!strcmp(actual, "A\nB\nC\n"));
+	expect_eof(output[0]);
+	close(output[0]);
+	for (int i = 0; i < 3; i++) {
+		int status;
+		assert(waitpid(pids[i], &status, 0) == pids[i]);
+		assert(WIFEXITED(status) && !WEXITSTATUS(status));
+	}
+
+	// A stage that can't be launched takes the rest down
+	char *const missing[] = { "scallop-no-such-command", NULL };
+	char *const sleeping[] = { "sleep", "10", NULL };
+	const struct scallop_command broken[] = { { sleeping }, { missing } };
+	assert(!scallop_pipeline_launch(broken, 2, 0, method, pids));
+	assert(errno == ENOENT);
+	assert(waitpid(pids[0], NULL, WNOHANG) < 0);
+}
+
+static void test_pipe_size(void)
+{
+	int fds[2];
+	assert(scallop_pipe(fds, SCALLOP_PIPE_SIZE));
+	assert(fcntl(fds[0], F_GETPIPE_SZ) == SCALLOP_PIPE_SIZE);
+	assert(fcntl(fds[0], F_GETFD) & FD_CLOEXEC);
+	close(fds[0]);
+	close(fds[1]);
+}
+
+static void test_relay(void)
+{
+	char *data = malloc(BIG_SIZE);
+	char *actual = malloc(BIG_SIZE);
+	assert(data && actual);
+	fill(data, BIG_SIZE);
+
+	// File to file, with neither a pipe
+	const int source = temp_file();
+	assert(write(source, data, BIG_SIZE) == BIG_SIZE);
+	assert(lseek(source, 0, SEEK_SET) == 0);
+	const int destination = temp_file();
+	assert(scallop_relay(source, destination) == BIG_SIZE);
+	assert(pread(destination, actual, BIG_SIZE, 0) == BIG_SIZE);
+	assert(!memcmp(data, actual, BIG_SIZE));
+
+	// File to pipe, read by a child as it goes
+	int fds[2];
+	assert(scallop_pipe(fds, 0));
+	char *const argv[] = { "cat", NULL };
+	const int copied = temp_file();
+	const struct scallop_redirect redirects[] = {
+		{ SCALLOP_REDIRECT_DUP, 0, fds[0] },
+		{ SCALLOP_REDIRECT_DUP, 1, copied },
+	};
+	const struct scallop_command cat = { argv, NULL, redirects, 2 };
+	pid_t pid = scallop_launch(&cat, SCALLOP_LAUNCH_SPAWN);
+	assert(pid > 0);
+	close(fds[0]);
+	assert(lseek(source, 0, SEEK_SET) == 0);
+	assert(scallop_relay(source, fds[1]) == BIG_SIZE);
+	close(fds[1]);
+	assert(waitpid(pid, NULL, 0) == pid);
+	assert(pread(copied, actual, BIG_SIZE, 0) == BIG_SIZE);
+	assert(!memcmp(data, actual, BIG_SIZE));
+
+	// Pipe to a pipe and a file at once
+	int in[2], out[2];
+	assert(scallop_pipe(in, 0) && scallop_pipe(out, SCALLOP_PIPE_SIZE));
+	char *const cat_argv[] = { "cat", NULL };
+	const struct scallop_redirect writer_redirects[] = {
+		{ SCALLOP_REDIRECT_DUP, 0, source },
+		{ SCALLOP_REDIRECT_DUP, 1, in[1] },
+	};
+	const struct scallop_command writer = { cat_argv, NULL, writer_redirects, 2 };
+	assert(lseek(source, 0, SEEK_SET) == 0);
+	pid = scallop_launch(&writer, SCALLOP_LAUNCH_SPAWN);
+	assert(pid > 0);
+	close(in[1]);
+	const struct scallop_redirect reader_redirects[] = {
+		{ SCALLOP_REDIRECT_DUP, 0, out[0] },
+		{ SCALLOP_REDIRECT_DUP, 1, destination },
+	};
+	assert(!ftruncate(destination, 0) && lseek(destination, 0, SEEK_SET) == 0);
+	const struct scallop_command reader = { cat_argv, NULL, reader_redirects, 2 };
+	const pid_t reader_pid = scallop_launch(&reader, SCALLOP_LAUNCH_SPAWN);
+	assert(reader_pid > 0);
+	close(out[0]);
+	assert(!ftruncate(copied, 0) && lseek(copied, 0, SEEK_SET) == 0);
+	assert(scallop_relay_tee(in[0], out[1], copied) == BIG_SIZE);
+	close(in[0]);
+	close(out[1]);
+	assert(waitpid(pid, NULL, 0) == pid);
+	assert(waitpid(reader_pid, NULL, 0) == reader_pid);
+	assert(pread(destination, actual, BIG_SIZE, 0) == BIG_SIZE);
+	assert(!memcmp(data, actual, BIG_SIZE));
+	assert(pread(copied, actual, BIG_SIZE, 0) == BIG_SIZE);
+	assert(!memcmp(data, actual, BIG_SIZE));
+
+	close(source);
+	close(destination);
+	close(copied);
+	free(data);
+	free(actual);
+}
+
+int main()
+{
+	test_pipe_size();
+	test_pipeline(SCALLOP_LAUNCH_SPAWN);
+	test_pipeline(SCALLOP_LAUNCH_FORK);
+	test_relay();
+	return 0;
+}
@@ -0,0 +1,47 @@
+#include "test_macros.h"
+
+#include <csalt/stores.h>
+
+int main()
+{
+	static const char script[] = "a|b | c|'d|e'\"f|g\"|💩|{x}|\n|";
+	expect(script,
+		{ SCALLOP_TOKEN_WORD, 0, 1 },
+		{ SCALLOP_TOKEN_PIPE, 1, 2 },
+		{ SCALLOP_TOKEN_WORD, 2, 3 },
+		{ SCALLOP_TOKEN_WORD_SEPARATOR, 3, 4 },
+		{ SCALLOP_TOKEN_PIPE, 4, 5 },
+		{ SCALLOP_TOKEN_WORD_SEPARATOR, 5, 6 },
+		{ SCALLOP_TOKEN_WORD, 6, 7 },
+		{ SCALLOP_TOKEN_PIPE, 7, 8 },
+		{ SCALLOP_TOKEN_WORD, 8, 18 },
+		{ SCALLOP_TOKEN_PIPE, 18, 19 },
+		{ SCALLOP_TOKEN_WORD, 19, 23 },
+		{ SCALLOP_TOKEN_PIPE, 23, 24 },
+		{ SCALLOP_TOKEN_OPEN_CURLY_BRACKET, 24, 25 },
+		{ SCALLOP_TOKEN_WORD, 25, 26 },
+		{ SCALLOP_TOKEN_CLOSE_CURLY_BRACKET, 26, 27 },
+		{ SCALLOP_TOKEN_PIPE, 27, 28 },
+		{ SCALLOP_TOKEN_STATEMENT_SEPARATOR, 28, 29 },
+		{ SCALLOP_TOKEN_PIPE, 29, 30 },
+		{ SCALLOP_TOKEN_EOF, 30, 31 }
+	);
+
+	static const char binary[] = "a||b || c|||d'||'|| |";
+	expect(binary,
+		{ SCALLOP_TOKEN_WORD, 0, 1 },
+		{ SCALLOP_TOKEN_BINARY_PIPE, 1, 3 },
+		{ SCALLOP_TOKEN_WORD, 3, 4 },
+		{ SCALLOP_TOKEN_WORD_SEPARATOR, 4, 5 },
+		{ SCALLOP_TOKEN_BINARY_PIPE, 5, 7 },
+		{ SCALLOP_TOKEN_WORD_SEPARATOR, 7, 8 },
+		{ SCALLOP_TOKEN_WORD, 8, 9 },
+		{ SCALLOP_TOKEN_BINARY_PIPE, 9, 11 },
+		{ SCALLOP_TOKEN_PIPE, 11, 12 },
+		{ SCALLOP_TOKEN_WORD, 12, 17 },
+		{ SCALLOP_TOKEN_BINARY_PIPE, 17, 19 },
+		{ SCALLOP_TOKEN_WORD_SEPARATOR, 19, 20 },
+		{ SCALLOP_TOKEN_PIPE, 20, 21 },
+		{ SCALLOP_TOKEN_EOF, 21, 22 }
+	);
+}
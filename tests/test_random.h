@@ -0,0 +1,21 @@
+#ifndef TEST_RANDOM_H
+#define TEST_RANDOM_H
+
+#include <stdint.h>
+
+/*
+ * A xorshift generator, so randomised tests come out
+ * the same on every run; tests set random_state to
+ * try different seeds.
+ */
+static uint64_t random_state = 0x9E3779B97F4A7C15;
+
+static inline uint32_t random_below(uint32_t bound)
+{
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 7;
+	random_state ^= random_state << 17;
+	return (uint32_t)(random_state % bound);
+}
+
+#endif // TEST_RANDOM_H
@@ -0,0 +1,193 @@
+#include "test_macros.h"
+#include "test_random.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define SCRIPT_CAPACITY 8192
+#define TOKEN_CAPACITY SCRIPT_CAPACITY
+
+#define assert_positions_equal(expected, actual) \
+{ \
+	assert_tokens_equal(expected, actual); \
+	assert((expected).row == (actual).row); \
+	assert((expected).col == (actual).col); \
+}
+
+static char script[SCRIPT_CAPACITY];
+static ssize_t script_length;
+static struct scallop_parse_token tokens[TOKEN_CAPACITY];
+static struct scallop_parse_token expected[TOKEN_CAPACITY];
+static struct scallop_parse_token tight[TOKEN_CAPACITY];
+
+// Inserted between tokens, where none of them can
+// leave the lexer in an error state
+static const char *const insertions[] = {
+	"foo", " ", "\n", ";", "{", "}", "[", "]", "a💩a",
+	"'quoted string'", "\"double\nquoted\"", "\\;", "\t\t",
+	"word 'with quotes' and\nnew lines\n",
+};
+
+static ssize_t lex_all(struct scallop_parse_token *output)
+{
+	const struct scallop_parse_token *end = scallop_lex_memory_batch(
+		script,
+		script + script_length,
+		(struct scallop_parse_token) { 0 },
+		output,
+		output + TOKEN_CAPACITY
+	);
+	assert(end[-1].token == SCALLOP_TOKEN_EOF);
+	return end - output;
+}
+
+static struct scallop_edit replace(
+	int64_t offset,
+	int64_t deleted,
+	const char *insertion
+)
+{
+	const int64_t inserted = strlen(insertion);
+	memmove(
+		script + offset + inserted,
+		script + offset + deleted,
+		script_length - offset - deleted
+	);
+	memcpy(script + offset, insertion, inserted);
+	script_length += inserted - deleted;
+	return (struct scallop_edit) { offset, deleted, inserted };
+}
+
+/*
+ * Tokens are only ever inserted or deleted whole, so
+ * quotes stay paired, while letters can also go in the
+ * middle of tokens.
+ */
+static struct scallop_edit try_random_edit(ssize_t count)
+{
+	// The last token is EOF, which starts past the end
+	const uint32_t first = random_below(count);
+	const int64_t boundary = tokens[first].start_offset;
+
+	switch (random_below(4)) {
+	case 0: {
+		const uint32_t last = first + random_below(count - first);
+		return replace(
+			boundary,
+			tokens[last].start_offset - boundary,
+			""
+		);
+	}
+	case 1: {
+		const int64_t offset = random_below(script_length + 1);
+		const unsigned char next = script[offset];
+		if (
+			(next & 0xC0) == 0x80
+			|| (offset && script[offset - 1] == '\\')
+			|| script_length + 1 >= SCRIPT_CAPACITY
+		)
+			return replace(offset, 0, "");
+		return replace(offset, 0, "x");
+	}
+	default: {
+		const char *insertion = insertions[
+			random_below(sizeof(insertions) / sizeof(*insertions))
+		];
+		if (script_length + (ssize_t)strlen(insertion) >= SCRIPT_CAPACITY)
+			return replace(boundary, 0, "");
+		return replace(boundary, 0, insertion);
+	}
+	}
+}
+
+// The lexer treats a statement separator straight
+// after a word separator as an error
+static int has_errors(void)
+{
+	for (ssize_t i = 1; i < script_length; i++)
+		if (strchr(" \t", script[i - 1]) && strchr(";\n", script[i]))
+			return 1;
+	return 0;
+}
+
+static struct scallop_edit random_edit(ssize_t count)
+{
+	static char original[SCRIPT_CAPACITY];
+	const ssize_t original_length = script_length;
+	memcpy(original, script, script_length);
+	for (;;) {
+		const struct scallop_edit edit = try_random_edit(count);
+		if (!has_errors())
+			return edit;
+		memcpy(script, original, original_length);
+		script_length = original_length;
+	}
+}
+
+int main()
+{
+	ssize_t count = lex_all(tokens);
+
+	for (int i = 0; i < 5000; i++) {
+		const struct scallop_edit edit = random_edit(count);
+
+		// Without spare room, edits either fit or say so
+		memcpy(tight, tokens, count * sizeof(*tokens));
+		const ssize_t tight_count = scallop_relex_memory(
+			script,
+			script + script_length,
+			tight,
+			count,
+			count,
+			edit
+		);
+
+		count = scallop_relex_memory(
+			script,
+			script + script_length,
+			tokens,
+			count,
+			TOKEN_CAPACITY,
+			edit
+		);
+
+		assert(count == lex_all(expected));
+		for (ssize_t j = 0; j < count; j++)
+			assert_positions_equal(expected[j], tokens[j]);
+		assert(tight_count == -1 || tight_count == count);
+		for (ssize_t j = 0; j < tight_count; j++)
+			assert_positions_equal(expected[j], tight[j]);
+	}
+
+	// Replacing tokens one for one needs no spare room
+	script_length = 0;
+	replace(0, 0, "foo {bar} baz");
+	count = lex_all(tokens);
+	const struct scallop_edit same_count = replace(5, 3, "quux");
+	assert(scallop_relex_memory(
+		script,
+		script + script_length,
+		tokens,
+		count,
+		count,
+		same_count
+	) == count);
+	assert(count == lex_all(expected));
+	for (ssize_t j = 0; j < count; j++)
+		assert_positions_equal(expected[j], tokens[j]);
+
+	// Edits which don't fit are reported, rather than
+	// writing past the end of the array
+	script_length = 0;
+	count = lex_all(tokens);
+	const struct scallop_edit edit = replace(0, 0, "a b c d");
+	assert(scallop_relex_memory(
+		script,
+		script + script_length,
+		tokens,
+		count,
+		4,
+		edit
+	) == -1);
+}
+
@@ -0,0 +1,164 @@
+#include "test_macros.h"
+#include "test_random.h"
+#include "scallop/ring.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define STREAM_SIZE (64 * 1024 * 1024)
+
+static unsigned char pattern(size_t offset)
+{
+	return (unsigned char)(offset * 31 + offset / 4093);
+}
+
+/*
+ * Writes the pattern in chunks of every size, some
+ * bigger than the ring, while the other end reads it
+ * back in chunks of other sizes.
+ */
+static void *write_stream(void *param)
+{
+	struct scallop_ring *ring = param;
+	static unsigned char chunk[3 * 4096];
+	uint64_t state = 12345;
+	for (size_t offset = 0; offset < STREAM_SIZE;) {
+		state = state * 6364136223846793005 + 1442695040888963407;
+		size_t length = (state >> 33) % sizeof(chunk) + 1;
+		if (length > STREAM_SIZE - offset)
+			length = STREAM_SIZE - offset;
+		for (size_t i = 0; i < length; i++)
+			chunk[i] = pattern(offset + i);
+		assert(scallop_ring_write(ring, chunk, length) == (ssize_t)length);
+		offset += length;
+	}
+	scallop_ring_close_writer(ring);
+	return NULL;
+}
+
+static void read_stream(struct scallop_ring *ring)
+{
+	unsigned char chunk[5000];
+	size_t offset = 0;
+	for (;;) {
+		const ssize_t length = scallop_ring_read(ring, chunk, random_below(sizeof(chunk)) + 1);
+		if (!length)
+			break;
+		for (ssize_t i = 0; i < length; i++)
+			assert(chunk[i] == pattern(offset + i));
+		offset += length;
+	}
+	assert(offset == STREAM_SIZE);
+}
+
+static void test_threads(void)
+{
+	struct scallop_ring ring;
+	// The smallest ring, so it wraps and fills up a lot
+	assert(scallop_ring_create(&ring, 1));
+	assert(ring.capacity == (size_t)sysconf(_SC_PAGESIZE));
+	pthread_t writer;
+	assert(!pthread_create(&writer, NULL, write_stream, &ring));
+	read_stream(&ring);
+	assert(!pthread_join(writer, NULL));
+	scallop_ring_unmap(&ring);
+}
+
+static void test_processes(void)
+{
+	struct scallop_ring ring;
+	assert(scallop_ring_create(&ring, 64 * 1024));
+	const pid_t pid = fork();
+	assert(pid >= 0);
+	if (!pid) {
+		// Map it again from the fd, as another process would
+		struct scallop_ring child;
+		if (!scallop_ring_map(&child, ring.fd))
+			_exit(1);
+		write_stream(&child);
+		_exit(0);
+	}
+	read_stream(&ring);
+	int status;
+	assert(waitpid(pid, &status, 0) == pid);
+	assert(WIFEXITED(status) && !WEXITSTATUS(status));
+	scallop_ring_unmap(&ring);
+}
+
+static void test_spans(void)
+{
+	struct scallop_ring ring;
+	assert(scallop_ring_create(&ring, 4096));
+	const size_t capacity = ring.capacity;
+
+	// Leave the read and write positions near the end
+	size_t length;
+	char *space = scallop_ring_reserve(&ring, &length);
+	assert(space && length == capacity);
+	memset(space, 'x', capacity - 10);
+	scallop_ring_commit(&ring, capacity - 10);
+	const char *data = scallop_ring_peek(&ring, &length);
+	assert(data && length == capacity - 10);
+	scallop_ring_consume(&ring, length);
+
+	// A span across the end is still contiguous
+	space = scallop_ring_reserve(&ring, &length);
+	assert(length == capacity);
+	for (size_t i = 0; i < 100; i++)
+		space[i] = (char)i;
+	scallop_ring_commit(&ring, 100);
+	data = scallop_ring_peek(&ring, &length);
+	assert(length == 100);
+	for (size_t i = 0; i < 100; i++)
+		assert(data[i] == (char)i);
+	// and wrapped round to the start of the data
+	assert(ring.data[0] == 10);
+	scallop_ring_consume(&ring, 100);
+
+	// EOF only once everything's read
+	assert(scallop_ring_write(&ring, "abc", 3) == 3);
+	scallop_ring_close_writer(&ring);
+	char buffer[8];
+	assert(scallop_ring_read(&ring, buffer, 2) == 2);
+	assert(scallop_ring_read(&ring, buffer + 2, sizeof(buffer)) == 1);
+	assert(!memcmp(buffer, "abc", 3));
+	assert(scallop_ring_read(&ring, buffer, sizeof(buffer)) == 0);
+	assert(!scallop_ring_peek(&ring, &length) && !length);
+	scallop_ring_unmap(&ring);
+}
+
+static void *close_reader_later(void *param)
+{
+	usleep(10000);
+	scallop_ring_close_reader(param);
+	return NULL;
+}
+
+static void test_closed_reader(void)
+{
+	struct scallop_ring ring;
+	assert(scallop_ring_create(&ring, 4096));
+	pthread_t reader;
+	assert(!pthread_create(&reader, NULL, close_reader_later, &ring));
+	// Fills the ring, then waits until the reader goes
+	static char buffer[3 * 4096];
+	errno = 0;
+	assert(scallop_ring_write(&ring, buffer, sizeof(buffer)) == -1);
+	assert(errno == EPIPE);
+	assert(!pthread_join(reader, NULL));
+	scallop_ring_unmap(&ring);
+}
+
+int main()
+{
+	test_spans();
+	test_closed_reader();
+	test_threads();
+	test_processes();
+	return 0;
+}
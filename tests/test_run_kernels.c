@@ -0,0 +1,79 @@
+#include "test_macros.h"
+#include "test_scripts.h"
+#include "lexer_runs.h"
+
+#include <csalt/stores.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SCRIPT_SIZE (256 * 1024)
+#define MAX_TOKENS SCRIPT_SIZE
+
+#define assert_positions_equal(expected, actual) \
+{ \
+	assert_tokens_equal(expected, actual); \
+	assert((expected).row == (actual).row); \
+	assert((expected).col == (actual).col); \
+}
+
+static struct scallop_parse_token expected[MAX_TOKENS];
+static struct scallop_parse_token actual[MAX_TOKENS];
+static char script[SCRIPT_SIZE];
+
+static ssize_t lex_with(enum LEX_RUN_KERNEL kernel, struct scallop_parse_token *tokens)
+{
+	assert(lex_use_run_kernel(kernel));
+	const struct scallop_parse_token *end = scallop_lex_memory_batch(
+		script,
+		arrend(script),
+		(struct scallop_parse_token) { 0 },
+		tokens,
+		tokens + MAX_TOKENS
+	);
+	assert(end[-1].token == SCALLOP_TOKEN_EOF);
+	return end - tokens;
+}
+
+int main()
+{
+	static const enum LEX_RUN_KERNEL kernels[] = {
+		LEX_RUN_KERNEL_SCALAR,
+		LEX_RUN_KERNEL_SSE2,
+		LEX_RUN_KERNEL_AVX2,
+	};
+
+	for (uint64_t seed = 1; seed <= 8; seed++) {
+		random_state = seed * 0x9E3779B97F4A7C15;
+		generate(script, arrend(script));
+
+		const ssize_t expected_count = lex_with(LEX_RUN_KERNEL_NONE, expected);
+
+		for (
+			const enum LEX_RUN_KERNEL *kernel = kernels;
+			kernel < arrend(kernels);
+			kernel++
+		) {
+			if (!lex_use_run_kernel(*kernel)) {
+				print_error("skipping unsupported kernel %d", *kernel);
+				continue;
+			}
+			assert(lex_with(*kernel, actual) == expected_count);
+			for (ssize_t i = 0; i < expected_count; i++)
+				assert_positions_equal(expected[i], actual[i]);
+		}
+
+		// Chunked windows end in the middle of runs
+		struct csalt_cmemory csalt_script = csalt_cmemory_array(script);
+		const struct scallop_parse_token *end = scallop_lex_batch(
+			(csalt_store *)&csalt_script,
+			(struct scallop_parse_token) { 0 },
+			actual,
+			arrend(actual)
+		);
+		assert(end - actual == expected_count);
+		for (ssize_t i = 0; i < expected_count; i++)
+			assert_positions_equal(expected[i], actual[i]);
+	}
+}
+
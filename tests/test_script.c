@@ -0,0 +1,101 @@
+#include "test_macros.h"
+#include "scallop/script.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define assert_positions_equal(expected, actual) \
+{ \
+	assert_tokens_equal(expected, actual); \
+	assert((expected).row == (actual).row); \
+	assert((expected).col == (actual).col); \
+}
+
+static char script[50000];
+static struct scallop_parse_token expected[sizeof(script)];
+static struct scallop_parse_token actual[sizeof(script)];
+
+static void write_file(const char *path, const char *begin, const char *end)
+{
+	FILE *file = fopen(path, "wb");
+	assert(file);
+	assert(fwrite(begin, 1, end - begin, file) == (size_t)(end - begin));
+	assert(!fclose(file));
+}
+
+int main()
+{
+	static const char phrase[] = "foo 'bar\nbaz' {\"qu💩x\"};\n";
+	const size_t phrase_length = sizeof(phrase) - 1;
+	const size_t script_length =
+		(sizeof(script) - 1) / phrase_length * phrase_length;
+	for (size_t i = 0; i < script_length; i++)
+		script[i] = phrase[i % phrase_length];
+
+	char path[] = "/tmp/test_script_XXXXXX";
+	const int fd = mkstemp(path);
+	assert(fd >= 0);
+	close(fd);
+	write_file(path, script, script + script_length);
+
+	const struct scallop_parse_token *expected_end = scallop_lex_memory_batch(
+		script,
+		script + script_length,
+		(struct scallop_parse_token) { 0 },
+		expected,
+		arrend(expected)
+	);
+
+	struct scallop_script mapped;
+	assert(scallop_script_open(&mapped, path));
+	assert(mapped.end - mapped.begin == (ssize_t)script_length);
+	assert(!memcmp(mapped.begin, script, script_length));
+
+	// Straight from the mapping
+	const struct scallop_parse_token *actual_end = scallop_lex_memory_batch(
+		mapped.begin,
+		mapped.end,
+		(struct scallop_parse_token) { 0 },
+		actual,
+		arrend(actual)
+	);
+	assert(actual_end - actual == expected_end - expected);
+	for (ssize_t i = 0; i < expected_end - expected; i++)
+		assert_positions_equal(expected[i], actual[i]);
+
+	// Through the store
+	actual_end = scallop_lex_batch(
+		(csalt_store *)&mapped.store,
+		(struct scallop_parse_token) { 0 },
+		actual,
+		arrend(actual)
+	);
+	assert(actual_end - actual == expected_end - expected);
+	for (ssize_t i = 0; i < expected_end - expected; i++)
+		assert_positions_equal(expected[i], actual[i]);
+
+	scallop_script_close(&mapped);
+	assert(!mapped.begin && !mapped.end);
+
+	// Empty files can't be mapped, but are still scripts
+	write_file(path, script, script);
+	assert(scallop_script_open(&mapped, path));
+	assert(mapped.begin == mapped.end);
+	const struct scallop_parse_token eof = scallop_lex_memory(
+		mapped.begin,
+		mapped.end,
+		(struct scallop_parse_token) { 0 }
+	);
+	assert(eof.token == SCALLOP_TOKEN_EOF);
+	scallop_script_close(&mapped);
+
+	assert(!unlink(path));
+	assert(!scallop_script_open(&mapped, path));
+	assert(errno == ENOENT);
+
+	assert(!scallop_script_open(&mapped, "/tmp"));
+	assert(errno == ENODEV);
+}
@@ -0,0 +1,135 @@
+#ifndef TEST_SCRIPTS_H
+#define TEST_SCRIPTS_H
+
+#include "test_random.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Generates random scripts which are long enough to
+ * cover every part of the run kernels.
+ */
+struct script {
+	char *current;
+	char *end;
+};
+
+static void put(struct script *script, const char *characters)
+{
+	const size_t length = strlen(characters);
+	assert(length < (size_t)(script->end - script->current));
+	memcpy(script->current, characters, length);
+	script->current += length;
+}
+
+static void put_random(struct script *script, const char *choices)
+{
+	const char character[] = { choices[random_below(strlen(choices))], 0 };
+	put(script, character);
+}
+
+static const char word_characters[] =
+	"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-_./=:,+@%";
+
+static const char *const utf8_characters[] = {
+	"é", "ß", "€", "日", "本", "💩", "ñ",
+};
+
+static void put_utf8(struct script *script)
+{
+	const uint32_t count = 1 + random_below(12);
+	for (uint32_t i = 0; i < count; i++)
+		put(
+			script,
+			utf8_characters[
+				random_below(sizeof(utf8_characters) / sizeof(*utf8_characters))
+			]
+		);
+}
+
+static void put_escape(struct script *script)
+{
+	put(script, "\\");
+	put_random(script, "abc'\"\\|{}[]; \n\t");
+}
+
+static void put_quoted(struct script *script, const char *quote, const char *excluded)
+{
+	put(script, quote);
+	const uint32_t length = random_below(random_below(8) ? 40 : 400);
+	for (uint32_t i = 0; i < length; i++) {
+		switch (random_below(20)) {
+			case 0:
+				put_utf8(script);
+				break;
+			case 1:
+				put_escape(script);
+				break;
+			case 2:
+				put_random(script, "\n\t {}[];");
+				break;
+			default: {
+				const char character[] = { (char)(' ' + random_below('~' - ' ' + 1)), 0 };
+				if (!strchr(excluded, character[0]))
+					put(script, character);
+			}
+		}
+	}
+	put(script, quote);
+}
+
+static void put_word(struct script *script)
+{
+	const uint32_t length = 1 + random_below(random_below(8) ? 12 : 200);
+	for (uint32_t i = 0; i < length; i++) {
+		switch (random_below(24)) {
+			case 0:
+				put_utf8(script);
+				break;
+			case 1:
+				put_escape(script);
+				break;
+			case 2:
+				put_quoted(script, "'", "'\\|");
+				put_random(script, "abc");
+				break;
+			case 3:
+				put_quoted(script, "\"", "\"\\|");
+				put_random(script, "abc");
+				break;
+			default:
+				put_random(script, word_characters);
+		}
+	}
+}
+
+static inline void generate(char *begin, char *end)
+{
+	struct script script = { begin, end - 1 };
+	// Leave plenty of room, so nothing gets cut off half-way
+	while (script.end - script.current > 64 * 1024) {
+		switch (random_below(8)) {
+			case 0:
+				put_quoted(&script, "'", "'\\|");
+				break;
+			case 1:
+				put_quoted(&script, "\"", "\"\\|");
+				break;
+			case 2:
+				put_random(&script, "{}[]");
+				break;
+			default:
+				put_word(&script);
+		}
+
+		const uint32_t separators = 1 + random_below(random_below(8) ? 2 : 100);
+		const char *choices = random_below(4) ? " \t" : " \t\r;\n";
+		for (uint32_t i = 0; i < separators; i++)
+			put_random(&script, choices);
+	}
+	memset(script.current, 0, end - script.current);
+}
+
+#endif // TEST_SCRIPTS_H
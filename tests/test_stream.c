@@ -0,0 +1,141 @@
+#include "test_macros.h"
+
+#include <csalt/stores.h>
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+
+#define assert_positions_equal(expected, actual) \
+{ \
+	assert_tokens_equal(expected, actual); \
+	assert((expected).row == (actual).row); \
+	assert((expected).col == (actual).col); \
+}
+
+static char script[20000];
+static struct scallop_parse_token expected[sizeof(script)];
+
+static int read_into_stream(csalt_store *store, void *param)
+{
+	struct scallop_stream_lexer *lexer = param;
+	return scallop_stream_read(lexer, store) >= 0;
+}
+
+int main()
+{
+	static const char phrase[] =
+		"foo 'bar\nbaz' {\"qu💩x\"};\n\\\"a\\a \\z;\\b [x]\t\t'éa\\'' ";
+	const size_t phrase_length = sizeof(phrase) - 1;
+	const ssize_t script_length =
+		(sizeof(script) - 1) / phrase_length * phrase_length;
+	for (ssize_t i = 0; i < script_length; i++)
+		script[i] = phrase[i % phrase_length];
+
+	const struct scallop_parse_token *expected_end = scallop_lex_memory_batch(
+		script,
+		script + script_length,
+		(struct scallop_parse_token) { 0 },
+		expected,
+		arrend(expected)
+	);
+	assert(expected_end[-1].token == SCALLOP_TOKEN_EOF);
+
+	// A buffer smaller than some tokens, fed in uneven
+	// pieces and released as soon as possible
+	{
+		char buffer[16];
+		struct scallop_stream_lexer lexer = scallop_stream_lexer_make(
+			buffer,
+			sizeof(buffer)
+		);
+		const struct scallop_parse_token *current = expected;
+		ssize_t written = 0;
+		ssize_t piece = 1;
+		while (current < expected_end) {
+			struct scallop_parse_token actual;
+			if (scallop_stream_next(&lexer, &actual)) {
+				assert_positions_equal(*current, actual);
+				current++;
+				continue;
+			}
+
+			scallop_stream_release(&lexer, SSIZE_MAX);
+			assert(lexer.written - lexer.released <= (ssize_t)sizeof(buffer));
+			if (written == script_length) {
+				scallop_stream_finish(&lexer);
+				continue;
+			}
+			piece = piece % 23 + 1;
+			if (script_length - written < piece)
+				piece = script_length - written;
+			written += scallop_stream_write(&lexer, script + written, piece);
+		}
+	}
+
+	// A buffer big enough to hold any token, read from a
+	// store and released only after copying the token out
+	{
+		char buffer[64];
+		struct scallop_stream_lexer lexer = scallop_stream_lexer_make(
+			buffer,
+			sizeof(buffer)
+		);
+		struct csalt_cmemory csalt_script = csalt_cmemory_make(
+			script,
+			script + script_length
+		);
+		const struct scallop_parse_token *current = expected;
+		while (current < expected_end) {
+			struct scallop_parse_token actual;
+			if (scallop_stream_next(&lexer, &actual)) {
+				assert_positions_equal(*current, actual);
+				if (actual.token != SCALLOP_TOKEN_EOF) {
+					char value[sizeof(buffer)];
+					const ssize_t length = actual.end_offset - actual.start_offset;
+					assert(scallop_stream_copy(
+						&lexer,
+						actual.start_offset,
+						actual.end_offset,
+						value
+					) == length);
+					assert(!memcmp(value, script + actual.start_offset, length));
+				}
+				scallop_stream_release(&lexer, actual.end_offset);
+				current++;
+				continue;
+			}
+
+			if (lexer.written == script_length) {
+				scallop_stream_finish(&lexer);
+				continue;
+			}
+			assert(csalt_store_split(
+				(csalt_store *)&csalt_script,
+				lexer.written,
+				script_length,
+				read_into_stream,
+				&lexer
+			));
+		}
+
+		// Released bytes can't be copied any more
+		char value[1];
+		assert(scallop_stream_copy(&lexer, 0, 1, value) == -1);
+	}
+
+	// A single byte could never be released, so it's
+	// turned down rather than left to stall
+	{
+		char buffer[1];
+		errno = 0;
+		struct scallop_stream_lexer lexer = scallop_stream_lexer_make(
+			buffer,
+			sizeof(buffer)
+		);
+		assert(errno == EINVAL && !lexer.buffer);
+		assert(scallop_stream_write(&lexer, script, 1) == -1);
+		struct csalt_cmemory csalt_script = csalt_cmemory_make(script, script + 1);
+		assert(scallop_stream_read(&lexer, (csalt_store *)&csalt_script) == -1);
+	}
+}
+
@@ -0,0 +1,223 @@
+#include "test_macros.h"
+#include "scallop/builtin.h"
+#include "scallop/symbols.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define THREADS 8
+#define SHARED_NAMES 2000
+#define MANY_NAMES 10000
+
+static void test_table(void)
+{
+	struct scallop_symbols *symbols = scallop_symbols_create();
+	assert(symbols);
+	assert(scallop_symbols_count(symbols) == 0);
+	assert(scallop_symbols_find(symbols, "echo", 4) == SCALLOP_SYMBOL_NONE);
+	assert(!scallop_symbols_name(symbols, SCALLOP_SYMBOL_NONE, NULL));
+	assert(!scallop_symbols_name(symbols, 1, NULL));
+
+	const uint32_t echo = scallop_symbols_intern(symbols, "echo", 4);
+	const uint32_t ech = scallop_symbols_intern(symbols, "echo", 3);
+	const uint32_t with_null = scallop_symbols_intern(symbols, "ec\0ho", 5);
+	assert(echo != SCALLOP_SYMBOL_NONE);
+	assert(echo != ech && echo != with_null && ech != with_null);
+	assert(scallop_symbols_intern(symbols, "echo", 4) == echo);
+	assert(scallop_symbols_find(symbols, "echo", 4) == echo);
+	assert(scallop_symbols_intern_hashed(
+		symbols,
+		"echo",
+		4,
+		scallop_symbol_hash("echo", 4)
+	) == echo);
+	assert(scallop_symbols_count(symbols) == 3);
+
+	size_t length;
+	assert(!strcmp(scallop_symbols_name(symbols, echo, &length), "echo"));
+	assert(length == 4);
+	assert(!memcmp(scallop_symbols_name(symbols, with_null, &length), "ec\0ho", 6));
+	assert(length == 5);
+
+	// Symbols and names have to survive the table growing
+	const char *echo_name = scallop_symbols_name(symbols, echo, NULL);
+	for (int i = 0; i < MANY_NAMES; i++) {
+		char name[32];
+		const int name_length = snprintf(name, sizeof(name), "name%d", i);
+		assert(scallop_symbols_intern(symbols, name, name_length) == (uint32_t)i + 4);
+	}
+	assert(scallop_symbols_count(symbols) == MANY_NAMES + 3);
+	assert(scallop_symbols_find(symbols, "echo", 4) == echo);
+	assert(scallop_symbols_name(symbols, echo, NULL) == echo_name);
+	assert(!strcmp(scallop_symbols_name(symbols, MANY_NAMES + 3, NULL), "name9999"));
+
+	scallop_symbols_destroy(symbols);
+}
+
+/*
+ * The interning lexer has to give the same tokens as
+ * the plain one, and every plain word the symbol its
+ * bytes would get, however the batches split.
+ */
+static void expect_interned(const char *script, ssize_t batch_size)
+{
+	const ssize_t size = strlen(script);
+	struct scallop_parse_token expected[MAX_TEST_TOKENS];
+	const ssize_t count = scallop_lex_memory_batch(
+		script,
+		script + size,
+		(struct scallop_parse_token) { 0 },
+		expected,
+		arrend(expected)
+	) - expected;
+	assert(expected[count - 1].token == SCALLOP_TOKEN_EOF);
+
+	struct scallop_symbols *symbols = scallop_symbols_create();
+	assert(symbols);
+	struct scallop_parse_token tokens[MAX_TEST_TOKENS];
+	uint32_t token_symbols[MAX_TEST_TOKENS];
+	struct scallop_parse_token token = { 0 };
+	ssize_t lexed = 0;
+	do {
+		ssize_t end = lexed + batch_size;
+		if (end > count)
+			end = count;
+		const struct scallop_parse_token *tokens_end =
+			scallop_lex_memory_interned_batch(
+				script,
+				script + size,
+				token,
+				symbols,
+				tokens + lexed,
+				tokens + end,
+				token_symbols + lexed
+			);
+		lexed = tokens_end - tokens;
+		token = tokens_end[-1];
+	} while (token.token != SCALLOP_TOKEN_EOF);
+	assert(lexed == count);
+
+	for (ssize_t i = 0; i < count; i++) {
+		assert_tokens_equal(expected[i], tokens[i]);
+		assert(expected[i].flags == tokens[i].flags);
+		assert(expected[i].row == tokens[i].row);
+		assert(expected[i].col == tokens[i].col);
+
+		const int plain = tokens[i].token == SCALLOP_TOKEN_WORD && !(tokens[i].flags & (
+			SCALLOP_TOKEN_QUOTED | SCALLOP_TOKEN_DOUBLE_QUOTED | SCALLOP_TOKEN_ESCAPED
+		));
+		const char *word = script + tokens[i].start_offset;
+		const size_t length = tokens[i].end_offset - tokens[i].start_offset;
+		const uint32_t symbol = plain ?
+			scallop_symbols_find(symbols, word, length) :
+			SCALLOP_SYMBOL_NONE;
+		if (token_symbols[i] != symbol || (plain && !symbol)) {
+			print_error(
+				"%s: token %zd (%.*s): expected symbol %u, got %u",
+				script,
+				i,
+				(int)length,
+				word,
+				symbol,
+				token_symbols[i]
+			);
+			assert(!"wrong symbol");
+		}
+	}
+	scallop_symbols_destroy(symbols);
+}
+
+static void test_lexing(void)
+{
+	static const char *const scripts[] = {
+		"echo hello",
+		"echo hello hello echo\necho",
+		"echo 'hello' \"hello\" hel\\lo hello",
+		"héllo wörld 日本語 héllo",
+		"{echo a}[b c] x|y z||w",
+		"a'b' a\"b\" a\\ b ab",
+		"a_word_long_enough_for_the_runs_to_skip_over_most_of_it_in_one_go "
+			"a_word_long_enough_for_the_runs_to_skip_over_most_of_it_in_one_go",
+		"",
+	};
+	for (size_t i = 0; i < arrend(scripts) - scripts; i++) {
+		expect_interned(scripts[i], MAX_TEST_TOKENS);
+		expect_interned(scripts[i], 1);
+		expect_interned(scripts[i], 3);
+	}
+}
+
+static void test_builtins(void)
+{
+	struct scallop_symbols *symbols = scallop_symbols_create();
+	assert(symbols);
+	const uint32_t before = scallop_symbols_intern(symbols, "before", 6);
+	struct scallop_builtins *builtins = scallop_builtins_create();
+	assert(builtins);
+	assert(!scallop_builtins_find_symbol(builtins, before));
+	assert(scallop_builtins_intern(builtins, symbols));
+
+	const uint32_t echo = scallop_symbols_find(symbols, "echo", 4);
+	assert(echo);
+	assert(scallop_builtins_find_symbol(builtins, echo) == scallop_builtins_find(builtins, "echo"));
+	assert(scallop_builtins_find_symbol(builtins, scallop_symbols_find(symbols, "[", 1)));
+	assert(!scallop_builtins_find_symbol(builtins, before));
+	assert(!scallop_builtins_find_symbol(builtins, SCALLOP_SYMBOL_NONE));
+	assert(!scallop_builtins_find_symbol(builtins, UINT32_MAX));
+
+	// Builtins added or replaced later are interned too
+	scallop_builtin_fn *true_builtin = scallop_builtins_find(builtins, "true");
+	assert(scallop_builtins_add(builtins, "before", true_builtin));
+	assert(scallop_builtins_add(builtins, "echo", true_builtin));
+	assert(scallop_builtins_find_symbol(builtins, before) == true_builtin);
+	assert(scallop_builtins_find_symbol(builtins, echo) == true_builtin);
+
+	scallop_builtins_free(builtins);
+	scallop_symbols_destroy(symbols);
+}
+
+static struct scallop_symbols *shared;
+static uint32_t shared_symbols[THREADS][SHARED_NAMES];
+
+static void *intern_names(void *param)
+{
+	uint32_t *symbols = param;
+	for (int i = 0; i < SHARED_NAMES; i++) {
+		char name[32];
+		const int length = snprintf(name, sizeof(name), "name%d", i);
+		symbols[i] = scallop_symbols_intern(shared, name, length);
+		assert(symbols[i]);
+	}
+	return NULL;
+}
+
+static void test_threads(void)
+{
+	shared = scallop_symbols_create();
+	assert(shared);
+	pthread_t threads[THREADS];
+	for (int i = 0; i < THREADS; i++)
+		assert(!pthread_create(&threads[i], NULL, intern_names, shared_symbols[i]));
+	for (int i = 0; i < THREADS; i++)
+		pthread_join(threads[i], NULL);
+
+	assert(scallop_symbols_count(shared) == SHARED_NAMES);
+	for (int i = 1; i < THREADS; i++)
+		assert(!memcmp(shared_symbols[0], shared_symbols[i], sizeof(shared_symbols[0])));
+	for (int i = 0; i < SHARED_NAMES; i++) {
+		char name[32];
+		snprintf(name, sizeof(name), "name%d", i);
+		assert(!strcmp(scallop_symbols_name(shared, shared_symbols[0][i], NULL), name));
+	}
+	scallop_symbols_destroy(shared);
+}
+
+int main()
+{
+	test_table();
+	test_lexing();
+	test_builtins();
+	test_threads();
+	return 0;
+}
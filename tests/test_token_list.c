@@ -0,0 +1,86 @@
+#include "test_macros.h"
+
+#include <string.h>
+
+#define assert_positions_equal(expected, actual) \
+{ \
+	assert_tokens_equal(expected, actual); \
+	assert((expected).row == (actual).row); \
+	assert((expected).col == (actual).col); \
+}
+
+static struct scallop_parse_token expected[20000];
+
+static void expect_same_tokens(const char *begin, const char *end)
+{
+	const struct scallop_parse_token *expected_end = scallop_lex_memory_batch(
+		begin,
+		end,
+		(struct scallop_parse_token) { 0 },
+		expected,
+		arrend(expected)
+	);
+	assert(expected_end[-1].token == SCALLOP_TOKEN_EOF);
+
+	struct scallop_token_list list = scallop_token_list_make(begin, end);
+	assert(scallop_lex_memory_compact(&list));
+	assert(list.count == expected_end - expected);
+	// Lines aren't looked for until they're needed
+	assert(list.newline_count < 0);
+
+	for (ssize_t i = 0; i < list.count; i++) {
+		const struct scallop_parse_token actual = scallop_token_list_get(&list, i);
+		assert_positions_equal(expected[i], actual);
+	}
+	// Going backwards can't carry on from the last col
+	for (ssize_t i = list.count - 1; i >= 0; i--) {
+		const struct scallop_parse_token actual = scallop_token_list_get(&list, i);
+		assert_positions_equal(expected[i], actual);
+	}
+	scallop_token_list_free(&list);
+}
+
+int main()
+{
+	static char script[50000];
+	// Lines longer than a block, so newlines are found
+	// by both the SIMD and scalar ends of the search
+	static const char phrase[] =
+		"foo 'bar\nbaz' {\"qu💩x\"};\n"
+		"echo a very long line, longer than any block is; echo ééé\n"
+		"\n\n[x]\t'\\''\n";
+	const size_t phrase_length = sizeof(phrase) - 1;
+	const size_t script_length =
+		(sizeof(script) - 1) / phrase_length * phrase_length;
+	for (size_t i = 0; i < script_length; i++)
+		script[i] = phrase[i % phrase_length];
+
+	expect_same_tokens(script, script + script_length);
+
+	// Cutting the script off after each token ends up
+	// with the EOF token in every position on a line
+	static struct scallop_parse_token boundaries[100];
+	scallop_lex_memory_batch(
+		script,
+		script + script_length,
+		(struct scallop_parse_token) { 0 },
+		boundaries,
+		arrend(boundaries)
+	);
+	expect_same_tokens(script, script);
+	for (size_t i = 0; i < sizeof(boundaries) / sizeof(*boundaries); i++)
+		expect_same_tokens(script, script + boundaries[i].end_offset);
+
+	// All on one line, as a minified script would be
+	static const char statement[] = "echo é 'a b';x|y ";
+	const size_t statement_length = sizeof(statement) - 1;
+	static char one_line[30000];
+	const size_t one_line_length = sizeof(one_line) / statement_length * statement_length;
+	for (size_t i = 0; i < one_line_length; i++)
+		one_line[i] = statement[i % statement_length];
+	expect_same_tokens(one_line, one_line + one_line_length);
+
+	// The lexer never counts the first character
+	static const char leading_newline[] = "\nfoo\nbar";
+	expect_same_tokens(leading_newline, arrend(leading_newline) - 1);
+}
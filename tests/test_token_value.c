@@ -0,0 +1,147 @@
+#include "test_macros.h"
+
+#include <string.h>
+
+#define QUOTED SCALLOP_TOKEN_QUOTED
+#define DOUBLE_QUOTED SCALLOP_TOKEN_DOUBLE_QUOTED
+#define ESCAPED SCALLOP_TOKEN_ESCAPED
+#define NON_ASCII SCALLOP_TOKEN_NON_ASCII
+
+static struct scallop_parse_token tokens[256];
+
+static const struct scallop_parse_token *lex(const char *script)
+{
+	const struct scallop_parse_token *end = scallop_lex_memory_batch(
+		script,
+		script + strlen(script),
+		(struct scallop_parse_token) { 0 },
+		tokens,
+		arrend(tokens)
+	);
+	assert(end[-1].token == SCALLOP_TOKEN_EOF);
+	return end;
+}
+
+/*
+ * Every way of lexing has to agree on the flags,
+ * including the ones that skip UTF-8 or don't keep
+ * whole tokens.
+ */
+static void expect_flags(const char *script, uint32_t flags)
+{
+	const ssize_t size = strlen(script);
+	const ssize_t count = lex(script) - tokens;
+	if (tokens[0].flags != flags) {
+		print_error("%s: expected flags %u, got %u", script, flags, tokens[0].flags);
+		assert(tokens[0].flags == flags);
+	}
+	for (ssize_t i = 1; i < count; i++)
+		assert(tokens[i].token == SCALLOP_TOKEN_WORD || !tokens[i].flags);
+
+	struct csalt_cmemory store = csalt_cmemory_make(script, script + size);
+	const struct scallop_parse_token token = scallop_lex(
+		(csalt_store *)&store,
+		(struct scallop_parse_token) { 0 }
+	);
+	assert(token.flags == flags);
+
+	struct scallop_parse_token validated[arrend(tokens) - tokens];
+	struct scallop_utf8_error error;
+	assert(scallop_validate_utf8(script, script + size, &error));
+	scallop_lex_validated_batch(
+		script,
+		script + size,
+		(struct scallop_parse_token) { 0 },
+		validated,
+		arrend(validated)
+	);
+
+	struct scallop_token_list list = scallop_token_list_make(script, script + size);
+	assert(scallop_lex_memory_compact(&list));
+	assert(list.count == count);
+	for (ssize_t i = 0; i < count; i++) {
+		assert(validated[i].flags == tokens[i].flags);
+		assert(scallop_token_list_get(&list, i).flags == tokens[i].flags);
+	}
+	scallop_token_list_free(&list);
+}
+
+static void expect_value(const char *script, const char *expected, int in_source)
+{
+	lex(script);
+	char buffer[256];
+	struct scallop_arena arena = scallop_arena_make(buffer, sizeof(buffer));
+	struct scallop_token_value value;
+	assert(scallop_token_value(script, script + strlen(script), tokens, &arena, &value));
+	if ((ssize_t)strlen(expected) != value.length || memcmp(expected, value.begin, value.length)) {
+		print_error("expected: %s", expected);
+		print_error("actual: %.*s", (int)value.length, value.begin);
+		assert(!"wrong value");
+	}
+	if (in_source) {
+		assert(value.begin == script);
+		assert(arena.current == buffer);
+	} else {
+		assert(value.begin == buffer);
+		assert(arena.current == buffer + value.length);
+	}
+}
+
+int main()
+{
+	expect_flags("plain words", 0);
+	expect_flags("-j8;", 0);
+	expect_flags("'a b' c", QUOTED);
+	expect_flags("\"a b\"", DOUBLE_QUOTED);
+	expect_flags("a\\ b", ESCAPED);
+	expect_flags("'a\\'b'", QUOTED | ESCAPED);
+	expect_flags("\"a\\\"b\"", DOUBLE_QUOTED | ESCAPED);
+	expect_flags("x'a'\"b\"", QUOTED | DOUBLE_QUOTED);
+	expect_flags("é", NON_ASCII);
+	expect_flags("héllo wörld", NON_ASCII);
+	expect_flags("a_word_long_enough_for_a_run_to_take_in_the_é_and_more", NON_ASCII);
+	expect_flags("'quoted ü.' x", QUOTED | NON_ASCII);
+	expect_flags("{é} [ü]", 0);
+
+	expect_value("plain words", "plain", 1);
+	expect_value("héllo", "héllo", 1);
+	expect_value("'a b' c", "a b", 0);
+	expect_value("\"it's\"", "it's", 0);
+	expect_value("'say \"hi\"'", "say \"hi\"", 0);
+	expect_value("a\\ b\\;c\\\\", "a b;c\\", 0);
+	expect_value("'a\\'b'", "a'b", 0);
+	expect_value("pre'mid'\"dle\"post", "premiddlepost", 0);
+	expect_value("''", "", 0);
+	// Long enough for both the SIMD and scalar searches
+	expect_value(
+		"'a quoted string longer than any block, \\'with escapes\\', "
+		"and \"double quotes\" inside it'\\ \"and then some more besides\"",
+		"a quoted string longer than any block, 'with escapes', "
+		"and \"double quotes\" inside it and then some more besides",
+		0
+	);
+
+	// Separators and EOF tokens are just their characters
+	static const char script[] = "'a b'\n";
+	const ssize_t count = lex(script) - tokens;
+	assert(count == 3);
+	struct scallop_arena arena = scallop_arena_make(NULL, 0);
+	struct scallop_token_value value;
+	assert(scallop_token_value(script, script + 6, &tokens[1], &arena, &value));
+	assert(value.begin == script + 5 && value.length == 1);
+	assert(scallop_token_value(script, script + 6, &tokens[2], &arena, &value));
+	assert(value.length == 0);
+	// Unescaping needs the arena
+	assert(!scallop_token_value(script, script + 6, &tokens[0], &arena, &value));
+
+	// Room for the whole token is needed, but only the
+	// value is kept
+	char buffer[5];
+	arena = scallop_arena_make(buffer, sizeof(buffer));
+	assert(scallop_token_value(script, script + 6, &tokens[0], &arena, &value));
+	assert(value.length == 3 && !memcmp(value.begin, "a b", 3));
+	assert(scallop_arena_alloc(&arena, 2) == buffer + 3);
+	assert(!scallop_arena_alloc(&arena, 1));
+	scallop_arena_reset(&arena);
+	assert(scallop_arena_alloc(&arena, 5) == buffer);
+}
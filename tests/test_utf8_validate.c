@@ -0,0 +1,290 @@
+#include "test_macros.h"
+#include "test_random.h"
+#include "lexer_runs.h"
+#include "utf8_validate.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define assert_positions_equal(expected, actual) \
+{ \
+	assert_tokens_equal(expected, actual); \
+	assert((expected).row == (actual).row); \
+	assert((expected).col == (actual).col); \
+}
+
+static const enum UTF8_KERNEL kernels[] = {
+	UTF8_KERNEL_SCALAR,
+	UTF8_KERNEL_SSSE3,
+	UTF8_KERNEL_AVX2,
+};
+
+/*
+ * Decodes each character and checks the code point,
+ * rather than the byte ranges the kernels use.
+ */
+static ssize_t reference_error(const char *begin, const char *end)
+{
+	const unsigned char *source = (const unsigned char *)begin;
+	const ssize_t size = end - begin;
+	ssize_t i = 0;
+	while (i < size) {
+		const unsigned char start = source[i];
+		if (start < 0x80) {
+			if ((start < ' ' && start && start != '\t' && start != '\n' && start != '\r') || start == 0x7F)
+				return i;
+			i++;
+			continue;
+		}
+
+		int length;
+		uint32_t code_point, min;
+		if ((start & 0xE0) == 0xC0) {
+			length = 2;
+			code_point = start & 0x1F;
+			min = 0x80;
+		} else if ((start & 0xF0) == 0xE0) {
+			length = 3;
+			code_point = start & 0x0F;
+			min = 0x800;
+		} else if ((start & 0xF8) == 0xF0) {
+			length = 4;
+			code_point = start & 0x07;
+			min = 0x10000;
+		} else {
+			return i;
+		}
+
+		if (size - i < length)
+			return i;
+		for (int j = 1; j < length; j++) {
+			if ((source[i + j] & 0xC0) != 0x80)
+				return i;
+			code_point = code_point << 6 | (source[i + j] & 0x3F);
+		}
+		if (
+			code_point < min
+			|| 0x10FFFF < code_point
+			|| (0xD800 <= code_point && code_point <= 0xDFFF)
+		)
+			return i;
+		i += length;
+	}
+	return size;
+}
+
+static void expect_kernels_agree(const char *begin, const char *end)
+{
+	const ssize_t expected = reference_error(begin, end);
+	for (
+		const enum UTF8_KERNEL *kernel = kernels;
+		kernel < arrend(kernels);
+		kernel++
+	) {
+		if (!utf8_use_kernel(*kernel))
+			continue;
+		const ssize_t actual = utf8_find_error(begin, end);
+		if (actual != expected) {
+			print_error(
+				"kernel %d: expected %zd, got %zd of %zd",
+				*kernel,
+				expected,
+				actual,
+				end - begin
+			);
+			assert(actual == expected);
+		}
+	}
+}
+
+static char *put_code_point(char *current, uint32_t code_point)
+{
+	if (code_point < 0x80) {
+		*current++ = (char)code_point;
+	} else if (code_point < 0x800) {
+		*current++ = (char)(0xC0 | code_point >> 6);
+		*current++ = (char)(0x80 | (code_point & 0x3F));
+	} else if (code_point < 0x10000) {
+		*current++ = (char)(0xE0 | code_point >> 12);
+		*current++ = (char)(0x80 | (code_point >> 6 & 0x3F));
+		*current++ = (char)(0x80 | (code_point & 0x3F));
+	} else {
+		*current++ = (char)(0xF0 | code_point >> 18);
+		*current++ = (char)(0x80 | (code_point >> 12 & 0x3F));
+		*current++ = (char)(0x80 | (code_point >> 6 & 0x3F));
+		*current++ = (char)(0x80 | (code_point & 0x3F));
+	}
+	return current;
+}
+
+// Mostly the edges of each range
+static uint32_t random_code_point(void)
+{
+	static const uint32_t edges[] = {
+		'\t', '\n', '\r', ' ', '~', 0x80, 0x7FF, 0x800, 0xD7FF, 0xE000,
+		0xFFFF, 0x10000, 0x10FFFF,
+	};
+	switch (random_below(4)) {
+		case 0:
+			return edges[random_below(sizeof(edges) / sizeof(*edges))];
+		case 1:
+			return 0x80 + random_below(0xD800 - 0x80);
+		case 2:
+			return 0xE000 + random_below(0x110000 - 0xE000);
+		default:
+			return ' ' + random_below('~' - ' ' + 1);
+	}
+}
+
+static void random_scripts(void)
+{
+	static char script[4096];
+	for (int i = 0; i < 20000; i++) {
+		const ssize_t size = i % 8 ? random_below(200) : random_below(sizeof(script) - 4);
+		char *current = script;
+		while (current - script < size)
+			current = put_code_point(current, random_code_point());
+
+		// Break a character somewhere, some of the time
+		if (current > script && random_below(4)) {
+			const uint32_t at = random_below(current - script);
+			switch (random_below(3)) {
+				case 0:
+					script[at] = (char)random_below(256);
+					break;
+				case 1:
+					current = script + at;
+					break;
+				default:
+					script[at] = (char)(0x80 | random_below(0x40));
+			}
+		}
+		expect_kernels_agree(script, current);
+	}
+}
+
+/*
+ * Every sequence of up to three characters, which is
+ * enough to see each kind of error, put across where
+ * both SIMD kernels' blocks meet.
+ */
+static void every_sequence(void)
+{
+	char script[64];
+	memset(script, 'a', sizeof(script));
+	for (int first = 0x80; first < 0x100; first++) {
+		for (int second = 0; second < 0x100; second++) {
+			script[30] = (char)first;
+			script[31] = (char)second;
+			script[32] = 'a';
+			expect_kernels_agree(script, arrend(script));
+			// And cut off at the end
+			expect_kernels_agree(script, script + 32);
+			// Only a three or four character start followed
+			// by a continuation needs a third character
+			if (first < 0xE0 || (second & 0xC0) != 0x80)
+				continue;
+			for (int third = 0; third < 0x100; third++) {
+				script[32] = (char)third;
+				expect_kernels_agree(script, arrend(script));
+			}
+		}
+	}
+}
+
+static void expect_error(const char *script, int64_t offset, int64_t row, int64_t col)
+{
+	struct scallop_utf8_error error = { 0 };
+	assert(!scallop_validate_utf8(script, script + strlen(script), &error));
+	assert(error.offset == offset);
+	assert(error.row == row);
+	assert(error.col == col);
+}
+
+static struct scallop_parse_token expected[4096];
+static struct scallop_parse_token actual[4096];
+
+static void expect_same_tokens(const char *begin, const char *end)
+{
+	struct scallop_utf8_error error;
+	assert(scallop_validate_utf8(begin, end, &error));
+
+	static const ssize_t batch_sizes[] = { 1, 7, 4096 };
+	for (
+		const ssize_t *batch_size = batch_sizes;
+		batch_size < arrend(batch_sizes);
+		batch_size++
+	) {
+		const struct scallop_parse_token *expected_end = scallop_lex_memory_batch(
+			begin,
+			end,
+			(struct scallop_parse_token) { 0 },
+			expected,
+			arrend(expected)
+		);
+		assert(expected_end[-1].token == SCALLOP_TOKEN_EOF);
+
+		struct scallop_parse_token last = { 0 };
+		struct scallop_parse_token *current = actual;
+		do {
+			struct scallop_parse_token *written = scallop_lex_validated_batch(
+				begin,
+				end,
+				last,
+				current,
+				current + *batch_size < arrend(actual) ?
+					current + *batch_size :
+					arrend(actual)
+			);
+			assert(current < written);
+			current = written;
+			last = current[-1];
+		} while (last.token != SCALLOP_TOKEN_EOF);
+
+		assert(current - actual == expected_end - expected);
+		for (ssize_t i = 0; i < current - actual; i++)
+			assert_positions_equal(expected[i], actual[i]);
+	}
+}
+
+int main()
+{
+	random_state = 0x9E3779B97F4A7C15;
+	random_scripts();
+	every_sequence();
+
+	for (
+		const enum UTF8_KERNEL *kernel = kernels;
+		kernel < arrend(kernels);
+		kernel++
+	) {
+		if (!utf8_use_kernel(*kernel)) {
+			print_error("skipping unsupported kernel %d", *kernel);
+			continue;
+		}
+		struct scallop_utf8_error error;
+		assert(scallop_validate_utf8(NULL, NULL, &error));
+		assert(scallop_validate_utf8("", "", &error));
+		expect_error("\x01", 0, 0, 0);
+		expect_error("ab\n\x01", 3, 1, 2);
+		expect_error("échoué \xC3\x28", 9, 0, 7);
+		expect_error("x\r\x0B", 2, 0, 2);
+		expect_error("a\n💩\xF0\x9F\x92", 6, 1, 3);
+	}
+
+	// Continuation characters are skipped in every state
+	// that takes them, whether or not runs are too
+	static const char phrase[] =
+		"é 'üa\\'öa' \"日本a\\\"語a\" {💩} [ñ]\n"
+		"aé€b'x€a'\"y€a\";ß\n";
+	static char script[3000];
+	const size_t phrase_length = sizeof(phrase) - 1;
+	const size_t script_length =
+		sizeof(script) / phrase_length * phrase_length;
+	for (size_t i = 0; i < script_length; i++)
+		script[i] = phrase[i % phrase_length];
+
+	expect_same_tokens(script, script + script_length);
+	assert(lex_use_run_kernel(LEX_RUN_KERNEL_NONE));
+	expect_same_tokens(script, script + script_length);
+}
@@ -10,5 +10,21 @@ int main()
 		{ SCALLOP_TOKEN_WORD, 0, 3 },
 		{ SCALLOP_TOKEN_EOF, 3, 4 }
 	);
+
+	// Quotes can follow a UTF-8 character, in a word or
+	// in a string
+	static const char utf8_quotes[] = "é'b' ü\"c\" 'ö' \"ñ\\\"\" x";
+	expect(utf8_quotes,
+		{ SCALLOP_TOKEN_WORD, 0, 5 },
+		{ SCALLOP_TOKEN_WORD_SEPARATOR, 5, 6 },
+		{ SCALLOP_TOKEN_WORD, 6, 11 },
+		{ SCALLOP_TOKEN_WORD_SEPARATOR, 11, 12 },
+		{ SCALLOP_TOKEN_WORD, 12, 16 },
+		{ SCALLOP_TOKEN_WORD_SEPARATOR, 16, 17 },
+		{ SCALLOP_TOKEN_WORD, 17, 23 },
+		{ SCALLOP_TOKEN_WORD_SEPARATOR, 23, 24 },
+		{ SCALLOP_TOKEN_WORD, 24, 25 },
+		{ SCALLOP_TOKEN_EOF, 25, 26 }
+	);
 }
 
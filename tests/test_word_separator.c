@@ -10,6 +10,35 @@ int main()
 		{ SCALLOP_TOKEN_WORD_SEPARATOR, 0, 2 },
 		{ SCALLOP_TOKEN_EOF, 2, 3 }
 	);
+
+	// Statement separators can follow them
+	static const char before_separator[] = "a ;";
+	expect(before_separator,
+		{ SCALLOP_TOKEN_WORD, 0, 1 },
+		{ SCALLOP_TOKEN_WORD_SEPARATOR, 1, 2 },
+		{ SCALLOP_TOKEN_STATEMENT_SEPARATOR, 2, 3 },
+		{ SCALLOP_TOKEN_EOF, 3, 4 }
+	);
+
+	static const char after_pipe[] = "a | ;";
+	expect(after_pipe,
+		{ SCALLOP_TOKEN_WORD, 0, 1 },
+		{ SCALLOP_TOKEN_WORD_SEPARATOR, 1, 2 },
+		{ SCALLOP_TOKEN_PIPE, 2, 3 },
+		{ SCALLOP_TOKEN_WORD_SEPARATOR, 3, 4 },
+		{ SCALLOP_TOKEN_STATEMENT_SEPARATOR, 4, 5 },
+		{ SCALLOP_TOKEN_EOF, 5, 6 }
+	);
+
+	// Carriage returns separate words, so CRLF lines lex
+	static const char crlf[] = "a\r\nb";
+	expect(crlf,
+		{ SCALLOP_TOKEN_WORD, 0, 1 },
+		{ SCALLOP_TOKEN_WORD_SEPARATOR, 1, 2 },
+		{ SCALLOP_TOKEN_STATEMENT_SEPARATOR, 2, 3 },
+		{ SCALLOP_TOKEN_WORD, 3, 4 },
+		{ SCALLOP_TOKEN_EOF, 4, 5 }
+	);
 }
 
 